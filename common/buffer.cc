@@ -32,6 +32,139 @@
 
 #include <common/buffer.h>
 
+#if defined(THREADS)
+#include <sched.h>
+
+#include <common/thread/atomic.h>
+#endif
+
+/*
+ * The per-thread caches of free BufferSegments, by size class, and the
+ * depots they spill over in to and refill from.  A depot is only touched
+ * once per half a cache's worth of segments, so a simple lock will do.
+ */
+#define	BUFFER_SEGMENT_DEPOT_SLOTS	(BUFFER_SEGMENT_DEPOT_BYTES / BUFFER_SEGMENT_SIZE)
+
+struct BufferSegmentDepot {
+#if defined(THREADS)
+	Atomic<unsigned> lock_;
+#endif
+	unsigned count_;
+	BufferSegment *segments_[BUFFER_SEGMENT_DEPOT_SLOTS];
+
+	void lock(void)
+	{
+#if defined(THREADS)
+		while (!lock_.cmpset(0, 1))
+			sched_yield();
+#endif
+	}
+
+	void unlock(void)
+	{
+#if defined(THREADS)
+		lock_.store_release(0);
+#endif
+	}
+};
+
+static __thread BufferSegment *segment_cache[BUFFER_SEGMENT_SIZE_CLASSES][BUFFER_SEGMENT_CACHE];
+static __thread unsigned segment_cache_count[BUFFER_SEGMENT_SIZE_CLASSES];
+static BufferSegmentDepot segment_depot[BUFFER_SEGMENT_DEPOT_NODES][BUFFER_SEGMENT_SIZE_CLASSES];
+
+static int
+segment_cache_index(buffer_segment_size_t size)
+{
+	switch (size) {
+	case BUFFER_SEGMENT_SIZE:
+		return (0);
+	case BUFFER_SEGMENT_SIZE_MEDIUM:
+		return (1);
+	case BUFFER_SEGMENT_SIZE_LARGE:
+		return (2);
+	default:
+		return (-1);
+	}
+}
+
+/*
+ * Find the depot for the NUMA node the calling thread is running on.
+ * Threads which are not pinned may move between nodes, but then nothing
+ * they allocate is reliably local anyway.
+ */
+static BufferSegmentDepot *
+segment_depot_local(int i)
+{
+#if defined(THREADS) && defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+	unsigned cpu, node;
+
+	if (getcpu(&cpu, &node) == 0)
+		return (&segment_depot[node % BUFFER_SEGMENT_DEPOT_NODES][i]);
+#endif
+	return (&segment_depot[0][i]);
+}
+
+BufferSegment *
+BufferSegment::cache_get(buffer_segment_size_t size)
+{
+	int i = segment_cache_index(size);
+	ASSERT("/buffer/segment/cache", i != -1);
+
+	BufferSegment **cache = segment_cache[i];
+	unsigned *count = &segment_cache_count[i];
+	if (*count == 0) {
+		BufferSegmentDepot *depot = segment_depot_local(i);
+
+		depot->lock();
+		while (depot->count_ != 0 && *count < BUFFER_SEGMENT_CACHE / 2)
+			cache[(*count)++] = depot->segments_[--depot->count_];
+		depot->unlock();
+
+		if (*count == 0)
+			return (NULL);
+	}
+
+	BufferSegment *seg = cache[--*count];
+	seg->ref_.revive();
+	return (seg);
+}
+
+/*
+ * Only segments which own their data, sized exactly to a size class, are
+ * kept; anything else, or anything beyond what the depot will hold, is
+ * deleted as usual.
+ */
+bool
+BufferSegment::cache_put(BufferSegment *seg)
+{
+	if (seg->data_free_ != NULL || seg->data_ == NULL)
+		return (false);
+
+	int i = segment_cache_index(seg->size_);
+	if (i == -1)
+		return (false);
+
+	BufferSegment **cache = segment_cache[i];
+	unsigned *count = &segment_cache_count[i];
+	if (*count == BUFFER_SEGMENT_CACHE) {
+		BufferSegmentDepot *depot = segment_depot_local(i);
+		unsigned limit = BUFFER_SEGMENT_DEPOT_BYTES / seg->size_;
+
+		depot->lock();
+		while (depot->count_ < limit && *count > BUFFER_SEGMENT_CACHE / 2)
+			depot->segments_[depot->count_++] = cache[--*count];
+		depot->unlock();
+
+		if (*count == BUFFER_SEGMENT_CACHE)
+			return (false);
+	}
+
+	seg->offset_ = 0;
+	seg->length_ = 0;
+	cache[(*count)++] = seg;
+	return (true);
+}
+
 size_t
 Buffer::fill_iovec(struct iovec *iov, size_t niov) const
 {
@@ -28,7 +28,6 @@
 
 #include <string.h> /* memmove(3), memcpy(3), etc.  */
 
-#include <deque>
 #include <vector>
 
 #include <common/refcount.h>
@@ -49,13 +48,40 @@
 
 struct iovec;
 
+/*
+ * BufferSegments come in a few size classes.  BUFFER_SEGMENT_SIZE is the
+ * smallest and the default, and is the size that small appends and the
+ * codecs work in.  Bulk data is carried in segments of up to
+ * BUFFER_SEGMENT_SIZE_MAX so that it can be moved with fewer segments (and
+ * iovecs) per byte.
+ */
 #define	BUFFER_SEGMENT_SIZE		(2048)
+#define	BUFFER_SEGMENT_SIZE_MEDIUM	(16384)
+#define	BUFFER_SEGMENT_SIZE_LARGE	(65536)
+#define	BUFFER_SEGMENT_SIZE_MAX		BUFFER_SEGMENT_SIZE_LARGE
+#define	BUFFER_SEGMENT_SIZE_CLASSES	(3)
+
+/*
+ * Freed BufferSegments which own their data are kept to be handed back out,
+ * so that the steady state of reading data in to new segments and freeing
+ * them once written does not go to the allocator at all.  Each thread keeps
+ * up to BUFFER_SEGMENT_CACHE of each size class, and exchanges them in
+ * batches of half that with a shared depot which holds at most
+ * BUFFER_SEGMENT_DEPOT_BYTES of each size class; the depot is what lets
+ * segments which are created on one thread and freed on another be reused.
+ * Where the NUMA node a thread is running on can be found, there is a depot
+ * per node (up to BUFFER_SEGMENT_DEPOT_NODES), so that segments are reused
+ * on the node whose memory they were first touched from.
+ */
+#define	BUFFER_SEGMENT_CACHE		(32)
+#define	BUFFER_SEGMENT_DEPOT_BYTES	(4 * 1024 * 1024)
+#define	BUFFER_SEGMENT_DEPOT_NODES	(8)
 
 typedef	unsigned buffer_segment_size_t;
 
 /*
- * A BufferSegment is a contiguous chunk of data which may be at most a fixed
- * size of BUFFER_SEGMENT_SIZE.  The data in a BufferSegment may begin at a
+ * A BufferSegment is a contiguous chunk of data which may be at most the
+ * size of its size class.  The data in a BufferSegment may begin at a
  * non-zero offset within the BufferSegment and may end prematurely.  This
  * allows for skip()/trim() semantics.
  *
@@ -75,6 +101,7 @@ class BufferSegment {
 	typedef	void data_free_t(void *, uint8_t *, buffer_segment_size_t, buffer_segment_size_t);
 
 	uint8_t *data_;
+	buffer_segment_size_t size_;
 	buffer_segment_size_t offset_;
 	buffer_segment_size_t length_;
 	RefCount ref_;
@@ -84,8 +111,9 @@ class BufferSegment {
 	/*
 	 * Creates a new, empty BufferSegment with a single reference.
 	 */
-	BufferSegment(void)
+	BufferSegment(buffer_segment_size_t size)
 	: data_(NULL),
+	  size_(size),
 	  offset_(0),
 	  length_(0),
 	  ref_(),
@@ -93,15 +121,17 @@ class BufferSegment {
 	  data_free_arg_(NULL)
 	{
 		/* XXX Built-in slab allocator?  */
-		data_ = (uint8_t *)malloc(BUFFER_SEGMENT_SIZE);
+		data_ = (uint8_t *)malloc(size_);
 	}
 
 	/*
 	 * Creates a new BufferSegment with independent metadata and
-	 * external/shared data.
+	 * external/shared data.  The size is that of the external data, and
+	 * is used if the data must later be copied.
 	 */
-	BufferSegment(uint8_t *xdata, buffer_segment_size_t offset, buffer_segment_size_t xlength, data_free_t *data_free, void *data_free_arg)
+	BufferSegment(uint8_t *xdata, buffer_segment_size_t size, buffer_segment_size_t offset, buffer_segment_size_t xlength, data_free_t *data_free, void *data_free_arg)
 	: data_(xdata),
+	  size_(size),
 	  offset_(offset),
 	  length_(xlength),
 	  ref_(),
@@ -109,9 +139,10 @@ class BufferSegment {
 	  data_free_arg_(data_free_arg)
 	{
 		ASSERT_NON_NULL("/buffer/segment", data_);
-		ASSERT("/buffer/segment", offset_ <= BUFFER_SEGMENT_SIZE);
-		ASSERT("/buffer/segment", length_ <= BUFFER_SEGMENT_SIZE);
-		ASSERT("/buffer/segment", offset_ + length_ <= BUFFER_SEGMENT_SIZE);
+		ASSERT("/buffer/segment", size_ <= BUFFER_SEGMENT_SIZE_MAX);
+		ASSERT("/buffer/segment", offset_ <= size_);
+		ASSERT("/buffer/segment", length_ <= size_);
+		ASSERT("/buffer/segment", offset_ + length_ <= size_);
 		ASSERT("/buffer/segment", length_ > 0);
 		ASSERT_NON_NULL("/buffer/segment", data_free_);
 	}
@@ -132,23 +163,48 @@ class BufferSegment {
 
 public:
 	/*
-	 * Get an empty BufferSegment.
+	 * Returns the smallest size class which can hold len bytes.
+	 */
+	static buffer_segment_size_t size_class(size_t len)
+	{
+		ASSERT("/buffer/segment", len <= BUFFER_SEGMENT_SIZE_MAX);
+		if (len <= BUFFER_SEGMENT_SIZE)
+			return (BUFFER_SEGMENT_SIZE);
+		if (len <= BUFFER_SEGMENT_SIZE_MEDIUM)
+			return (BUFFER_SEGMENT_SIZE_MEDIUM);
+		return (BUFFER_SEGMENT_SIZE_LARGE);
+	}
+
+	/*
+	 * Get an empty BufferSegment of the default size.
 	 */
 	static BufferSegment *create(void)
 	{
-		return (new BufferSegment());
+		return (create(BUFFER_SEGMENT_SIZE));
+	}
+
+	/*
+	 * Get an empty BufferSegment which can hold at least size bytes.
+	 */
+	static BufferSegment *create(size_t size)
+	{
+		buffer_segment_size_t size_class = BufferSegment::size_class(size);
+		BufferSegment *seg = cache_get(size_class);
+		if (seg != NULL)
+			return (seg);
+		return (new BufferSegment(size_class));
 	}
 
 	/*
-	 * Get a BufferSegment with the requested data.
+	 * Get a BufferSegment with the requested data, in the smallest size
+	 * class that will hold it.
 	 */
 	static BufferSegment *create(const uint8_t *buf, size_t len)
 	{
 		ASSERT_NON_NULL("/buffer/segment", buf);
 		ASSERT_NON_ZERO("/buffer/segment", len);
-		ASSERT("/buffer/segment", len <= BUFFER_SEGMENT_SIZE);
 
-		BufferSegment *seg = create();
+		BufferSegment *seg = create(len);
 		memcpy(seg->data_, buf, len);
 		seg->length_ = len;
 
@@ -169,8 +225,11 @@ public:
 	 */
 	void unref(void)
 	{
-		if (ref_.drop())
+		if (ref_.drop()) {
+			if (cache_put(this))
+				return;
 			delete this;
+		}
 	}
 
 	/*
@@ -255,7 +314,26 @@ public:
 	 */
 	size_t avail(void) const
 	{
-		return (BUFFER_SEGMENT_SIZE - length());
+		return (size_ - length());
+	}
+
+	/*
+	 * Return the size of the storage behind this BufferSegment.
+	 */
+	size_t size(void) const
+	{
+		return (size_);
+	}
+
+	/*
+	 * Returns true if this BufferSegment's storage is of a larger size
+	 * class than its data needs, e.g. a 2KB reference carved out of a
+	 * 64KB segment.  Holding on to such a segment holds on to all of its
+	 * storage.
+	 */
+	bool oversized(void) const
+	{
+		return (size_ > size_class(length_));
 	}
 
 	/*
@@ -275,7 +353,7 @@ public:
 	BufferSegment *metacopy(void)
 	{
 		ASSERT_NON_ZERO("/buffer/segment", length_);
-		return (new BufferSegment(data_, offset_, length_, &BufferSegment::free_meta, this));
+		return (new BufferSegment(data_, size_, offset_, length_, &BufferSegment::free_meta, this));
 	}
 
 	/*
@@ -315,7 +393,7 @@ public:
 		if (data_free_ != NULL) {
 			uint8_t *data;
 
-			data = (uint8_t *)malloc(BUFFER_SEGMENT_SIZE);
+			data = (uint8_t *)malloc(size_);
 			copyout(data, 0, length_);
 
 			ASSERT_NON_NULL("/buffer/segment", data_free_);
@@ -399,7 +477,7 @@ public:
 	{
 		ASSERT("/buffer/segment", data_exclusive());
 		ASSERT_ZERO("/buffer/segment", offset_);
-		ASSERT("/buffer/segment", len <= BUFFER_SEGMENT_SIZE);
+		ASSERT("/buffer/segment", len <= size_);
 		length_ = len;
 	}
 
@@ -455,9 +533,11 @@ public:
 		if (!data_exclusive()) {
 			BufferSegment *seg;
 
-			seg = BufferSegment::create(this->data(), offset);
-			seg->append(this->data() + offset + bytes,
-				    this->length() - (offset + bytes));
+			seg = BufferSegment::create(this->length() - bytes);
+			memcpy(seg->head(), this->data(), offset);
+			memcpy(seg->head() + offset, this->data() + offset + bytes,
+			       this->length() - (offset + bytes));
+			seg->set_length(this->length() - bytes);
 			this->unref();
 			return (seg);
 		}
@@ -516,6 +596,304 @@ public:
 		BufferSegment *seg = (BufferSegment *)arg;
 		seg->unref();
 	}
+
+	static BufferSegment *cache_get(buffer_segment_size_t);
+	static bool cache_put(BufferSegment *);
+};
+
+#define	BUFFER_SEGMENT_LIST_INLINE	(4)
+
+/*
+ * A BufferSegmentList is the list of BufferSegment pointers that backs a
+ * Buffer.  Most Buffers hold only a handful of segments and are copied
+ * freely, so the list is a ring which keeps up to BUFFER_SEGMENT_LIST_INLINE
+ * pointers within the object itself and only moves to a heap-allocated ring
+ * (growing by powers of two) for longer chains.  A heap ring is kept until
+ * the list is destroyed or hands it off with splice().
+ *
+ * It provides the subset of the std::deque interface that Buffer uses, with
+ * iterators that are indices into the list.  Insertion and erasure shift
+ * whichever side of the ring is shorter.
+ *
+ * The list does not manage references to the BufferSegments it holds; that
+ * is left to Buffer.
+ */
+class BufferSegmentList {
+	template<typename Tl, typename Tv>
+	class Iterator {
+		friend class BufferSegmentList;
+
+		Tl *list_;
+		unsigned index_;
+	public:
+		Iterator(void)
+		: list_(NULL),
+		  index_(0)
+		{ }
+
+		Iterator(Tl *list, unsigned index)
+		: list_(list),
+		  index_(index)
+		{ }
+
+		template<typename Tol, typename Tov>
+		Iterator(const Iterator<Tol, Tov>& other)
+		: list_(other.list_),
+		  index_(other.index_)
+		{ }
+
+		Tv& operator* (void) const
+		{
+			return (list_->at(index_));
+		}
+
+		Iterator& operator++ (void)
+		{
+			index_++;
+			return (*this);
+		}
+
+		Iterator operator++ (int)
+		{
+			Iterator old(*this);
+			index_++;
+			return (old);
+		}
+
+		Iterator& operator-- (void)
+		{
+			index_--;
+			return (*this);
+		}
+
+		template<typename Tol, typename Tov>
+		bool operator== (const Iterator<Tol, Tov>& other) const
+		{
+			return (index_ == other.index_);
+		}
+
+		template<typename Tol, typename Tov>
+		bool operator!= (const Iterator<Tol, Tov>& other) const
+		{
+			return (index_ != other.index_);
+		}
+
+		template<typename Tol, typename Tov> friend class Iterator;
+	};
+public:
+	typedef	Iterator<BufferSegmentList, BufferSegment *> iterator;
+	typedef	Iterator<const BufferSegmentList, BufferSegment *const> const_iterator;
+
+private:
+	BufferSegment **slots_;
+	unsigned head_;
+	unsigned count_;
+	unsigned mask_;
+	BufferSegment *inline_[BUFFER_SEGMENT_LIST_INLINE];
+public:
+	BufferSegmentList(void)
+	: slots_(inline_),
+	  head_(0),
+	  count_(0),
+	  mask_(BUFFER_SEGMENT_LIST_INLINE - 1)
+	{ }
+
+	BufferSegmentList(const BufferSegmentList& src)
+	: slots_(inline_),
+	  head_(0),
+	  count_(0),
+	  mask_(BUFFER_SEGMENT_LIST_INLINE - 1)
+	{
+		insert(end(), src.begin(), src.end());
+	}
+
+	~BufferSegmentList()
+	{
+		if (slots_ != inline_)
+			delete[] slots_;
+	}
+
+	BufferSegmentList& operator= (const BufferSegmentList& src)
+	{
+		if (&src == this)
+			return (*this);
+		clear();
+		insert(end(), src.begin(), src.end());
+		return (*this);
+	}
+
+	iterator begin(void)
+	{
+		return (iterator(this, 0));
+	}
+
+	const_iterator begin(void) const
+	{
+		return (const_iterator(this, 0));
+	}
+
+	iterator end(void)
+	{
+		return (iterator(this, count_));
+	}
+
+	const_iterator end(void) const
+	{
+		return (const_iterator(this, count_));
+	}
+
+	bool empty(void) const
+	{
+		return (count_ == 0);
+	}
+
+	size_t size(void) const
+	{
+		return (count_);
+	}
+
+	BufferSegment *& at(unsigned i)
+	{
+		return (slots_[(head_ + i) & mask_]);
+	}
+
+	BufferSegment *const& at(unsigned i) const
+	{
+		return (slots_[(head_ + i) & mask_]);
+	}
+
+	BufferSegment *& front(void)
+	{
+		return (at(0));
+	}
+
+	BufferSegment *const& front(void) const
+	{
+		return (at(0));
+	}
+
+	BufferSegment *& back(void)
+	{
+		return (at(count_ - 1));
+	}
+
+	void clear(void)
+	{
+		head_ = 0;
+		count_ = 0;
+	}
+
+	void push_back(BufferSegment *seg)
+	{
+		if (count_ == mask_ + 1)
+			grow();
+		at(count_++) = seg;
+	}
+
+	void pop_front(void)
+	{
+		head_ = (head_ + 1) & mask_;
+		count_--;
+	}
+
+	/*
+	 * Remove the element at it and return an iterator to the element
+	 * that followed it.
+	 */
+	iterator erase(iterator it)
+	{
+		unsigned i = it.index_;
+
+		if (i < count_ / 2) {
+			while (i != 0) {
+				at(i) = at(i - 1);
+				i--;
+			}
+			head_ = (head_ + 1) & mask_;
+		} else {
+			for (; i + 1 < count_; i++)
+				at(i) = at(i + 1);
+		}
+		count_--;
+		return (it);
+	}
+
+	/*
+	 * Insert seg before it and return an iterator to seg.
+	 */
+	iterator insert(iterator it, BufferSegment *seg)
+	{
+		unsigned i = it.index_;
+		unsigned j;
+
+		if (count_ == mask_ + 1)
+			grow();
+
+		if (i < count_ / 2) {
+			head_ = (head_ - 1) & mask_;
+			for (j = 0; j < i; j++)
+				at(j) = at(j + 1);
+		} else {
+			for (j = count_; j > i; j--)
+				at(j) = at(j - 1);
+		}
+		at(i) = seg;
+		count_++;
+		return (it);
+	}
+
+	/*
+	 * Append a range of elements.  Only insertion at the end is supported.
+	 */
+	void insert(iterator it, const_iterator first, const_iterator last)
+	{
+		ASSERT("/buffer/segment/list", it.index_ == count_);
+		while (count_ + (last.index_ - first.index_) > mask_ + 1)
+			grow();
+		for (; first != last; ++first)
+			at(count_++) = *first;
+	}
+
+	/*
+	 * Move all elements of src to the end of this list, leaving src empty.
+	 * If this list is empty, a heap ring in src is taken over rather than
+	 * copied.
+	 */
+	void splice(BufferSegmentList& src)
+	{
+		if (count_ == 0 && src.slots_ != src.inline_) {
+			if (slots_ != inline_)
+				delete[] slots_;
+			slots_ = src.slots_;
+			head_ = src.head_;
+			count_ = src.count_;
+			mask_ = src.mask_;
+
+			src.slots_ = src.inline_;
+			src.head_ = 0;
+			src.count_ = 0;
+			src.mask_ = BUFFER_SEGMENT_LIST_INLINE - 1;
+			return;
+		}
+		insert(end(), src.begin(), src.end());
+		src.clear();
+	}
+
+private:
+	void grow(void)
+	{
+		unsigned size = (mask_ + 1) * 2;
+		BufferSegment **slots = new BufferSegment *[size];
+		unsigned i;
+
+		for (i = 0; i < count_; i++)
+			slots[i] = at(i);
+		if (slots_ != inline_)
+			delete[] slots_;
+		slots_ = slots;
+		head_ = 0;
+		mask_ = size - 1;
+	}
 };
 
 /*
@@ -537,7 +915,7 @@ public:
  */
 class Buffer {
 public:
-	typedef	std::deque<BufferSegment *> segment_list_t;
+	typedef	BufferSegmentList segment_list_t;
 
 	/*
 	 * A SegmentIterator allows for enumeration of the BufferSegments that
@@ -757,28 +1135,29 @@ public:
 		 * If we are adding less than a single segment worth of data,
 		 * try to append it to the end of the last segment.
 		 */
-		if (len < BUFFER_SEGMENT_SIZE && !data_.empty()) {
-			segment_list_t::reverse_iterator it = data_.rbegin();
-			seg = *it;
+		if (len < BUFFER_SEGMENT_SIZE_MAX && !data_.empty()) {
+			BufferSegment *& last = data_.back();
+			seg = last;
 			if (seg->data_exclusive() && seg->avail() >= len) {
 				seg = seg->append(buf, len);
-				*it = seg;
+				last = seg;
 				length_ += len;
 				return;
 			}
 		}
 
 		/*
-		 * Complete segments.
+		 * Complete segments of the largest size class, and then the
+		 * remainder in a segment of the smallest class that holds it.
 		 */
-		for (o = 0; o < len / BUFFER_SEGMENT_SIZE; o++) {
-			seg = BufferSegment::create(buf + (o * BUFFER_SEGMENT_SIZE), BUFFER_SEGMENT_SIZE);
+		for (o = 0; o < len / BUFFER_SEGMENT_SIZE_MAX; o++) {
+			seg = BufferSegment::create(buf + (o * BUFFER_SEGMENT_SIZE_MAX), BUFFER_SEGMENT_SIZE_MAX);
 			append(seg);
 			seg->unref();
 		}
-		if (len % BUFFER_SEGMENT_SIZE == 0)
+		if (len % BUFFER_SEGMENT_SIZE_MAX == 0)
 			return;
-		seg = BufferSegment::create(buf + (o * BUFFER_SEGMENT_SIZE), len % BUFFER_SEGMENT_SIZE);
+		seg = BufferSegment::create(buf + (o * BUFFER_SEGMENT_SIZE_MAX), len % BUFFER_SEGMENT_SIZE_MAX);
 		append(seg);
 		seg->unref();
 	}
@@ -894,12 +1273,13 @@ public:
 	/*
 	 * Take a reference to a BufferSegment of len bytes and create one
 	 * from the start of this Buffer if the first BufferSegment is not of
-	 * the expected length.
+	 * the expected length.  If the first BufferSegment is longer, the
+	 * result shares its data.
 	 */
 	void copyout(BufferSegment **segp, size_t len) const
 	{
 		ASSERT_NON_ZERO("/buffer", len);
-		ASSERT("/buffer", len <= BUFFER_SEGMENT_SIZE);
+		ASSERT("/buffer", len <= BUFFER_SEGMENT_SIZE_MAX);
 		ASSERT("/buffer", length() >= len);
 		BufferSegment *src = data_.front();
 		if (src->length() == len) {
@@ -912,8 +1292,8 @@ public:
 			*segp = src->truncate(len);
 			return;
 		}
-		BufferSegment *seg = src->copy();
-		copyout(seg->tail(), seg->length(), len - seg->length());
+		BufferSegment *seg = BufferSegment::create(len);
+		copyout(seg->head(), len);
 		seg->set_length(len);
 		*segp = seg;
 	}
@@ -1211,18 +1591,7 @@ public:
 	 */
 	void moveout(Buffer *dst)
 	{
-		if (dst->empty()) {
-			dst->data_ = data_;
-			data_.clear();
-
-			dst->length_ = length_;
-			length_ = 0;
-
-			return;
-		}
-
-		dst->data_.insert(dst->data_.end(), data_.begin(), data_.end());
-		data_.clear();
+		dst->data_.splice(data_);
 
 		dst->length_ += length_;
 		length_ = 0;
@@ -1571,7 +1940,8 @@ public:
 				ASSERT("/buffer", seg->length() == offset);
 				offset = 0;
 
-				data_.insert(it, seg);
+				it = data_.insert(it, seg);
+				++it;
 
 				if (bytes == 0)
 					break;
@@ -26,9 +26,18 @@
 #ifndef	COMMON_REFCOUNT_H
 #define	COMMON_REFCOUNT_H
 
-/* XXX If !THREADS, do not use atomics.  */
+#if defined(THREADS)
 #include <common/thread/atomic.h>
 
+/*
+ * Most references are taken and dropped by the thread which created the
+ * object, with only a single reference outstanding; a Buffer segment is
+ * appended, consumed and freed without ever being shared.  When the count
+ * is 1, the caller holds the only reference and no other thread can be
+ * looking at it, so the count can be changed with a plain store rather
+ * than a locked read-modify-write.  Once a second reference exists, the
+ * object may be shared and all updates become atomic.
+ */
 class RefCount {
 	Atomic<unsigned> refs_;
 public:
@@ -43,7 +52,7 @@ public:
 
 	bool exclusive(void) const
 	{
-		return (refs_.load() == 1);
+		return (refs_.load_acquire() == 1);
 	}
 
 	bool inuse(void) const
@@ -53,6 +62,10 @@ public:
 
 	void hold(void)
 	{
+		if (exclusive()) {
+			refs_.store_release(2);
+			return;
+		}
 		refs_.add(1);
 	}
 
@@ -61,13 +74,69 @@ public:
 	 */
 	bool drop(void)
 	{
-		for (;;) {
-			unsigned r = refs_.load();
-			if (!refs_.cmpset(r, r - 1))
-				continue;
-			return (r == 1);
+		if (exclusive()) {
+			refs_.store_release(0);
+			return (true);
 		}
+		return (refs_.subtract(1) == 1);
+	}
+
+	/*
+	 * Take the first reference again on an object which is being
+	 * reused after its last reference was dropped.
+	 */
+	void revive(void)
+	{
+		ASSERT("/refcount", refs_.load() == 0);
+		refs_.store_release(1);
+	}
+};
+#else
+/*
+ * Without threads there is nobody to race with; use a plain count.
+ */
+class RefCount {
+	unsigned refs_;
+public:
+	RefCount(void)
+	: refs_(1)
+	{ }
+
+	~RefCount()
+	{
+		ASSERT("/refcount", refs_ == 0);
+	}
+
+	bool exclusive(void) const
+	{
+		return (refs_ == 1);
+	}
+
+	bool inuse(void) const
+	{
+		return (refs_ != 0);
+	}
+
+	void hold(void)
+	{
+		refs_++;
+	}
+
+	/*
+	 * Drops a reference and returns true if that was the last reference.
+	 */
+	bool drop(void)
+	{
+		ASSERT("/refcount", refs_ != 0);
+		return (--refs_ == 0);
+	}
+
+	void revive(void)
+	{
+		ASSERT("/refcount", refs_ == 0);
+		refs_ = 1;
 	}
 };
+#endif
 
 #endif /* !COMMON_REFCOUNT_H */
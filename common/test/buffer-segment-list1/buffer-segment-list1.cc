@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <common/buffer.h>
+#include <common/test.h>
+
+#define	LIST_ROUNDS	(20000)
+#define	LIST_MAX	(64)
+
+/*
+ * Check a Buffer built of many small segments against a std::string model
+ * across operations which add and remove segments at either end and in the
+ * middle, so that the segment list spills out of its inline storage and
+ * wraps around its ring.
+ */
+
+static bool
+check(const Buffer& buf, const std::string& model)
+{
+	std::string str;
+
+	if (buf.length() != model.length())
+		return (false);
+	buf.extract(str);
+	return (str == model);
+}
+
+int
+main(void)
+{
+	TestGroup g("/test/buffer/segment/list1", "BufferSegmentList #1");
+
+	Buffer buf;
+	std::string model;
+	unsigned failures = 0;
+	unsigned i;
+
+	for (i = 0; i < LIST_ROUNDS; i++) {
+		unsigned op = random() % 9;
+		size_t len, off;
+
+		if (model.empty() || op < 4) {
+			uint8_t data[LIST_MAX];
+			unsigned j;
+
+			len = 1 + random() % sizeof data;
+			for (j = 0; j < len; j++)
+				data[j] = random();
+
+			BufferSegment *seg = BufferSegment::create(data, len);
+			buf.append(seg);
+			seg->unref();
+			model += std::string((const char *)data, len);
+		} else {
+			len = std::min(model.length(), (size_t)LIST_MAX);
+			switch (op) {
+			case 4:
+				len = 1 + random() % len;
+				buf.skip(len);
+				model.erase(0, len);
+				break;
+			case 5:
+				len = 1 + random() % len;
+				buf.trim(len);
+				model.erase(model.length() - len);
+				break;
+			case 6:
+				off = random() % model.length();
+				len = 1 + random() % std::min(len, model.length() - off);
+				buf.cut(off, len);
+				model.erase(off, len);
+				break;
+			case 7:
+				if (buf.pop() != (uint8_t)model[0])
+					failures++;
+				model.erase(0, 1);
+				break;
+			case 8: {
+				Buffer copy(buf);
+				Buffer moved;
+				copy.moveout(&moved);
+				if (!copy.empty() || !check(moved, model))
+					failures++;
+				break;
+			}
+			}
+		}
+
+		if (!check(buf, model))
+			failures++;
+	}
+
+	{
+		Test _(g, "Random operations match model.");
+		if (failures == 0)
+			_.pass();
+	}
+
+	{
+		Test _(g, "Spilled out of inline storage.");
+		Buffer::SegmentIterator iter = buf.segments();
+		unsigned segments = 0;
+		while (!iter.end()) {
+			segments++;
+			iter.next();
+		}
+		if (segments > 16 * BUFFER_SEGMENT_LIST_INLINE)
+			_.pass();
+	}
+
+	{
+		Test _(g, "Copy of long chain.");
+		Buffer copy;
+		copy = buf;
+		if (check(copy, model))
+			_.pass();
+	}
+
+	buf.clear();
+	{
+		Test _(g, "Empty after clear.");
+		if (buf.empty() && buf.length() == 0)
+			_.pass();
+	}
+
+	return (0);
+}
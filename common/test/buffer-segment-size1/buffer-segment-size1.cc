@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <common/buffer.h>
+#include <common/test.h>
+
+static uint8_t data[BUFFER_SEGMENT_SIZE_MAX * 3];
+
+static unsigned
+count_segments(const Buffer& buf)
+{
+	Buffer::SegmentIterator iter = buf.segments();
+	unsigned segments = 0;
+
+	while (!iter.end()) {
+		segments++;
+		iter.next();
+	}
+	return (segments);
+}
+
+int
+main(void)
+{
+	TestGroup g("/test/buffer/segment/size1", "BufferSegment size classes #1");
+
+	unsigned i;
+	for (i = 0; i < sizeof data; i++)
+		data[i] = random();
+
+	{
+		Test _(g, "Size classes.");
+		if (BufferSegment::size_class(1) == BUFFER_SEGMENT_SIZE &&
+		    BufferSegment::size_class(BUFFER_SEGMENT_SIZE) == BUFFER_SEGMENT_SIZE &&
+		    BufferSegment::size_class(BUFFER_SEGMENT_SIZE + 1) == BUFFER_SEGMENT_SIZE_MEDIUM &&
+		    BufferSegment::size_class(BUFFER_SEGMENT_SIZE_MEDIUM + 1) == BUFFER_SEGMENT_SIZE_LARGE &&
+		    BufferSegment::size_class(BUFFER_SEGMENT_SIZE_MAX) == BUFFER_SEGMENT_SIZE_LARGE)
+			_.pass();
+	}
+
+	{
+		Test _(g, "Default segment size.");
+		BufferSegment *seg = BufferSegment::create();
+		if (seg->avail() == BUFFER_SEGMENT_SIZE)
+			_.pass();
+		seg->unref();
+	}
+
+	Buffer big(data, sizeof data);
+	{
+		Test _(g, "Bulk data in large segments.");
+		if (count_segments(big) == sizeof data / BUFFER_SEGMENT_SIZE_MAX)
+			_.pass();
+	}
+
+	{
+		Test _(g, "Remainder in smallest size class.");
+		Buffer buf(data, BUFFER_SEGMENT_SIZE_MAX + BUFFER_SEGMENT_SIZE + 1);
+		Buffer::SegmentIterator iter = buf.segments();
+		iter.next();
+		const BufferSegment *seg = *iter;
+		if (count_segments(buf) == 2 &&
+		    seg->size() == BUFFER_SEGMENT_SIZE_MEDIUM &&
+		    !seg->oversized())
+			_.pass();
+	}
+
+	{
+		Test _(g, "Small appends fill a large segment.");
+		Buffer buf(data, BUFFER_SEGMENT_SIZE_MEDIUM + 1);
+		for (i = 0; i < 8; i++)
+			buf.append(data, BUFFER_SEGMENT_SIZE / 2);
+		if (count_segments(buf) == 1 &&
+		    buf.length() == BUFFER_SEGMENT_SIZE_MEDIUM + 1 + 4 * BUFFER_SEGMENT_SIZE)
+			_.pass();
+	}
+
+	{
+		Buffer buf(big);
+		buf.skip(BUFFER_SEGMENT_SIZE * 3);
+
+		BufferSegment *seg;
+		buf.copyout(&seg, BUFFER_SEGMENT_SIZE);
+		{
+			Test _(g, "Small views carved from a large segment share data.");
+			const BufferSegment *front = *buf.segments();
+			if (seg->length() == BUFFER_SEGMENT_SIZE &&
+			    seg->data() == front->data() &&
+			    seg->oversized() &&
+			    seg->equal(data + BUFFER_SEGMENT_SIZE * 3, BUFFER_SEGMENT_SIZE))
+				_.pass();
+		}
+		{
+			Test _(g, "Copy of a view is compact.");
+			BufferSegment *cseg = seg->copy();
+			if (!cseg->oversized() && cseg->equal(seg))
+				_.pass();
+			cseg->unref();
+		}
+		seg->unref();
+	}
+
+	{
+		Test _(g, "Segment spanning copyout.");
+		Buffer buf(big);
+		buf.skip(BUFFER_SEGMENT_SIZE_MAX - 10);
+
+		BufferSegment *seg;
+		buf.copyout(&seg, BUFFER_SEGMENT_SIZE);
+		if (seg->equal(data + BUFFER_SEGMENT_SIZE_MAX - 10, BUFFER_SEGMENT_SIZE))
+			_.pass();
+		seg->unref();
+	}
+
+	{
+		Test _(g, "Cut within a shared large segment.");
+		Buffer buf(big);
+		buf.cut(100, BUFFER_SEGMENT_SIZE_MEDIUM);
+
+		Buffer expected(data, 100);
+		expected.append(data + 100 + BUFFER_SEGMENT_SIZE_MEDIUM,
+				sizeof data - (100 + BUFFER_SEGMENT_SIZE_MEDIUM));
+		if (buf.equal(&expected) && big.equal(data, sizeof data))
+			_.pass();
+	}
+
+	return (0);
+}
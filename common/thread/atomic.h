@@ -98,6 +98,21 @@ public:
 				return;
 		}
 	}
+
+	/*
+	 * Ordered load and store, for callers which need a plain (unlocked)
+	 * access to synchronize with atomic operations in other threads.
+	 */
+	T load_acquire(void) const
+	{
+		return (__atomic_load_n(&val_, __ATOMIC_ACQUIRE));
+	}
+
+	template<typename Ta>
+	void store_release(Ta val)
+	{
+		__atomic_store_n(&val_, val, __ATOMIC_RELEASE);
+	}
 #else
 #error "No support for atomic operations for your compiler.  Why not add some?"
 #endif
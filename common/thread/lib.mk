@@ -2,10 +2,23 @@ VPATH+=	${TOPDIR}/common/thread
 
 THREAD_MODEL=	posix
 
-SRCS+=	mutex_${THREAD_MODEL}.cc
-SRCS+=	sleep_queue_${THREAD_MODEL}.cc
+# Set MUTEX_MODEL=posix to use pthread mutexes instead of futex(2) on Linux.
+ifndef MUTEX_MODEL
+ifeq "${OSNAME}" "Linux"
+MUTEX_MODEL=	futex
+else
+MUTEX_MODEL=	${THREAD_MODEL}
+endif
+endif
+
+SRCS+=	mutex_${MUTEX_MODEL}.cc
+SRCS+=	mutex_profile.cc
+SRCS+=	sleep_queue_${MUTEX_MODEL}.cc
 SRCS+=	thread_${THREAD_MODEL}.cc
 
 CFLAGS+=-DTHREADS
+ifeq "${MUTEX_MODEL}" "futex"
+CFLAGS+=-DMUTEX_FUTEX
+endif
 
 LDADD+=	-lpthread
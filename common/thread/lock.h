@@ -37,7 +37,7 @@ public:
 	{ }
 
 #ifndef NDEBUG
-	virtual void assert_owned(bool, const LogHandle&, const std::string&, unsigned, const std::string&) = 0;
+	virtual void assert_owned(bool, const LogHandle&, const char *, unsigned, const char *) = 0;
 #endif
 	virtual void lock(void) = 0;
 	virtual bool try_lock(void) = 0;
@@ -28,23 +28,50 @@
 
 #include <common/thread/lock.h>
 
+class MutexProfile;
+#if !defined(MUTEX_FUTEX)
 struct MutexState;
+#endif
 class SleepQueue;
 
 class Mutex : public Lock {
 	friend class SleepQueue;
 
+#if defined(MUTEX_FUTEX)
+	/*
+	 * With futexes, the state is kept inline: the futex word itself, an
+	 * estimate of how long it is worth spinning for, and, for assertions,
+	 * the owning Thread::ID.
+	 */
+	volatile int futex_;
+	int spins_;
+#ifndef NDEBUG
+	void *owner_;
+#endif
+#else
 	MutexState *state_;
+#endif
+	MutexProfile *profile_;
 public:
 	Mutex(const std::string&);
 	~Mutex();
 
 #ifndef NDEBUG
-	void assert_owned(bool, const LogHandle&, const std::string&, unsigned, const std::string&);
+	void assert_owned(bool, const LogHandle&, const char *, unsigned, const char *);
 #endif
 	void lock(void);
 	bool try_lock(void);
 	void unlock(void);
+
+private:
+	void acquire(void);
+#if defined(MUTEX_FUTEX)
+	void contend(void);
+#ifndef NDEBUG
+	void acquired(void);
+#endif
+#endif
+	void profile_lock(void);
 };
 
 #endif /* !COMMON_THREAD_MUTEX_H */
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <common/thread/mutex.h>
+#include <common/thread/mutex_profile.h>
+#include <common/thread/thread.h>
+
+#include "mutex_futex.h"
+
+/*
+ * A Mutex is a futex word which is 0 when unlocked, 1 when locked, and 2
+ * when locked and some thread may be asleep waiting for it; see Ulrich
+ * Drepper's "Futexes Are Tricky".  Before going to sleep, a thread spins
+ * for a while, in case the owner is about to release the lock, which is
+ * the common case for the short critical sections we use locks for.  How
+ * long it spins is adapted to how long it has taken to acquire the lock
+ * by spinning in the past, as with glibc's adaptive mutexes.  There is no
+ * point spinning if there is only one CPU to run the owner on.
+ */
+#define	MUTEX_SPIN_MAX	(100)
+
+static const int mutex_spin_max = ::sysconf(_SC_NPROCESSORS_ONLN) > 1 ? MUTEX_SPIN_MAX : 0;
+
+static inline void
+mutex_spin_pause(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#endif
+}
+
+Mutex::Mutex(const std::string& name)
+: Lock(name),
+  futex_(0),
+  spins_(0),
+#ifndef NDEBUG
+  owner_(NULL),
+#endif
+  profile_(NULL)
+{ }
+
+/*
+ * A Mutex may be destroyed while held, as the DestroyThread does with the
+ * locks of the objects it deletes.
+ */
+Mutex::~Mutex()
+{ }
+
+#ifndef NDEBUG
+/*
+ * Only the owner sets or clears owner_, so while it may be stale when
+ * another thread owns the Mutex, it can only be equal to the calling
+ * thread if the calling thread really is the owner.
+ */
+void
+Mutex::assert_owned(bool owned, const LogHandle& log, const char *file, unsigned line, const char *function)
+{
+	Thread::ID self = Thread::selfID();
+	ASSERT_NON_NULL("/mutex/futex", self);
+
+	Thread::ID owner = __atomic_load_n(&owner_, __ATOMIC_RELAXED);
+	if (owner == NULL) {
+		if (owned)
+			HALT(log) << "Lock at " << file << ":" << line << " is not owned; in function " << function;
+		return;
+	}
+	if (owner == self) {
+		if (!owned)
+			HALT(log) << "Lock at " << file << ":" << line << " is owned; in function " << function;
+		return;
+	}
+	if (owned)
+		HALT(log) << "Lock at " << file << ":" << line << " is owned by another thread; in function " << function;
+}
+#endif
+
+void
+Mutex::lock(void)
+{
+	if (MutexProfile::enabled_) {
+		profile_lock();
+		return;
+	}
+	acquire();
+}
+
+bool
+Mutex::try_lock(void)
+{
+	if (!__sync_bool_compare_and_swap(&futex_, 0, 1))
+		return (false);
+#ifndef NDEBUG
+	acquired();
+#endif
+	return (true);
+}
+
+void
+Mutex::unlock(void)
+{
+#ifndef NDEBUG
+	if (futex_ == 0) {
+		HALT("/mutex/futex") << "Attempt to unlock already-unlocked mutex.";
+		return;
+	}
+	ASSERT("/mutex/futex", owner_ == Thread::selfID());
+	__atomic_store_n(&owner_, (Thread::ID)NULL, __ATOMIC_RELAXED);
+#endif
+	if (__sync_fetch_and_sub(&futex_, 1) == 1)
+		return;
+	__atomic_store_n(&futex_, 0, __ATOMIC_RELEASE);
+	futex_wake(&futex_, 1);
+}
+
+void
+Mutex::acquire(void)
+{
+	if (!__sync_bool_compare_and_swap(&futex_, 0, 1))
+		contend();
+#ifndef NDEBUG
+	acquired();
+#endif
+}
+
+void
+Mutex::contend(void)
+{
+	int c, n, spin;
+
+#ifndef NDEBUG
+	if (owner_ == Thread::selfID())
+		HALT("/mutex/futex") << "Attempt to lock mutex recursively.";
+#endif
+
+	spin = spins_ * 2 + 10;
+	if (spin > mutex_spin_max)
+		spin = mutex_spin_max;
+	for (n = 0; n < spin; n++) {
+		mutex_spin_pause();
+		if (futex_ == 0 && __sync_bool_compare_and_swap(&futex_, 0, 1)) {
+			spins_ += (n - spins_) / 8;
+			return;
+		}
+	}
+	spins_ += (spin - spins_) / 8;
+
+	c = __atomic_exchange_n(&futex_, 2, __ATOMIC_ACQUIRE);
+	while (c != 0) {
+		futex_wait(&futex_, 2, NULL);
+		c = __atomic_exchange_n(&futex_, 2, __ATOMIC_ACQUIRE);
+	}
+}
+
+#ifndef NDEBUG
+void
+Mutex::acquired(void)
+{
+	Thread::ID self = Thread::selfID();
+	ASSERT_NON_NULL("/mutex/futex", self);
+	ASSERT_NULL("/mutex/futex", owner_);
+	__atomic_store_n(&owner_, self, __ATOMIC_RELAXED);
+}
+#endif
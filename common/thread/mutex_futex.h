@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	COMMON_THREAD_MUTEX_FUTEX_H
+#define	COMMON_THREAD_MUTEX_FUTEX_H
+
+#include <sys/syscall.h>
+#include <errno.h>
+#include <linux/futex.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Thin wrappers around futex(2), which has no libc interface.  Mutexes
+ * and sleep queues are only ever shared between threads of one process,
+ * so we use the private operations throughout.
+ */
+
+/*
+ * Sleep as long as *word is val, until woken or, if deadline is not NULL,
+ * until the absolute CLOCK_MONOTONIC time it points to.  Returns false
+ * only if the deadline passed.
+ */
+static inline bool
+futex_wait(volatile int *word, int val, const struct timespec *deadline)
+{
+	int rv;
+
+	rv = ::syscall(SYS_futex, word, FUTEX_WAIT_BITSET_PRIVATE, val, deadline, NULL, FUTEX_BITSET_MATCH_ANY);
+	if (rv == 0)
+		return (true);
+	switch (errno) {
+	case EAGAIN:
+	case EINTR:
+		return (true);
+	case ETIMEDOUT:
+		return (false);
+	default:
+		HALT("/mutex/futex") << "Could not wait on futex.";
+		return (false);
+	}
+}
+
+/*
+ * Wake up to count threads sleeping on word.
+ */
+static inline void
+futex_wake(volatile int *word, int count)
+{
+	int rv;
+
+	rv = ::syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+	if (rv == -1)
+		HALT("/mutex/futex") << "Could not wake futex.";
+}
+
+#endif /* !COMMON_THREAD_MUTEX_FUTEX_H */
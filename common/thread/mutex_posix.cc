@@ -26,16 +26,16 @@
 #include <errno.h>
 #include <pthread.h>
 
-#include <deque>
-
 #include <common/thread/mutex.h>
+#include <common/thread/mutex_profile.h>
 #include <common/thread/thread.h>
 
 #include "mutex_posix.h"
 
 Mutex::Mutex(const std::string& name)
 : Lock(name),
-  state_(new MutexState())
+  state_(new MutexState()),
+  profile_(NULL)
 { }
 
 Mutex::~Mutex()
@@ -48,7 +48,7 @@ Mutex::~Mutex()
 
 #ifndef NDEBUG
 void
-Mutex::assert_owned(bool owned, const LogHandle& log, const std::string& file, unsigned line, const std::string& function)
+Mutex::assert_owned(bool owned, const LogHandle& log, const char *file, unsigned line, const char *function)
 {
 	(void)owned;
 	(void)log;
@@ -88,6 +88,16 @@ Mutex::assert_owned(bool owned, const LogHandle& log, const std::string& file, u
 
 void
 Mutex::lock(void)
+{
+	if (MutexProfile::enabled_) {
+		profile_lock();
+		return;
+	}
+	acquire();
+}
+
+void
+Mutex::acquire(void)
 {
 	state_->lock();
 #ifndef NDEBUG
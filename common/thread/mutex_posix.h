@@ -27,12 +27,24 @@
 #define	COMMON_THREAD_MUTEX_POSIX_H
 
 struct MutexState {
+#ifndef NDEBUG
+	/*
+	 * Threads waiting for ownership are queued in FIFO order, each by
+	 * an entry on its own stack, so that contention never allocates.
+	 */
+	struct Waiter {
+		Thread::ID id_;
+		Waiter *next_;
+	};
+#endif
+
 	pthread_mutex_t mutex_;
 	pthread_mutexattr_t mutex_attr_;
 #ifndef NDEBUG
 	pthread_cond_t cond_;
 	Thread::ID owner_;
-	std::deque<Thread::ID> waiters_;
+	Waiter *waiters_head_;
+	Waiter **waiters_tail_;
 #endif
 
 	MutexState(void)
@@ -41,7 +53,8 @@ struct MutexState {
 #ifndef NDEBUG
 	, cond_(),
 	  owner_(NULL),
-	  waiters_()
+	  waiters_head_(NULL),
+	  waiters_tail_(&waiters_head_)
 #endif
 	{
 		int error;
@@ -119,15 +132,22 @@ struct MutexState {
 		ASSERT_NON_NULL("/mutex/posix/state", self);
 
 		if (owner_ != NULL) {
-			waiters_.push_back(self);
+			Waiter waiter;
+
+			waiter.id_ = self;
+			waiter.next_ = NULL;
+			*waiters_tail_ = &waiter;
+			waiters_tail_ = &waiter.next_;
 			for (;;) {
 				error = pthread_cond_wait(&cond_, &mutex_);
 				ASSERT_ZERO("/mutex/posix/state", error);
 				if (owner_ != NULL)
 					continue;
-				if (waiters_.front() != self)
+				if (waiters_head_ != &waiter)
 					continue;
-				waiters_.pop_front();
+				waiters_head_ = waiter.next_;
+				if (waiters_head_ == NULL)
+					waiters_tail_ = &waiters_head_;
 				break;
 			}
 		}
@@ -178,7 +198,7 @@ struct MutexState {
 		ASSERT("/mutex/posix/state", owner_ == self);
 		owner_ = NULL;
 
-		if (waiters_.empty())
+		if (waiters_head_ == NULL)
 			return;
 
 		error = pthread_cond_broadcast(&cond_);
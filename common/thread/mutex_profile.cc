@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sched.h>
+
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include <common/thread/mutex.h>
+#include <common/thread/mutex_profile.h>
+
+#include <common/time/time.h>
+
+/*
+ * The table of profiles can't be protected by a Mutex, since looking
+ * profiles up is part of locking one, so it has a simple lock of its own.
+ * Profiles are never freed, so once a Mutex has found its profile it can
+ * keep a pointer to it.
+ */
+static Atomic<unsigned> mutex_profile_lock;
+static std::map<std::string, MutexProfile *> mutex_profile_map;
+
+volatile bool MutexProfile::enabled_;
+
+static void
+mutex_profile_table_lock(void)
+{
+	while (!mutex_profile_lock.cmpset(0, 1))
+		sched_yield();
+}
+
+static void
+mutex_profile_table_unlock(void)
+{
+	mutex_profile_lock.store_release(0);
+}
+
+static bool
+mutex_profile_compare(const std::pair<uintmax_t, MutexProfile *>& a, const std::pair<uintmax_t, MutexProfile *>& b)
+{
+	return (a.first > b.first);
+}
+
+MutexProfile::MutexProfile(const std::string& name)
+: name_(name),
+  acquisitions_(0),
+  contentions_(0),
+  wait_(0),
+  wait_max_(0)
+{ }
+
+MutexProfile::~MutexProfile()
+{ }
+
+/*
+ * Record an acquisition which had to wait, for the given number of
+ * nanoseconds.
+ */
+void
+MutexProfile::contended(uintmax_t ns)
+{
+	uintmax_t max;
+
+	acquisitions_.add(1);
+	contentions_.add(1);
+	wait_.add(ns);
+	for (;;) {
+		max = wait_max_.load();
+		if (ns <= max || wait_max_.cmpset(max, ns))
+			break;
+	}
+}
+
+void
+MutexProfile::enable(void)
+{
+	enabled_ = true;
+}
+
+MutexProfile *
+MutexProfile::get(const std::string& name)
+{
+	std::map<std::string, MutexProfile *>::const_iterator it;
+	MutexProfile *profile;
+
+	mutex_profile_table_lock();
+	it = mutex_profile_map.find(name);
+	if (it != mutex_profile_map.end()) {
+		profile = it->second;
+	} else {
+		profile = new MutexProfile(name);
+		mutex_profile_map[name] = profile;
+	}
+	mutex_profile_table_unlock();
+	return (profile);
+}
+
+/*
+ * Get every profile, those which have been waited for longest first.
+ */
+static void
+mutex_profile_sorted(std::vector<std::pair<uintmax_t, MutexProfile *> > *profiles)
+{
+	std::map<std::string, MutexProfile *>::const_iterator it;
+
+	mutex_profile_table_lock();
+	for (it = mutex_profile_map.begin(); it != mutex_profile_map.end(); ++it)
+		profiles->push_back(std::make_pair(it->second->wait(), it->second));
+	mutex_profile_table_unlock();
+
+	std::stable_sort(profiles->begin(), profiles->end(), mutex_profile_compare);
+}
+
+void
+MutexProfile::dump(const LogHandle& log)
+{
+	std::vector<std::pair<uintmax_t, MutexProfile *> > profiles;
+	std::vector<std::pair<uintmax_t, MutexProfile *> >::const_iterator it;
+
+	mutex_profile_sorted(&profiles);
+
+	INFO(log) << "Mutex contention profile, by total wait time:";
+	for (it = profiles.begin(); it != profiles.end(); ++it) {
+		std::ostringstream os;
+
+		it->second->marshall(os);
+		INFO(log) << os.str();
+	}
+}
+
+void
+MutexProfile::dump(std::ostream& os)
+{
+	std::vector<std::pair<uintmax_t, MutexProfile *> > profiles;
+	std::vector<std::pair<uintmax_t, MutexProfile *> >::const_iterator it;
+
+	mutex_profile_sorted(&profiles);
+
+	for (it = profiles.begin(); it != profiles.end(); ++it) {
+		it->second->marshall(os);
+		os << std::endl;
+	}
+}
+
+void
+MutexProfile::marshall(std::ostream& os) const
+{
+	os << name_ << ": " <<
+		acquisitions_.load() << " acquisitions, " <<
+		contentions_.load() << " contended, " <<
+		(wait_.load() / 1000) << "us waiting, " <<
+		(wait_max_.load() / 1000) << "us longest wait.";
+}
+
+/*
+ * Acquire a Mutex while profiling.  This is common to all Mutex
+ * implementations, which need only provide try_lock and acquire.
+ */
+void
+Mutex::profile_lock(void)
+{
+	if (profile_ == NULL)
+		profile_ = MutexProfile::get(name());
+
+	if (try_lock()) {
+		profile_->acquired();
+		return;
+	}
+
+	NanoTime start = NanoTime::current_time();
+	acquire();
+	NanoTime wait = NanoTime::current_time();
+	wait -= start;
+
+	profile_->contended((uintmax_t)wait.seconds_ * 1000000000 + wait.nanoseconds_);
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	COMMON_THREAD_MUTEX_PROFILE_H
+#define	COMMON_THREAD_MUTEX_PROFILE_H
+
+#include <ostream>
+
+#include <common/thread/atomic.h>
+
+/*
+ * Contention profiling for Mutexes, to find out which locks actually
+ * serialize a program.  Once enabled, every acquisition of a Mutex by
+ * Mutex::lock is counted, and the time spent waiting for any that could
+ * not be acquired straight away is measured.  Statistics are kept by the
+ * name given to the Mutex, since it is usually the kind of lock (every
+ * PipePair's, say) rather than any one lock which is interesting.
+ *
+ * Profiling costs nothing but a test of a flag until it is enabled, and
+ * may be enabled at any time; a summary may be dumped, to the log or to a
+ * stream, at any time after that.
+ */
+class MutexProfile {
+	std::string name_;
+	Atomic<uintmax_t> acquisitions_;
+	Atomic<uintmax_t> contentions_;
+	Atomic<uintmax_t> wait_;	/* Nanoseconds.  */
+	Atomic<uintmax_t> wait_max_;
+
+	MutexProfile(const std::string&);
+	~MutexProfile();
+public:
+	static volatile bool enabled_;
+
+	void acquired(void)
+	{
+		acquisitions_.add(1);
+	}
+
+	void contended(uintmax_t);
+
+	uintmax_t acquisitions(void) const
+	{
+		return (acquisitions_.load());
+	}
+
+	uintmax_t contentions(void) const
+	{
+		return (contentions_.load());
+	}
+
+	uintmax_t wait(void) const
+	{
+		return (wait_.load());
+	}
+
+	static void enable(void);
+	static MutexProfile *get(const std::string&);
+	static void dump(const LogHandle&);
+	static void dump(std::ostream&);
+
+private:
+	void marshall(std::ostream&) const;
+
+	MutexProfile(const MutexProfile&); /* XXX Disable copy.  */
+};
+
+#endif /* !COMMON_THREAD_MUTEX_PROFILE_H */
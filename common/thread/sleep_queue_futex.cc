@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <common/thread/mutex.h>
+#include <common/thread/sleep_queue.h>
+#include <common/thread/thread.h>
+
+#include <common/time/time.h>
+
+#include "mutex_futex.h"
+
+/*
+ * A sleep queue is a futex word which is bumped on every signal.  A waiter
+ * notes its value before dropping the Mutex, and then sleeps only if it is
+ * unchanged, so that a signal between the two is not lost.
+ */
+struct SleepQueueState {
+	volatile int futex_;
+	bool waiting_;
+
+	SleepQueueState(void)
+	: futex_(0),
+	  waiting_(false)
+	{ }
+};
+
+SleepQueue::SleepQueue(const std::string& name, Mutex *mutex)
+: name_(name),
+  mutex_(mutex),
+  state_(new SleepQueueState())
+{ }
+
+SleepQueue::~SleepQueue()
+{
+	if (state_ != NULL) {
+		delete state_;
+		state_ = NULL;
+	}
+}
+
+void
+SleepQueue::signal(void)
+{
+	ASSERT_LOCK_OWNED("/sleep/queue", mutex_);
+	if (!state_->waiting_)
+		return;
+	__sync_fetch_and_add(&state_->futex_, 1);
+	futex_wake(&state_->futex_, 1);
+}
+
+void
+SleepQueue::wait(const NanoTime *deadline)
+{
+	struct timespec ts;
+	int val;
+
+	ASSERT_LOCK_OWNED("/sleep/queue", mutex_);
+
+	if (deadline != NULL) {
+		ts.tv_sec = deadline->seconds_;
+		ts.tv_nsec = deadline->nanoseconds_;
+	}
+
+	state_->waiting_ = true;
+	val = state_->futex_;
+	mutex_->unlock();
+	futex_wait(&state_->futex_, val, deadline == NULL ? NULL : &ts);
+	mutex_->lock();
+	state_->waiting_ = false;
+
+	ASSERT_LOCK_OWNED("/sleep/queue", mutex_);
+}
@@ -26,8 +26,6 @@
 #include <errno.h>
 #include <pthread.h>
 
-#include <deque>
-
 #include <common/thread/mutex.h>
 #include <common/thread/sleep_queue.h>
 #include <common/thread/thread.h>
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <common/test.h>
+
+#include <common/thread/mutex.h>
+#include <common/thread/mutex_profile.h>
+#include <common/thread/thread.h>
+
+/*
+ * Have NTHREAD threads each take the same Mutex ROUNDS times to bump a
+ * counter, with contention profiling enabled, and check that no increment
+ * was lost and that the profile saw every acquisition.
+ */
+#define	NTHREAD		8
+#define	ROUNDS		(1024 * 1024)
+
+static Mutex test_mtx("TestMutex");
+static unsigned test_counter;
+
+class TestThread : public WorkerThread {
+public:
+	TestThread(void)
+	: WorkerThread("TestThread")
+	{ }
+
+	~TestThread()
+	{ }
+
+	void work(void)
+	{
+		unsigned i;
+
+		for (i = 0; i < ROUNDS; i++) {
+			ScopedLock _(&test_mtx);
+			test_counter++;
+		}
+
+		stop();
+	}
+};
+
+int
+main(void)
+{
+	WorkerThread *threads[NTHREAD];
+	unsigned i;
+
+	TestGroup g("/test/mutex/contention1", "Mutex contention #1");
+
+	MutexProfile::enable();
+
+	{
+		Test _(g, "Mutex::try_lock fails while locked");
+		test_mtx.lock();
+		if (!test_mtx.try_lock())
+			_.pass();
+		test_mtx.unlock();
+	}
+	{
+		Test _(g, "Mutex::try_lock succeeds while unlocked");
+		if (test_mtx.try_lock()) {
+			_.pass();
+			test_mtx.unlock();
+		}
+	}
+
+	test_counter = 0;
+
+	for (i = 0; i < NTHREAD; i++)
+		threads[i] = new TestThread();
+
+	for (i = 0; i < NTHREAD; i++)
+		threads[i]->start();
+
+	for (i = 0; i < NTHREAD; i++)
+		threads[i]->submit();
+
+	for (i = 0; i < NTHREAD; i++)
+		threads[i]->join();
+
+	for (i = 0; i < NTHREAD; i++)
+		delete threads[i];
+
+	{
+		Test _(g, "Counter is correct");
+		if (test_counter == NTHREAD * ROUNDS)
+			_.pass();
+	}
+	{
+		Test _(g, "Profile counted every acquisition");
+		if (MutexProfile::get("TestMutex")->acquisitions() == NTHREAD * ROUNDS + 1)
+			_.pass();
+	}
+
+	MutexProfile::dump("/test/mutex/contention1");
+
+	return (0);
+}
@@ -26,6 +26,8 @@
 #ifndef	COMMON_THREAD_THREAD_H
 #define	COMMON_THREAD_THREAD_H
 
+#include <set>
+
 #include <common/thread/mutex.h>
 #include <common/thread/sleep_queue.h>
 
@@ -52,9 +54,15 @@ public:
 
 public:
 	typedef void * ID;
+	typedef std::set<unsigned> CPUSet;
+
+	bool affinity(const CPUSet&);
 
 	static Thread *self(void);
 	static Thread::ID selfID(void);
+
+	static bool affinity(const std::string&, const CPUSet&);
+	static bool parse_cpus(const std::string&, CPUSet *);
 };
 
 class WorkerThread : public Thread {
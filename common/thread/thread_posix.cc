@@ -23,12 +23,21 @@
  * SUCH DAMAGE.
  */
 
+#if defined(__FreeBSD__)
+#include <sys/param.h>
+#include <sys/cpuset.h>
+#endif
 #include <pthread.h>
 #if defined(__FreeBSD__)
 #include <pthread_np.h>
 #endif
+#if defined(__linux__)
+#include <sched.h>
+#endif
 #include <signal.h>
+#include <stdlib.h>
 
+#include <map>
 #include <set>
 
 #include <common/thread/mutex.h>
@@ -50,6 +59,13 @@ namespace {
 
 	static std::set<Thread *> running_threads;
 
+	/*
+	 * CPUs to run threads on by name, for those without CPUs of their
+	 * own; see Thread::affinity.
+	 */
+	static std::map<std::string, Thread::CPUSet> thread_affinity;
+
+	static bool thread_posix_affinity(pthread_t, const Thread::CPUSet&);
 	static void thread_posix_init(void);
 	static void *thread_posix_start(void *);
 
@@ -116,6 +132,20 @@ Thread::start(void)
 	thread_start_mutex.unlock();
 }
 
+/*
+ * Run this thread only on the given CPUs.  If it has not been started yet,
+ * this takes effect when it is.
+ */
+bool
+Thread::affinity(const CPUSet& cpus)
+{
+	ScopedLock _(&thread_start_mutex);
+	state_->cpus_ = cpus;
+	if (running_threads.find(this) == running_threads.end())
+		return (true);
+	return (thread_posix_affinity(state_->td_, cpus));
+}
+
 Thread *
 Thread::self(void)
 {
@@ -135,6 +165,86 @@ Thread::selfID(void)
 	return ((Thread::ID)pthread_self());
 }
 
+/*
+ * Run threads with the given name, such as all EventThreads, only on the
+ * given CPUs, both those running now and any started later, unless they
+ * have been given CPUs of their own.
+ */
+bool
+Thread::affinity(const std::string& name, const CPUSet& cpus)
+{
+	std::set<Thread *>::const_iterator it;
+	bool ok;
+
+	ScopedLock _(&thread_start_mutex);
+	thread_affinity[name] = cpus;
+
+	ok = true;
+	for (it = running_threads.begin(); it != running_threads.end(); ++it) {
+		Thread *td = *it;
+
+		if (td->name_ != name || !td->state_->cpus_.empty())
+			continue;
+		if (!thread_posix_affinity(td->state_->td_, cpus))
+			ok = false;
+	}
+	return (ok);
+}
+
+/*
+ * Parse a list of CPUs and ranges of CPUs, like "0-3,8".
+ */
+bool
+Thread::parse_cpus(const std::string& str, CPUSet *cpus)
+{
+	const char *p = str.c_str();
+	unsigned long first, last;
+	char *end;
+
+	cpus->clear();
+	for (;;) {
+		first = strtoul(p, &end, 10);
+		if (end == p)
+			return (false);
+		p = end;
+		if (*p == '-') {
+			p++;
+			last = strtoul(p, &end, 10);
+			if (end == p || last < first)
+				return (false);
+			p = end;
+		} else {
+			last = first;
+		}
+		while (first <= last)
+			cpus->insert(first++);
+		if (*p == '\0')
+			return (true);
+		if (*p != ',')
+			return (false);
+		p++;
+	}
+}
+
+/*
+ * Apply any affinity set for a thread which is starting, whether its own
+ * or that for its name.  Called with the start lock held.
+ */
+void
+ThreadState::place(Thread *td)
+{
+	std::map<std::string, Thread::CPUSet>::const_iterator it;
+
+	if (!td->state_->cpus_.empty()) {
+		thread_posix_affinity(td->state_->td_, td->state_->cpus_);
+		return;
+	}
+
+	it = thread_affinity.find(td->name_);
+	if (it != thread_affinity.end())
+		thread_posix_affinity(td->state_->td_, it->second);
+}
+
 void
 ThreadState::signal_stop(int sig)
 {
@@ -176,6 +286,41 @@ ThreadState::signal_stop(int sig)
 }
 
 namespace {
+	static bool
+	thread_posix_affinity(pthread_t td, const Thread::CPUSet& cpus)
+	{
+#if defined(__linux__) || defined(__FreeBSD__)
+		Thread::CPUSet::const_iterator it;
+#if defined(__linux__)
+		cpu_set_t set;
+#else
+		cpuset_t set;
+#endif
+		int error;
+
+		CPU_ZERO(&set);
+		for (it = cpus.begin(); it != cpus.end(); ++it) {
+			if (*it >= CPU_SETSIZE) {
+				ERROR("/thread/posix/affinity") << "CPU " << *it << " is out of range.";
+				return (false);
+			}
+			CPU_SET(*it, &set);
+		}
+
+		error = pthread_setaffinity_np(td, sizeof set, &set);
+		if (error != 0) {
+			ERROR("/thread/posix/affinity") << "Could not set thread affinity; error: " << error;
+			return (false);
+		}
+		return (true);
+#else
+		(void)td;
+		(void)cpus;
+		ERROR("/thread/posix/affinity") << "Thread affinity is not supported.";
+		return (false);
+#endif
+	}
+
 	static void
 	thread_posix_init(void)
 	{
@@ -209,6 +354,7 @@ namespace {
 		ThreadState::start(thread_posix_key, td);
 
 		thread_start_mutex.lock();
+		ThreadState::place(td);
 		thread_start_sleepq.signal();
 		thread_start_mutex.unlock();
 
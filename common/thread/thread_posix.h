@@ -28,6 +28,7 @@
 
 struct ThreadState {
 	pthread_t td_;
+	Thread::CPUSet cpus_;
 
 	static void start(pthread_key_t key, Thread *td)
 	{
@@ -48,6 +49,7 @@ struct ThreadState {
 #endif
 	}
 
+	static void place(Thread *);
 	static void signal_stop(int);
 };
 
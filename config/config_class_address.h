@@ -48,8 +48,9 @@ public:
 		bool activate(const ConfigObject *);
 	};
 
-	ConfigClassAddress(const std::string& xname = "address")
-	: ConfigClass(xname, new ConstructorFactory<ConfigClassInstance, Instance>)
+	ConfigClassAddress(const std::string& xname = "address",
+			   Factory<ConfigClassInstance> *factory = new ConstructorFactory<ConfigClassInstance, Instance>)
+	: ConfigClass(xname, factory)
 	{
 		add_member("family", &config_type_address_family, &Instance::family_);
 		add_member("host", &config_type_string, &Instance::host_);
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <config/config_class.h>
+#include <config/config_class_event_system.h>
+
+#include <event/event_callback.h>
+#include <event/event_system.h>
+
+ConfigClassEventSystem config_class_event_system;
+
+bool
+ConfigClassEventSystem::Instance::activate(const ConfigObject *)
+{
+	if (threads_ < 1 || threads_ > EVENT_SYSTEM_CALLBACK_THREAD_MAX) {
+		ERROR("/config/class/eventsystem") << "Number of threads must be between 1 and " << EVENT_SYSTEM_CALLBACK_THREAD_MAX << ".";
+		return (false);
+	}
+
+	if (reactors_ < 1 || reactors_ > EVENT_SYSTEM_CALLBACK_THREAD_MAX) {
+		ERROR("/config/class/eventsystem") << "Number of reactors must be between 1 and " << EVENT_SYSTEM_CALLBACK_THREAD_MAX << ".";
+		return (false);
+	}
+
+	if (threads_ != 1 && reactors_ != 1) {
+		ERROR("/config/class/eventsystem") << "Only one of threads and reactors may be set.";
+		return (false);
+	}
+
+	if (reactors_ != 1) {
+		if (!EventSystem::instance()->set_reactors(reactors_)) {
+			ERROR("/config/class/eventsystem") << "Could not set number of reactors.";
+			return (false);
+		}
+	} else {
+		if (!EventSystem::instance()->set_callback_threads(threads_)) {
+			ERROR("/config/class/eventsystem") << "Could not set number of threads.";
+			return (false);
+		}
+	}
+
+	/*
+	 * Place each kind of thread on its own CPUs, if asked.  Reactors
+	 * are each placed on a single CPU, which takes precedence over any
+	 * placement of EventThreads and EventPolls in general.
+	 */
+	if (!place("event_cpus", event_cpus_, "EventThread") ||
+	    !place("event_cpus", event_cpus_, "EventPoll") ||
+	    !place("worker_cpus", worker_cpus_, "EventWorker") ||
+	    !place("timeout_cpus", timeout_cpus_, "TimeoutThread") ||
+	    !place("destroy_cpus", destroy_cpus_, "DestroyThread") ||
+	    !place("io_cpus", io_cpus_, "System IOThread"))
+		return (false);
+
+	if (reactor_cpus_ != "") {
+		Thread::CPUSet cpus;
+
+		if (!Thread::parse_cpus(reactor_cpus_, &cpus)) {
+			ERROR("/config/class/eventsystem") << "Invalid list of CPUs for reactor_cpus: " << reactor_cpus_;
+			return (false);
+		}
+		if (!EventSystem::instance()->set_reactor_cpus(cpus)) {
+			ERROR("/config/class/eventsystem") << "Could not place reactors.";
+			return (false);
+		}
+	}
+
+	return (true);
+}
+
+bool
+ConfigClassEventSystem::Instance::place(const std::string& member, const std::string& list, const std::string& name)
+{
+	Thread::CPUSet cpus;
+
+	if (list == "")
+		return (true);
+
+	if (!Thread::parse_cpus(list, &cpus)) {
+		ERROR("/config/class/eventsystem") << "Invalid list of CPUs for " << member << ": " << list;
+		return (false);
+	}
+
+	if (!Thread::affinity(name, cpus)) {
+		ERROR("/config/class/eventsystem") << "Could not place " << name << " threads.";
+		return (false);
+	}
+
+	return (true);
+}
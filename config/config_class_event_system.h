@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	CONFIG_CONFIG_CLASS_EVENT_SYSTEM_H
+#define	CONFIG_CONFIG_CLASS_EVENT_SYSTEM_H
+
+#include <config/config_type_int.h>
+#include <config/config_type_string.h>
+
+class ConfigClassEventSystem : public ConfigClass {
+	struct Instance : public ConfigClassInstance {
+		intmax_t threads_;
+		intmax_t reactors_;
+		std::string event_cpus_;
+		std::string reactor_cpus_;
+		std::string worker_cpus_;
+		std::string timeout_cpus_;
+		std::string destroy_cpus_;
+		std::string io_cpus_;
+
+		Instance(void)
+		: threads_(1),
+		  reactors_(1),
+		  event_cpus_(""),
+		  reactor_cpus_(""),
+		  worker_cpus_(""),
+		  timeout_cpus_(""),
+		  destroy_cpus_(""),
+		  io_cpus_("")
+		{ }
+
+		bool activate(const ConfigObject *);
+		bool place(const std::string&, const std::string&, const std::string&);
+	};
+public:
+	ConfigClassEventSystem(void)
+	: ConfigClass("event-system", new ConstructorFactory<ConfigClassInstance, Instance>)
+	{
+		add_member("threads", &config_type_int, &Instance::threads_);
+		add_member("reactors", &config_type_int, &Instance::reactors_);
+		add_member("event_cpus", &config_type_string, &Instance::event_cpus_);
+		add_member("reactor_cpus", &config_type_string, &Instance::reactor_cpus_);
+		add_member("worker_cpus", &config_type_string, &Instance::worker_cpus_);
+		add_member("timeout_cpus", &config_type_string, &Instance::timeout_cpus_);
+		add_member("destroy_cpus", &config_type_string, &Instance::destroy_cpus_);
+		add_member("io_cpus", &config_type_string, &Instance::io_cpus_);
+	}
+
+	~ConfigClassEventSystem()
+	{ }
+};
+
+extern ConfigClassEventSystem config_class_event_system;
+
+#endif /* !CONFIG_CONFIG_CLASS_EVENT_SYSTEM_H */
@@ -13,3 +13,5 @@ SRCS+=	config_type_string.cc
 
 SRCS_io_socket+=config_class_address.cc
 SRCS_io_socket+=config_type_address_family.cc
+
+SRCS_event+=config_class_event_system.cc
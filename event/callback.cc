@@ -30,21 +30,18 @@ CallbackBase::CallbackBase(CallbackScheduler *scheduler, Lock *xlock)
 : scheduler_(scheduler),
   lock_(xlock),
   scheduled_(false),
+  list_(NULL),
   next_(NULL),
   prev_(NULL)
 {
 	/*
 	 * Use the default scheduler if we haven't been given one.
 	 *
-	 * This uses the legacy callback thread, as it were, which
-	 * does not distribute callbacks over all available workers,
-	 * but rather runs naive callbacks all in the same thread.
-	 *
-	 * Eventually this needs to pick a worker using the lock
-	 * as an index into the available pool.
+	 * The lock picks which of the callback threads we run in, so
+	 * that everything using one lock stays in one thread.
 	 */
 	if (scheduler_ == NULL)
-		scheduler_ = EventSystem::instance()->scheduler();
+		scheduler_ = EventSystem::instance()->scheduler(lock_);
 }
 
 void
@@ -29,6 +29,7 @@
 #include <event/action.h>
 
 class CallbackBase;
+class CallbackList;
 class Lock;
 
 class CallbackScheduler {
@@ -47,11 +48,13 @@ public:
 class CallbackBase : private Action {
 	friend class CallbackList;
 	friend class CallbackThread;
+	friend class CallbackWorkerPool;
 
 	CallbackScheduler *scheduler_;
 	Lock *lock_;
 	bool scheduled_;
 
+	CallbackList *list_;
 	CallbackBase *next_;
 	CallbackBase *prev_;
 protected:
@@ -87,6 +90,16 @@ public:
 	{
 		return (lock_);
 	}
+
+	CallbackScheduler *scheduler(void) const
+	{
+		return (scheduler_);
+	}
+
+	CallbackList *list(void) const
+	{
+		return (list_);
+	}
 };
 
 class CallbackList {
@@ -106,9 +119,12 @@ public:
 
 	void append(CallbackBase *cb)
 	{
+		ASSERT_NULL("/callback/list", cb->list_);
 		ASSERT_NULL("/callback/list", cb->next_);
 		ASSERT_NULL("/callback/list", cb->prev_);
 
+		cb->list_ = this;
+
 		if (tail_ != NULL) {
 			ASSERT_NON_NULL("/callback/list", head_);
 			tail_->next_ = cb;
@@ -152,7 +168,7 @@ public:
 		ASSERT_NON_NULL("/callback/list", head_);
 		ASSERT_NON_NULL("/callback/list", tail_);
 
-		ASSERT("/callback/list", present(cb));
+		ASSERT("/callback/list", cb->list_ == this);
 
 		if (cb->next_ != NULL) {
 			cb->next_->prev_ = cb->prev_;
@@ -167,6 +183,7 @@ public:
 			head_ = cb->next_;
 		}
 
+		cb->list_ = NULL;
 		cb->next_ = NULL;
 		cb->prev_ = NULL;
 
@@ -36,18 +36,31 @@ CallbackThread::CallbackThread(const std::string& name)
   mtx_(name),
   sleepq_(name, &mtx_),
   idle_(false),
-  queue_()
+  inbox_(),
+  queue_(),
+  parked_()
 { }
 
 Action *
 CallbackThread::schedule(CallbackBase *cb)
 {
-	ScopedLock _(&mtx_);
-	bool need_wakeup = queue_.empty();
-	queue_.append(cb);
-	if (need_wakeup && idle_)
+	CallbackBase *head;
+
+	Action *a = cb->scheduled(this);
+	do {
+		head = inbox_.load();
+		cb->next_ = head;
+	} while (!inbox_.cmpset(head, cb));
+
+	/*
+	 * The cmpset above is a full barrier, so if the thread has not
+	 * yet seen our callback, we will see that it has gone idle.
+	 */
+	if (idle_.load()) {
+		ScopedLock _(&mtx_);
 		sleepq_.signal();
-	return (cb->scheduled(this));
+	}
+	return (a);
 }
 
 void
@@ -55,7 +68,17 @@ CallbackThread::cancel(CallbackBase *cb)
 {
 	ScopedLock _(&mtx_);
 	ASSERT_LOCK_OWNED(log_, cb->lock());
-	queue_.remove(cb);
+	drain();
+	if (cb->list_ == &queue_) {
+		queue_.remove(cb);
+		return;
+	}
+
+	std::map<Lock *, CallbackList>::iterator it = parked_.find(cb->lock());
+	ASSERT(log_, it != parked_.end());
+	it->second.remove(cb);
+	if (it->second.empty())
+		parked_.erase(it);
 }
 
 void
@@ -63,46 +86,115 @@ CallbackThread::main(void)
 {
 	mtx_.lock();
 	for (;;) {
-		if (queue_.empty()) {
-			idle_ = true;
-			for (;;) {
+		drain();
+		if (queue_.empty() && parked_.empty()) {
+			/*
+			 * Go idle before checking the inbox one last time,
+			 * so that anything scheduled after that check will
+			 * wake us up.
+			 */
+			idle_.store(true);
+			if (inbox_.load() == NULL) {
 				if (stop_) {
+					idle_.store(false);
 					mtx_.unlock();
 					return;
 				}
 				sleepq_.wait();
-				if (queue_.empty())
-					continue;
-				idle_ = false;
-				break;
 			}
+			idle_.store(false);
+			continue;
 		}
 
-		while (!queue_.empty()) {
-			CallbackBase *cb = select();
-			if (cb == NULL) {
-				mtx_.unlock();
-				sched_yield();
-				mtx_.lock();
-				continue;
-			}
+		CallbackBase *cb = select();
+		if (cb == NULL) {
 			mtx_.unlock();
-			cb->deschedule();
+			sched_yield();
 			mtx_.lock();
+			continue;
 		}
+		mtx_.unlock();
+		cb->deschedule();
+		mtx_.lock();
 	}
 }
 
+/*
+ * Move everything pushed onto the inbox to the run queue.  The inbox
+ * is a stack, so reverse it first to keep callbacks in order.
+ */
+void
+CallbackThread::drain(void)
+{
+	CallbackBase *head, *next, *cb;
+
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+
+	do {
+		head = inbox_.load();
+		if (head == NULL)
+			return;
+	} while (!inbox_.cmpset(head, (CallbackBase *)NULL));
+
+	for (cb = NULL; head != NULL; head = next) {
+		next = head->next_;
+		head->next_ = cb;
+		cb = head;
+	}
+
+	for (; cb != NULL; cb = next) {
+		next = cb->next_;
+		cb->next_ = NULL;
+		queue_.append(cb);
+	}
+}
+
+void
+CallbackThread::park(CallbackBase *cb)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+
+	queue_.remove(cb);
+	parked_[cb->lock()].append(cb);
+}
+
 CallbackBase *
 CallbackThread::select(void)
 {
-	CallbackBase *cb;
+	std::map<Lock *, CallbackList>::iterator it;
+	CallbackBase *cb, *next;
+
+	/*
+	 * Parked callbacks were scheduled before anything in the run
+	 * queue, so give each busy lock one chance first.
+	 */
+	for (it = parked_.begin(); it != parked_.end(); ++it) {
+		if (!it->first->try_lock())
+			continue;
+		cb = it->second.head();
+		it->second.remove(cb);
+		if (it->second.empty())
+			parked_.erase(it);
+		return (cb);
+	}
+
+	for (cb = queue_.head(); cb != NULL; cb = next) {
+		next = cb->next_;
+
+		/*
+		 * Keep callbacks for the same lock in order behind
+		 * the ones already parked.
+		 */
+		if (parked_.find(cb->lock()) != parked_.end()) {
+			park(cb);
+			continue;
+		}
 
-	for (cb = queue_.head(); cb != NULL; cb = cb->next_) {
 		if (cb->lock()->try_lock()) {
 			queue_.remove(cb);
 			return (cb);
 		}
+		park(cb);
 	}
 
 	return (NULL);
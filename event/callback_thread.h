@@ -26,18 +26,35 @@
 #ifndef	EVENT_CALLBACK_THREAD_H
 #define	EVENT_CALLBACK_THREAD_H
 
+#include <map>
+
+#include <common/thread/atomic.h>
 #include <common/thread/thread.h>
 
 #include <event/callback.h>
 
+/*
+ * Callbacks are scheduled by pushing them onto a lock-free inbox, so
+ * that producers never contend on the thread's mutex unless it needs
+ * to be woken up.  The thread moves the inbox onto its run queue in
+ * order.
+ *
+ * A callback whose lock is busy is parked on a list for that lock, as
+ * is every later callback using the same lock, rather than having its
+ * lock retried on every pass.  Each pass tries each parked lock once,
+ * so a hot lock with thousands of waiting callbacks costs one try_lock
+ * rather than thousands.
+ */
 class CallbackThread : public Thread, public CallbackScheduler {
 protected:
 	LogHandle log_;
 private:
 	Mutex mtx_;
 	SleepQueue sleepq_;
-	bool idle_;
+	Atomic<bool> idle_;
+	Atomic<CallbackBase *> inbox_;
 	CallbackList queue_;
+	std::map<Lock *, CallbackList> parked_;
 public:
 	CallbackThread(const std::string&);
 
@@ -51,6 +68,8 @@ private:
 
 	void main(void);
 
+	void drain(void);
+	void park(CallbackBase *);
 	CallbackBase *select(void);
 
 public:
@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sched.h>
+#include <unistd.h>
+
+#include <event/callback_worker_pool.h>
+
+#include <event/event_callback.h>
+#include <event/event_system.h>
+
+CallbackWorkerPool::Worker::Worker(const std::string& name, CallbackWorkerPool *pool, unsigned index)
+: Thread(name),
+  pool_(pool),
+  index_(index),
+  mtx_(name),
+  sleepq_(name, &mtx_),
+  idle_(false),
+  queue_()
+{ }
+
+void
+CallbackWorkerPool::Worker::main(void)
+{
+	for (;;) {
+		CallbackBase *cb = take();
+		if (cb == NULL)
+			cb = pool_->steal(this);
+		if (cb != NULL) {
+			cb->deschedule();
+			continue;
+		}
+
+		/*
+		 * Go idle before checking for pending callbacks, so that
+		 * anything scheduled after that check will wake us up.
+		 */
+		mtx_.lock();
+		idle_ = true;
+		pool_->idle_.add(1);
+		bool busy = pool_->pending_.load() != 0;
+		if (!busy) {
+			if (stop_) {
+				pool_->idle_.subtract(1);
+				idle_ = false;
+				mtx_.unlock();
+				return;
+			}
+			sleepq_.wait();
+		}
+		pool_->idle_.subtract(1);
+		idle_ = false;
+		mtx_.unlock();
+
+		/*
+		 * There is work, but every lock it needs is busy.
+		 */
+		if (busy)
+			sched_yield();
+	}
+}
+
+/*
+ * Take the oldest callback whose lock we can get.  Used by the worker
+ * on its own queue, and by other workers stealing from it.
+ */
+CallbackBase *
+CallbackWorkerPool::Worker::take(void)
+{
+	CallbackBase *cb;
+
+	ScopedLock _(&mtx_);
+	for (cb = queue_.head(); cb != NULL; cb = cb->next_) {
+		if (cb->lock()->try_lock()) {
+			queue_.remove(cb);
+			pool_->pending_.subtract(1);
+			return (cb);
+		}
+	}
+	return (NULL);
+}
+
+CallbackWorkerPool::CallbackWorkerPool(const std::string& name, unsigned count)
+: log_("/callback/worker/pool/" + name),
+  workers_(),
+  next_(0),
+  pending_(0),
+  idle_(0)
+{
+	unsigned i;
+
+	ASSERT(log_, count != 0);
+	for (i = 0; i < count; i++)
+		workers_.push_back(new Worker(name, this, i));
+}
+
+CallbackWorkerPool::~CallbackWorkerPool()
+{
+	std::vector<Worker *>::iterator it;
+
+	for (it = workers_.begin(); it != workers_.end(); ++it)
+		delete *it;
+	workers_.clear();
+}
+
+Action *
+CallbackWorkerPool::schedule(CallbackBase *cb)
+{
+	Action *a;
+
+	/*
+	 * Keep work scheduled from a worker on that worker, where its
+	 * data is likely to be in cache; others can steal it if idle.
+	 */
+	Worker *w = self();
+	if (w == NULL)
+		w = workers_[next_.add(1) % workers_.size()];
+
+	{
+		ScopedLock _(&w->mtx_);
+		a = cb->scheduled(this);
+		w->queue_.append(cb);
+		pending_.add(1);
+		if (w->idle_) {
+			w->sleepq_.signal();
+			return (a);
+		}
+	}
+
+	if (idle_.load() != 0)
+		wakeup();
+	return (a);
+}
+
+void
+CallbackWorkerPool::start(void)
+{
+	std::vector<Worker *>::const_iterator it;
+
+	for (it = workers_.begin(); it != workers_.end(); ++it) {
+		(*it)->start();
+		EventSystem::instance()->thread_wait(*it);
+	}
+}
+
+void
+CallbackWorkerPool::cancel(CallbackBase *cb)
+{
+	std::vector<Worker *>::const_iterator it;
+
+	/*
+	 * Holding the callback's lock keeps anyone from taking it, so
+	 * it stays on whichever queue it was scheduled to.
+	 */
+	ASSERT_LOCK_OWNED(log_, cb->lock());
+	for (it = workers_.begin(); it != workers_.end(); ++it) {
+		Worker *w = *it;
+		if (cb->list() != &w->queue_)
+			continue;
+
+		ScopedLock _(&w->mtx_);
+		w->queue_.remove(cb);
+		pending_.subtract(1);
+		return;
+	}
+	NOTREACHED(log_);
+}
+
+CallbackWorkerPool::Worker *
+CallbackWorkerPool::self(void) const
+{
+	std::vector<Worker *>::const_iterator it;
+	Thread *td = Thread::self();
+
+	for (it = workers_.begin(); it != workers_.end(); ++it) {
+		if (*it == td)
+			return (*it);
+	}
+	return (NULL);
+}
+
+CallbackBase *
+CallbackWorkerPool::steal(Worker *thief)
+{
+	unsigned i;
+
+	for (i = 1; i < workers_.size(); i++) {
+		Worker *victim = workers_[(thief->index_ + i) % workers_.size()];
+		CallbackBase *cb = victim->take();
+		if (cb != NULL)
+			return (cb);
+	}
+	return (NULL);
+}
+
+/*
+ * Wake up one idle worker to steal work from a busy one.
+ */
+void
+CallbackWorkerPool::wakeup(void)
+{
+	std::vector<Worker *>::const_iterator it;
+
+	for (it = workers_.begin(); it != workers_.end(); ++it) {
+		Worker *w = *it;
+
+		ScopedLock _(&w->mtx_);
+		if (!w->idle_)
+			continue;
+		w->sleepq_.signal();
+		return;
+	}
+}
+
+unsigned
+CallbackWorkerPool::cpu_count(void)
+{
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpu < 1)
+		return (1);
+	return (ncpu);
+}
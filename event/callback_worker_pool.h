@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	EVENT_CALLBACK_WORKER_POOL_H
+#define	EVENT_CALLBACK_WORKER_POOL_H
+
+#include <vector>
+
+#include <common/thread/atomic.h>
+#include <common/thread/thread.h>
+
+#include <event/callback.h>
+
+/*
+ * A pool of threads for CPU-heavy callbacks, such as codec, compression
+ * and crypto stages, which would otherwise hold up an EventThread.
+ *
+ * Each worker has its own queue.  Callbacks scheduled from a worker go
+ * on that worker's queue, others are spread over the workers in turn.
+ * A worker with nothing runnable of its own steals from the others, so
+ * that a few long callbacks do not leave work stranded behind them.
+ * Everybody takes the oldest runnable callback from the head of a
+ * queue, so callbacks sharing a lock still run in the order they were
+ * scheduled.
+ */
+class CallbackWorkerPool : public CallbackScheduler {
+	class Worker : public Thread {
+		friend class CallbackWorkerPool;
+
+		CallbackWorkerPool *pool_;
+		unsigned index_;
+		Mutex mtx_;
+		SleepQueue sleepq_;
+		bool idle_;
+		CallbackList queue_;
+	public:
+		Worker(const std::string&, CallbackWorkerPool *, unsigned);
+
+		~Worker()
+		{ }
+
+	private:
+		void main(void);
+
+		CallbackBase *take(void);
+
+	public:
+		void stop(void)
+		{
+			ScopedLock _(&mtx_);
+			if (stop_)
+				return;
+			stop_ = true;
+			sleepq_.signal();
+		}
+	};
+
+	LogHandle log_;
+	std::vector<Worker *> workers_;
+	Atomic<unsigned> next_;
+	Atomic<unsigned> pending_;
+	Atomic<unsigned> idle_;
+public:
+	CallbackWorkerPool(const std::string&, unsigned);
+	~CallbackWorkerPool();
+
+	Action *schedule(CallbackBase *);
+
+	void start(void);
+
+private:
+	void cancel(CallbackBase *);
+
+	Worker *self(void) const;
+	CallbackBase *steal(Worker *);
+	void wakeup(void);
+
+public:
+	static unsigned cpu_count(void);
+};
+
+#endif /* !EVENT_CALLBACK_WORKER_POOL_H */
@@ -26,6 +26,19 @@
 #include <event/event_callback.h>
 #include <event/event_poll.h>
 
+Action *
+EventPoll::activate(PollHandler *poll_handler, const Type& type, int fd, EventCallback *cb)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	ASSERT(log_, !poll_handler->active_);
+	ASSERT_NULL(log_, poll_handler->action_);
+	poll_handler->callback_ = cb;
+	poll_handler->active_ = true;
+	poll_handler->generation_ = next_generation();
+	poll_handler->poll_action_.reset(this, type, fd);
+	return (&poll_handler->poll_action_);
+}
+
 void
 EventPoll::PollHandler::callback(Event e)
 {
@@ -47,6 +60,8 @@ EventPoll::PollHandler::callback(Event e)
 void
 EventPoll::PollHandler::cancel(void)
 {
+	ASSERT("/event/poll/handler", active_);
+	active_ = false;
 	if (callback_ != NULL) {
 		callback_ = NULL;
 		ASSERT_NULL("/event/poll/handler", action_);
@@ -26,12 +26,11 @@
 #ifndef	EVENT_EVENT_POLL_H
 #define	EVENT_EVENT_POLL_H
 
-#include <map>
-
 #include <common/thread/mutex.h>
 #include <common/thread/thread.h>
 
 #include <event/cancellation.h>
+#include <event/fd_table.h>
 
 struct EventPollState;
 
@@ -45,34 +44,59 @@ public:
 	};
 
 private:
+	/*
+	 * The Action returned by poll() is embedded in the PollHandler for
+	 * its descriptor, and handlers are kept around (inactive) once they
+	 * are cancelled, so that polling a descriptor that has been polled
+	 * before allocates nothing.
+	 *
+	 * Handlers live in a table indexed by descriptor.  Because a
+	 * descriptor may be closed and its number reused while an event
+	 * for it is in flight, each activation of a handler is stamped
+	 * with a new generation, as is each registration of a descriptor
+	 * with the kernel; backends which can carry a generation through
+	 * the kernel with an event use it to recognize stale events.
+	 */
 	class PollAction : public Action {
 		EventPoll *poll_;
 		Type type_;
 		int fd_;
 	public:
-		PollAction(EventPoll *poll, const Type& type, int fd)
-		: poll_(poll),
-		  type_(type),
-		  fd_(fd)
+		PollAction(void)
+		: poll_(NULL),
+		  type_(Readable),
+		  fd_(-1)
 		{ }
 
 		~PollAction()
 		{ }
 
+		void reset(EventPoll *poll, const Type& type, int fd)
+		{
+			poll_ = poll;
+			type_ = type;
+			fd_ = fd;
+		}
+
 		void cancel(void)
 		{
 			poll_->cancel(type_, fd_);
-			delete this;
 		}
 	};
 
 	struct PollHandler {
 		EventCallback *callback_;
 		Action *action_;
+		bool active_;
+		uint32_t generation_;
+		PollAction poll_action_;
 
 		PollHandler(void)
 		: callback_(NULL),
-		  action_(NULL)
+		  action_(NULL),
+		  active_(false),
+		  generation_(0),
+		  poll_action_()
 		{ }
 
 		~PollHandler()
@@ -102,12 +126,35 @@ private:
 		void callback(Event);
 		void cancel(void);
 	};
-	typedef std::map<int, PollHandler> poll_handler_map_t;
+
+	struct PollSlot {
+		PollHandler read_;
+		PollHandler write_;
+		uint32_t generation_;
+
+		PollSlot(void)
+		: read_(),
+		  write_(),
+		  generation_(0)
+		{ }
+
+		PollHandler *handler(const Type& type)
+		{
+			switch (type) {
+			case Readable:
+				return (&read_);
+			case Writable:
+				return (&write_);
+			default:
+				NOTREACHED("/event/poll/slot");
+			}
+		}
+	};
 
 	LogHandle log_;
 	Mutex mtx_;
-	poll_handler_map_t read_poll_;
-	poll_handler_map_t write_poll_;
+	FDTable<PollSlot> poll_table_;
+	uint32_t generation_;
 	EventPollState *state_;
 
 public:
@@ -118,6 +165,35 @@ public:
 
 private:
 	void cancel(const Type&, int);
+
+	bool polling(const Type& type, int fd) const
+	{
+		PollSlot *slot = poll_table_.lookup(fd);
+		if (slot == NULL)
+			return (false);
+		return (slot->handler(type)->active_);
+	}
+
+	bool idle(void) const
+	{
+		int fd, limit;
+
+		limit = poll_table_.limit();
+		for (fd = 0; fd < limit; fd++) {
+			if (polling(Readable, fd) || polling(Writable, fd))
+				return (false);
+		}
+		return (true);
+	}
+
+	uint32_t next_generation(void)
+	{
+		if (++generation_ == 0)
+			generation_++;
+		return (generation_);
+	}
+
+	Action *activate(PollHandler *, const Type&, int, EventCallback *);
 	void main(void);
 
 public:
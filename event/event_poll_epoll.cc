@@ -35,6 +35,25 @@
 
 #define	EPOLL_EVENT_COUNT	128
 
+/*
+ * Each registration carries the descriptor and the generation of the
+ * registration in its event data.  The eventfd used for wakeups is
+ * registered with generation zero, which is never otherwise used.
+ */
+#define	EPOLL_DATA(fd, gen)	(((uint64_t)(gen) << 32) | (uint32_t)(fd))
+#define	EPOLL_DATA_FD(d)	((int)((d) & 0xffffffff))
+#define	EPOLL_DATA_GEN(d)	((uint32_t)((d) >> 32))
+
+/*
+ * Descriptors are registered one-shot.  A handler stays active from the
+ * time its event is delivered until its callback has run and cancelled
+ * it, and with a level-triggered registration every epoll_wait in that
+ * window would return the same event again, leaving this thread spinning
+ * until the callback thread got to run.  After an event, the kernel
+ * disarms the descriptor and we re-arm whichever handler did not fire.
+ */
+#define	EPOLL_EVENTS(ev)	((ev) | EPOLLONESHOT)
+
 struct EventPollState {
 	int ep_;
 	int fd_;
@@ -44,8 +63,8 @@ EventPoll::EventPoll(void)
 : Thread("EventPoll"),
   log_("/event/poll"),
   mtx_("EventPoll"),
-  read_poll_(),
-  write_poll_(),
+  poll_table_(log_),
+  generation_(0),
   state_(new EventPollState())
 {
 	state_->ep_ = epoll_create(EPOLL_EVENT_COUNT);
@@ -55,7 +74,7 @@ EventPoll::EventPoll(void)
 	ASSERT(log_, state_->fd_ != -1);
 
 	struct epoll_event eev;
-	eev.data.fd = state_->fd_;
+	eev.data.u64 = EPOLL_DATA(state_->fd_, 0);
 	eev.events = EPOLLIN;
 	int rv = ::epoll_ctl(state_->ep_, EPOLL_CTL_ADD, state_->fd_, &eev);
 	if (rv == -1)
@@ -64,8 +83,7 @@ EventPoll::EventPoll(void)
 
 EventPoll::~EventPoll()
 {
-	ASSERT(log_, read_poll_.empty());
-	ASSERT(log_, write_poll_.empty());
+	ASSERT(log_, idle());
 
 	if (state_ != NULL) {
 		if (state_->ep_ != -1) {
@@ -94,23 +112,20 @@ EventPoll::poll(const Type& type, int fd, EventCallback *cb)
 
 	ASSERT(log_, fd != -1);
 
-	EventPoll::PollHandler *poll_handler;
+	EventPoll::PollSlot *slot = poll_table_.get(fd);
 	struct epoll_event eev;
 	bool unique = true;
-	eev.data.fd = fd;
 	switch (type) {
 	case EventPoll::Readable:
-		ASSERT(log_, read_poll_.find(fd) == read_poll_.end());
-		unique = write_poll_.find(fd) == write_poll_.end();
-		poll_handler = &read_poll_[fd];
+		ASSERT(log_, !slot->read_.active_);
+		unique = !slot->write_.active_;
 		eev.events = EPOLLIN;
 		if (!unique)
 			eev.events |= EPOLLOUT;
 		break;
 	case EventPoll::Writable:
-		ASSERT(log_, write_poll_.find(fd) == write_poll_.end());
-		unique = read_poll_.find(fd) == read_poll_.end();
-		poll_handler = &write_poll_[fd];
+		ASSERT(log_, !slot->write_.active_);
+		unique = !slot->read_.active_;
 		eev.events = EPOLLOUT;
 		if (!unique)
 			eev.events |= EPOLLIN;
@@ -118,14 +133,15 @@ EventPoll::poll(const Type& type, int fd, EventCallback *cb)
 	default:
 		NOTREACHED(log_);
 	}
+	if (unique)
+		slot->generation_ = next_generation();
+	eev.events = EPOLL_EVENTS(eev.events);
+	eev.data.u64 = EPOLL_DATA(fd, slot->generation_);
 	int rv = ::epoll_ctl(state_->ep_, unique ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &eev);
 	if (rv == -1)
 		HALT(log_) << "Could not add event to epoll.";
 	ASSERT_ZERO(log_, rv);
-	ASSERT_NULL(log_, poll_handler->action_);
-	poll_handler->callback_ = cb;
-	Action *a = new EventPoll::PollAction(this, type, fd);
-	return (a);
+	return (activate(slot->handler(type), type, fd, cb));
 }
 
 void
@@ -133,29 +149,25 @@ EventPoll::cancel(const Type& type, int fd)
 {
 	ScopedLock _(&mtx_);
 
-	EventPoll::PollHandler *poll_handler;
+	EventPoll::PollSlot *slot = poll_table_.lookup(fd);
+	ASSERT_NON_NULL(log_, slot);
 
 	struct epoll_event eev;
 	bool unique = true;
-	eev.data.fd = fd;
 	switch (type) {
 	case EventPoll::Readable:
-		ASSERT(log_, read_poll_.find(fd) != read_poll_.end());
-		unique = write_poll_.find(fd) == write_poll_.end();
-		poll_handler = &read_poll_[fd];
-		poll_handler->cancel();
-		read_poll_.erase(fd);
+		ASSERT(log_, slot->read_.active_);
+		unique = !slot->write_.active_;
+		slot->read_.cancel();
 		if (unique)
 			eev.events = 0;
 		else
 			eev.events = EPOLLOUT;
 		break;
 	case EventPoll::Writable:
-		ASSERT(log_, write_poll_.find(fd) != write_poll_.end());
-		unique = read_poll_.find(fd) == read_poll_.end();
-		poll_handler = &write_poll_[fd];
-		poll_handler->cancel();
-		write_poll_.erase(fd);
+		ASSERT(log_, slot->write_.active_);
+		unique = !slot->read_.active_;
+		slot->write_.cancel();
 		if (unique)
 			eev.events = 0;
 		else
@@ -164,6 +176,8 @@ EventPoll::cancel(const Type& type, int fd)
 	default:
 		NOTREACHED(log_);
 	}
+	eev.events = EPOLL_EVENTS(eev.events);
+	eev.data.u64 = EPOLL_DATA(fd, slot->generation_);
 	int rv = ::epoll_ctl(state_->ep_, unique ? EPOLL_CTL_DEL : EPOLL_CTL_MOD, fd, &eev);
 	if (rv == -1)
 		HALT(log_) << "Could not delete event from epoll.";
@@ -196,10 +210,9 @@ EventPoll::main(void)
 		int i;
 		for (i = 0; i < evcnt; i++) {
 			struct epoll_event *ev = &eev[i];
-			EventPoll::PollHandler *poll_handler;
-			poll_handler_map_t::iterator it;
+			int fd = EPOLL_DATA_FD(ev->data.u64);
 
-			if (ev->data.fd == state_->fd_) {
+			if (ev->data.u64 == EPOLL_DATA(state_->fd_, 0)) {
 				ASSERT(log_, (ev->events & EPOLLIN) != 0);
 				/* A user event was triggered to wake us up.  Clear it.  */
 				uint64_t cnt;
@@ -210,27 +223,48 @@ EventPoll::main(void)
 				continue;
 			}
 
-			if ((it = read_poll_.find(ev->data.fd)) != read_poll_.end()) {
-				poll_handler = &it->second;
+			/*
+			 * Events from a registration which has since been
+			 * deleted, perhaps with the descriptor closed and
+			 * reused, are simply dropped.
+			 */
+			EventPoll::PollSlot *slot = poll_table_.lookup(fd);
+			if (slot == NULL ||
+			    slot->generation_ != EPOLL_DATA_GEN(ev->data.u64))
+				continue;
+
+			uint32_t rearm = 0;
 
+			if (slot->read_.active_) {
 				if ((ev->events & EPOLLIN) != 0) {
-					poll_handler->callback(Event::Done);
+					slot->read_.callback(Event::Done);
 				} else if ((ev->events & EPOLLERR) != 0) {
-					poll_handler->callback(Event::Error);
+					slot->read_.callback(Event::Error);
 				} else if ((ev->events & EPOLLHUP) != 0) {
-					poll_handler->callback(Event::EOS);
+					slot->read_.callback(Event::EOS);
+				} else {
+					rearm |= EPOLLIN;
 				}
 			}
 
-			if ((it = write_poll_.find(ev->data.fd)) != write_poll_.end()) {
-				poll_handler = &it->second;
-
+			if (slot->write_.active_) {
 				if ((ev->events & EPOLLOUT) != 0) {
-					poll_handler->callback(Event::Done);
+					slot->write_.callback(Event::Done);
 				} else if ((ev->events & EPOLLERR) != 0) {
-					poll_handler->callback(Event::Error);
+					slot->write_.callback(Event::Error);
+				} else {
+					rearm |= EPOLLOUT;
 				}
 			}
+
+			if (rearm != 0) {
+				struct epoll_event reev;
+				reev.events = EPOLL_EVENTS(rearm);
+				reev.data.u64 = ev->data.u64;
+				int rv = ::epoll_ctl(state_->ep_, EPOLL_CTL_MOD, fd, &reev);
+				if (rv == -1)
+					HALT(log_) << "Could not re-arm event in epoll.";
+			}
 		}
 
 		if (stop_)
@@ -0,0 +1,350 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <event/event_callback.h>
+#include <event/event_poll.h>
+
+/*
+ * An EventPoll built on io_uring(7) one-shot polls, rather than on epoll.
+ * Registrations and cancellations are submission queue entries, and all
+ * completions which are ready are reaped in one go for each io_uring_enter
+ * the poll thread makes.
+ *
+ * Each poll is tagged with a generation, so that the completion of a poll
+ * which has since been cancelled (and perhaps replaced by a new poll for
+ * the same descriptor) is ignored rather than mistaken for the new one.
+ * The generation is that of the activation of the handler.
+ */
+
+#define	IO_URING_ENTRIES	256
+
+#define	IO_URING_DATA_WAKEUP	((uint64_t)0)
+#define	IO_URING_DATA_IGNORE	((uint64_t)1)
+
+#define	IO_URING_DATA(fd, type, gen)					\
+	(((uint64_t)(gen) << 32) | ((uint64_t)(fd) << 1) | (type))
+#define	IO_URING_DATA_FD(d)	((int)(((d) & 0xffffffff) >> 1))
+#define	IO_URING_DATA_TYPE(d)	((EventPoll::Type)((d) & 1))
+#define	IO_URING_DATA_GEN(d)	((uint32_t)((d) >> 32))
+
+struct EventPollState {
+	int ring_;
+
+	void *sq_ring_;
+	size_t sq_ring_size_;
+	unsigned *sq_head_;
+	unsigned *sq_tail_;
+	unsigned sq_mask_;
+	unsigned *sq_array_;
+	struct io_uring_sqe *sqes_;
+	size_t sqes_size_;
+	unsigned sq_local_tail_;
+
+	void *cq_ring_;
+	size_t cq_ring_size_;
+	unsigned *cq_head_;
+	unsigned *cq_tail_;
+	unsigned cq_mask_;
+	struct io_uring_cqe *cqes_;
+
+	unsigned pending_;
+
+	struct io_uring_sqe *get(void);
+	void submit(void);
+};
+
+static int
+io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return (::syscall(__NR_io_uring_setup, entries, p));
+}
+
+static int
+io_uring_enter(int ring, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+	return (::syscall(__NR_io_uring_enter, ring, to_submit, min_complete, flags, NULL, 0));
+}
+
+EventPoll::EventPoll(void)
+: Thread("EventPoll"),
+  log_("/event/poll"),
+  mtx_("EventPoll"),
+  poll_table_(log_),
+  generation_(0),
+  state_(new EventPollState())
+{
+	struct io_uring_params p;
+	uint8_t *sq, *cq;
+
+	memset(&p, 0, sizeof p);
+	state_->ring_ = io_uring_setup(IO_URING_ENTRIES, &p);
+	if (state_->ring_ == -1)
+		HALT(log_) << "Could not create io_uring: " << strerror(errno);
+
+	state_->sq_ring_size_ = p.sq_off.array + p.sq_entries * sizeof (unsigned);
+	state_->cq_ring_size_ = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+	if ((p.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+		if (state_->cq_ring_size_ > state_->sq_ring_size_)
+			state_->sq_ring_size_ = state_->cq_ring_size_;
+		state_->cq_ring_size_ = state_->sq_ring_size_;
+	}
+
+	state_->sq_ring_ = mmap(NULL, state_->sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, state_->ring_, IORING_OFF_SQ_RING);
+	if (state_->sq_ring_ == MAP_FAILED)
+		HALT(log_) << "Could not map io_uring submission queue.";
+	if ((p.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+		state_->cq_ring_ = state_->sq_ring_;
+	} else {
+		state_->cq_ring_ = mmap(NULL, state_->cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, state_->ring_, IORING_OFF_CQ_RING);
+		if (state_->cq_ring_ == MAP_FAILED)
+			HALT(log_) << "Could not map io_uring completion queue.";
+	}
+
+	state_->sqes_size_ = p.sq_entries * sizeof (struct io_uring_sqe);
+	state_->sqes_ = (struct io_uring_sqe *)mmap(NULL, state_->sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, state_->ring_, IORING_OFF_SQES);
+	if (state_->sqes_ == MAP_FAILED)
+		HALT(log_) << "Could not map io_uring submission entries.";
+
+	sq = (uint8_t *)state_->sq_ring_;
+	state_->sq_head_ = (unsigned *)(sq + p.sq_off.head);
+	state_->sq_tail_ = (unsigned *)(sq + p.sq_off.tail);
+	state_->sq_mask_ = *(unsigned *)(sq + p.sq_off.ring_mask);
+	state_->sq_array_ = (unsigned *)(sq + p.sq_off.array);
+
+	cq = (uint8_t *)state_->cq_ring_;
+	state_->cq_head_ = (unsigned *)(cq + p.cq_off.head);
+	state_->cq_tail_ = (unsigned *)(cq + p.cq_off.tail);
+	state_->cq_mask_ = *(unsigned *)(cq + p.cq_off.ring_mask);
+	state_->cqes_ = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+	state_->sq_local_tail_ = *state_->sq_tail_;
+	state_->pending_ = 0;
+}
+
+EventPoll::~EventPoll()
+{
+	ASSERT(log_, idle());
+
+	if (state_ != NULL) {
+		munmap(state_->sqes_, state_->sqes_size_);
+		if (state_->cq_ring_ != state_->sq_ring_)
+			munmap(state_->cq_ring_, state_->cq_ring_size_);
+		munmap(state_->sq_ring_, state_->sq_ring_size_);
+		close(state_->ring_);
+		delete state_;
+		state_ = NULL;
+	}
+}
+
+Action *
+EventPoll::poll(const Type& type, int fd, EventCallback *cb)
+{
+	ScopedLock _(&mtx_);
+
+	ASSERT(log_, fd != -1);
+
+	EventPoll::PollHandler *poll_handler = poll_table_.get(fd)->handler(type);
+	ASSERT(log_, !poll_handler->active_);
+	Action *a = activate(poll_handler, type, fd, cb);
+
+	struct io_uring_sqe *sqe = state_->get();
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	switch (type) {
+	case EventPoll::Readable:
+		sqe->poll32_events = POLLIN;
+		break;
+	case EventPoll::Writable:
+		sqe->poll32_events = POLLOUT;
+		break;
+	default:
+		NOTREACHED(log_);
+	}
+	sqe->user_data = IO_URING_DATA(fd, type, poll_handler->generation_);
+	state_->submit();
+
+	return (a);
+}
+
+void
+EventPoll::cancel(const Type& type, int fd)
+{
+	ScopedLock _(&mtx_);
+
+	EventPoll::PollSlot *slot = poll_table_.lookup(fd);
+	ASSERT_NON_NULL(log_, slot);
+	EventPoll::PollHandler *poll_handler = slot->handler(type);
+	ASSERT(log_, poll_handler->active_);
+	poll_handler->cancel();
+
+	/*
+	 * The poll may already have completed, in which case this removal
+	 * simply fails, but it must be submitted now regardless: a pending
+	 * poll holds a reference to the file, which would otherwise keep
+	 * the descriptor open past close(2).
+	 */
+	struct io_uring_sqe *sqe = state_->get();
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = IO_URING_DATA(fd, type, poll_handler->generation_);
+	sqe->user_data = IO_URING_DATA_IGNORE;
+	state_->submit();
+}
+
+void
+EventPoll::main(void)
+{
+	for (;;) {
+		int rv = io_uring_enter(state_->ring_, 0, 1, IORING_ENTER_GETEVENTS);
+		if (rv == -1) {
+			if (errno == EINTR) {
+				if (stop_) {
+					INFO(log_) << "Received interrupt, ceasing polling until stop handlers have run.";
+					return;
+				}
+				continue;
+			}
+			HALT(log_) << "Could not wait for io_uring completions.";
+		}
+
+		/*
+		 * As with epoll, handle every completion there is under
+		 * one acquisition of the lock.
+		 */
+		ScopedLock _(&mtx_);
+		unsigned head = *state_->cq_head_;
+		unsigned tail = __atomic_load_n(state_->cq_tail_, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++) {
+			struct io_uring_cqe *cqe = &state_->cqes_[head & state_->cq_mask_];
+			uint64_t data = cqe->user_data;
+			int res = cqe->res;
+
+			if (data == IO_URING_DATA_WAKEUP) {
+				DEBUG(log_) << "Got wakeup request.";
+				continue;
+			}
+			if (data == IO_URING_DATA_IGNORE)
+				continue;
+
+			EventPoll::PollSlot *slot = poll_table_.lookup(IO_URING_DATA_FD(data));
+			if (slot == NULL)
+				continue;
+			EventPoll::PollHandler *poll_handler = slot->handler(IO_URING_DATA_TYPE(data));
+			if (!poll_handler->active_ ||
+			    poll_handler->generation_ != IO_URING_DATA_GEN(data))
+				continue;
+
+			if (res < 0) {
+				poll_handler->callback(Event(Event::Error, -res));
+				continue;
+			}
+
+			if (IO_URING_DATA_TYPE(data) == EventPoll::Readable) {
+				if ((res & POLLIN) != 0) {
+					poll_handler->callback(Event::Done);
+				} else if ((res & POLLERR) != 0) {
+					poll_handler->callback(Event::Error);
+				} else {
+					poll_handler->callback(Event::EOS);
+				}
+			} else {
+				if ((res & POLLOUT) != 0) {
+					poll_handler->callback(Event::Done);
+				} else {
+					poll_handler->callback(Event::Error);
+				}
+			}
+		}
+		__atomic_store_n(state_->cq_head_, head, __ATOMIC_RELEASE);
+
+		if (stop_)
+			break;
+	}
+}
+
+void
+EventPoll::stop(void)
+{
+	ScopedLock _(&mtx_);
+	if (stop_)
+		return;
+
+	struct io_uring_sqe *sqe = state_->get();
+	sqe->opcode = IORING_OP_NOP;
+	sqe->user_data = IO_URING_DATA_WAKEUP;
+	state_->submit();
+
+	stop_ = true;
+}
+
+/*
+ * Get a cleared submission queue entry, to be filled in and submitted
+ * with the EventPoll lock held.  Entries are only made visible to the
+ * kernel by submit().
+ */
+struct io_uring_sqe *
+EventPollState::get(void)
+{
+	unsigned tail = sq_local_tail_;
+
+	/*
+	 * Entries are submitted as soon as they are filled in, so the
+	 * queue can only be full if the kernel has yet to consume them.
+	 */
+	while (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) > sq_mask_)
+		submit();
+
+	struct io_uring_sqe *sqe = &sqes_[tail & sq_mask_];
+	memset(sqe, 0, sizeof *sqe);
+	sq_array_[tail & sq_mask_] = tail & sq_mask_;
+	sq_local_tail_ = tail + 1;
+	pending_++;
+	return (sqe);
+}
+
+void
+EventPollState::submit(void)
+{
+	__atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+
+	while (pending_ != 0) {
+		int rv = io_uring_enter(ring_, pending_, 0, 0);
+		if (rv == -1) {
+			if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+				continue;
+			HALT("/event/poll") << "Could not submit to io_uring: " << strerror(errno);
+		}
+		pending_ -= rv;
+	}
+}
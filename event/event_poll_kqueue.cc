@@ -42,8 +42,8 @@ EventPoll::EventPoll(void)
 : Thread("EventPoll"),
   log_("/event/poll"),
   mtx_("EventPoll"),
-  read_poll_(),
-  write_poll_(),
+  poll_table_(log_),
+  generation_(0),
   state_(new EventPollState())
 {
 	state_->kq_ = kqueue();
@@ -59,10 +59,8 @@ EventPoll::EventPoll(void)
 
 EventPoll::~EventPoll()
 {
-	if (!read_poll_.empty())
-		ERROR(log_) << "Exiting with pending read polls.";
-	if (!write_poll_.empty())
-		ERROR(log_) << "Exiting with pending write polls.";
+	if (!idle())
+		ERROR(log_) << "Exiting with pending polls.";
 
 	if (state_ != NULL) {
 		if (state_->kq_ != -1) {
@@ -87,18 +85,22 @@ EventPoll::poll(const Type& type, int fd, EventCallback *cb)
 
 	ASSERT(log_, fd != -1);
 
-	EventPoll::PollHandler *poll_handler;
+	EventPoll::PollHandler *poll_handler = poll_table_.get(fd)->handler(type);
+	ASSERT(log_, !poll_handler->active_);
+	Action *a = activate(poll_handler, type, fd, cb);
+
+	/*
+	 * The generation of the poll rides along in the udata, so that an
+	 * event for an earlier poll of a reused descriptor can be dropped.
+	 */
+	void *udata = (void *)(uintptr_t)poll_handler->generation_;
 	struct kevent kev;
 	switch (type) {
 	case EventPoll::Readable:
-		ASSERT(log_, read_poll_.find(fd) == read_poll_.end());
-		poll_handler = &read_poll_[fd];
-		EV_SET(&kev, fd, EVFILT_READ, EV_ADD | EV_ONESHOT, 0, 0, NULL);
+		EV_SET(&kev, fd, EVFILT_READ, EV_ADD | EV_ONESHOT, 0, 0, udata);
 		break;
 	case EventPoll::Writable:
-		ASSERT(log_, write_poll_.find(fd) == write_poll_.end());
-		poll_handler = &write_poll_[fd];
-		EV_SET(&kev, fd, EVFILT_WRITE, EV_ADD | EV_ONESHOT, 0, 0, NULL);
+		EV_SET(&kev, fd, EVFILT_WRITE, EV_ADD | EV_ONESHOT, 0, 0, udata);
 		break;
 	default:
 		NOTREACHED(log_);
@@ -107,9 +109,6 @@ EventPoll::poll(const Type& type, int fd, EventCallback *cb)
 	if (evcnt == -1)
 		HALT(log_) << "Could not add event to kqueue.";
 	ASSERT_ZERO(log_, evcnt);
-	ASSERT_NULL(log_, poll_handler->action_);
-	poll_handler->callback_ = cb;
-	Action *a = new EventPoll::PollAction(this, type, fd);
 	return (a);
 }
 
@@ -122,19 +121,10 @@ EventPoll::cancel(const Type& type, int fd)
 	 * XXX MT XXX
 	 * Needs to delete the evfilter iff unfired.
 	 */
-	EventPoll::PollHandler *poll_handler;
-	switch (type) {
-	case EventPoll::Readable:
-		ASSERT(log_, read_poll_.find(fd) != read_poll_.end());
-		poll_handler = &read_poll_[fd];
-		break;
-	case EventPoll::Writable:
-		ASSERT(log_, write_poll_.find(fd) != write_poll_.end());
-		poll_handler = &write_poll_[fd];
-		break;
-	default:
-		NOTREACHED(log_);
-	}
+	EventPoll::PollSlot *slot = poll_table_.lookup(fd);
+	ASSERT_NON_NULL(log_, slot);
+	EventPoll::PollHandler *poll_handler = slot->handler(type);
+	ASSERT(log_, poll_handler->active_);
 
 	/*
 	 * If the event never fired, delete the filter for it.
@@ -168,17 +158,6 @@ EventPoll::cancel(const Type& type, int fd)
 		(void)::kevent(state_->kq_, &kev, 1, NULL, 0, NULL);
 	}
 	poll_handler->cancel();
-
-	switch (type) {
-	case EventPoll::Readable:
-		read_poll_.erase(fd);
-		break;
-	case EventPoll::Writable:
-		write_poll_.erase(fd);
-		break;
-	default:
-		NOTREACHED(log_);
-	}
 }
 
 void
@@ -206,22 +185,16 @@ EventPoll::main(void)
 		for (i = 0; i < evcnt; i++) {
 			struct kevent *ev = &kev[i];
 			EventPoll::PollHandler *poll_handler;
-			poll_handler_map_t::iterator it;
+			EventPoll::PollSlot *slot;
 
 			switch (ev->filter) {
 			case EVFILT_READ:
-				it = read_poll_.find(ev->ident);
-				if (it == read_poll_.end()) {
-					DEBUG(log_) << "Dropping read event lost in race.";
-					continue;
-				}
+				slot = poll_table_.lookup(ev->ident);
+				poll_handler = slot == NULL ? NULL : &slot->read_;
 				break;
 			case EVFILT_WRITE:
-				it = write_poll_.find(ev->ident);
-				if (it == write_poll_.end()) {
-					DEBUG(log_) << "Dropping write event lost in race.";
-					continue;
-				}
+				slot = poll_table_.lookup(ev->ident);
+				poll_handler = slot == NULL ? NULL : &slot->write_;
 				break;
 			case EVFILT_USER:
 				/* A user event was triggered to wake us up.  Ignore it.  */
@@ -230,7 +203,11 @@ EventPoll::main(void)
 			default:
 				NOTREACHED(log_);
 			}
-			poll_handler = &it->second;
+			if (poll_handler == NULL || !poll_handler->active_ ||
+			    poll_handler->generation_ != (uint32_t)(uintptr_t)ev->udata) {
+				DEBUG(log_) << "Dropping event lost in race.";
+				continue;
+			}
 			if ((ev->flags & EV_ERROR) != 0) {
 				poll_handler->callback(Event(Event::Error, ev->fflags));
 				continue;
@@ -282,10 +259,13 @@ EventPoll::stop(void)
 	 * but then go down this path.  And we need to be sure we get
 	 * woken up by the deadline.
 	 */
-	poll_handler_map_t::iterator it;
-	for (it = read_poll_.begin(); it != read_poll_.end(); ++it)
-		it->second.callback(Event(Event::Error, 0));
-	for (it = write_poll_.begin(); it != write_poll_.end(); ++it)
-		it->second.callback(Event(Event::Error, 0));
+	int fd, limit;
+	limit = poll_table_.limit();
+	for (fd = 0; fd < limit; fd++) {
+		if (polling(Readable, fd))
+			poll_table_.lookup(fd)->read_.callback(Event(Event::Error, 0));
+		if (polling(Writable, fd))
+			poll_table_.lookup(fd)->write_.callback(Event(Event::Error, 0));
+	}
 #endif
 }
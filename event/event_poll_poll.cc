@@ -28,6 +28,8 @@
 #include <poll.h>
 #include <unistd.h>
 
+#include <map>
+
 #include <common/buffer.h>
 
 #include <event/event_callback.h>
@@ -35,16 +37,15 @@
 
 EventPoll::EventPoll(void)
 : log_("/event/poll"),
-  read_poll_(),
-  write_poll_(),
+  poll_table_(log_),
+  generation_(0),
   state_(NULL)
 {
 }
 
 EventPoll::~EventPoll()
 {
-	ASSERT(log_, read_poll_.empty());
-	ASSERT(log_, write_poll_.empty());
+	ASSERT(log_, idle());
 }
 
 Action *
@@ -55,20 +56,17 @@ EventPoll::poll(const Type& type, int fd, EventCallback *cb)
 	EventPoll::PollHandler *poll_handler;
 	switch (type) {
 	case EventPoll::Readable:
-		ASSERT(log_, read_poll_.find(fd) == read_poll_.end());
-		poll_handler = &read_poll_[fd];
+		ASSERT(log_, !polling(Readable, fd));
+		poll_handler = &poll_table_.get(fd)->read_;
 		break;
 	case EventPoll::Writable:
-		ASSERT(log_, write_poll_.find(fd) == write_poll_.end());
-		poll_handler = &write_poll_[fd];
+		ASSERT(log_, !polling(Writable, fd));
+		poll_handler = &poll_table_.get(fd)->write_;
 		break;
 	default:
 		NOTREACHED(log_);
 	}
-	ASSERT_NULL(log_, poll_handler->action_);
-	poll_handler->callback_ = cb;
-	Action *a = new EventPoll::PollAction(this, type, fd);
-	return (a);
+	return (activate(poll_handler, type, fd, cb));
 }
 
 void
@@ -78,16 +76,14 @@ EventPoll::cancel(const Type& type, int fd)
 
 	switch (type) {
 	case EventPoll::Readable:
-		ASSERT(log_, read_poll_.find(fd) != read_poll_.end());
-		poll_handler = &read_poll_[fd];
+		ASSERT(log_, polling(Readable, fd));
+		poll_handler = &poll_table_.get(fd)->read_;
 		poll_handler->cancel();
-		read_poll_.erase(fd);
 		break;
 	case EventPoll::Writable:
-		ASSERT(log_, write_poll_.find(fd) != write_poll_.end());
-		poll_handler = &write_poll_[fd];
+		ASSERT(log_, polling(Writable, fd));
+		poll_handler = &poll_table_.get(fd)->write_;
 		poll_handler->cancel();
-		write_poll_.erase(fd);
 		break;
 	}
 }
@@ -95,14 +91,16 @@ EventPoll::cancel(const Type& type, int fd)
 void
 EventPoll::wait(int ms)
 {
-	poll_handler_map_t::iterator it;
 	std::map<int, short> event_map;
-
-	for (it = read_poll_.begin(); it != read_poll_.end(); ++it)
-		event_map[it->first] |= POLLIN;
-
-	for (it = write_poll_.begin(); it != write_poll_.end(); ++it)
-		event_map[it->first] |= POLLOUT;
+	int pfd, limit;
+
+	limit = poll_table_.limit();
+	for (pfd = 0; pfd < limit; pfd++) {
+		if (polling(Readable, pfd))
+			event_map[pfd] |= POLLIN;
+		if (polling(Writable, pfd))
+			event_map[pfd] |= POLLOUT;
+	}
 
 	size_t nfds = event_map.size();
 	struct pollfd fds[nfds];
@@ -149,20 +147,18 @@ EventPoll::wait(int ms)
 
 		EventPoll::PollHandler *poll_handler;
 		if ((fd->revents & POLLIN) != 0) {
-			ASSERT(log_, read_poll_.find(fd->fd) != read_poll_.end());
-			poll_handler = &read_poll_[fd->fd];
+			ASSERT(log_, polling(Readable, fd->fd));
+			poll_handler = &poll_table_.get(fd->fd)->read_;
 		} else if ((fd->revents & POLLOUT) != 0) {
-			ASSERT(log_, write_poll_.find(fd->fd) != write_poll_.end());
-			poll_handler = &write_poll_[fd->fd];
+			ASSERT(log_, polling(Writable, fd->fd));
+			poll_handler = &poll_table_.get(fd->fd)->write_;
 		} else {
 			if ((fd->events & POLLIN) != 0) {
-				ASSERT(log_, read_poll_.find(fd->fd) !=
-				       read_poll_.end());
-				poll_handler = &read_poll_[fd->fd];
+				ASSERT(log_, polling(Readable, fd->fd));
+				poll_handler = &poll_table_.get(fd->fd)->read_;
 			} else if ((fd->events & POLLOUT) != 0) {
-				ASSERT(log_, write_poll_.find(fd->fd) !=
-				       write_poll_.end());
-				poll_handler = &write_poll_[fd->fd];
+				ASSERT(log_, polling(Writable, fd->fd));
+				poll_handler = &poll_table_.get(fd->fd)->write_;
 			} else {
 				HALT(log_) << "Unexpected poll fd.";
 				continue;
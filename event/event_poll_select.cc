@@ -33,16 +33,15 @@
 
 EventPoll::EventPoll(void)
 : log_("/event/poll"),
-  read_poll_(),
-  write_poll_(),
+  poll_table_(log_),
+  generation_(0),
   state_(NULL)
 {
 }
 
 EventPoll::~EventPoll()
 {
-	ASSERT(log_, read_poll_.empty());
-	ASSERT(log_, write_poll_.empty());
+	ASSERT(log_, idle());
 }
 
 Action *
@@ -53,20 +52,17 @@ EventPoll::poll(const Type& type, int fd, EventCallback *cb)
 	EventPoll::PollHandler *poll_handler;
 	switch (type) {
 	case EventPoll::Readable:
-		ASSERT(log_, read_poll_.find(fd) == read_poll_.end());
-		poll_handler = &read_poll_[fd];
+		ASSERT(log_, !polling(Readable, fd));
+		poll_handler = &poll_table_.get(fd)->read_;
 		break;
 	case EventPoll::Writable:
-		ASSERT(log_, write_poll_.find(fd) == write_poll_.end());
-		poll_handler = &write_poll_[fd];
+		ASSERT(log_, !polling(Writable, fd));
+		poll_handler = &poll_table_.get(fd)->write_;
 		break;
 	default:
 		NOTREACHED(log_);
 	}
-	ASSERT_NULL(log_, poll_handler->action_);
-	poll_handler->callback_ = cb;
-	Action *a = new EventPoll::PollAction(this, type, fd);
-	return (a);
+	return (activate(poll_handler, type, fd, cb));
 }
 
 void
@@ -76,16 +72,14 @@ EventPoll::cancel(const Type& type, int fd)
 
 	switch (type) {
 	case EventPoll::Readable:
-		ASSERT(log_, read_poll_.find(fd) != read_poll_.end());
-		poll_handler = &read_poll_[fd];
+		ASSERT(log_, polling(Readable, fd));
+		poll_handler = &poll_table_.get(fd)->read_;
 		poll_handler->cancel();
-		read_poll_.erase(fd);
 		break;
 	case EventPoll::Writable:
-		ASSERT(log_, write_poll_.find(fd) != write_poll_.end());
-		poll_handler = &write_poll_[fd];
+		ASSERT(log_, polling(Writable, fd));
+		poll_handler = &poll_table_.get(fd)->write_;
 		poll_handler->cancel();
-		write_poll_.erase(fd);
 		break;
 	}
 }
@@ -93,9 +87,8 @@ EventPoll::cancel(const Type& type, int fd)
 void
 EventPoll::wait(int ms)
 {
-	poll_handler_map_t::iterator it;
 	fd_set read_set, write_set;
-	int maxfd;
+	int fd, limit, maxfd;
 
 	/*
 	 * XXX
@@ -104,17 +97,22 @@ EventPoll::wait(int ms)
 	maxfd = -1;
 
 	FD_ZERO(&read_set);
-	for (it = read_poll_.begin(); it != read_poll_.end(); ++it) {
-		FD_SET(it->first, &read_set);
-		if (maxfd < it->first)
-			maxfd = it->first;
+	limit = poll_table_.limit();
+	for (fd = 0; fd < limit; fd++) {
+		if (!polling(Readable, fd))
+			continue;
+		FD_SET(fd, &read_set);
+		if (maxfd < fd)
+			maxfd = fd;
 	}
 
 	FD_ZERO(&write_set);
-	for (it = write_poll_.begin(); it != write_poll_.end(); ++it) {
-		FD_SET(it->first, &write_set);
-		if (maxfd < it->first)
-			maxfd = it->first;
+	for (fd = 0; fd < limit; fd++) {
+		if (!polling(Writable, fd))
+			continue;
+		FD_SET(fd, &write_set);
+		if (maxfd < fd)
+			maxfd = fd;
 	}
 
 	/*
@@ -150,19 +148,18 @@ EventPoll::wait(int ms)
 		HALT(log_) << "Could not select.";
 	}
 
-	int fd;
 	for (fd = 0; fdcnt != 0 && fd <= maxfd; fd++) {
 		if (FD_ISSET(fd, &read_set)) {
-			ASSERT(log_, read_poll_.find(fd) != read_poll_.end());
-			read_poll_[fd].callback(Event::Done);
+			ASSERT(log_, polling(Readable, fd));
+			poll_table_.lookup(fd)->read_.callback(Event::Done);
 
 			ASSERT_NON_ZERO(log_, fdcnt);
 			fdcnt--;
 		}
 
 		if (FD_ISSET(fd, &write_set)) {
-			ASSERT(log_, write_poll_.find(fd) != write_poll_.end());
-			write_poll_[fd].callback(Event::Done);
+			ASSERT(log_, polling(Writable, fd));
+			poll_table_.lookup(fd)->write_.callback(Event::Done);
 
 			ASSERT_NON_ZERO(log_, fdcnt);
 			fdcnt--;
@@ -26,19 +26,38 @@
 #include <event/event_callback.h>
 #include <event/event_system.h>
 
-#define	EVENT_SYSTEM_WORKER_MAX		8
-
 EventSystem::EventSystem(void)
 : td_("EventThread"),
+  callback_threads_(),
+  started_(false),
   poll_(),
+  reactor_polls_(),
   timeout_(),
   destroy_(),
+  threads_mtx_("EventSystem::threads"),
   threads_(),
+  stop_(false),
   interest_queue_mtx_("EventSystem::interest_queue"),
   interest_queue_(),
-  workers_()
+  workers_("EventWorker", CallbackWorkerPool::cpu_count())
 { }
 
+/*
+ * Poll for the callback's reactor, so that the callback is scheduled from
+ * the same reactor that it runs in.
+ */
+Action *
+EventSystem::poll(const EventPoll::Type& type, int fd, EventCallback *cb)
+{
+	unsigned i;
+
+	for (i = 0; i < reactor_polls_.size(); i++) {
+		if (cb->scheduler() == callback_threads_[i])
+			return (reactor_polls_[i]->poll(type, fd, cb));
+	}
+	return (poll_.poll(type, fd, cb));
+}
+
 Action *
 EventSystem::register_interest(const EventInterest& interest, SimpleCallback *cb)
 {
@@ -53,38 +72,163 @@ EventSystem::register_interest(const EventInterest& interest, SimpleCallback *cb
 }
 
 /*
- * Request an EventThread to submit work to.
- *
- * For now these are primarily for known long-running or demanding tasks,
- * and normal stff goes through the EventThread instead.  Eventually, we
- * want something like this to be the norm, and to have categories for
- * them, so that we can increase locality of reference, or even have a
- * variety of strategies available so that we could ensure heterogenous
- * workloads to maximize parallelism.
+ * Pick the thread to run callbacks which use the given lock.
  *
- * XXX All kinds of configuration and seatbelts needed here.
- *
- * For now we allow up to EVENT_SYSTEM_WORKER_MAX threads to be created.
+ * Callbacks which share a lock always run in the same thread, so that
+ * the lock and the state it protects stay with one CPU instead of
+ * ping-ponging, while callbacks with unrelated locks (and so, unrelated
+ * connections) are spread over all of the threads.  The lock's address
+ * is hashed multiplicatively so that allocator alignment does not skew
+ * the spread.
  */
 CallbackScheduler *
-EventSystem::worker(void)
+EventSystem::scheduler(Lock *lock)
 {
-	static unsigned wcnt;
+	/*
+	 * With reactors, callbacks instead run in the reactor they
+	 * were created in, which is where their connection lives.
+	 */
+	if (!reactor_polls_.empty())
+		return (reactor_scheduler(reactor()));
 
-	if (workers_.size() < EVENT_SYSTEM_WORKER_MAX) {
-		CallbackThread *td = new CallbackThread("EventWorker");
-		workers_.push_back(td);
+	if (callback_threads_.empty() || lock == NULL)
+		return (&td_);
 
-		td->start();
+	uint64_t hash = (uint64_t)(uintptr_t)lock * 0x9e3779b97f4a7c15ull;
+	unsigned i = (hash >> 32) % (callback_threads_.size() + 1);
+	if (i == 0)
+		return (&td_);
+	return (callback_threads_[i - 1]);
+}
 
-		thread_wait(td);
+/*
+ * Set the number of threads to spread callbacks over, including the
+ * EventThread itself.  This must be done before any callbacks we want
+ * to spread are created, and before the EventSystem is started.
+ */
+bool
+EventSystem::set_callback_threads(unsigned count)
+{
+	if (started_ || !callback_threads_.empty()) {
+		ERROR("/event/system") << "Callback threads must be set once, before starting.";
+		return (false);
+	}
 
-		return (td);
+	if (count == 0 || count > EVENT_SYSTEM_CALLBACK_THREAD_MAX) {
+		ERROR("/event/system") << "Invalid number of callback threads: " << count;
+		return (false);
 	}
 
-	CallbackThread *td = workers_[wcnt];
-	wcnt = (wcnt + 1) % EVENT_SYSTEM_WORKER_MAX;
-	return (td);
+	while (callback_threads_.size() + 1 < count)
+		callback_threads_.push_back(new CallbackThread("EventThread"));
+
+	return (true);
+}
+
+/*
+ * Set the number of reactors, each of which has its own EventPoll and
+ * callback thread.  As with set_callback_threads, this must be done
+ * before starting, and before any sockets are created, since IOSystem
+ * divides its handles among reactors when it is created.
+ */
+bool
+EventSystem::set_reactors(unsigned count)
+{
+	if (!set_callback_threads(count))
+		return (false);
+
+	while (reactor_polls_.size() + 1 < count)
+		reactor_polls_.push_back(new EventPoll());
+
+	return (true);
+}
+
+/*
+ * Find the reactor that the current thread belongs to.
+ */
+unsigned
+EventSystem::reactor(void) const
+{
+	unsigned i;
+
+	if (reactor_polls_.empty())
+		return (0);
+
+	Thread *td = Thread::self();
+	for (i = 0; i < reactor_polls_.size(); i++) {
+		if (td == callback_threads_[i] || td == reactor_polls_[i])
+			return (i + 1);
+	}
+	return (0);
+}
+
+CallbackScheduler *
+EventSystem::reactor_scheduler(unsigned i)
+{
+	ASSERT("/event/system", i < reactors());
+	if (i == 0)
+		return (&td_);
+	return (callback_threads_[i - 1]);
+}
+
+/*
+ * Run each reactor's threads on one of the given CPUs, taking them in
+ * turn, so that a reactor's connections, and the memory they use, stay
+ * on one CPU and its NUMA node.  Listeners opened by a reactor also ask
+ * for connections whose packets arrive on its CPU; see TCPServer.  This
+ * must be done after setting the number of reactors.
+ */
+bool
+EventSystem::set_reactor_cpus(const Thread::CPUSet& cpus)
+{
+	Thread::CPUSet::const_iterator it;
+	unsigned i;
+
+	if (cpus.empty()) {
+		ERROR("/event/system") << "No CPUs given for reactors.";
+		return (false);
+	}
+
+	reactor_cpus_.clear();
+	it = cpus.begin();
+	for (i = 0; i < reactors(); i++) {
+		Thread::CPUSet cpu;
+
+		cpu.insert(*it);
+		reactor_cpus_.push_back(*it);
+
+		Thread *td = i == 0 ? (Thread *)&td_ : callback_threads_[i - 1];
+		Thread *poll = i == 0 ? &poll_ : reactor_polls_[i - 1];
+		if (!td->affinity(cpu) || !poll->affinity(cpu))
+			return (false);
+
+		if (++it == cpus.end())
+			it = cpus.begin();
+	}
+	return (true);
+}
+
+/*
+ * The CPU a reactor runs on, or -1 if it may run on any.
+ */
+int
+EventSystem::reactor_cpu(unsigned i) const
+{
+	if (i >= reactor_cpus_.size())
+		return (-1);
+	return (reactor_cpus_[i]);
+}
+
+/*
+ * Get the scheduler for known long-running or demanding tasks, such as
+ * codec, compression and crypto stages, so that they run in parallel
+ * with each other and do not hold up normal callbacks, which go through
+ * the EventThreads.  There is one worker per CPU.
+ */
+CallbackScheduler *
+EventSystem::worker(void)
+{
+	return (&workers_);
 }
 
 void
@@ -106,6 +250,8 @@ EventSystem::stop(void)
 	/*
 	 * Pass stop notification on to all threads.
 	 */
+	ScopedLock _(&threads_mtx_);
+	stop_ = true;
 	std::deque<Thread *>::const_iterator it;
 	for (it = threads_.begin(); it != threads_.end(); ++it) {
 		Thread *td = *it;
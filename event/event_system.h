@@ -27,6 +27,7 @@
 #define	EVENT_EVENT_SYSTEM_H
 
 #include <event/callback_thread.h>
+#include <event/callback_worker_pool.h>
 #include <event/destroy_thread.h>
 #include <event/event_poll.h>
 #include <event/timeout_thread.h>
@@ -37,19 +38,30 @@
  * towards something thread-oriented.
  */
 
+/*
+ * The most threads callbacks may be spread over; see scheduler(Lock *).
+ */
+#define	EVENT_SYSTEM_CALLBACK_THREAD_MAX	64
+
 enum EventInterest {
 	EventInterestStop
 };
 
 class EventSystem {
 	CallbackThread td_;
+	std::vector<CallbackThread *> callback_threads_;
+	bool started_;
 	EventPoll poll_;
+	std::vector<EventPoll *> reactor_polls_;
+	std::vector<unsigned> reactor_cpus_;
 	TimeoutThread timeout_;
 	DestroyThread destroy_;
+	Mutex threads_mtx_;
 	std::deque<Thread *> threads_;
+	bool stop_;
 	Mutex interest_queue_mtx_;
 	std::map<EventInterest, CallbackQueue *> interest_queue_;
-	std::vector<CallbackThread *> workers_;
+	CallbackWorkerPool workers_;
 private:
 	EventSystem(void);
 
@@ -63,10 +75,7 @@ public:
 		destroy_.destroy(lock, obj);
 	}
 
-	Action *poll(const EventPoll::Type& type, int fd, EventCallback *cb)
-	{
-		return (poll_.poll(type, fd, cb));
-	}
+	Action *poll(const EventPoll::Type&, int, EventCallback *);
 
 	Action *register_interest(const EventInterest&, SimpleCallback *);
 
@@ -77,7 +86,15 @@ public:
 
 	void thread_wait(Thread *td)
 	{
+		ScopedLock _(&threads_mtx_);
 		threads_.push_back(td);
+
+		/*
+		 * Callbacks may run, and finish, before every thread has
+		 * been started; pass on a stop that already happened.
+		 */
+		if (stop_)
+			td->stop();
 	}
 
 	CallbackScheduler *scheduler(void)
@@ -85,29 +102,76 @@ public:
 		return (&td_);
 	}
 
+	CallbackScheduler *scheduler(Lock *);
+
+	bool set_callback_threads(unsigned);
+
+	/*
+	 * Reactors pair an EventPoll with a callback thread, so that
+	 * everything to do with a connection can be kept on one of
+	 * them.  Reactor 0 is the EventThread, and also stands in for
+	 * any thread which is not part of a reactor.
+	 */
+	bool set_reactors(unsigned);
+
+	unsigned reactors(void) const
+	{
+		return (reactor_polls_.size() + 1);
+	}
+
+	unsigned reactor(void) const;
+	CallbackScheduler *reactor_scheduler(unsigned);
+
+	bool set_reactor_cpus(const Thread::CPUSet&);
+	int reactor_cpu(unsigned) const;
+
 	CallbackScheduler *worker(void);
 
 	void start(void)
 	{
+		std::vector<CallbackThread *>::const_iterator it;
+		std::vector<EventPoll *>::const_iterator pit;
+
+		started_ = true;
+
 		td_.start();
 		thread_wait(&td_);
 
+		for (it = callback_threads_.begin(); it != callback_threads_.end(); ++it) {
+			(*it)->start();
+			thread_wait(*it);
+		}
+
 		poll_.start();
 		thread_wait(&poll_);
 
+		for (pit = reactor_polls_.begin(); pit != reactor_polls_.end(); ++pit) {
+			(*pit)->start();
+			thread_wait(*pit);
+		}
+
 		timeout_.start();
 		thread_wait(&timeout_);
 
 		destroy_.start();
 		thread_wait(&destroy_);
+
+		workers_.start();
 	}
 
 	void join(void)
 	{
+		threads_mtx_.lock();
 		while (!threads_.empty()) {
-			threads_.front()->join();
+			Thread *td = threads_.front();
+			threads_mtx_.unlock();
+
+			td->join();
+
+			threads_mtx_.lock();
 			threads_.pop_front();
 		}
+		threads_mtx_.unlock();
 	}
 
 	void stop(void);
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <event/event_callback.h>
+#include <event/event_main.h>
+#include <event/event_system.h>
+#include <event/speed_test.h>
+
+static uint8_t zbuf[BUFFER_SEGMENT_SIZE * 8];
+
+/*
+ * Exercises the segment reference counts the way the codecs do: copy a
+ * multi-segment Buffer, skip into it, and release both copies.
+ */
+class BufferSegmentRefSpeed : SpeedTest {
+	Buffer source_;
+	uintmax_t refs_;
+public:
+	BufferSegmentRefSpeed(void)
+	: source_(zbuf, sizeof zbuf),
+	  refs_(0)
+	{
+		ScopedLock _(&mtx_);
+		perform();
+	}
+
+	~BufferSegmentRefSpeed()
+	{ }
+
+private:
+	void perform(void)
+	{
+		unsigned i;
+
+		for (i = 0; i < 1024; i++) {
+			Buffer tmp(source_);
+			tmp.skip(BUFFER_SEGMENT_SIZE);
+
+			Buffer tmp2;
+			tmp2.append(tmp);
+			refs_ += tmp.length() / BUFFER_SEGMENT_SIZE + tmp2.length() / BUFFER_SEGMENT_SIZE;
+		}
+
+		schedule();
+	}
+
+	void finish(void)
+	{
+		INFO("/example/buffer/segment/ref/speed1") << "Timer expired; " << refs_ << " segment references taken.";
+	}
+};
+
+int
+main(void)
+{
+	memset(zbuf, 0, sizeof zbuf);
+
+	BufferSegmentRefSpeed *cs = new BufferSegmentRefSpeed();
+
+	event_main();
+
+	delete cs;
+}
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+
+#include <common/thread/atomic.h>
+#include <common/thread/mutex.h>
+#include <common/thread/thread.h>
+
+#include <event/event_callback.h>
+#include <event/event_main.h>
+#include <event/event_system.h>
+#include <event/speed_test.h>
+
+/*
+ * Like callback-speed1, count how many times a callback can reschedule
+ * itself in a second, but do so with HOT_CALLBACKS other callbacks
+ * queued behind a single hot lock, which another thread holds for
+ * HOT_HOLD_US out of every HOT_HOLD_US + HOT_RELEASE_US.  While the
+ * hot lock is held, its callbacks should not slow down the others
+ * however many of them are waiting.
+ */
+#define	HOT_CALLBACKS		4096
+#define	HOT_HOLD_US		1000
+#define	HOT_RELEASE_US		1000
+
+static Mutex hot_mtx("HotLock");
+static Atomic<bool> hot_stopping;
+static uintmax_t hot_callback_count;
+
+class HotCallback {
+	SimpleCallback::Method<HotCallback> callback_complete_;
+	Action *callback_action_;
+public:
+	HotCallback(void)
+	: callback_complete_(NULL, &hot_mtx, this, &HotCallback::callback_complete),
+	  callback_action_(NULL)
+	{
+		ScopedLock _(&hot_mtx);
+		callback_action_ = callback_complete_.schedule();
+	}
+
+	~HotCallback()
+	{
+		ScopedLock _(&hot_mtx);
+		if (callback_action_ != NULL) {
+			callback_action_->cancel();
+			callback_action_ = NULL;
+		}
+	}
+
+private:
+	void callback_complete(void)
+	{
+		ASSERT_LOCK_OWNED("/example/callback/contention/speed1", &hot_mtx);
+		callback_action_->cancel();
+		callback_action_ = NULL;
+
+		hot_callback_count++;
+
+		if (!hot_stopping.load())
+			callback_action_ = callback_complete_.schedule();
+	}
+};
+
+class HotLockHolder : public Thread {
+public:
+	HotLockHolder(void)
+	: Thread("HotLockHolder")
+	{ }
+
+	~HotLockHolder()
+	{ }
+
+private:
+	void main(void)
+	{
+		while (!hot_stopping.load()) {
+			hot_mtx.lock();
+			usleep(HOT_HOLD_US);
+			hot_mtx.unlock();
+			usleep(HOT_RELEASE_US);
+		}
+	}
+
+public:
+	void stop(void)
+	{
+		hot_stopping.store(true);
+	}
+};
+
+class CallbackContentionSpeed : SpeedTest {
+	uintmax_t callback_count_;
+public:
+	CallbackContentionSpeed(void)
+	: callback_count_(0)
+	{
+		ScopedLock _(&mtx_);
+		perform();
+	}
+
+	~CallbackContentionSpeed()
+	{ }
+
+private:
+	void perform(void)
+	{
+		callback_count_++;
+
+		schedule();
+	}
+
+	void finish(void)
+	{
+		hot_stopping.store(true);
+
+		ScopedLock _(&hot_mtx);
+		INFO("/example/callback/contention/speed1") << "Timer expired; " << callback_count_ << " callbacks, " << hot_callback_count << " on the hot lock.";
+	}
+};
+
+int
+main(void)
+{
+	HotCallback *hot[HOT_CALLBACKS];
+	unsigned i;
+
+	for (i = 0; i < HOT_CALLBACKS; i++)
+		hot[i] = new HotCallback();
+
+	HotLockHolder holder;
+	holder.start();
+
+	CallbackContentionSpeed *cs = new CallbackContentionSpeed();
+
+	event_main();
+
+	holder.stop();
+	holder.join();
+
+	delete cs;
+
+	for (i = 0; i < HOT_CALLBACKS; i++)
+		delete hot[i];
+}
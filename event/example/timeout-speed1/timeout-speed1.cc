@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2009-2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+
+#include <common/thread/mutex.h>
+#include <common/time/time.h>
+
+#include <event/event_callback.h>
+#include <event/event_main.h>
+#include <event/event_system.h>
+
+/*
+ * Arm TIMEOUT_COUNT concurrent timeouts spread over TIMEOUT_SPREAD_MS,
+ * cancel every other one, and wait for the rest to expire, reporting
+ * the cost of arming and cancelling and how late the timeouts fire.
+ * The first TIMEOUT_DELAY_MS leave time for arming to finish.
+ */
+#define	TIMEOUT_COUNT		100000
+#define	TIMEOUT_DELAY_MS	500
+#define	TIMEOUT_SPREAD_MS	1000
+
+static uintmax_t
+usec(const NanoTime& nt)
+{
+	return (nt.seconds_ * 1000000 + nt.nanoseconds_ / 1000);
+}
+
+class TimeoutSpeed;
+
+class Timeout {
+	TimeoutSpeed *speed_;
+	SimpleCallback::Method<Timeout> expire_;
+	uintmax_t deadline_;
+public:
+	Action *action_;
+
+	Timeout(TimeoutSpeed *, Mutex *);
+
+	~Timeout()
+	{
+		ASSERT_NULL("/example/timeout/speed1", action_);
+	}
+
+	void arm(unsigned ms)
+	{
+		deadline_ = usec(NanoTime::current_time()) + ms * 1000;
+		action_ = EventSystem::instance()->timeout(ms, &expire_);
+	}
+
+private:
+	void expire(void);
+};
+
+class TimeoutSpeed {
+	Mutex mtx_;
+	Timeout *timeouts_[TIMEOUT_COUNT];
+	unsigned expected_;
+	unsigned expired_;
+	uintmax_t late_total_;
+	uintmax_t late_max_;
+public:
+	TimeoutSpeed(void)
+	: mtx_("TimeoutSpeed"),
+	  timeouts_(),
+	  expected_(0),
+	  expired_(0),
+	  late_total_(0),
+	  late_max_(0)
+	{
+		ScopedLock _(&mtx_);
+		unsigned i;
+
+		for (i = 0; i < TIMEOUT_COUNT; i++)
+			timeouts_[i] = new Timeout(this, &mtx_);
+
+		uintmax_t start = usec(NanoTime::current_time());
+		for (i = 0; i < TIMEOUT_COUNT; i++)
+			timeouts_[i]->arm(TIMEOUT_DELAY_MS + random() % TIMEOUT_SPREAD_MS);
+		report("Armed", TIMEOUT_COUNT, start);
+
+		start = usec(NanoTime::current_time());
+		for (i = 0; i < TIMEOUT_COUNT; i += 2) {
+			timeouts_[i]->action_->cancel();
+			timeouts_[i]->action_ = NULL;
+		}
+		report("Cancelled", TIMEOUT_COUNT / 2, start);
+
+		expected_ = TIMEOUT_COUNT / 2;
+	}
+
+	~TimeoutSpeed()
+	{
+		unsigned i;
+
+		for (i = 0; i < TIMEOUT_COUNT; i++)
+			delete timeouts_[i];
+	}
+
+	void expired(uintmax_t deadline)
+	{
+		ASSERT_LOCK_OWNED("/example/timeout/speed1", &mtx_);
+
+		uintmax_t now = usec(NanoTime::current_time());
+		if (now < deadline)
+			HALT("/example/timeout/speed1") << "Timeout expired early by " << deadline - now << "us.";
+		late_total_ += now - deadline;
+		if (now - deadline > late_max_)
+			late_max_ = now - deadline;
+
+		if (++expired_ != expected_)
+			return;
+
+		INFO("/example/timeout/speed1") << expired_ << " timeouts expired; mean lateness " << late_total_ / expired_ << "us, max " << late_max_ << "us.";
+
+		EventSystem::instance()->stop();
+	}
+
+private:
+	void report(const std::string& what, unsigned count, uintmax_t start)
+	{
+		uintmax_t us = usec(NanoTime::current_time()) - start;
+		INFO("/example/timeout/speed1") << what << " " << count << " timeouts in " << us << "us.";
+	}
+};
+
+Timeout::Timeout(TimeoutSpeed *speed, Mutex *mtx)
+: speed_(speed),
+  expire_(NULL, mtx, this, &Timeout::expire),
+  deadline_(0),
+  action_(NULL)
+{ }
+
+void
+Timeout::expire(void)
+{
+	action_->cancel();
+	action_ = NULL;
+
+	speed_->expired(deadline_);
+}
+
+int
+main(void)
+{
+	TimeoutSpeed *ts = new TimeoutSpeed();
+
+	event_main();
+
+	delete ts;
+}
@@ -34,15 +34,19 @@
 
 class TimeoutTest {
 	Mutex mtx_;
+	SimpleCallback::Method<TimeoutTest> timer1_;
+	SimpleCallback::Method<TimeoutTest> timer2_;
 	Action *action_;
 public:
 	TimeoutTest(void)
 	: mtx_("TimeoutTest"),
+	  timer1_(NULL, &mtx_, this, &TimeoutTest::timer1),
+	  timer2_(NULL, &mtx_, this, &TimeoutTest::timer2),
 	  action_(NULL)
 	{
 		ScopedLock _(&mtx_);
 		INFO("/example/timeout/test1") << "Arming timer 1.";
-		action_ = EventSystem::instance()->timeout(TIMER1_MS, callback(&mtx_, this, &TimeoutTest::timer1));
+		action_ = EventSystem::instance()->timeout(TIMER1_MS, &timer1_);
 	}
 
 	~TimeoutTest()
@@ -59,7 +63,7 @@ private:
 
 		INFO("/example/timeout/test1") << "Timer 1 expired, arming timer 2.";
 
-		action_ = EventSystem::instance()->timeout(TIMER2_MS, callback(&mtx_, this, &TimeoutTest::timer2));
+		action_ = EventSystem::instance()->timeout(TIMER2_MS, &timer2_);
 	}
 
 	void timer2(void)
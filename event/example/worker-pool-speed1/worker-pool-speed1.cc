@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include <common/thread/mutex.h>
+#include <common/time/time.h>
+
+#include <event/event_callback.h>
+#include <event/event_main.h>
+#include <event/event_system.h>
+
+/*
+ * Schedule JOB_COUNT compression jobs of JOB_SMALL bytes, with every
+ * JOB_LARGE_EVERY'th job JOB_LARGE bytes instead, and report how long
+ * they take and how long the small jobs wait behind the large ones.
+ * By default the jobs run on EventSystem::worker(); given "thread"
+ * they all run on the EventThread, for comparison.
+ */
+#define	JOB_COUNT		2048
+#define	JOB_SMALL		2048
+#define	JOB_LARGE		(1024 * 1024)
+#define	JOB_LARGE_EVERY		64
+
+static uintmax_t
+usec(const NanoTime& nt)
+{
+	return (nt.seconds_ * 1000000 + nt.nanoseconds_ / 1000);
+}
+
+static uint8_t job_data[JOB_LARGE];
+
+class WorkerPoolSpeed;
+
+class Job {
+	WorkerPoolSpeed *speed_;
+	Mutex mtx_;
+	size_t length_;
+	SimpleCallback::Method<Job> run_;
+	Action *action_;
+	uintmax_t scheduled_;
+public:
+	Job(WorkerPoolSpeed *speed, CallbackScheduler *scheduler, size_t length)
+	: speed_(speed),
+	  mtx_("Job"),
+	  length_(length),
+	  run_(scheduler, &mtx_, this, &Job::run),
+	  action_(NULL),
+	  scheduled_(0)
+	{ }
+
+	~Job()
+	{
+		ASSERT_NULL("/example/worker/pool/speed1", action_);
+	}
+
+	void schedule(void)
+	{
+		ScopedLock _(&mtx_);
+		scheduled_ = usec(NanoTime::current_time());
+		action_ = run_.schedule();
+	}
+
+private:
+	void run(void);
+};
+
+class WorkerPoolSpeed {
+	Mutex mtx_;
+	Job *jobs_[JOB_COUNT];
+	unsigned done_;
+	uintmax_t start_;
+	uintmax_t small_wait_total_;
+	uintmax_t small_wait_max_;
+public:
+	WorkerPoolSpeed(CallbackScheduler *scheduler)
+	: mtx_("WorkerPoolSpeed"),
+	  jobs_(),
+	  done_(0),
+	  start_(0),
+	  small_wait_total_(0),
+	  small_wait_max_(0)
+	{
+		unsigned i;
+
+		for (i = 0; i < JOB_COUNT; i++) {
+			size_t length = (i % JOB_LARGE_EVERY) == 0 ? JOB_LARGE : JOB_SMALL;
+			jobs_[i] = new Job(this, scheduler, length);
+		}
+
+		start_ = usec(NanoTime::current_time());
+		for (i = 0; i < JOB_COUNT; i++)
+			jobs_[i]->schedule();
+	}
+
+	~WorkerPoolSpeed()
+	{
+		unsigned i;
+
+		for (i = 0; i < JOB_COUNT; i++)
+			delete jobs_[i];
+	}
+
+	void finished(size_t length, uintmax_t wait)
+	{
+		ScopedLock _(&mtx_);
+
+		if (length == JOB_SMALL) {
+			small_wait_total_ += wait;
+			if (wait > small_wait_max_)
+				small_wait_max_ = wait;
+		}
+
+		if (++done_ != JOB_COUNT)
+			return;
+
+		uintmax_t us = usec(NanoTime::current_time()) - start_;
+		unsigned small = JOB_COUNT - JOB_COUNT / JOB_LARGE_EVERY;
+		INFO("/example/worker/pool/speed1") << JOB_COUNT << " jobs in " << us << "us; small jobs waited " << small_wait_total_ / small << "us on average, " << small_wait_max_ << "us at most.";
+
+		EventSystem::instance()->stop();
+	}
+};
+
+void
+Job::run(void)
+{
+	uint8_t out[JOB_LARGE + JOB_LARGE / 1000 + 64];
+	uLongf outlen = sizeof out;
+
+	action_->cancel();
+	action_ = NULL;
+
+	uintmax_t wait = usec(NanoTime::current_time()) - scheduled_;
+
+	if (compress2(out, &outlen, job_data, length_, Z_DEFAULT_COMPRESSION) != Z_OK)
+		HALT("/example/worker/pool/speed1") << "Compression failed.";
+
+	speed_->finished(length_, wait);
+}
+
+int
+main(int argc, char *argv[])
+{
+	CallbackScheduler *scheduler;
+	unsigned i;
+
+	for (i = 0; i < sizeof job_data; i++)
+		job_data[i] = "abcdefghijklmnop"[random() % 16];
+
+	if (argc > 1 && strcmp(argv[1], "thread") == 0)
+		scheduler = EventSystem::instance()->scheduler();
+	else
+		scheduler = EventSystem::instance()->worker();
+
+	WorkerPoolSpeed *wps = new WorkerPoolSpeed(scheduler);
+
+	event_main();
+
+	delete wps;
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	EVENT_FD_TABLE_H
+#define	EVENT_FD_TABLE_H
+
+#include <common/thread/atomic.h>
+
+/*
+ * A table of per-descriptor state, indexed directly by file descriptor,
+ * for the places which would otherwise look descriptors up in a map on
+ * every event.  Descriptors are small, dense integers, so the table is
+ * an array of chunks of FD_TABLE_CHUNK entries, each allocated the first
+ * time a descriptor in its range is used and kept until the table is
+ * destroyed.  Entries therefore never move, and lookups need no lock:
+ * a chunk is published with a single compare-and-set, and once there it
+ * stays.  Synchronizing access to the entries themselves is up to the
+ * user of the table.
+ */
+#define	FD_TABLE_CHUNK_BITS	(10)
+#define	FD_TABLE_CHUNK		(1 << FD_TABLE_CHUNK_BITS)
+#define	FD_TABLE_CHUNK_MASK	(FD_TABLE_CHUNK - 1)
+#define	FD_TABLE_CHUNKS		(1024)
+#define	FD_TABLE_MAX		(FD_TABLE_CHUNKS * FD_TABLE_CHUNK)
+
+template<typename T>
+class FDTable {
+	LogHandle log_;
+	Atomic<T *> chunks_[FD_TABLE_CHUNKS];
+public:
+	FDTable(const LogHandle& log)
+	: log_(log),
+	  chunks_()
+	{ }
+
+	~FDTable()
+	{
+		unsigned i;
+
+		for (i = 0; i < FD_TABLE_CHUNKS; i++) {
+			T *chunk = chunks_[i].load();
+			if (chunk == NULL)
+				continue;
+			delete[] chunk;
+		}
+	}
+
+	/*
+	 * Get the entry for a descriptor, creating it if need be.
+	 */
+	T *get(int fd)
+	{
+		ASSERT(log_, fd >= 0);
+		if (fd >= FD_TABLE_MAX)
+			HALT(log_) << "File descriptor " << fd << " is beyond the end of the table.";
+
+		Atomic<T *> *chunkp = &chunks_[fd >> FD_TABLE_CHUNK_BITS];
+		T *chunk = chunkp->load_acquire();
+		if (chunk == NULL) {
+			chunk = new T[FD_TABLE_CHUNK];
+			if (!chunkp->cmpset((T *)NULL, chunk)) {
+				delete[] chunk;
+				chunk = chunkp->load_acquire();
+			}
+		}
+		return (&chunk[fd & FD_TABLE_CHUNK_MASK]);
+	}
+
+	/*
+	 * Get the entry for a descriptor if there is one, without creating it.
+	 */
+	T *lookup(int fd) const
+	{
+		if (fd < 0 || fd >= FD_TABLE_MAX)
+			return (NULL);
+
+		T *chunk = chunks_[fd >> FD_TABLE_CHUNK_BITS].load_acquire();
+		if (chunk == NULL)
+			return (NULL);
+		return (&chunk[fd & FD_TABLE_CHUNK_MASK]);
+	}
+
+	/*
+	 * One more than the highest descriptor which may have an entry, for
+	 * walking the table.
+	 */
+	int limit(void) const
+	{
+		unsigned i;
+
+		for (i = FD_TABLE_CHUNKS; i > 0; i--)
+			if (chunks_[i - 1].load_acquire() != NULL)
+				return (i * FD_TABLE_CHUNK);
+		return (0);
+	}
+
+private:
+	FDTable(const FDTable&); /* XXX Disable copy.  */
+};
+
+#endif /* !EVENT_FD_TABLE_H */
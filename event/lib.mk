@@ -2,6 +2,7 @@ VPATH+=	${TOPDIR}/event
 
 SRCS+=	callback.cc
 SRCS+=	callback_thread.cc
+SRCS+=	callback_worker_pool.cc
 SRCS+=	destroy_thread.cc
 SRCS+=	event_main.cc
 SRCS+=	event_poll.cc
@@ -22,6 +23,7 @@ ifeq "${OSNAME}" "OpenBSD"
 USE_POLL=	kqueue
 endif
 
+# Set USE_POLL=io_uring to use io_uring(7) instead of epoll.
 ifeq "${OSNAME}" "Linux"
 USE_POLL=	epoll
 endif
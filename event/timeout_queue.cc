@@ -27,53 +27,238 @@
 
 #include <event/action.h>
 #include <event/callback.h>
-#include <event/callback_queue.h>
 #include <event/timeout_queue.h>
 
+TimeoutQueue::TimeoutQueue(void)
+: log_("/event/timeout/queue"),
+  mtx_("TimeoutQueue"),
+  now_(tick(NanoTime::current_time())),
+  count_(),
+  wheel_(),
+  free_(NULL)
+{ }
+
+TimeoutQueue::~TimeoutQueue()
+{
+	ScopedLock _(&mtx_);
+	unsigned l, i;
+
+	for (l = 0; l < TIMEOUT_WHEEL_LEVELS; l++) {
+		for (i = 0; i < TIMEOUT_WHEEL_SLOTS; i++) {
+			while (wheel_[l][i] != NULL) {
+				TimeoutAction *a = wheel_[l][i];
+				remove(a);
+				a->callback_ = NULL;
+				delete a;
+			}
+		}
+	}
+
+	while (free_ != NULL) {
+		TimeoutAction *a = free_;
+		free_ = a->next_;
+		a->next_ = NULL;
+		delete a;
+	}
+}
+
 Action *
 TimeoutQueue::append(uintmax_t ms, SimpleCallback *cb)
 {
 	ScopedLock _(&mtx_);
-	NanoTime deadline;
-	deadline.seconds_ = ms / 1000;
-	deadline.nanoseconds_ = (ms % 1000) * 1000000;
-	deadline += NanoTime::current_time();
-
-	CallbackQueue *queue = timeout_queue_[deadline];
-	if (queue == NULL) {
-		queue = new CallbackQueue();
-		timeout_queue_[deadline] = queue;
+	uint64_t now = tick(NanoTime::current_time());
+
+	/*
+	 * If nothing is pending, nothing has kept the wheel turning, so
+	 * catch up without visiting every slot along the way.
+	 */
+	if (pending() == 0 && now > now_)
+		now_ = now;
+
+	/*
+	 * Round up to the next tick so that we never fire early.
+	 */
+	uint64_t expiry = now + 1 + ms;
+
+	/*
+	 * Cancelled timeouts are kept on a free list, since the common case
+	 * is for a timeout to be cancelled and another appended in its place
+	 * over and over, as with idle timers.
+	 */
+	TimeoutAction *a = free_;
+	if (a != NULL) {
+		free_ = a->next_;
+		a->next_ = NULL;
+		a->callback_ = cb;
+		a->expiry_ = expiry;
+	} else {
+		a = new TimeoutAction(this, cb, expiry);
 	}
-	Action *a = queue->append(cb);
+	insert(a);
 	return (a);
 }
 
+/*
+ * Turn the wheel up to the current time, scheduling any callbacks whose
+ * timeouts have expired.  This is the only place the clock is read
+ * other than when adding a timeout; the wheel keeps the time it was
+ * last turned to in now_.
+ */
 void
 TimeoutQueue::perform(void)
 {
-	mtx_.lock();
-	timeout_map_t::iterator it = timeout_queue_.begin();
-	if (it == timeout_queue_.end())
-		return;
-	NanoTime now = NanoTime::current_time();
-	if (it->first > now)
-		return;
-	CallbackQueue *queue = it->second;
-	timeout_queue_.erase(it);
-	mtx_.unlock();
-
-	queue->drain();
+	ScopedLock _(&mtx_);
+	uint64_t now = tick(NanoTime::current_time());
+
+	while (now_ < now) {
+		if (pending() == 0) {
+			now_ = now;
+			break;
+		}
+
+		now_++;
+
+		unsigned i = now_ & TIMEOUT_WHEEL_MASK;
+		if (i == 0) {
+			unsigned l;
+
+			for (l = 1; l < TIMEOUT_WHEEL_LEVELS; l++) {
+				unsigned j = (now_ >> (l * TIMEOUT_WHEEL_BITS)) & TIMEOUT_WHEEL_MASK;
+				cascade(l, j);
+				if (j != 0)
+					break;
+			}
+		}
+		expire(i);
+	}
 }
 
-bool
-TimeoutQueue::ready(void)
+void
+TimeoutQueue::cancel(TimeoutAction *a)
 {
 	ScopedLock _(&mtx_);
-	timeout_map_t::const_iterator it = timeout_queue_.begin();
-	if (it == timeout_queue_.end())
-		return (false);
-	NanoTime now = NanoTime::current_time();
-	if (it->first <= now)
-		return (true);
-	return (false);
+	if (a->action_ != NULL) {
+		a->action_->cancel();
+		a->action_ = NULL;
+		ASSERT_NULL(log_, a->callback_);
+	} else {
+		ASSERT_NON_NULL(log_, a->callback_);
+		remove(a);
+		a->callback_ = NULL;
+	}
+
+	a->next_ = free_;
+	free_ = a;
+}
+
+/*
+ * Put a timeout in the slot at the lowest level which can hold it.
+ * Timeouts too far away for even the highest level are parked in its
+ * furthest slot and placed again when that slot is cascaded.
+ */
+void
+TimeoutQueue::insert(TimeoutAction *a)
+{
+	ASSERT(log_, a->expiry_ >= now_);
+
+	uint64_t expiry = a->expiry_;
+	if (expiry - now_ >= TIMEOUT_WHEEL_RANGE)
+		expiry = now_ + TIMEOUT_WHEEL_RANGE - 1;
+
+	uint64_t delta = expiry - now_;
+	unsigned l = 0;
+	while (l + 1 < TIMEOUT_WHEEL_LEVELS &&
+	       delta >= ((uint64_t)1 << ((l + 1) * TIMEOUT_WHEEL_BITS)))
+		l++;
+
+	TimeoutAction **slot = &wheel_[l][(expiry >> (l * TIMEOUT_WHEEL_BITS)) & TIMEOUT_WHEEL_MASK];
+	a->level_ = l;
+	a->slot_ = slot;
+	a->prev_ = NULL;
+	a->next_ = *slot;
+	if (*slot != NULL)
+		(*slot)->prev_ = a;
+	*slot = a;
+	count_[l]++;
+}
+
+void
+TimeoutQueue::remove(TimeoutAction *a)
+{
+	ASSERT_NON_NULL(log_, a->slot_);
+
+	if (a->prev_ != NULL)
+		a->prev_->next_ = a->next_;
+	else
+		*a->slot_ = a->next_;
+	if (a->next_ != NULL)
+		a->next_->prev_ = a->prev_;
+
+	count_[a->level_]--;
+	a->slot_ = NULL;
+	a->prev_ = NULL;
+	a->next_ = NULL;
+}
+
+void
+TimeoutQueue::cascade(unsigned l, unsigned i)
+{
+	TimeoutAction *a = wheel_[l][i];
+
+	while (a != NULL) {
+		TimeoutAction *next = a->next_;
+		remove(a);
+		insert(a);
+		a = next;
+	}
+}
+
+void
+TimeoutQueue::expire(unsigned i)
+{
+	TimeoutAction *a;
+
+	while ((a = wheel_[0][i]) != NULL) {
+		ASSERT(log_, a->expiry_ == now_);
+		remove(a);
+		a->action_ = a->callback_->schedule();
+		a->callback_ = NULL;
+	}
+}
+
+/*
+ * The earliest tick at which the wheel may have work to do: either the
+ * first occupied slot in the lowest level or, if anything is waiting in
+ * a higher level, the next time the lowest level wraps and a cascade
+ * happens.
+ */
+uint64_t
+TimeoutQueue::next_tick(void) const
+{
+	uint64_t next = now_ + TIMEOUT_WHEEL_SLOTS;
+	unsigned l;
+
+	ASSERT(log_, pending() != 0);
+
+	if (count_[0] != 0) {
+		uint64_t t;
+
+		for (t = now_ + 1; t < now_ + TIMEOUT_WHEEL_SLOTS; t++) {
+			if (wheel_[0][t & TIMEOUT_WHEEL_MASK] == NULL)
+				continue;
+			next = t;
+			break;
+		}
+	}
+
+	for (l = 1; l < TIMEOUT_WHEEL_LEVELS; l++) {
+		if (count_[l] == 0)
+			continue;
+		uint64_t wrap = (now_ | TIMEOUT_WHEEL_MASK) + 1;
+		if (wrap < next)
+			next = wrap;
+		break;
+	}
+
+	return (next);
 }
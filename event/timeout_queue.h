@@ -26,80 +26,120 @@
 #ifndef	EVENT_TIMEOUT_QUEUE_H
 #define	EVENT_TIMEOUT_QUEUE_H
 
-#include <map>
-
 #include <common/thread/mutex.h>
 #include <common/time/time.h>
 
+#include <event/action.h>
+
+/*
+ * Timeouts are kept in a hierarchical timing wheel with a resolution of
+ * one millisecond.  Each level has TIMEOUT_WHEEL_SLOTS slots, each slot
+ * covering TIMEOUT_WHEEL_SLOTS times as many ticks as a slot in the
+ * level below it; as time passes, the slots of the higher levels are
+ * cascaded down until the timeouts in them reach the lowest level and
+ * expire.  Adding and cancelling a timeout are constant-time.
+ */
+#define	TIMEOUT_WHEEL_BITS	8
+#define	TIMEOUT_WHEEL_SLOTS	(1 << TIMEOUT_WHEEL_BITS)
+#define	TIMEOUT_WHEEL_MASK	(TIMEOUT_WHEEL_SLOTS - 1)
+#define	TIMEOUT_WHEEL_LEVELS	4
+#define	TIMEOUT_WHEEL_RANGE	((uint64_t)1 << (TIMEOUT_WHEEL_BITS * TIMEOUT_WHEEL_LEVELS))
+
+class SimpleCallback;
+
 class TimeoutQueue {
-	typedef std::map<NanoTime, CallbackQueue *> timeout_map_t;
+	class TimeoutAction : public Action {
+	public:
+		TimeoutQueue *const queue_;
+		SimpleCallback *callback_;
+		Action *action_;
+		uint64_t expiry_;
+		unsigned level_;
+		TimeoutAction **slot_;
+		TimeoutAction *prev_;
+		TimeoutAction *next_;
+
+		TimeoutAction(TimeoutQueue *queue, SimpleCallback *callback, uint64_t expiry)
+		: queue_(queue),
+		  callback_(callback),
+		  action_(NULL),
+		  expiry_(expiry),
+		  level_(0),
+		  slot_(NULL),
+		  prev_(NULL),
+		  next_(NULL)
+		{ }
+
+		~TimeoutAction()
+		{
+			ASSERT_NULL("/timeout/queue/action", callback_);
+			ASSERT_NULL("/timeout/queue/action", action_);
+			ASSERT_NULL("/timeout/queue/action", slot_);
+		}
+
+		void cancel(void)
+		{
+			queue_->cancel(this);
+		}
+	};
+
+	friend class TimeoutAction;
 
 	LogHandle log_;
 	Mutex mtx_;
-	timeout_map_t timeout_queue_;
+	uint64_t now_;
+	size_t count_[TIMEOUT_WHEEL_LEVELS];
+	TimeoutAction *wheel_[TIMEOUT_WHEEL_LEVELS][TIMEOUT_WHEEL_SLOTS];
+	TimeoutAction *free_;
 public:
-	TimeoutQueue(void)
-	: log_("/event/timeout/queue"),
-	  mtx_("TimeoutQueue"),
-	  timeout_queue_()
-	{ }
-
-	~TimeoutQueue()
-	{
-		ScopedLock _(&mtx_);
-		timeout_map_t::iterator it;
+	TimeoutQueue(void);
+	~TimeoutQueue();
 
-		for (it = timeout_queue_.begin(); it != timeout_queue_.end(); ++it)
-			delete it->second;
-		timeout_queue_.clear();
-	}
-
-	/* XXX Can't be const because CallbackQueue::empty can't be due to locking.  */
 	bool empty(void)
 	{
 		ScopedLock _(&mtx_);
-		timeout_map_t::iterator it;
-
-		/*
-		 * Since we allow elements within each CallbackQueue to be
-		 * cancelled, we must scan them.
-		 *
-		 * XXX
-		 * We really shouldn't allow this, even if it means we have
-		 * to specialize CallbackQueue for this purpose or add
-		 * virtual methods to it.  As it is, we can return true
-		 * for empty and for ready at the same time.  And in those
-		 * cases we have to call perform to garbage collect the
-		 * unused CallbackQueues.  We'll, quite conveniently,
-		 * never make that call.  Yikes.
-		 */
-		for (it = timeout_queue_.begin(); it != timeout_queue_.end(); ++it) {
-			if (it->second->empty())
-				continue;
-			return (false);
-		}
-		return (true);
+		return (pending() == 0);
 	}
 
-	/* Like ::empty() and ::ready(), has to possibly ignore empty queues.  */
 	NanoTime next_deadline(void)
 	{
 		ScopedLock _(&mtx_);
-		timeout_map_t::iterator it;
+		uint64_t tick = next_tick();
+		NanoTime deadline;
 
-		ASSERT(log_, !timeout_queue_.empty());
-		for (it = timeout_queue_.begin(); it != timeout_queue_.end(); ++it) {
-			if (it->second->empty())
-				continue;
-			return (it->first);
-		}
-		/* XXX Almost NOTREACHED */
-		return (NanoTime());
+		deadline.seconds_ = tick / 1000;
+		deadline.nanoseconds_ = (tick % 1000) * 1000000;
+		return (deadline);
 	}
 
 	Action *append(uintmax_t, SimpleCallback *);
 	void perform(void);
-	bool ready(void);
+
+private:
+	void cancel(TimeoutAction *);
+
+	void insert(TimeoutAction *);
+	void remove(TimeoutAction *);
+	void cascade(unsigned, unsigned);
+	void expire(unsigned);
+
+	uint64_t next_tick(void) const;
+
+	size_t pending(void) const
+	{
+		size_t count;
+		unsigned l;
+
+		count = 0;
+		for (l = 0; l < TIMEOUT_WHEEL_LEVELS; l++)
+			count += count_[l];
+		return (count);
+	}
+
+	static uint64_t tick(const NanoTime& nt)
+	{
+		return ((uint64_t)nt.seconds_ * 1000 + nt.nanoseconds_ / 1000000);
+	}
 };
 
 #endif /* !EVENT_TIMEOUT_QUEUE_H */
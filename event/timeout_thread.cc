@@ -45,23 +45,10 @@ TimeoutThread::TimeoutThread(void)
   timeout_queue_()
 { }
 
-/*
- * XXX
- * Locking?
- */
 void
 TimeoutThread::work(void)
 {
-	if (!timeout_queue_.empty()) {
-		/*
-		 * XXX
-		 * We need to manage the queue here and schedule the
-		 * callbacks in the main EventThread, not just
-		 * execute them in this thread directly.
-		 */
-		while (timeout_queue_.ready())
-			timeout_queue_.perform();
-	}
+	timeout_queue_.perform();
 }
 
 void
@@ -74,6 +61,10 @@ TimeoutThread::wait(void)
 	NanoTime deadline = timeout_queue_.next_deadline();
 	sleepq_.wait(&deadline);
 
-	if (!pending_ && !timeout_queue_.empty() && timeout_queue_.ready())
-		pending_ = true;
+	/*
+	 * Whether we reached the deadline or were woken early, turning
+	 * the wheel is cheap, so always do it rather than checking the
+	 * clock twice.
+	 */
+	pending_ = true;
 }
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	IO_COROUTINE_COROUTINE_H
+#define	IO_COROUTINE_COROUTINE_H
+
+#include <coroutine>
+
+/*
+ * A Coroutine is the return type of a function written as a sequence of
+ * co_await expressions on a CoroutineChannel or CoroutinePipe rather than
+ * as a chain of callbacks and Actions.  It runs as soon as it is called,
+ * up to the first operation which cannot be satisfied immediately, and
+ * is resumed inline by the callback which completes that operation, with
+ * the owner's lock held.  Its frame is freed when it returns.
+ *
+ * There is no way to cancel a suspended Coroutine; the object which owns
+ * the channels it awaits must not be destroyed until it has returned.
+ * The usual way to arrange that is for the Coroutine itself to end by
+ * calling EventSystem::destroy on its owner.
+ */
+class Coroutine {
+public:
+	struct promise_type {
+		Coroutine get_return_object(void)
+		{
+			return (Coroutine());
+		}
+
+		std::suspend_never initial_suspend(void)
+		{
+			return (std::suspend_never());
+		}
+
+		std::suspend_never final_suspend(void) noexcept
+		{
+			return (std::suspend_never());
+		}
+
+		void return_void(void)
+		{ }
+
+		void unhandled_exception(void)
+		{
+			HALT("/coroutine") << "Unhandled exception in coroutine.";
+		}
+	};
+};
+
+#endif /* !IO_COROUTINE_COROUTINE_H */
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <event/action.h>
+#include <event/event_callback.h>
+
+#include <io/coroutine/coroutine_channel.h>
+
+CoroutineChannel::CoroutineChannel(const LogHandle& log, Lock *lock, StreamChannel *channel)
+: log_(log + "/coroutine"),
+  channel_(channel),
+  buffer_(),
+  read_event_(Event::Done),
+  read_amount_(0),
+  event_(),
+  action_(NULL),
+  waiter_(),
+  read_complete_(NULL, lock, this, &CoroutineChannel::read_complete),
+  write_complete_(NULL, lock, this, &CoroutineChannel::write_complete),
+  close_complete_(NULL, lock, this, &CoroutineChannel::close_complete)
+{ }
+
+CoroutineChannel::~CoroutineChannel()
+{
+	ASSERT_NULL(log_, action_);
+	ASSERT(log_, !waiter_);
+}
+
+bool
+CoroutineChannel::read_ready(size_t amount) const
+{
+	if (read_event_.type_ != Event::Done)
+		return (true);
+	if (amount == 0)
+		return (!buffer_.empty());
+	return (buffer_.length() >= amount);
+}
+
+void
+CoroutineChannel::read_suspend(std::coroutine_handle<> waiter, size_t amount)
+{
+	ASSERT_NULL(log_, action_);
+	ASSERT(log_, !waiter_);
+
+	waiter_ = waiter;
+	read_amount_ = amount;
+	action_ = channel_->read(0, &read_complete_);
+}
+
+Event
+CoroutineChannel::read_resume(size_t amount, Buffer *buf)
+{
+	if (amount == 0 && !buffer_.empty()) {
+		buffer_.moveout(buf);
+		return (Event::Done);
+	}
+	if (amount != 0 && buffer_.length() >= amount) {
+		buffer_.moveout(buf, amount);
+		return (Event::Done);
+	}
+
+	ASSERT(log_, read_event_.type_ != Event::Done);
+	if (!buffer_.empty())
+		buffer_.moveout(buf);
+	return (read_event_);
+}
+
+void
+CoroutineChannel::read_complete(Event e, Buffer buf)
+{
+	action_->cancel();
+	action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		buffer_.append(buf);
+		if (!read_ready(read_amount_)) {
+			action_ = channel_->read(0, &read_complete_);
+			return;
+		}
+		break;
+	case Event::EOS:
+		buffer_.append(buf);
+		read_event_ = e;
+		break;
+	default:
+		read_event_ = e;
+		break;
+	}
+
+	resume();
+}
+
+void
+CoroutineChannel::write_suspend(std::coroutine_handle<> waiter, Buffer *buf)
+{
+	ASSERT_NULL(log_, action_);
+	ASSERT(log_, !waiter_);
+
+	waiter_ = waiter;
+	action_ = channel_->write(buf, &write_complete_);
+}
+
+void
+CoroutineChannel::write_complete(Event e)
+{
+	action_->cancel();
+	action_ = NULL;
+
+	event_ = e;
+	resume();
+}
+
+void
+CoroutineChannel::close_suspend(std::coroutine_handle<> waiter)
+{
+	ASSERT_NULL(log_, action_);
+	ASSERT(log_, !waiter_);
+
+	waiter_ = waiter;
+	action_ = channel_->close(&close_complete_);
+}
+
+void
+CoroutineChannel::close_complete(void)
+{
+	action_->cancel();
+	action_ = NULL;
+
+	resume();
+}
+
+/*
+ * Hand control back to the suspended Coroutine.  It may run to
+ * completion and arrange for our owner to be destroyed, so nothing
+ * here may be touched once it has been resumed.
+ */
+void
+CoroutineChannel::resume(void)
+{
+	std::coroutine_handle<> waiter = waiter_;
+	waiter_ = nullptr;
+	waiter.resume();
+}
@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	IO_COROUTINE_COROUTINE_CHANNEL_H
+#define	IO_COROUTINE_COROUTINE_CHANNEL_H
+
+#include <io/channel.h>
+
+#include <io/coroutine/coroutine.h>
+
+/*
+ * Sequential access to a StreamChannel from a Coroutine:
+ *
+ *	Buffer buf;
+ *	Event e = co_await channel_.read(2, &buf);
+ *
+ * Reads ask the underlying channel for whatever it has available and
+ * keep any excess, so that a protocol parser asking for one field at a
+ * time only waits on the channel when it has run out of bytes; a read
+ * which can be satisfied from what is already buffered completes inline
+ * without scheduling anything.  The data returned by read is appended to
+ * the caller's Buffer.  Once the channel has reported EOS or an error,
+ * reads which cannot be satisfied return that event along with whatever
+ * bytes remain.
+ *
+ * Only one operation may be outstanding at a time, and the owner's lock
+ * must be held whenever an operation is started.
+ */
+class CoroutineChannel {
+	LogHandle log_;
+	StreamChannel *channel_;
+	Buffer buffer_;
+	Event read_event_;
+	size_t read_amount_;
+	Event event_;
+	Action *action_;
+	std::coroutine_handle<> waiter_;
+	BufferEventCallback::Method<CoroutineChannel> read_complete_;
+	EventCallback::Method<CoroutineChannel> write_complete_;
+	SimpleCallback::Method<CoroutineChannel> close_complete_;
+public:
+	class Read {
+		CoroutineChannel *channel_;
+		size_t amount_;
+		Buffer *buf_;
+	public:
+		Read(CoroutineChannel *channel, size_t amount, Buffer *buf)
+		: channel_(channel),
+		  amount_(amount),
+		  buf_(buf)
+		{ }
+
+		bool await_ready(void) const
+		{
+			return (channel_->read_ready(amount_));
+		}
+
+		void await_suspend(std::coroutine_handle<> waiter)
+		{
+			channel_->read_suspend(waiter, amount_);
+		}
+
+		Event await_resume(void)
+		{
+			return (channel_->read_resume(amount_, buf_));
+		}
+	};
+
+	class Write {
+		CoroutineChannel *channel_;
+		Buffer *buf_;
+	public:
+		Write(CoroutineChannel *channel, Buffer *buf)
+		: channel_(channel),
+		  buf_(buf)
+		{ }
+
+		bool await_ready(void) const
+		{
+			return (false);
+		}
+
+		void await_suspend(std::coroutine_handle<> waiter)
+		{
+			channel_->write_suspend(waiter, buf_);
+		}
+
+		Event await_resume(void)
+		{
+			return (channel_->event_);
+		}
+	};
+
+	class Close {
+		CoroutineChannel *channel_;
+	public:
+		Close(CoroutineChannel *channel)
+		: channel_(channel)
+		{ }
+
+		bool await_ready(void) const
+		{
+			return (false);
+		}
+
+		void await_suspend(std::coroutine_handle<> waiter)
+		{
+			channel_->close_suspend(waiter);
+		}
+
+		void await_resume(void)
+		{ }
+	};
+
+	CoroutineChannel(const LogHandle&, Lock *, StreamChannel *);
+	~CoroutineChannel();
+
+	/*
+	 * Read exactly the given number of bytes, or whatever is
+	 * available if the amount is zero.
+	 */
+	Read read(size_t amount, Buffer *buf)
+	{
+		return (Read(this, amount, buf));
+	}
+
+	Write write(Buffer *buf)
+	{
+		return (Write(this, buf));
+	}
+
+	Close close(void)
+	{
+		return (Close(this));
+	}
+
+	/*
+	 * Data which has been read from the channel but not yet
+	 * returned by read; anyone taking over the channel from a
+	 * Coroutine must take this too.
+	 */
+	Buffer *buffered(void)
+	{
+		return (&buffer_);
+	}
+
+private:
+	bool read_ready(size_t) const;
+	void read_suspend(std::coroutine_handle<>, size_t);
+	Event read_resume(size_t, Buffer *);
+	void read_complete(Event, Buffer);
+
+	void write_suspend(std::coroutine_handle<>, Buffer *);
+	void write_complete(Event);
+
+	void close_suspend(std::coroutine_handle<>);
+	void close_complete(void);
+
+	void resume(void);
+};
+
+#endif /* !IO_COROUTINE_COROUTINE_CHANNEL_H */
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <event/action.h>
+#include <event/event_callback.h>
+
+#include <io/pipe/pipe.h>
+
+#include <io/coroutine/coroutine_pipe.h>
+
+CoroutinePipe::CoroutinePipe(const LogHandle& log, Lock *lock, Pipe *pipe)
+: log_(log + "/coroutine"),
+  pipe_(pipe),
+  event_(),
+  output_buffer_(NULL),
+  action_(NULL),
+  waiter_(),
+  input_complete_(NULL, lock, this, &CoroutinePipe::input_complete),
+  output_complete_(NULL, lock, this, &CoroutinePipe::output_complete)
+{ }
+
+CoroutinePipe::~CoroutinePipe()
+{
+	ASSERT_NULL(log_, action_);
+	ASSERT(log_, !waiter_);
+}
+
+void
+CoroutinePipe::input_suspend(std::coroutine_handle<> waiter, Buffer *buf)
+{
+	ASSERT_NULL(log_, action_);
+	ASSERT(log_, !waiter_);
+
+	waiter_ = waiter;
+	action_ = pipe_->input(buf, &input_complete_);
+}
+
+void
+CoroutinePipe::input_complete(Event e)
+{
+	action_->cancel();
+	action_ = NULL;
+
+	event_ = e;
+	resume();
+}
+
+void
+CoroutinePipe::output_suspend(std::coroutine_handle<> waiter, Buffer *buf)
+{
+	ASSERT_NULL(log_, action_);
+	ASSERT(log_, !waiter_);
+
+	waiter_ = waiter;
+	output_buffer_ = buf;
+	action_ = pipe_->output(&output_complete_);
+}
+
+void
+CoroutinePipe::output_complete(Event e, Buffer buf)
+{
+	action_->cancel();
+	action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+	case Event::EOS:
+		output_buffer_->append(buf);
+		break;
+	default:
+		break;
+	}
+	output_buffer_ = NULL;
+
+	event_ = e;
+	resume();
+}
+
+void
+CoroutinePipe::resume(void)
+{
+	std::coroutine_handle<> waiter = waiter_;
+	waiter_ = nullptr;
+	waiter.resume();
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	IO_COROUTINE_COROUTINE_PIPE_H
+#define	IO_COROUTINE_COROUTINE_PIPE_H
+
+#include <io/coroutine/coroutine.h>
+
+class Pipe;
+
+/*
+ * Sequential access to a Pipe from a Coroutine.  input hands a Buffer to
+ * the Pipe (an empty Buffer signals EOS, as with Pipe::input) and output
+ * appends whatever the Pipe produces next to the caller's Buffer.  Both
+ * return the Event which completed them.  As with CoroutineChannel, only
+ * one operation may be outstanding and the owner's lock must be held.
+ */
+class CoroutinePipe {
+	LogHandle log_;
+	Pipe *pipe_;
+	Event event_;
+	Buffer *output_buffer_;
+	Action *action_;
+	std::coroutine_handle<> waiter_;
+	EventCallback::Method<CoroutinePipe> input_complete_;
+	BufferEventCallback::Method<CoroutinePipe> output_complete_;
+public:
+	class Input {
+		CoroutinePipe *pipe_;
+		Buffer *buf_;
+	public:
+		Input(CoroutinePipe *pipe, Buffer *buf)
+		: pipe_(pipe),
+		  buf_(buf)
+		{ }
+
+		bool await_ready(void) const
+		{
+			return (false);
+		}
+
+		void await_suspend(std::coroutine_handle<> waiter)
+		{
+			pipe_->input_suspend(waiter, buf_);
+		}
+
+		Event await_resume(void)
+		{
+			return (pipe_->event_);
+		}
+	};
+
+	class Output {
+		CoroutinePipe *pipe_;
+		Buffer *buf_;
+	public:
+		Output(CoroutinePipe *pipe, Buffer *buf)
+		: pipe_(pipe),
+		  buf_(buf)
+		{ }
+
+		bool await_ready(void) const
+		{
+			return (false);
+		}
+
+		void await_suspend(std::coroutine_handle<> waiter)
+		{
+			pipe_->output_suspend(waiter, buf_);
+		}
+
+		Event await_resume(void)
+		{
+			return (pipe_->event_);
+		}
+	};
+
+	CoroutinePipe(const LogHandle&, Lock *, Pipe *);
+	~CoroutinePipe();
+
+	Input input(Buffer *buf)
+	{
+		return (Input(this, buf));
+	}
+
+	Output output(Buffer *buf)
+	{
+		return (Output(this, buf));
+	}
+
+private:
+	void input_suspend(std::coroutine_handle<>, Buffer *);
+	void input_complete(Event);
+
+	void output_suspend(std::coroutine_handle<>, Buffer *);
+	void output_complete(Event, Buffer);
+
+	void resume(void);
+};
+
+#endif /* !IO_COROUTINE_COROUTINE_PIPE_H */
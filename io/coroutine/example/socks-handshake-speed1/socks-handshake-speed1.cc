@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <common/thread/mutex.h>
+#include <common/time/time.h>
+
+#include <event/event_callback.h>
+#include <event/event_main.h>
+#include <event/event_system.h>
+
+#include <io/net/tcp_client.h>
+
+#include <io/socket/socket.h>
+
+#include <io/coroutine/coroutine_channel.h>
+
+/*
+ * Measure SOCKS5 handshake latency against a running SOCKS proxy, such as
+ * a WANProxy proxy-socks.  Connections are made one at a time.  Each sends
+ * its method selection and CONNECT request in a single write, as clients
+ * which only offer "no authentication" may, and is timed from the end of
+ * the TCP connect until the CONNECT reply has been read.  The connection
+ * is then closed.  The requested destination is 127.0.0.1:9, and it does
+ * not matter to the measurement whether the proxy can reach it.
+ *
+ * If the proxy's process ID is given, the CPU time it used over the run
+ * is read from /proc and reported per connection.
+ *
+ * Usage: socks-handshake-speed1 socks-address [connections] [pid]
+ */
+#define	HANDSHAKE_CONNECTIONS	10000
+
+static std::string socks_address;
+static unsigned connections_started;
+static unsigned connections;
+static NanoTime handshake_time;
+static uintmax_t handshake_max;
+
+static const uint8_t socks5_request[] = {
+	0x05, 0x01, 0x00,
+	0x05, 0x01, 0x00, 0x01,
+	0x7f, 0x00, 0x00, 0x01,
+	0x00, 0x09,
+};
+
+class Client {
+	friend class DestroyThread;
+
+	LogHandle log_;
+	Mutex mtx_;
+	Socket *socket_;
+	CoroutineChannel *channel_;
+	Action *action_;
+	SocketEventCallback::Method<Client> connect_complete_;
+public:
+	Client(void)
+	: log_("/example/coroutine/socks/handshake/speed1/client"),
+	  mtx_("Client"),
+	  socket_(NULL),
+	  channel_(NULL),
+	  action_(NULL),
+	  connect_complete_(NULL, &mtx_, this, &Client::connect_complete)
+	{
+		ScopedLock _(&mtx_);
+		connections_started++;
+		action_ = TCPClient::connect(SocketImplOS, SocketAddressFamilyIP, socks_address, &connect_complete_);
+	}
+
+private:
+	~Client()
+	{
+		ASSERT_NULL(log_, action_);
+
+		if (channel_ != NULL) {
+			delete channel_;
+			channel_ = NULL;
+		}
+
+		ASSERT_NULL(log_, socket_);
+	}
+
+	void connect_complete(Event e, Socket *socket)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		switch (e.type_) {
+		case Event::Done:
+			break;
+		default:
+			HALT(log_) << "Could not connect to SOCKS proxy: " << e;
+			return;
+		}
+
+		socket_ = socket;
+		channel_ = new CoroutineChannel(log_, &mtx_, socket_);
+		handshake();
+	}
+
+	Coroutine handshake(void)
+	{
+		NanoTime start = NanoTime::current_time();
+		Buffer buf(socks5_request, sizeof socks5_request);
+		Event e;
+
+		e = co_await channel_->write(&buf);
+		if (e.type_ != Event::Done)
+			HALT(log_) << "Unexpected event: " << e;
+
+		/* Method selection reply and the start of the CONNECT reply.  */
+		e = co_await channel_->read(2 + 3, &buf);
+		if (e.type_ != Event::Done)
+			HALT(log_) << "Unexpected event: " << e;
+		if (buf.peek() != 0x05)
+			HALT(log_) << "Invalid SOCKS reply.";
+
+		/*
+		 * The proxy may describe the address it connected to by name
+		 * or by IPv4 address.
+		 */
+		uint8_t atype;
+		buf.clear();
+		e = co_await channel_->read(1, &buf);
+		if (e.type_ != Event::Done)
+			HALT(log_) << "Unexpected event: " << e;
+		buf.moveout(&atype, 1);
+		switch (atype) {
+		case 0x01:
+			e = co_await channel_->read(4 + 2, &buf);
+			break;
+		case 0x03:
+			e = co_await channel_->read(1, &buf);
+			if (e.type_ == Event::Done)
+				e = co_await channel_->read(buf.peek() + 2, &buf);
+			break;
+		default:
+			HALT(log_) << "Unsupported address type in SOCKS reply.";
+		}
+		if (e.type_ != Event::Done)
+			HALT(log_) << "Unexpected event: " << e;
+
+		NanoTime elapsed = NanoTime::current_time();
+		elapsed -= start;
+		handshake_time += elapsed;
+		uintmax_t ns = elapsed.seconds_ * 1000000000 + elapsed.nanoseconds_;
+		if (ns > handshake_max)
+			handshake_max = ns;
+
+		co_await channel_->close();
+		delete socket_;
+		socket_ = NULL;
+
+		if (connections_started == connections)
+			EventSystem::instance()->stop();
+		else
+			new Client();
+		EventSystem::instance()->destroy(&mtx_, this);
+	}
+};
+
+/*
+ * User and system time used by a process, from /proc; Linux only.
+ */
+static double
+process_cpu(pid_t pid)
+{
+	char path[64];
+	unsigned long utime, stime;
+
+	snprintf(path, sizeof path, "/proc/%ld/stat", (long)pid);
+	FILE *f = fopen(path, "r");
+	if (f == NULL)
+		return (-1);
+	int rv = fscanf(f, "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime);
+	fclose(f);
+	if (rv != 2)
+		return (-1);
+	return ((double)(utime + stime) / sysconf(_SC_CLK_TCK));
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 2 || argc > 4) {
+		fprintf(stderr, "usage: socks-handshake-speed1 socks-address [connections] [pid]\n");
+		return (1);
+	}
+
+	socks_address = argv[1];
+	connections = argc > 2 ? atoi(argv[2]) : HANDSHAKE_CONNECTIONS;
+	pid_t pid = argc > 3 ? atoi(argv[3]) : -1;
+
+	double cpu = pid == -1 ? -1 : process_cpu(pid);
+
+	new Client();
+
+	event_main();
+
+	double ns = (handshake_time.seconds_ * 1e9 + handshake_time.nanoseconds_) / connections;
+	INFO("/example/coroutine/socks/handshake/speed1") << connections << " handshakes: " << (ns / 1000) << " us average, " << (handshake_max / 1000) << " us maximum";
+
+	if (cpu != -1) {
+		double used = process_cpu(pid) - cpu;
+		INFO("/example/coroutine/socks/handshake/speed1") << "Proxy CPU: " << (used * 1e6 / connections) << " us per connection";
+	}
+}
@@ -0,0 +1,7 @@
+VPATH+=	${TOPDIR}/io/coroutine
+
+SRCS+=	coroutine_channel.cc
+SRCS+=	coroutine_pipe.cc
+
+# Coroutines need C++20.
+CXXFLAGS+=-std=gnu++20
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <common/test.h>
+#include <common/thread/mutex.h>
+
+#include <event/event_callback.h>
+#include <event/event_main.h>
+#include <event/event_system.h>
+
+#include <io/stream_handle.h>
+
+#include <io/coroutine/coroutine_channel.h>
+
+static const uint8_t request[] = {
+	0x05, 0x01, 0x00,
+	0x05, 0x01, 0x00, 0x01,
+	0x7f, 0x00, 0x00, 0x01,
+	0x00, 0x50,
+	'h', 'e', 'l', 'l', 'o',
+};
+
+static const uint8_t reply[] = {
+	0x05, 0x00,
+};
+
+/*
+ * Counts the reads which reach the real channel, so that we can check
+ * that reads which are satisfied from buffered data never get there.
+ */
+class CountingChannel : public StreamChannel {
+	StreamChannel *channel_;
+public:
+	unsigned reads_;
+
+	CountingChannel(StreamChannel *channel)
+	: channel_(channel),
+	  reads_(0)
+	{ }
+
+	~CountingChannel()
+	{ }
+
+	Action *close(SimpleCallback *cb)
+	{
+		return (channel_->close(cb));
+	}
+
+	Action *read(size_t amount, BufferEventCallback *cb)
+	{
+		reads_++;
+		return (channel_->read(amount, cb));
+	}
+
+	Action *write(Buffer *buf, EventCallback *cb)
+	{
+		return (channel_->write(buf, cb));
+	}
+
+	Action *shutdown(bool shut_read, bool shut_write, EventCallback *cb)
+	{
+		return (channel_->shutdown(shut_read, shut_write, cb));
+	}
+};
+
+class Reader {
+	LogHandle log_;
+	Mutex mtx_;
+	TestGroup group_;
+	int peer_;
+	StreamHandle handle_;
+	CountingChannel counter_;
+	CoroutineChannel channel_;
+public:
+	bool finished_;
+
+	Reader(int fd, int peer)
+	: log_("/reader"),
+	  mtx_("Reader"),
+	  group_("/test/io/coroutine/channel1", "CoroutineChannel"),
+	  peer_(peer),
+	  handle_(fd),
+	  counter_(&handle_),
+	  channel_(log_, &mtx_, &counter_),
+	  finished_(false)
+	{
+		ScopedLock _(&mtx_);
+		run();
+	}
+
+	~Reader()
+	{ }
+
+private:
+	Coroutine run(void)
+	{
+		Buffer buf;
+		Event e;
+
+		{
+			Test _(group_, "First read waits for the channel");
+			e = co_await channel_.read(3, &buf);
+			if (e.type_ == Event::Done && buf.equal(request, 3))
+				_.pass();
+		}
+
+		unsigned reads = counter_.reads_;
+		{
+			Test _(group_, "Buffered reads return the right bytes");
+			buf.clear();
+			e = co_await channel_.read(4, &buf);
+			if (e.type_ == Event::Done && buf.equal(request + 3, 4)) {
+				buf.clear();
+				e = co_await channel_.read(4, &buf);
+				if (e.type_ == Event::Done && buf.equal(request + 7, 4)) {
+					buf.clear();
+					e = co_await channel_.read(2, &buf);
+					if (e.type_ == Event::Done && buf.equal(request + 11, 2))
+						_.pass();
+				}
+			}
+		}
+		{
+			Test _(group_, "Buffered reads complete inline");
+			if (counter_.reads_ == reads)
+				_.pass();
+		}
+		{
+			Test _(group_, "Read of zero returns what is buffered");
+			buf.clear();
+			e = co_await channel_.read(0, &buf);
+			if (e.type_ == Event::Done && buf.equal(request + 13, 5))
+				_.pass();
+		}
+
+		{
+			Test _(group_, "Write completes");
+			Buffer out(reply, sizeof reply);
+			e = co_await channel_.write(&out);
+			if (e.type_ == Event::Done)
+				_.pass();
+		}
+		{
+			Test _(group_, "Peer sees written data");
+			uint8_t in[sizeof reply];
+			if (::read(peer_, in, sizeof in) == (ssize_t)sizeof in &&
+			    memcmp(in, reply, sizeof in) == 0)
+				_.pass();
+		}
+
+		::shutdown(peer_, SHUT_WR);
+		{
+			Test _(group_, "Short read at end of stream returns EOS");
+			buf.clear();
+			e = co_await channel_.read(1, &buf);
+			if (e.type_ == Event::EOS && buf.empty())
+				_.pass();
+		}
+
+		co_await channel_.close();
+
+		finished_ = true;
+		EventSystem::instance()->stop();
+	}
+};
+
+int
+main(void)
+{
+	int sv[2];
+	int rv;
+
+	rv = socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+	if (rv == -1)
+		HALT("/main") << "Could not create socket pair.";
+
+	rv = ::write(sv[1], request, sizeof request);
+	if (rv != (int)sizeof request)
+		HALT("/main") << "Could not write request.";
+
+	Reader *reader = new Reader(sv[0], sv[1]);
+
+	event_main();
+
+	{
+		TestGroup g("/test/io/coroutine/channel1/main", "CoroutineChannel");
+		Test _(g, "Coroutine ran to completion");
+		if (reader->finished_)
+			_.pass();
+	}
+
+	delete reader;
+	close(sv[1]);
+}
@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include <common/thread/atomic.h>
+#include <common/thread/mutex.h>
+#include <common/thread/thread.h>
+#include <common/time/time.h>
+
+#include <event/event_callback.h>
+#include <event/event_main.h>
+#include <event/event_system.h>
+
+#include <io/stream_handle.h>
+
+/*
+ * Measure how quickly the IO system services a set of active connections
+ * while it also holds a much larger set of idle ones, each with a read
+ * pending.  Every connection is a socketpair, one end of which is read by
+ * an Echo, which writes back whatever it reads.  The load thread holds the
+ * other ends, and for ACTIVE_ROUNDS rounds writes a byte to every active
+ * connection and then reads every byte back.  Idle connections see no
+ * traffic until the end, when the load thread closes everything.
+ *
+ * Each connection uses two descriptors, so the numbers of connections are
+ * limited by the process's descriptor limit.
+ *
+ * Usage: idle-speed1 [idle] [active]
+ */
+#define	IDLE_CONNECTIONS	8192
+#define	ACTIVE_CONNECTIONS	1024
+#define	ACTIVE_ROUNDS		64
+
+static Atomic<unsigned> echoes_finished;
+static NanoTime *start_time, *finish_time;
+
+class Echo {
+	LogHandle log_;
+	Mutex mtx_;
+	StreamHandle fd_;
+	Action *action_;
+	BufferEventCallback::Method<Echo> read_complete_;
+	EventCallback::Method<Echo> write_complete_;
+	SimpleCallback::Method<Echo> close_complete_;
+public:
+	Echo(int fd)
+	: log_("/example/io/idle/speed1/echo"),
+	  mtx_("Echo"),
+	  fd_(fd),
+	  action_(NULL),
+	  read_complete_(NULL, &mtx_, this, &Echo::read_complete),
+	  write_complete_(NULL, &mtx_, this, &Echo::write_complete),
+	  close_complete_(NULL, &mtx_, this, &Echo::close_complete)
+	{
+		ScopedLock _(&mtx_);
+		action_ = fd_.read(0, &read_complete_);
+	}
+
+	~Echo()
+	{
+		ASSERT_NULL(log_, action_);
+	}
+
+private:
+	void read_complete(Event e, Buffer buf)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		switch (e.type_) {
+		case Event::Done:
+			action_ = fd_.write(&buf, &write_complete_);
+			return;
+		case Event::EOS:
+			break;
+		default:
+			ERROR(log_) << "Unexpected event: " << e;
+			break;
+		}
+
+		action_ = fd_.close(&close_complete_);
+	}
+
+	void write_complete(Event e)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		switch (e.type_) {
+		case Event::Done:
+			action_ = fd_.read(0, &read_complete_);
+			return;
+		default:
+			ERROR(log_) << "Unexpected event: " << e;
+			break;
+		}
+
+		action_ = fd_.close(&close_complete_);
+	}
+
+	void close_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		echoes_finished.add(1);
+
+		EventSystem::instance()->destroy(&mtx_, this);
+	}
+};
+
+class LoadThread : public Thread {
+	const std::vector<int>& active_;
+	const std::vector<int>& idle_;
+public:
+	LoadThread(const std::vector<int>& active, const std::vector<int>& idle)
+	: Thread("LoadThread"),
+	  active_(active),
+	  idle_(idle)
+	{ }
+
+	~LoadThread()
+	{ }
+
+private:
+	void main(void)
+	{
+		std::vector<int>::const_iterator it;
+		unsigned i;
+		uint8_t ch;
+
+		start_time = new NanoTime(NanoTime::current_time());
+		for (i = 0; i < ACTIVE_ROUNDS; i++) {
+			ch = i;
+			for (it = active_.begin(); it != active_.end(); ++it) {
+				if (::write(*it, &ch, 1) != 1)
+					HALT("/example/io/idle/speed1/load") << "Write failed.";
+			}
+			for (it = active_.begin(); it != active_.end(); ++it) {
+				if (::read(*it, &ch, 1) != 1 || ch != (uint8_t)i)
+					HALT("/example/io/idle/speed1/load") << "Read failed.";
+			}
+		}
+		finish_time = new NanoTime(NanoTime::current_time());
+
+		/*
+		 * Close everything and wait for the Echoes to see it before
+		 * stopping the event system.
+		 */
+		for (it = active_.begin(); it != active_.end(); ++it)
+			::close(*it);
+		for (it = idle_.begin(); it != idle_.end(); ++it)
+			::close(*it);
+		while (echoes_finished.load() != active_.size() + idle_.size())
+			usleep(1000);
+
+		EventSystem::instance()->stop();
+	}
+
+public:
+	void stop(void)
+	{ }
+};
+
+static void
+connect(std::vector<int> *peers, unsigned count)
+{
+	unsigned i;
+
+	for (i = 0; i < count; i++) {
+		int fds[2];
+
+		if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+			HALT("/example/io/idle/speed1") << "Could not create socketpair.";
+		new Echo(fds[0]);
+		peers->push_back(fds[1]);
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	std::vector<int> active, idle;
+	unsigned idle_count, active_count;
+
+	idle_count = argc > 1 ? atoi(argv[1]) : IDLE_CONNECTIONS;
+	active_count = argc > 2 ? atoi(argv[2]) : ACTIVE_CONNECTIONS;
+
+	/*
+	 * Interleave the idle and active connections, so that the active
+	 * descriptors are spread across the whole range in use.
+	 */
+	while (idle.size() != idle_count || active.size() != active_count) {
+		if (idle.size() * active_count <= active.size() * idle_count && idle.size() != idle_count)
+			connect(&idle, 1);
+		else
+			connect(&active, 1);
+	}
+
+	LoadThread load(active, idle);
+	load.start();
+
+	event_main();
+
+	load.join();
+
+	NanoTime elapsed(*finish_time);
+	elapsed -= *start_time;
+	double seconds = elapsed.seconds_ + elapsed.nanoseconds_ / 1e9;
+
+	INFO("/example/io/idle/speed1") << idle_count << " idle, " << active_count << " active: " << ((active_count * ACTIVE_ROUNDS) / seconds) << " round trips/s";
+}
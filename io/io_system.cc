@@ -24,7 +24,10 @@
  */
 
 #include <sys/resource.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <sched.h>
 #include <signal.h>
 #include <unistd.h>
 
@@ -36,9 +39,9 @@
 
 IOSystem::IOSystem(void)
 : log_("/io/system"),
-  mtx_("IOSystem"),
-  handle_map_(),
-  handler_thread_(new CallbackThread("System IOThread"))
+  handle_table_(log_),
+  schedulers_(),
+  handler_thread_(NULL)
 {
 	/*
 	 * Prepare system to handle IO.
@@ -79,41 +82,72 @@ IOSystem::IOSystem(void)
 		INFO(log_) << "Unable to get file descriptor limit.";
 	}
 
-	handler_thread_->start();
+	unsigned reactors = EventSystem::instance()->reactors();
+	if (reactors == 1) {
+		handler_thread_ = new CallbackThread("System IOThread");
+		handler_thread_->start();
 
-	EventSystem::instance()->thread_wait(handler_thread_);
+		EventSystem::instance()->thread_wait(handler_thread_);
+
+		schedulers_.push_back(handler_thread_);
+	} else {
+		unsigned i;
+
+		for (i = 0; i < reactors; i++)
+			schedulers_.push_back(EventSystem::instance()->reactor_scheduler(i));
+	}
 }
 
 IOSystem::~IOSystem()
 {
-	ASSERT(log_, handle_map_.empty());
+	int fd, limit;
+
+	limit = handle_table_.limit();
+	for (fd = 0; fd < limit; fd++) {
+		Slot *slot = handle_table_.lookup(fd);
+		if (slot == NULL)
+			continue;
+		ASSERT(log_, slot->handles_ == NULL);
+	}
 }
 
+/*
+ * With multiple reactors, a Handle's callbacks run in the reactor it
+ * was attached from.
+ */
 void
 IOSystem::attach(int fd, Channel *owner)
 {
-	ScopedLock _(&mtx_);
-	ASSERT(log_, handle_map_.find(handle_key_t(fd, owner)) == handle_map_.end());
-	handle_map_[handle_key_t(fd, owner)] = new IOSystem::Handle(handler_thread_, fd, owner);
+	CallbackScheduler *scheduler = schedulers_[EventSystem::instance()->reactor() % schedulers_.size()];
+	IOSystem::Handle *h = new IOSystem::Handle(scheduler, fd, owner);
+
+	Slot *slot = handle_table_.get(fd);
+	slot->lock();
+#ifndef NDEBUG
+	IOSystem::Handle *o;
+	for (o = slot->handles_; o != NULL; o = o->next_)
+		ASSERT(log_, o->owner_ != owner);
+#endif
+	h->next_ = slot->handles_;
+	slot->handles_ = h;
+	slot->unlock();
 }
 
 void
 IOSystem::detach(int fd, Channel *owner)
 {
-	handle_map_t::iterator it;
-	IOSystem::Handle *h;
-
-	mtx_.lock();
-	it = handle_map_.find(handle_key_t(fd, owner));
-	ASSERT(log_, it != handle_map_.end());
-
-	h = it->second;
+	IOSystem::Handle **hp, *h;
+
+	Slot *slot = handle_table_.lookup(fd);
+	ASSERT_NON_NULL(log_, slot);
+	slot->lock();
+	for (hp = &slot->handles_; (h = *hp) != NULL; hp = &h->next_)
+		if (h->owner_ == owner)
+			break;
 	ASSERT_NON_NULL(log_, h);
+	*hp = h->next_;
+	slot->unlock();
 
-	ASSERT(log_, h->owner_ == owner);
-
-	handle_map_.erase(it);
-	mtx_.unlock();
 	delete h;
 }
 
@@ -122,12 +156,8 @@ IOSystem::close(int fd, Channel *owner, SimpleCallback *cb)
 {
 	IOSystem::Handle *h;
 
-	mtx_.lock();
-	h = handle_map_[handle_key_t(fd, owner)];
-	ASSERT_NON_NULL(log_, h);
-	
+	h = handle(fd, owner);
 	ScopedLock _(&h->mtx_);
-	mtx_.unlock();
 
 	ASSERT_NULL(log_, h->read_callback_);
 	ASSERT_NULL(log_, h->read_action_);
@@ -135,6 +165,12 @@ IOSystem::close(int fd, Channel *owner, SimpleCallback *cb)
 	ASSERT_NULL(log_, h->write_callback_);
 	ASSERT_NULL(log_, h->write_action_);
 
+	ASSERT_NULL(log_, h->splice_callback_);
+	ASSERT_NULL(log_, h->splice_action_);
+
+	ASSERT_NULL(log_, h->close_callback_);
+	ASSERT_NULL(log_, h->close_action_);
+
 	ASSERT(log_, h->fd_ != -1);
 
 	return (h->close_do(cb));
@@ -145,12 +181,8 @@ IOSystem::read(int fd, Channel *owner, off_t offset, size_t amount, BufferEventC
 {
 	IOSystem::Handle *h;
 
-	mtx_.lock();
-	h = handle_map_[handle_key_t(fd, owner)];
-	ASSERT_NON_NULL(log_, h);
-
+	h = handle(fd, owner);
 	ScopedLock _(&h->mtx_);
-	mtx_.unlock();
 
 	ASSERT_NULL(log_, h->read_callback_);
 	ASSERT_NULL(log_, h->read_action_);
@@ -190,12 +222,8 @@ IOSystem::write(int fd, Channel *owner, off_t offset, Buffer *buffer, EventCallb
 {
 	IOSystem::Handle *h;
 
-	mtx_.lock();
-	h = handle_map_[handle_key_t(fd, owner)];
-	ASSERT_NON_NULL(log_, h);
-
+	h = handle(fd, owner);
 	ScopedLock _(&h->mtx_);
-	mtx_.unlock();
 
 	ASSERT_NULL(log_, h->write_callback_);
 	ASSERT_NULL(log_, h->write_action_);
@@ -217,3 +245,139 @@ IOSystem::write(int fd, Channel *owner, off_t offset, Buffer *buffer, EventCallb
 	ASSERT_NULL(log_, h->write_callback_);
 	return (a);
 }
+
+/*
+ * Move everything that can be read from one descriptor to another
+ * without bringing it in to userspace, until the source reaches EOS,
+ * by way of a kernel pipe and splice(2).  Data which has already been
+ * read in to the source's buffer is written out first.  The callback
+ * receives EOS once everything has been written, or an error.  Neither
+ * the source may be read nor the sink written while this is pending.
+ *
+ * Returns NULL if the system has no way to do this, in which case the
+ * caller must move the data itself.
+ */
+#if defined(__linux__)
+Action *
+IOSystem::splice(int fd, Channel *owner, int sink_fd, Channel *sink, EventCallback *cb)
+{
+	IOSystem::Handle *h;
+
+	/*
+	 * Notifications of completed zero-copy sends wake polls on a
+	 * descriptor as errors, which only the descriptor's own Handle
+	 * knows to expect; leave such descriptors to the caller.
+	 */
+	h = handle(sink_fd, sink);
+	{
+		ScopedLock _(&h->mtx_);
+		ASSERT_NULL(log_, h->write_callback_);
+		ASSERT_NULL(log_, h->write_action_);
+
+		if (h->write_zerocopy_ != 0 || !h->write_zerocopy_pending_.empty())
+			return (NULL);
+	}
+
+	h = handle(fd, owner);
+	ScopedLock _(&h->mtx_);
+
+	ASSERT_NULL(log_, h->read_callback_);
+	ASSERT_NULL(log_, h->read_action_);
+
+	ASSERT_NULL(log_, h->splice_callback_);
+	ASSERT_NULL(log_, h->splice_action_);
+	ASSERT(log_, h->splice_pipe_[0] == -1);
+
+	if (h->write_zerocopy_ != 0 || !h->write_zerocopy_pending_.empty())
+		return (NULL);
+
+	if (::pipe2(h->splice_pipe_, O_NONBLOCK | O_CLOEXEC) == -1) {
+		ERROR(log_) << "Could not create pipe for splicing: " << strerror(errno);
+		h->splice_pipe_[0] = h->splice_pipe_[1] = -1;
+		return (NULL);
+	}
+
+	/*
+	 * The default pipe holds only 64K, which makes for many more
+	 * trips through it than necessary; if we may not have a bigger
+	 * one, the default will do.
+	 */
+	::fcntl(h->splice_pipe_[1], F_SETPIPE_SZ, IO_SPLICE_BURST);
+
+	h->splice_fd_ = sink_fd;
+	h->splice_length_ = 0;
+	h->splice_eos_ = false;
+	h->splice_callback_ = cb;
+	Action *a = h->splice_do();
+	if (a == NULL) {
+		ASSERT_NON_NULL(log_, h->splice_callback_);
+		h->splice_action_ = h->splice_schedule();
+		ASSERT_NON_NULL(log_, h->splice_action_);
+		return (&h->splice_cancel_);
+	}
+	ASSERT_NULL(log_, h->splice_callback_);
+	return (a);
+}
+#else
+Action *
+IOSystem::splice(int, Channel *, int, Channel *, EventCallback *)
+{
+	return (NULL);
+}
+#endif
+
+/*
+ * Send writes of at least the given number of bytes with MSG_ZEROCOPY,
+ * or none if it is 0.  The owner must already have enabled SO_ZEROCOPY
+ * on the socket.
+ */
+void
+IOSystem::zerocopy(int fd, Channel *owner, size_t threshold)
+{
+	IOSystem::Handle *h;
+
+	h = handle(fd, owner);
+	ScopedLock _(&h->mtx_);
+
+	h->write_zerocopy_ = threshold;
+}
+
+/*
+ * Find the Handle for a descriptor and channel.  Only the channel itself
+ * detaches its Handle, and never while it has a call in to us pending,
+ * so the Handle may safely be used once the slot is unlocked.
+ */
+IOSystem::Handle *
+IOSystem::handle(int fd, Channel *owner)
+{
+	IOSystem::Handle *h;
+
+	Slot *slot = handle_table_.lookup(fd);
+	if (slot == NULL)
+		HALT(log_) << "No handle for file descriptor " << fd << ".";
+	slot->lock();
+	for (h = slot->handles_; h != NULL; h = h->next_)
+		if (h->owner_ == owner)
+			break;
+	slot->unlock();
+	if (h == NULL)
+		HALT(log_) << "No handle for file descriptor " << fd << ".";
+	return (h);
+}
+
+/*
+ * The lock on a slot is only ever held for a few instructions, to walk
+ * or change its short list of Handles.
+ */
+void
+IOSystem::Slot::lock(void)
+{
+	while (!lock_.cmpset(0, 1))
+		sched_yield();
+}
+
+void
+IOSystem::Slot::unlock(void)
+{
+	lock_.store_release(0);
+}
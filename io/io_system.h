@@ -26,11 +26,33 @@
 #ifndef	IO_IO_SYSTEM_H
 #define	IO_IO_SYSTEM_H
 
-#include <map>
+#include <deque>
+#include <vector>
 
+#include <common/thread/atomic.h>
 #include <common/thread/mutex.h>
 
 #include <event/cancellation.h>
+#include <event/fd_table.h>
+
+/*
+ * Number of maximum-size BufferSegments each Handle keeps in reserve to
+ * read in to directly.
+ */
+#define	IO_READ_RESERVE_SEGMENTS	2
+
+/*
+ * Number of bytes a kernel splice moves before going back through the
+ * poll loop, so that one busy connection cannot monopolize its thread.
+ */
+#define	IO_SPLICE_BURST			(1024 * 1024)
+
+/*
+ * How often, and for how long in all, a close waits for the kernel to
+ * finish with data sent with MSG_ZEROCOPY, in milliseconds.
+ */
+#define	IO_ZEROCOPY_CLOSE_INTERVAL	10
+#define	IO_ZEROCOPY_CLOSE_WAIT		30000
 
 class CallbackScheduler;
 class CallbackThread;
@@ -44,12 +66,20 @@ class IOSystem {
 
 		int fd_;
 		Channel *owner_;
+		Handle *next_;
+
+		SimpleCallback::Method<Handle> close_timeout_complete_;
+		Cancellation<Handle> close_cancel_;
+		unsigned close_wait_;
+		SimpleCallback *close_callback_;
+		Action *close_action_;
 
 		EventCallback::Method<Handle> read_poll_complete_;
 		Cancellation<Handle> read_cancel_;
 		off_t read_offset_;
 		size_t read_amount_;
 		Buffer read_buffer_;
+		BufferSegment *read_reserve_[IO_READ_RESERVE_SEGMENTS];
 		BufferEventCallback *read_callback_;
 		Action *read_action_;
 
@@ -59,40 +89,80 @@ class IOSystem {
 		Buffer write_buffer_;
 		EventCallback *write_callback_;
 		Action *write_action_;
+		size_t write_zerocopy_;
+		uint32_t write_zerocopy_first_;
+		std::deque<Buffer> write_zerocopy_pending_;
+
+		EventCallback::Method<Handle> splice_poll_complete_;
+		Cancellation<Handle> splice_cancel_;
+		int splice_fd_;
+		int splice_pipe_[2];
+		size_t splice_length_;
+		bool splice_eos_;
+		EventCallback *splice_callback_;
+		Action *splice_action_;
 
 		Handle(CallbackScheduler *, int, Channel *);
 		~Handle();
 
 		Action *close_do(SimpleCallback *);
+		void close_timeout_complete(void);
+		void close_cancel(void);
+		void close_finish(void);
 
 		void read_poll_complete(Event);
 		void read_cancel(void);
 		Action *read_do(void);
+		void read_release(void);
 		Action *read_schedule(void);
 
 		void write_poll_complete(Event);
 		void write_cancel(void);
 		Action *write_do(void);
 		Action *write_schedule(void);
+		ssize_t write_zerocopy(const struct iovec *, size_t);
+		bool write_zerocopy_reap(void);
+
+		void splice_poll_complete(Event);
+		void splice_cancel(void);
+		Action *splice_complete(Event);
+		Action *splice_do(void);
+		Action *splice_schedule(void);
 	};
 
 	/*
-	 * The map is keyed by fd and channel to prevent collision
-	 * on the fd with a common race on close.  This is also why
-	 * we pass the fd and channel to all functions.  There is
-	 * no interaction, it's just a disambiguator.
+	 * Handles are kept in a table indexed by fd, so that finding
+	 * one costs the same however many there are.  A slot usually
+	 * holds a single Handle, but may briefly hold more than one:
+	 * a descriptor may be closed, and its number reused by a new
+	 * channel, before the old channel detaches.  This is why we
+	 * pass the fd and channel to all functions; the channel is
+	 * just a disambiguator.  The list in each slot is protected
+	 * by a lock of its own, held only to walk or change it.
 	 */
-	typedef std::pair<int, Channel *> handle_key_t;
-	typedef std::map<handle_key_t, Handle *> handle_map_t;
+	struct Slot {
+		Atomic<unsigned> lock_;
+		Handle *handles_;
+
+		Slot(void)
+		: lock_(0),
+		  handles_(NULL)
+		{ }
+
+		void lock(void);
+		void unlock(void);
+	};
 
 	LogHandle log_;
-	Mutex mtx_;
-	handle_map_t handle_map_;
+	FDTable<Slot> handle_table_;
+	std::vector<CallbackScheduler *> schedulers_;
 	CallbackThread *handler_thread_;
 
 	IOSystem(void);
 	~IOSystem();
 
+	Handle *handle(int, Channel *);
+
 public:
 	void attach(int, Channel *);
 	void detach(int, Channel *);
@@ -100,6 +170,9 @@ public:
 	Action *close(int, Channel *, SimpleCallback *);
 	Action *read(int, Channel *, off_t, size_t, BufferEventCallback *);
 	Action *write(int, Channel *, off_t, Buffer *, EventCallback *);
+	Action *splice(int, Channel *, int, Channel *, EventCallback *);
+
+	void zerocopy(int, Channel *, size_t);
 
 	static IOSystem *instance(void)
 	{
@@ -24,11 +24,19 @@
  */
 
 #include <sys/errno.h>
+#include <sys/socket.h>
 #include <sys/uio.h>
+#include <netinet/in.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <string.h>
 #include <unistd.h>
 
+#if defined(__linux__)
+#include <linux/errqueue.h>
+#endif
+
 #include <common/limits.h>
 
 #include <event/event_callback.h>
@@ -36,18 +44,23 @@
 
 #include <io/io_system.h>
 
-#define	IO_READ_BUFFER_SIZE	65536
-
 IOSystem::Handle::Handle(CallbackScheduler *scheduler, int fd, Channel *owner)
 : log_("/io/system/handle"),
   mtx_("IOSystem::Handle"),
   fd_(fd),
   owner_(owner),
+  next_(NULL),
+  close_timeout_complete_(scheduler, &mtx_, this, &Handle::close_timeout_complete),
+  close_cancel_(&mtx_, this, &Handle::close_cancel),
+  close_wait_(0),
+  close_callback_(NULL),
+  close_action_(NULL),
   read_poll_complete_(scheduler, &mtx_, this, &Handle::read_poll_complete),
   read_cancel_(&mtx_, this, &Handle::read_cancel),
   read_offset_(-1),
   read_amount_(0),
   read_buffer_(),
+  read_reserve_(),
   read_callback_(NULL),
   read_action_(NULL),
   write_poll_complete_(scheduler, &mtx_, this, &Handle::write_poll_complete),
@@ -55,18 +68,40 @@ IOSystem::Handle::Handle(CallbackScheduler *scheduler, int fd, Channel *owner)
   write_offset_(-1),
   write_buffer_(),
   write_callback_(NULL),
-  write_action_(NULL)
-{ }
+  write_action_(NULL),
+  write_zerocopy_(0),
+  write_zerocopy_first_(0),
+  write_zerocopy_pending_(),
+  splice_poll_complete_(scheduler, &mtx_, this, &Handle::splice_poll_complete),
+  splice_cancel_(&mtx_, this, &Handle::splice_cancel),
+  splice_fd_(-1),
+  splice_pipe_(),
+  splice_length_(0),
+  splice_eos_(false),
+  splice_callback_(NULL),
+  splice_action_(NULL)
+{
+	splice_pipe_[0] = splice_pipe_[1] = -1;
+}
 
 IOSystem::Handle::~Handle()
 {
 	ASSERT(log_, fd_ == -1);
 
+	ASSERT_NULL(log_, close_action_);
+	ASSERT_NULL(log_, close_callback_);
+
 	ASSERT_NULL(log_, read_action_);
 	ASSERT_NULL(log_, read_callback_);
 
 	ASSERT_NULL(log_, write_action_);
 	ASSERT_NULL(log_, write_callback_);
+
+	ASSERT_NULL(log_, splice_action_);
+	ASSERT_NULL(log_, splice_callback_);
+	ASSERT(log_, splice_pipe_[0] == -1);
+
+	read_release();
 }
 
 Action *
@@ -74,6 +109,77 @@ IOSystem::Handle::close_do(SimpleCallback *cb)
 {
 	ASSERT_LOCK_OWNED(log_, &mtx_);
 
+	/*
+	 * The kernel may still be sending from data we wrote with
+	 * MSG_ZEROCOPY, and once the descriptor is closed it can no
+	 * longer tell us when it is done, so give it a chance to finish
+	 * before closing.
+	 */
+	if (!write_zerocopy_pending_.empty()) {
+		write_zerocopy_reap();
+		if (!write_zerocopy_pending_.empty()) {
+			close_wait_ = 0;
+			close_callback_ = cb;
+			close_action_ = EventSystem::instance()->timeout(IO_ZEROCOPY_CLOSE_INTERVAL, &close_timeout_complete_);
+			return (&close_cancel_);
+		}
+	}
+
+	close_finish();
+	return (cb->schedule());
+}
+
+void
+IOSystem::Handle::close_timeout_complete(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	close_action_->cancel();
+	close_action_ = NULL;
+
+	write_zerocopy_reap();
+	if (!write_zerocopy_pending_.empty() &&
+	    ++close_wait_ < IO_ZEROCOPY_CLOSE_WAIT / IO_ZEROCOPY_CLOSE_INTERVAL) {
+		close_action_ = EventSystem::instance()->timeout(IO_ZEROCOPY_CLOSE_INTERVAL, &close_timeout_complete_);
+		return;
+	}
+
+	close_finish();
+	close_action_ = close_callback_->schedule();
+	close_callback_ = NULL;
+}
+
+void
+IOSystem::Handle::close_cancel(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	ASSERT_NON_NULL(log_, close_action_);
+	close_action_->cancel();
+	close_action_ = NULL;
+
+	/*
+	 * Cancelled while still waiting; stop waiting.
+	 */
+	if (close_callback_ != NULL) {
+		close_callback_ = NULL;
+		close_finish();
+	}
+}
+
+void
+IOSystem::Handle::close_finish(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+
+	if (!write_zerocopy_pending_.empty()) {
+		/*
+		 * We will never hear when the kernel is done with these,
+		 * so they must never be reused.
+		 */
+		ERROR(log_) << "Closing with " << write_zerocopy_pending_.size() << " zero-copy sends outstanding.";
+		std::deque<Buffer> *leaked = new std::deque<Buffer>;
+		leaked->swap(write_zerocopy_pending_);
+	}
+
 	ASSERT(log_, fd_ != -1);
 	int rv = ::close(fd_);
 	if (rv == -1) {
@@ -92,7 +198,6 @@ IOSystem::Handle::close_do(SimpleCallback *cb)
 		ERROR(log_) << "Close returned error: " << strerror(errno);
 	}
 	fd_ = -1;
-	return (cb->schedule());
 }
 
 void
@@ -107,6 +212,8 @@ IOSystem::Handle::read_poll_complete(Event e)
 	case Event::Done:
 		break;
 	case Event::Error: {
+		if (write_zerocopy_reap())
+			break;
 		DEBUG(log_) << "Poll returned error: " << e;
 		read_callback_->param(e, Buffer());
 		Action *a = read_callback_->schedule();
@@ -154,112 +261,153 @@ IOSystem::Handle::read_do(void)
 	}
 
 	/*
-	 * A bit of discussion is warranted on this:
-	 *
-	 * In tack, IOV_MAX BufferSegments are allocated and read in to
-	 * with readv(2), and then the lengths are adjusted and the ones
-	 * that are empty are freed.  It's also possible to set the
-	 * expected lengths first (and only allocate
-	 * 	roundup(rlen, BUFFER_SEGMENT_SIZE) / BUFFER_SEGMENT_SIZE
-	 * BufferSegments, though really IOV_MAX (or some chosen number)
-	 * seems a bit better since most of our reads right now are
-	 * read_amount_==0) and put them into a Buffer and trim the
-	 * leftovers, which is a bit nicer.
-	 *
-	 * Since our read_amount_ is usually 0, though, we're kind of at
-	 * the mercy of chance (well, not really) as to how much data we
-	 * will read, which means a sizable amount of thrashing of memory;
-	 * allocating and freeing BufferSegments.
-	 *
-	 * By comparison, stack space is cheap in userland and allocating
-	 * 64K of it here is pretty painless.  Reading to it is fast and
-	 * then copying only what we need into BufferSegments isn't very
-	 * costly.  Indeed, since readv can't sparsely-populate each data
-	 * pointer, it has to do some data shuffling, already.
+	 * We read directly in to a small reserve of maximum-size
+	 * BufferSegments with readv(2), so that a large read costs no
+	 * copying at all.  Segments which are filled well enough to be
+	 * worth keeping are handed to read_buffer_ as they are, and
+	 * replaced on the next read; for small reads, which are the
+	 * common case on interactive connections, the data is copied
+	 * in to a right-sized segment and the reserve segment is kept.
 	 *
-	 * Benchmarking used to show that readv was actually markedly
-	 * slower here, primarily because of the need to new and delete
-	 * lots of BufferSegments.  Now that there is a BufferSegment
-	 * cache, that cost is significantly lowered.  It is probably a
-	 * good idea to reevaluate it now, especially if we can stomach
-	 * also keeping a small cache of BufferSegments just for this
-	 * IOSystem Handle.
+	 * The reserve is only held while data keeps arriving; when a
+	 * read would block, it is released so that idle Handles do not
+	 * pin memory.
 	 */
-	uint8_t data[IO_READ_BUFFER_SIZE];
-	ssize_t len;
-	if (read_offset_ == -1) {
-		len = ::read(fd_, data, sizeof data);
-	} else {
+	for (;;) {
+		struct iovec iov[IO_READ_RESERVE_SEGMENTS];
+		size_t iovcnt;
+		size_t size;
+		unsigned i;
+
+		size = 0;
+		for (i = 0; i < IO_READ_RESERVE_SEGMENTS; i++) {
+			BufferSegment *seg = read_reserve_[i];
+			if (seg == NULL) {
+				seg = BufferSegment::create(BUFFER_SEGMENT_SIZE_MAX);
+				read_reserve_[i] = seg;
+			}
+			iov[i].iov_base = seg->head();
+			iov[i].iov_len = seg->size();
+			size += seg->size();
+		}
+		iovcnt = IO_READ_RESERVE_SEGMENTS;
+
+		ssize_t len;
+		if (read_offset_ == -1) {
+			len = ::readv(fd_, iov, iovcnt);
+		} else {
+			/*
+			 * For offset reads, we do not read extra data since we do
+			 * not know whether the next read will be to the subsequent
+			 * location.
+			 *
+			 * This makes even more sense since we don't allow 0-length
+			 * offset reads.
+			 */
+			size_t resid = read_amount_ - read_buffer_.length();
+			for (i = 0, size = 0; i < iovcnt && size < resid; i++) {
+				iov[i].iov_len = std::min(iov[i].iov_len, resid - size);
+				size += iov[i].iov_len;
+			}
+			iovcnt = i;
+#if defined(__FreeBSD__) || defined(__linux__)
+			len = ::preadv(fd_, iov, iovcnt, read_offset_);
+#else
+			len = ::pread(fd_, iov[0].iov_base, iov[0].iov_len, read_offset_);
+			size = iov[0].iov_len;
+#endif
+			if (len > 0)
+				read_offset_ += len;
+		}
+		if (len == -1) {
+			switch (errno) {
+			case EAGAIN:
+				read_release();
+				return (NULL);
+			default:
+				read_release();
+				read_callback_->param(Event(Event::Error, errno), read_buffer_);
+				Action *a = read_callback_->schedule();
+				read_callback_ = NULL;
+				read_buffer_.clear();
+				read_amount_ = 0;
+				return (a);
+			}
+			NOTREACHED(log_);
+		}
+
 		/*
-		 * For offset reads, we do not read extra data since we do
-		 * not know whether the next read will be to the subsequent
-		 * location.
-		 *
-		 * This makes even more sense since we don't allow 0-length
-		 * offset reads.
+		 * XXX
+		 * If we get a short read from readv and detected EOS from
+		 * EventPoll is that good enough, instead?  We can keep reading
+		 * until we get a 0, sure, but if things other than network
+		 * conditions influence whether reads would block (and whether
+		 * non-blocking reads return), there could be more data waiting,
+		 * and so we shouldn't just use a short read as an indicator?
 		 */
-		size_t size = std::min(sizeof data, read_amount_);
-		len = ::pread(fd_, data, size, read_offset_);
-		if (len > 0)
-			read_offset_ += len;
-	}
-	if (len == -1) {
-		switch (errno) {
-		case EAGAIN:
-			return (NULL);
-		default:
-			read_callback_->param(Event(Event::Error, errno), read_buffer_);
+		if (len == 0) {
+			read_release();
+			read_callback_->param(Event::EOS, read_buffer_);
 			Action *a = read_callback_->schedule();
 			read_callback_ = NULL;
 			read_buffer_.clear();
 			read_amount_ = 0;
 			return (a);
 		}
-		NOTREACHED(log_);
-	}
 
-	/*
-	 * XXX
-	 * If we get a short read from readv and detected EOS from
-	 * EventPoll is that good enough, instead?  We can keep reading
-	 * until we get a 0, sure, but if things other than network
-	 * conditions influence whether reads would block (and whether
-	 * non-blocking reads return), there could be more data waiting,
-	 * and so we shouldn't just use a short read as an indicator?
-	 */
-	if (len == 0) {
-		read_callback_->param(Event::EOS, read_buffer_);
-		Action *a = read_callback_->schedule();
-		read_callback_ = NULL;
-		read_buffer_.clear();
-		read_amount_ = 0;
-		return (a);
-	}
+		size_t resid = len;
+		for (i = 0; i < iovcnt && resid != 0; i++) {
+			BufferSegment *seg = read_reserve_[i];
+			size_t seglen = std::min(resid, seg->size());
+
+			seg->set_length(seglen);
+			if (seg->oversized()) {
+				read_buffer_.append(seg->data(), seglen);
+				seg->set_length(0);
+			} else {
+				read_buffer_.append(seg);
+				seg->unref();
+				read_reserve_[i] = NULL;
+			}
+			resid -= seglen;
+		}
 
-	read_buffer_.append(data, len);
+		if (!read_buffer_.empty() &&
+		    read_buffer_.length() >= read_amount_) {
+			if (read_amount_ == 0)
+				read_amount_ = read_buffer_.length();
+			read_callback_->param(Event::Done, Buffer(read_buffer_, read_amount_));
+			Action *a = read_callback_->schedule();
+			read_callback_ = NULL;
+			read_buffer_.skip(read_amount_);
+			read_amount_ = 0;
+			return (a);
+		}
 
-	if (!read_buffer_.empty() &&
-	    read_buffer_.length() >= read_amount_) {
-		if (read_amount_ == 0)
-			read_amount_ = read_buffer_.length();
-		read_callback_->param(Event::Done, Buffer(read_buffer_, read_amount_));
-		Action *a = read_callback_->schedule();
-		read_callback_ = NULL;
-		read_buffer_.skip(read_amount_);
-		read_amount_ = 0;
-		return (a);
+		/*
+		 * A short read means that we have drained the descriptor, so
+		 * go back to polling.  After a full read there is very likely
+		 * more data waiting, so read again without the round-trip.
+		 */
+		if ((size_t)len != size)
+			return (NULL);
 	}
+}
 
-	/*
-	 * We may do another read without polling, but yield to other
-	 * callbacks.
-	 */
-	if (len == sizeof data) {
-		/* TODO */
-		DEBUG(log_) << "Could read without polling.";
-	}
+/*
+ * Drop any BufferSegments held in reserve for reading.
+ */
+void
+IOSystem::Handle::read_release(void)
+{
+	unsigned i;
 
-	return (NULL);
+	for (i = 0; i < IO_READ_RESERVE_SEGMENTS; i++) {
+		if (read_reserve_[i] == NULL)
+			continue;
+		read_reserve_[i]->unref();
+		read_reserve_[i] = NULL;
+	}
 }
 
 Action *
@@ -283,6 +431,8 @@ IOSystem::Handle::write_poll_complete(Event e)
 	case Event::Done:
 		break;
 	case Event::Error: {
+		if (write_zerocopy_reap())
+			break;
 		DEBUG(log_) << "Poll returned error: " << e;
 		write_callback_->param(e);
 		Action *a = write_callback_->schedule();
@@ -334,9 +484,12 @@ IOSystem::Handle::write_do(void)
 
 	ssize_t len;
 	if (write_offset_ == -1) {
-		len = ::writev(fd_, iov, iovcnt);
+		if (write_zerocopy_ != 0 && write_buffer_.length() >= write_zerocopy_)
+			len = write_zerocopy(iov, iovcnt);
+		else
+			len = ::writev(fd_, iov, iovcnt);
 	} else {
-#if defined(__FreeBSD__)
+#if defined(__FreeBSD__) || defined(__linux__)
 		len = ::pwritev(fd_, iov, iovcnt, write_offset_);
 		if (len > 0)
 			write_offset_ += len;
@@ -420,3 +573,263 @@ IOSystem::Handle::write_schedule(void)
 	Action *a = EventSystem::instance()->poll(EventPoll::Writable, fd_, &write_poll_complete_);
 	return (a);
 }
+
+/*
+ * Send with MSG_ZEROCOPY, so that the kernel transmits straight from our
+ * BufferSegments rather than copying them.  What is sent must not change
+ * until the kernel says it is done with it, so we keep a reference to it
+ * for each send, in order, and drop them as completions come in on the
+ * socket's error queue.  Completions are numbered by the kernel, one for
+ * each send which took any data, counting from zero.
+ */
+ssize_t
+IOSystem::Handle::write_zerocopy(const struct iovec *iov, size_t iovcnt)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+
+#if defined(MSG_ZEROCOPY)
+	if (!write_zerocopy_pending_.empty())
+		write_zerocopy_reap();
+
+	struct msghdr msg;
+	memset(&msg, 0, sizeof msg);
+	msg.msg_iov = const_cast<struct iovec *>(iov);
+	msg.msg_iovlen = iovcnt;
+
+	ssize_t len = ::sendmsg(fd_, &msg, MSG_ZEROCOPY);
+	if (len == -1 && errno == ENOBUFS) {
+		/*
+		 * Too many sends are waiting to complete; copy this one.
+		 */
+		return (::writev(fd_, iov, iovcnt));
+	}
+	if (len > 0)
+		write_zerocopy_pending_.push_back(Buffer(write_buffer_, len));
+	return (len);
+#else
+	return (::writev(fd_, iov, iovcnt));
+#endif
+}
+
+/*
+ * Collect completions of zero-copy sends from the error queue, releasing
+ * the data they were sent from.  If the kernel had to copy the data after
+ * all, as it does over loopback, sending with MSG_ZEROCOPY only costs us,
+ * so stop.  Returns true if there were any completions, which polls see
+ * as an error on the descriptor.
+ */
+bool
+IOSystem::Handle::write_zerocopy_reap(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+
+#if defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+	if (write_zerocopy_ == 0 && write_zerocopy_pending_.empty())
+		return (false);
+
+	bool reaped = false;
+	for (;;) {
+		uint8_t control[CMSG_SPACE(sizeof (struct sock_extended_err) + sizeof (struct sockaddr_in6))];
+		struct msghdr msg;
+
+		memset(&msg, 0, sizeof msg);
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof control;
+
+		if (::recvmsg(fd_, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+			return (reaped);
+
+		struct cmsghdr *cmsg;
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+		     cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+			    !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+				continue;
+
+			struct sock_extended_err ee;
+			memcpy(&ee, CMSG_DATA(cmsg), sizeof ee);
+			if (ee.ee_origin != SO_EE_ORIGIN_ZEROCOPY || ee.ee_errno != 0)
+				continue;
+			reaped = true;
+
+			if ((ee.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0 &&
+			    write_zerocopy_ != 0) {
+				DEBUG(log_) << "Zero-copy sends are being copied, disabling.";
+				write_zerocopy_ = 0;
+			}
+
+			/*
+			 * Completions are given as an inclusive range, and
+			 * while they come in order for TCP, allow for gaps.
+			 */
+			uint32_t i;
+			for (i = ee.ee_info - write_zerocopy_first_;
+			     i <= ee.ee_data - write_zerocopy_first_ &&
+			     i < write_zerocopy_pending_.size(); i++)
+				write_zerocopy_pending_[i].clear();
+			while (!write_zerocopy_pending_.empty() &&
+			       write_zerocopy_pending_.front().empty()) {
+				write_zerocopy_pending_.pop_front();
+				write_zerocopy_first_++;
+			}
+		}
+	}
+#else
+	return (false);
+#endif
+}
+
+void
+IOSystem::Handle::splice_poll_complete(Event e)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	splice_action_->cancel();
+	splice_action_ = NULL;
+
+	switch (e.type_) {
+	case Event::EOS:
+	case Event::Done:
+		break;
+	case Event::Error:
+		DEBUG(log_) << "Poll returned error: " << e;
+		splice_action_ = splice_complete(e);
+		return;
+	default:
+		HALT(log_) << "Unexpected event: " << e;
+	}
+
+	splice_action_ = splice_do();
+	if (splice_action_ == NULL)
+		splice_action_ = splice_schedule();
+	ASSERT_NON_NULL(log_, splice_action_);
+}
+
+void
+IOSystem::Handle::splice_cancel(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	ASSERT_NON_NULL(log_, splice_action_);
+	splice_action_->cancel();
+	splice_action_ = NULL;
+
+	/*
+	 * Anything still in the pipe is lost, just as data which has
+	 * been read but not yet delivered is when a read is cancelled.
+	 */
+	if (splice_callback_ != NULL) {
+		splice_callback_ = NULL;
+
+		::close(splice_pipe_[0]);
+		::close(splice_pipe_[1]);
+		splice_pipe_[0] = splice_pipe_[1] = -1;
+	}
+}
+
+/*
+ * Finish splicing, releasing the pipe.
+ */
+Action *
+IOSystem::Handle::splice_complete(Event e)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+
+	::close(splice_pipe_[0]);
+	::close(splice_pipe_[1]);
+	splice_pipe_[0] = splice_pipe_[1] = -1;
+
+	splice_callback_->param(e);
+	Action *a = splice_callback_->schedule();
+	splice_callback_ = NULL;
+	return (a);
+}
+
+Action *
+IOSystem::Handle::splice_do(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	ASSERT_NULL(log_, splice_action_);
+
+#if defined(__linux__)
+	size_t moved = 0;
+
+	for (;;) {
+		ssize_t len;
+
+		/*
+		 * Anything that was read ahead in to userspace before we
+		 * were asked to splice has to go out first.
+		 */
+		if (!read_buffer_.empty()) {
+			struct iovec iov[IOV_MAX];
+			size_t iovcnt = read_buffer_.fill_iovec(iov, IOV_MAX);
+
+			len = ::writev(splice_fd_, iov, iovcnt);
+			if (len == -1) {
+				if (errno == EAGAIN)
+					return (NULL);
+				return (splice_complete(Event(Event::Error, errno)));
+			}
+			read_buffer_.skip(len);
+			continue;
+		}
+
+		/*
+		 * Drain the pipe before refilling it, so that it only ever
+		 * holds data the sink is not yet ready for.
+		 */
+		if (splice_length_ != 0) {
+			len = ::splice(splice_pipe_[0], NULL, splice_fd_, NULL,
+				       splice_length_,
+				       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if (len == -1) {
+				if (errno == EAGAIN)
+					return (NULL);
+				return (splice_complete(Event(Event::Error, errno)));
+			}
+			splice_length_ -= len;
+			moved += len;
+			continue;
+		}
+
+		if (splice_eos_)
+			return (splice_complete(Event::EOS));
+
+		if (moved >= IO_SPLICE_BURST)
+			return (NULL);
+
+		len = ::splice(fd_, NULL, splice_pipe_[1], NULL,
+			       IO_SPLICE_BURST,
+			       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (len == -1) {
+			if (errno == EAGAIN)
+				return (NULL);
+			return (splice_complete(Event(Event::Error, errno)));
+		}
+		if (len == 0) {
+			splice_eos_ = true;
+			continue;
+		}
+		splice_length_ += len;
+	}
+#else
+	NOTREACHED(log_);
+#endif
+}
+
+/*
+ * Wait for whichever end we are held up on: the sink if there is data
+ * waiting to go out to it, the source otherwise.
+ */
+Action *
+IOSystem::Handle::splice_schedule(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	ASSERT_NULL(log_, splice_action_);
+
+	Action *a;
+	if (!read_buffer_.empty() || splice_length_ != 0)
+		a = EventSystem::instance()->poll(EventPoll::Writable, splice_fd_, &splice_poll_complete_);
+	else
+		a = EventSystem::instance()->poll(EventPoll::Readable, fd_, &splice_poll_complete_);
+	return (a);
+}
@@ -0,0 +1,3 @@
+VPATH+=	${TOPDIR}/io/mux
+
+SRCS+=	mux_session.cc
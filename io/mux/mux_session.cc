@@ -0,0 +1,1012 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <errno.h>
+
+#include <common/endian.h>
+#include <common/thread/mutex.h>
+
+#include <event/event_callback.h>
+
+#include <io/channel.h>
+#include <io/pipe/pipe.h>
+
+#include <io/mux/mux_session.h>
+
+/*
+ * Every frame is a 32-bit stream number, an 8-bit type and a 32-bit length,
+ * all in network byte order, followed by that many bytes of payload.  The
+ * client side numbers the streams it opens with odd numbers, and the server
+ * side with even ones; numbers are never reused within a session.
+ */
+namespace {
+	static const uint8_t MuxFrameOpen = 0x01;	/* Stream opened.  */
+	static const uint8_t MuxFrameData = 0x02;	/* Data for a stream.  */
+	static const uint8_t MuxFrameWindow = 0x03;	/* 32-bit window increment.  */
+	static const uint8_t MuxFrameEOS = 0x04;	/* No more data will follow.  */
+	static const uint8_t MuxFrameClose = 0x05;	/* Stream closed.  */
+
+	static const size_t MuxFrameHeaderLength = 9;
+
+	static void
+	mux_frame(Buffer *out, uint32_t id, uint8_t type, uint32_t length)
+	{
+		id = BigEndian::encode(id);
+		length = BigEndian::encode(length);
+
+		out->append(&id);
+		out->append(type);
+		out->append(&length);
+	}
+}
+
+class MuxSession::Stream : public StreamChannel {
+	LogHandle log_;
+public:
+	MuxSession *session_;
+	uint32_t id_;
+	bool open_;
+
+	bool ready_;
+	std::list<Stream *>::iterator ready_it_;
+
+	Buffer send_buffer_;
+	size_t send_window_;
+	bool send_eos_;
+	bool sent_eos_;
+
+	Buffer receive_buffer_;
+	size_t receive_window_;
+	size_t receive_credit_;
+	bool receive_eos_;
+
+	Cancellation<Stream> read_cancel_;
+	size_t read_amount_;
+	BufferEventCallback *read_callback_;
+	Action *read_action_;
+
+	Cancellation<Stream> write_cancel_;
+	EventCallback *write_callback_;
+	Action *write_action_;
+
+	Stream(MuxSession *session, uint32_t id)
+	: log_(session->log_ + "/stream"),
+	  session_(session),
+	  id_(id),
+	  open_(true),
+	  ready_(false),
+	  ready_it_(),
+	  send_buffer_(),
+	  send_window_(MUX_SESSION_WINDOW),
+	  send_eos_(false),
+	  sent_eos_(false),
+	  receive_buffer_(),
+	  receive_window_(MUX_SESSION_WINDOW),
+	  receive_credit_(0),
+	  receive_eos_(false),
+	  read_cancel_(&session->mtx_, this, &Stream::read_cancel),
+	  read_amount_(0),
+	  read_callback_(NULL),
+	  read_action_(NULL),
+	  write_cancel_(&session->mtx_, this, &Stream::write_cancel),
+	  write_callback_(NULL),
+	  write_action_(NULL)
+	{ }
+
+	~Stream()
+	{
+		ASSERT(log_, !ready_);
+		ASSERT_NULL(log_, read_callback_);
+		ASSERT_NULL(log_, read_action_);
+		ASSERT_NULL(log_, write_callback_);
+		ASSERT_NULL(log_, write_action_);
+	}
+
+	Action *close(SimpleCallback *cb)
+	{
+		ScopedLock _(&session_->mtx_);
+		ASSERT_NULL(log_, read_callback_);
+		ASSERT_NULL(log_, read_action_);
+		ASSERT_NULL(log_, write_callback_);
+		ASSERT_NULL(log_, write_action_);
+
+		session_->close_stream(this);
+
+		return (cb->schedule());
+	}
+
+	Action *read(size_t amount, BufferEventCallback *cb)
+	{
+		ScopedLock _(&session_->mtx_);
+		ASSERT_NULL(log_, read_callback_);
+		ASSERT_NULL(log_, read_action_);
+
+		read_amount_ = amount;
+		read_callback_ = cb;
+		deliver();
+
+		return (&read_cancel_);
+	}
+
+	/*
+	 * A write completes once all of its data has been sent, so that a
+	 * stream which has used up its window stops its writer.
+	 */
+	Action *write(Buffer *buf, EventCallback *cb)
+	{
+		ScopedLock _(&session_->mtx_);
+		ASSERT_NULL(log_, write_callback_);
+		ASSERT_NULL(log_, write_action_);
+		ASSERT(log_, !send_eos_);
+
+		write_callback_ = cb;
+		if (open_) {
+			buf->moveout(&send_buffer_);
+			session_->schedule(this);
+		}
+		if (send_buffer_.empty())
+			flushed();
+
+		return (&write_cancel_);
+	}
+
+	/*
+	 * Like a write, shutting down completes once the end of the stream
+	 * has been sent, so that closing the stream afterwards does not
+	 * reset it.
+	 */
+	Action *shutdown(bool, bool shut_write, EventCallback *cb)
+	{
+		ScopedLock _(&session_->mtx_);
+		ASSERT_NULL(log_, write_callback_);
+		ASSERT_NULL(log_, write_action_);
+
+		if (!shut_write || sent_eos_) {
+			cb->param(Event::Done);
+			return (cb->schedule());
+		}
+
+		write_callback_ = cb;
+		if (!send_eos_) {
+			send_eos_ = true;
+			if (open_)
+				session_->schedule(this);
+		}
+		if (!open_)
+			flushed();
+
+		return (&write_cancel_);
+	}
+
+	/*
+	 * Whether there is anything for this stream in the next batch.
+	 */
+	bool sendable(void) const
+	{
+		if (!open_)
+			return (false);
+		if (!send_buffer_.empty())
+			return (send_window_ != 0);
+		return (send_eos_ && !sent_eos_);
+	}
+
+	/*
+	 * Hand the reader whatever has been received, or tell it that there
+	 * will be nothing more.
+	 */
+	void deliver(void)
+	{
+		if (read_callback_ == NULL)
+			return;
+
+		if (!receive_buffer_.empty()) {
+			size_t amount = receive_buffer_.length();
+			if (read_amount_ != 0 && read_amount_ < amount)
+				amount = read_amount_;
+
+			Buffer buf;
+			receive_buffer_.moveout(&buf, amount);
+			session_->credit(this, amount);
+
+			read_callback_->param(Event::Done, buf);
+		} else if (receive_eos_) {
+			read_callback_->param(Event::EOS, Buffer());
+		} else if (!open_) {
+			read_callback_->param(Event(Event::Error, ECONNRESET), Buffer());
+		} else {
+			return;
+		}
+		read_action_ = read_callback_->schedule();
+		read_callback_ = NULL;
+	}
+
+	void flushed(void)
+	{
+		if (write_callback_ == NULL)
+			return;
+
+		if (open_)
+			write_callback_->param(Event::Done);
+		else
+			write_callback_->param(Event(Event::Error, ECONNRESET));
+		write_action_ = write_callback_->schedule();
+		write_callback_ = NULL;
+	}
+
+	/*
+	 * The far side has closed the stream, or the session has ended.
+	 */
+	void reset(void)
+	{
+		ASSERT(log_, !ready_);
+		open_ = false;
+		send_buffer_.clear();
+
+		deliver();
+		flushed();
+	}
+
+private:
+	void read_cancel(void)
+	{
+		if (read_callback_ != NULL) {
+			read_callback_ = NULL;
+		} else {
+			ASSERT_NON_NULL(log_, read_action_);
+			read_action_->cancel();
+			read_action_ = NULL;
+		}
+	}
+
+	void write_cancel(void)
+	{
+		if (write_callback_ != NULL) {
+			/*
+			 * Whatever has not been sent yet is dropped.
+			 */
+			write_callback_ = NULL;
+			send_buffer_.clear();
+			if (ready_)
+				session_->unschedule(this);
+		} else {
+			ASSERT_NON_NULL(log_, write_action_);
+			write_action_->cancel();
+			write_action_ = NULL;
+		}
+	}
+};
+
+MuxSession::MuxSession(const LogHandle& log, bool client, Pipe *send_pipe, Pipe *receive_pipe)
+: log_(log + "/mux"),
+  mtx_("MuxSession"),
+  send_pipe_(send_pipe),
+  receive_pipe_(receive_pipe),
+  channel_(NULL),
+  running_(false),
+  ended_(false),
+  next_id_(client ? 1 : 2),
+  last_peer_id_(0),
+  streams_(),
+  stream_count_(0),
+  ready_(),
+  accept_queue_(),
+  control_(),
+  receive_buffer_(),
+  start_cancel_(&mtx_, this, &MuxSession::start_cancel),
+  start_callback_(NULL),
+  start_action_(NULL),
+  accept_cancel_(&mtx_, this, &MuxSession::accept_cancel),
+  accept_callback_(NULL),
+  accept_action_(NULL),
+  close_cancel_(&mtx_, this, &MuxSession::close_cancel),
+  close_callback_(NULL),
+  close_action_(NULL),
+  send_input_complete_(NULL, &mtx_, this, &MuxSession::send_input_complete),
+  send_input_action_(NULL),
+  send_output_complete_(NULL, &mtx_, this, &MuxSession::send_output_complete),
+  send_output_action_(NULL),
+  send_write_complete_(NULL, &mtx_, this, &MuxSession::send_write_complete),
+  send_write_action_(NULL),
+  receive_read_complete_(NULL, &mtx_, this, &MuxSession::receive_read_complete),
+  receive_read_eos_(false),
+  receive_read_action_(NULL),
+  receive_input_complete_(NULL, &mtx_, this, &MuxSession::receive_input_complete),
+  receive_input_action_(NULL),
+  receive_output_complete_(NULL, &mtx_, this, &MuxSession::receive_output_complete),
+  receive_output_action_(NULL)
+{ }
+
+MuxSession::~MuxSession()
+{
+	ASSERT(log_, !running_);
+	ASSERT_ZERO(log_, stream_count_);
+	ASSERT(log_, streams_.empty());
+	ASSERT_NULL(log_, start_callback_);
+	ASSERT_NULL(log_, start_action_);
+	ASSERT_NULL(log_, accept_callback_);
+	ASSERT_NULL(log_, accept_action_);
+	ASSERT_NULL(log_, close_callback_);
+	ASSERT_NULL(log_, close_action_);
+}
+
+/*
+ * Start exchanging frames over the channel, calling back when the session
+ * ends: with EOS if the far side ended it, or with an error.  Streams may
+ * be opened before the session is started.
+ */
+Action *
+MuxSession::start(StreamChannel *channel, EventCallback *cb)
+{
+	ScopedLock _(&mtx_);
+	ASSERT(log_, !running_ && !ended_);
+	ASSERT_NULL(log_, start_callback_);
+
+	channel_ = channel;
+	running_ = true;
+	start_callback_ = cb;
+
+	receive_read_action_ = channel_->read(0, &receive_read_complete_);
+	if (receive_pipe_ != NULL)
+		receive_output_action_ = receive_pipe_->output(&receive_output_complete_);
+	if (send_pipe_ != NULL)
+		send_output_action_ = send_pipe_->output(&send_output_complete_);
+	send();
+
+	return (&start_cancel_);
+}
+
+/*
+ * Open a stream, to which data may be written at once.  Returns NULL if
+ * the session has already ended.
+ */
+StreamChannel *
+MuxSession::open(void)
+{
+	ScopedLock _(&mtx_);
+	if (ended_)
+		return (NULL);
+
+	uint32_t id = next_id_;
+	next_id_ += 2;
+
+	Stream *stream = new Stream(this, id);
+	streams_[id] = stream;
+	stream_count_++;
+
+	mux_frame(&control_, id, MuxFrameOpen, 0);
+	send();
+
+	return (stream);
+}
+
+/*
+ * Accept a stream opened by the far side, or EOS once the session has
+ * ended.
+ */
+Action *
+MuxSession::accept(StreamChannelEventCallback *cb)
+{
+	ScopedLock _(&mtx_);
+	ASSERT_NULL(log_, accept_callback_);
+	ASSERT_NULL(log_, accept_action_);
+
+	if (!accept_queue_.empty()) {
+		Stream *stream = accept_queue_.front();
+		accept_queue_.pop_front();
+
+		cb->param(Event::Done, stream);
+	} else if (ended_) {
+		cb->param(Event::EOS, NULL);
+	} else {
+		accept_callback_ = cb;
+		return (&accept_cancel_);
+	}
+	accept_action_ = cb->schedule();
+
+	return (&accept_cancel_);
+}
+
+/*
+ * End the session, if it has not ended already, and call back once every
+ * stream has been closed, after which the session may be deleted.
+ */
+Action *
+MuxSession::close(SimpleCallback *cb)
+{
+	ScopedLock _(&mtx_);
+	ASSERT_NULL(log_, close_callback_);
+	ASSERT_NULL(log_, close_action_);
+	ASSERT_NULL(log_, start_callback_);
+
+	close_callback_ = cb;
+	halt();
+	closed();
+
+	return (&close_cancel_);
+}
+
+void
+MuxSession::start_cancel(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	if (start_callback_ != NULL) {
+		start_callback_ = NULL;
+		halt();
+	} else {
+		ASSERT_NON_NULL(log_, start_action_);
+		start_action_->cancel();
+		start_action_ = NULL;
+	}
+}
+
+void
+MuxSession::accept_cancel(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	if (accept_callback_ != NULL) {
+		accept_callback_ = NULL;
+	} else {
+		ASSERT_NON_NULL(log_, accept_action_);
+		accept_action_->cancel();
+		accept_action_ = NULL;
+	}
+}
+
+void
+MuxSession::close_cancel(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	if (close_callback_ != NULL) {
+		close_callback_ = NULL;
+	} else {
+		ASSERT_NON_NULL(log_, close_action_);
+		close_action_->cancel();
+		close_action_ = NULL;
+	}
+}
+
+/*
+ * Hand the next batch of frames to the channel, unless the last one is
+ * still on its way; limiting ourselves to one batch at a time is what
+ * lets streams take turns rather than queueing everything at once.
+ */
+void
+MuxSession::send(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	if (!running_)
+		return;
+	if (send_input_action_ != NULL || send_write_action_ != NULL)
+		return;
+
+	Buffer frames;
+	if (!send_batch(&frames))
+		return;
+
+	if (send_pipe_ != NULL)
+		send_input_action_ = send_pipe_->input(&frames, &send_input_complete_);
+	else
+		send_write_action_ = channel_->write(&frames, &send_write_complete_);
+}
+
+bool
+MuxSession::send_batch(Buffer *frames)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	if (!control_.empty())
+		control_.moveout(frames);
+
+	while (!ready_.empty() && frames->length() < MUX_SESSION_BATCH) {
+		Stream *stream = ready_.front();
+		ready_.pop_front();
+		stream->ready_ = false;
+
+		if (!stream->send_buffer_.empty()) {
+			size_t amount = stream->send_buffer_.length();
+			if (amount > stream->send_window_)
+				amount = stream->send_window_;
+			if (amount > MUX_SESSION_QUANTUM)
+				amount = MUX_SESSION_QUANTUM;
+
+			mux_frame(frames, stream->id_, MuxFrameData, amount);
+			stream->send_buffer_.moveout(frames, amount);
+			stream->send_window_ -= amount;
+
+			if (stream->send_buffer_.empty())
+				stream->flushed();
+		}
+
+		if (stream->send_buffer_.empty() && stream->send_eos_ &&
+		    !stream->sent_eos_) {
+			mux_frame(frames, stream->id_, MuxFrameEOS, 0);
+			stream->sent_eos_ = true;
+			stream->flushed();
+		}
+
+		if (stream->sendable()) {
+			stream->ready_ = true;
+			stream->ready_it_ = ready_.insert(ready_.end(), stream);
+		}
+	}
+
+	return (!frames->empty());
+}
+
+void
+MuxSession::send_input_complete(Event e)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	send_input_action_->cancel();
+	send_input_action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	default:
+		complete(e);
+		return;
+	}
+
+	send();
+}
+
+void
+MuxSession::send_output_complete(Event e, Buffer buf)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	send_output_action_->cancel();
+	send_output_action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+	case Event::EOS:
+		break;
+	default:
+		complete(e);
+		return;
+	}
+
+	if (buf.empty()) {
+		ASSERT(log_, e.type_ == Event::EOS);
+		complete(Event::EOS);
+		return;
+	}
+
+	send_write_action_ = channel_->write(&buf, &send_write_complete_);
+}
+
+void
+MuxSession::send_write_complete(Event e)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	send_write_action_->cancel();
+	send_write_action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	default:
+		complete(e);
+		return;
+	}
+
+	if (send_pipe_ != NULL)
+		send_output_action_ = send_pipe_->output(&send_output_complete_);
+	send();
+}
+
+void
+MuxSession::receive_read_complete(Event e, Buffer buf)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	receive_read_action_->cancel();
+	receive_read_action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+	case Event::EOS:
+		break;
+	default:
+		complete(e);
+		return;
+	}
+
+	if (buf.empty()) {
+		ASSERT(log_, e.type_ == Event::EOS);
+		receive_read_eos_ = true;
+	}
+
+	if (receive_pipe_ != NULL) {
+		receive_input_action_ = receive_pipe_->input(&buf, &receive_input_complete_);
+		return;
+	}
+
+	if (receive_read_eos_) {
+		complete(Event::EOS);
+		return;
+	}
+
+	if (!receive(&buf)) {
+		complete(Event::Error);
+		return;
+	}
+
+	receive_read_action_ = channel_->read(0, &receive_read_complete_);
+}
+
+void
+MuxSession::receive_input_complete(Event e)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	receive_input_action_->cancel();
+	receive_input_action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	default:
+		complete(e);
+		return;
+	}
+
+	if (!receive_read_eos_)
+		receive_read_action_ = channel_->read(0, &receive_read_complete_);
+}
+
+void
+MuxSession::receive_output_complete(Event e, Buffer buf)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	receive_output_action_->cancel();
+	receive_output_action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+	case Event::EOS:
+		break;
+	default:
+		complete(e);
+		return;
+	}
+
+	if (buf.empty()) {
+		ASSERT(log_, e.type_ == Event::EOS);
+		complete(Event::EOS);
+		return;
+	}
+
+	if (!receive(&buf)) {
+		complete(Event::Error);
+		return;
+	}
+
+	receive_output_action_ = receive_pipe_->output(&receive_output_complete_);
+}
+
+/*
+ * Process every complete frame received.
+ */
+bool
+MuxSession::receive(Buffer *buf)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	buf->moveout(&receive_buffer_);
+
+	while (receive_buffer_.length() >= MuxFrameHeaderLength) {
+		uint32_t id;
+		uint8_t type;
+		uint32_t length;
+
+		receive_buffer_.extract(&id);
+		id = BigEndian::decode(id);
+		receive_buffer_.extract(&type, sizeof id);
+		receive_buffer_.extract(&length, sizeof id + sizeof type);
+		length = BigEndian::decode(length);
+
+		if (length > MUX_SESSION_WINDOW) {
+			ERROR(log_) << "Frame too long: " << length;
+			return (false);
+		}
+
+		if (receive_buffer_.length() < MuxFrameHeaderLength + length)
+			break;
+		receive_buffer_.skip(MuxFrameHeaderLength);
+
+		Buffer payload;
+		if (length != 0)
+			receive_buffer_.moveout(&payload, length);
+
+		if (!receive_frame(id, type, &payload))
+			return (false);
+	}
+
+	return (true);
+}
+
+bool
+MuxSession::receive_frame(uint32_t id, uint8_t type, Buffer *payload)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+
+	Stream *stream;
+	std::map<uint32_t, Stream *>::iterator it = streams_.find(id);
+	if (it != streams_.end())
+		stream = it->second;
+	else
+		stream = NULL;
+
+	/*
+	 * Frames for a stream which is not open are for one which we have
+	 * closed, and are of no further interest.
+	 */
+	switch (type) {
+	case MuxFrameOpen:
+		if (!payload->empty() || stream != NULL || id <= last_peer_id_ ||
+		    (id & 1) == (next_id_ & 1)) {
+			ERROR(log_) << "Invalid stream opened: " << id;
+			return (false);
+		}
+		last_peer_id_ = id;
+
+		stream = new Stream(this, id);
+		streams_[id] = stream;
+		stream_count_++;
+
+		if (accept_callback_ != NULL) {
+			accept_callback_->param(Event::Done, stream);
+			accept_action_ = accept_callback_->schedule();
+			accept_callback_ = NULL;
+		} else {
+			accept_queue_.push_back(stream);
+		}
+		return (true);
+	case MuxFrameData:
+		if (stream == NULL)
+			return (true);
+		if (payload->length() > stream->receive_window_ ||
+		    stream->receive_eos_) {
+			ERROR(log_) << "Data exceeds window for stream: " << id;
+			return (false);
+		}
+		stream->receive_window_ -= payload->length();
+		payload->moveout(&stream->receive_buffer_);
+		stream->deliver();
+		return (true);
+	case MuxFrameWindow: {
+		if (payload->length() != sizeof (uint32_t)) {
+			ERROR(log_) << "Invalid window update for stream: " << id;
+			return (false);
+		}
+		if (stream == NULL)
+			return (true);
+
+		uint32_t increment;
+		payload->extract(&increment);
+		increment = BigEndian::decode(increment);
+
+		if (stream->send_window_ + increment > MUX_SESSION_WINDOW) {
+			ERROR(log_) << "Window too large for stream: " << id;
+			return (false);
+		}
+		stream->send_window_ += increment;
+		schedule(stream);
+		return (true);
+	}
+	case MuxFrameEOS:
+		if (!payload->empty()) {
+			ERROR(log_) << "Invalid EOS for stream: " << id;
+			return (false);
+		}
+		if (stream == NULL)
+			return (true);
+		stream->receive_eos_ = true;
+		stream->deliver();
+		return (true);
+	case MuxFrameClose:
+		if (!payload->empty()) {
+			ERROR(log_) << "Invalid close for stream: " << id;
+			return (false);
+		}
+		if (stream == NULL)
+			return (true);
+		streams_.erase(it);
+		unschedule(stream);
+		stream->reset();
+		return (true);
+	default:
+		ERROR(log_) << "Unknown frame type: " << (unsigned)type;
+		return (false);
+	}
+}
+
+void
+MuxSession::schedule(Stream *stream)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	if (stream->ready_ || !stream->sendable())
+		return;
+
+	stream->ready_ = true;
+	stream->ready_it_ = ready_.insert(ready_.end(), stream);
+
+	send();
+}
+
+void
+MuxSession::unschedule(Stream *stream)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	if (!stream->ready_)
+		return;
+
+	ready_.erase(stream->ready_it_);
+	stream->ready_ = false;
+}
+
+/*
+ * The reader has consumed data from a stream; once it has consumed half
+ * of the window, let the far side send that much more.
+ */
+void
+MuxSession::credit(Stream *stream, size_t amount)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	stream->receive_credit_ += amount;
+
+	if (!stream->open_ || stream->receive_eos_)
+		return;
+	if (stream->receive_credit_ < MUX_SESSION_WINDOW / 2)
+		return;
+
+	uint32_t increment = BigEndian::encode((uint32_t)stream->receive_credit_);
+	mux_frame(&control_, stream->id_, MuxFrameWindow, sizeof increment);
+	control_.append(&increment);
+
+	stream->receive_window_ += stream->receive_credit_;
+	stream->receive_credit_ = 0;
+
+	send();
+}
+
+void
+MuxSession::close_stream(Stream *stream)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	if (stream->open_) {
+		streams_.erase(stream->id_);
+		unschedule(stream);
+		stream->open_ = false;
+
+		mux_frame(&control_, stream->id_, MuxFrameClose, 0);
+		send();
+	}
+
+	ASSERT_NON_ZERO(log_, stream_count_);
+	stream_count_--;
+	closed();
+}
+
+/*
+ * Stop exchanging frames and reset every stream.  Streams which were
+ * never accepted are ours to close.
+ */
+void
+MuxSession::halt(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	ended_ = true;
+
+	if (running_) {
+		running_ = false;
+
+		if (send_input_action_ != NULL) {
+			send_input_action_->cancel();
+			send_input_action_ = NULL;
+		}
+		if (send_output_action_ != NULL) {
+			send_output_action_->cancel();
+			send_output_action_ = NULL;
+		}
+		if (send_write_action_ != NULL) {
+			send_write_action_->cancel();
+			send_write_action_ = NULL;
+		}
+		if (receive_read_action_ != NULL) {
+			receive_read_action_->cancel();
+			receive_read_action_ = NULL;
+		}
+		if (receive_input_action_ != NULL) {
+			receive_input_action_->cancel();
+			receive_input_action_ = NULL;
+		}
+		if (receive_output_action_ != NULL) {
+			receive_output_action_->cancel();
+			receive_output_action_ = NULL;
+		}
+	}
+
+	control_.clear();
+	receive_buffer_.clear();
+
+	std::map<uint32_t, Stream *>::iterator it;
+	while ((it = streams_.begin()) != streams_.end()) {
+		Stream *stream = it->second;
+		streams_.erase(it);
+
+		unschedule(stream);
+		stream->reset();
+	}
+	ASSERT(log_, ready_.empty());
+
+	while (!accept_queue_.empty()) {
+		Stream *stream = accept_queue_.front();
+		accept_queue_.pop_front();
+
+		delete stream;
+
+		ASSERT_NON_ZERO(log_, stream_count_);
+		stream_count_--;
+	}
+
+	if (accept_callback_ != NULL) {
+		accept_callback_->param(Event::EOS, NULL);
+		accept_action_ = accept_callback_->schedule();
+		accept_callback_ = NULL;
+	}
+}
+
+void
+MuxSession::complete(Event e)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	ASSERT(log_, running_);
+
+	switch (e.type_) {
+	case Event::EOS:
+		DEBUG(log_) << "Session ended by peer.";
+		break;
+	default:
+		INFO(log_) << "Session failed: " << e;
+		break;
+	}
+
+	halt();
+
+	ASSERT_NON_NULL(log_, start_callback_);
+	start_callback_->param(e);
+	start_action_ = start_callback_->schedule();
+	start_callback_ = NULL;
+}
+
+void
+MuxSession::closed(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	if (close_callback_ == NULL || stream_count_ != 0)
+		return;
+
+	close_action_ = close_callback_->schedule();
+	close_callback_ = NULL;
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	IO_MUX_MUX_SESSION_H
+#define	IO_MUX_MUX_SESSION_H
+
+#include <list>
+#include <map>
+
+#include <common/thread/mutex.h>
+
+#include <event/cancellation.h>
+#include <event/typed_pair_callback.h>
+
+#include <io/channel.h>
+
+class Pipe;
+
+typedef	class TypedPairCallback<Event, StreamChannel *> StreamChannelEventCallback;
+
+#define	MUX_SESSION_WINDOW	262144	/* Bytes a stream may have in flight.  */
+#define	MUX_SESSION_QUANTUM	16384	/* Bytes a stream may send per turn.  */
+#define	MUX_SESSION_BATCH	65536	/* Bytes handed to the channel at once.  */
+
+/*
+ * A MuxSession carries many streams over one StreamChannel, so that they
+ * share its connection setup and congestion window.  Frames may be passed
+ * through a pair of Pipes on their way to and from the channel, such as a
+ * codec, which then sees a single stream of data from every stream and
+ * keeps its state across all of them.
+ *
+ * Each stream may send MUX_SESSION_WINDOW bytes more than its reader on
+ * the far side has consumed, so that a slow reader holds up only its own
+ * stream, and streams with data to send take turns of MUX_SESSION_QUANTUM
+ * bytes, so that bulk transfers do not starve interactive ones.
+ *
+ * Streams are opened by one side and accepted by the other.  They must be
+ * closed by whoever has them, and the session must not be deleted until
+ * they have been.  When the session ends, its streams are reset, after
+ * which writes fail, as do reads once any data already received is gone.
+ */
+class MuxSession {
+	class Stream;
+	friend class Stream;
+
+	LogHandle log_;
+	Mutex mtx_;
+	Pipe *send_pipe_;
+	Pipe *receive_pipe_;
+	StreamChannel *channel_;
+	bool running_;
+	bool ended_;
+
+	uint32_t next_id_;
+	uint32_t last_peer_id_;
+	std::map<uint32_t, Stream *> streams_;
+	unsigned stream_count_;
+	std::list<Stream *> ready_;
+	std::list<Stream *> accept_queue_;
+	Buffer control_;
+	Buffer receive_buffer_;
+
+	Cancellation<MuxSession> start_cancel_;
+	EventCallback *start_callback_;
+	Action *start_action_;
+
+	Cancellation<MuxSession> accept_cancel_;
+	StreamChannelEventCallback *accept_callback_;
+	Action *accept_action_;
+
+	Cancellation<MuxSession> close_cancel_;
+	SimpleCallback *close_callback_;
+	Action *close_action_;
+
+	EventCallback::Method<MuxSession> send_input_complete_;
+	Action *send_input_action_;
+	BufferEventCallback::Method<MuxSession> send_output_complete_;
+	Action *send_output_action_;
+	EventCallback::Method<MuxSession> send_write_complete_;
+	Action *send_write_action_;
+
+	BufferEventCallback::Method<MuxSession> receive_read_complete_;
+	bool receive_read_eos_;
+	Action *receive_read_action_;
+	EventCallback::Method<MuxSession> receive_input_complete_;
+	Action *receive_input_action_;
+	BufferEventCallback::Method<MuxSession> receive_output_complete_;
+	Action *receive_output_action_;
+public:
+	MuxSession(const LogHandle&, bool, Pipe *, Pipe *);
+	~MuxSession();
+
+	Action *start(StreamChannel *, EventCallback *);
+
+	StreamChannel *open(void);
+	Action *accept(StreamChannelEventCallback *);
+
+	Action *close(SimpleCallback *);
+
+private:
+	void start_cancel(void);
+	void accept_cancel(void);
+	void close_cancel(void);
+
+	void send(void);
+	bool send_batch(Buffer *);
+	void send_input_complete(Event);
+	void send_output_complete(Event, Buffer);
+	void send_write_complete(Event);
+
+	void receive_read_complete(Event, Buffer);
+	void receive_input_complete(Event);
+	void receive_output_complete(Event, Buffer);
+	bool receive(Buffer *);
+	bool receive_frame(uint32_t, uint8_t, Buffer *);
+
+	void schedule(Stream *);
+	void unschedule(Stream *);
+	void credit(Stream *, size_t);
+	void close_stream(Stream *);
+
+	void halt(void);
+	void complete(Event);
+	void closed(void);
+};
+
+#endif /* !IO_MUX_MUX_SESSION_H */
@@ -0,0 +1,577 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <list>
+
+#include <common/test.h>
+#include <common/thread/atomic.h>
+#include <common/thread/mutex.h>
+
+#include <event/event_callback.h>
+#include <event/event_main.h>
+#include <event/event_system.h>
+
+#include <io/mux/mux_session.h>
+
+#include <io/net/tcp_client.h>
+#include <io/net/tcp_server.h>
+
+#include <io/pipe/splice.h>
+
+#include <io/socket/socket.h>
+
+/*
+ * Each flow writes more than a window's worth of data to a stream, which
+ * the server echoes back.  One flow does not start to read until all of
+ * the others have finished, and so must not hold them up.
+ */
+#define	MUX_TEST_FLOWS		8
+#define	MUX_TEST_DATA		(1024 * 1024)
+
+static uint8_t data[MUX_TEST_DATA];
+
+static Atomic<unsigned> sides_running;
+
+static void
+side_finished(void)
+{
+	if (sides_running.subtract(1) == 1)
+		EventSystem::instance()->stop();
+}
+
+class Echo {
+	LogHandle log_;
+	Mutex mtx_;
+	TestGroup& group_;
+	StreamChannel *stream_;
+	Splice *splice_;
+	Action *action_;
+	EventCallback::Method<Echo> splice_complete_;
+	SimpleCallback::Method<Echo> close_complete_;
+public:
+	Echo(TestGroup& group, StreamChannel *stream)
+	: log_("/echo"),
+	  mtx_("Echo"),
+	  group_(group),
+	  stream_(stream),
+	  splice_(NULL),
+	  action_(NULL),
+	  splice_complete_(NULL, &mtx_, this, &Echo::splice_complete),
+	  close_complete_(NULL, &mtx_, this, &Echo::close_complete)
+	{
+		ScopedLock _(&mtx_);
+		splice_ = new Splice(log_, stream_, NULL, stream_);
+		action_ = splice_->start(&splice_complete_);
+	}
+
+	~Echo()
+	{
+		Test _(group_, "Echoed stream closed");
+		if (stream_ == NULL && action_ == NULL)
+			_.pass();
+	}
+
+private:
+	void splice_complete(Event e)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		delete splice_;
+		splice_ = NULL;
+
+		{
+			Test _(group_, "Echo reached end of stream");
+			if (e.type_ == Event::EOS)
+				_.pass();
+		}
+
+		action_ = stream_->close(&close_complete_);
+	}
+
+	void close_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		delete stream_;
+		stream_ = NULL;
+	}
+};
+
+class Server {
+	LogHandle log_;
+	Mutex mtx_;
+	TestGroup group_;
+	TCPServer *server_;
+	Socket *client_;
+	MuxSession *session_;
+	std::list<Echo *> echoes_;
+	Action *action_;
+	Action *session_action_;
+	Action *accept_action_;
+	SocketEventCallback::Method<Server> client_complete_;
+	EventCallback::Method<Server> session_complete_;
+	StreamChannelEventCallback::Method<Server> accept_complete_;
+	SimpleCallback::Method<Server> server_close_complete_;
+	SimpleCallback::Method<Server> session_close_complete_;
+	SimpleCallback::Method<Server> close_complete_;
+public:
+	Server(void)
+	: log_("/server"),
+	  mtx_("Server"),
+	  group_("/test/io/mux/session/server", "MuxSession server"),
+	  server_(NULL),
+	  client_(NULL),
+	  session_(NULL),
+	  echoes_(),
+	  action_(NULL),
+	  session_action_(NULL),
+	  accept_action_(NULL),
+	  client_complete_(NULL, &mtx_, this, &Server::client_complete),
+	  session_complete_(NULL, &mtx_, this, &Server::session_complete),
+	  accept_complete_(NULL, &mtx_, this, &Server::accept_complete),
+	  server_close_complete_(NULL, &mtx_, this, &Server::server_close_complete),
+	  session_close_complete_(NULL, &mtx_, this, &Server::session_close_complete),
+	  close_complete_(NULL, &mtx_, this, &Server::close_complete)
+	{
+		ScopedLock _(&mtx_);
+		server_ = TCPServer::listen(SocketImplOS, SocketAddressFamilyIP, "[localhost]:0");
+		ASSERT_NON_NULL(log_, server_);
+		action_ = server_->accept(&client_complete_);
+	}
+
+	~Server()
+	{
+		while (!echoes_.empty()) {
+			delete echoes_.front();
+			echoes_.pop_front();
+		}
+
+		Test _(group_, "Server finished");
+		if (server_ == NULL && client_ == NULL && session_ == NULL)
+			_.pass();
+	}
+
+	std::string getsockname(void) const
+	{
+		return (server_->getsockname());
+	}
+
+private:
+	void client_complete(Event e, Socket *socket)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		{
+			Test _(group_, "Session connection accepted");
+			if (e.type_ != Event::Done)
+				return;
+			_.pass();
+		}
+		client_ = socket;
+
+		session_ = new MuxSession(log_, false, NULL, NULL);
+		session_action_ = session_->start(client_, &session_complete_);
+		accept_action_ = session_->accept(&accept_complete_);
+
+		action_ = server_->close(&server_close_complete_);
+	}
+
+	void server_close_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		delete server_;
+		server_ = NULL;
+	}
+
+	void accept_complete(Event e, StreamChannel *stream)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		accept_action_->cancel();
+		accept_action_ = NULL;
+
+		switch (e.type_) {
+		case Event::Done:
+			echoes_.push_back(new Echo(group_, stream));
+			accept_action_ = session_->accept(&accept_complete_);
+			break;
+		case Event::EOS:
+			break;
+		default:
+			HALT(log_) << "Unexpected event: " << e;
+		}
+	}
+
+	void session_complete(Event e)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		session_action_->cancel();
+		session_action_ = NULL;
+
+		{
+			Test _(group_, "Session ended by client");
+			if (e.type_ == Event::EOS)
+				_.pass();
+		}
+		{
+			Test _(group_, "Accepted every stream");
+			if (echoes_.size() == MUX_TEST_FLOWS)
+				_.pass();
+		}
+
+		session_action_ = session_->close(&session_close_complete_);
+	}
+
+	void session_close_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		session_action_->cancel();
+		session_action_ = NULL;
+
+		if (accept_action_ != NULL) {
+			accept_action_->cancel();
+			accept_action_ = NULL;
+		}
+
+		delete session_;
+		session_ = NULL;
+
+		action_ = client_->close(&close_complete_);
+	}
+
+	void close_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		delete client_;
+		client_ = NULL;
+
+		side_finished();
+	}
+};
+
+class Client;
+
+class Flow {
+	LogHandle log_;
+	Mutex mtx_;
+	TestGroup& group_;
+	Client *client_;
+	StreamChannel *stream_;
+	Buffer received_;
+	bool write_done_;
+	bool read_done_;
+	Action *write_action_;
+	Action *read_action_;
+	EventCallback::Method<Flow> write_complete_;
+	EventCallback::Method<Flow> shutdown_complete_;
+	BufferEventCallback::Method<Flow> read_complete_;
+	SimpleCallback::Method<Flow> close_complete_;
+public:
+	Flow(TestGroup& group, Client *client, MuxSession *session, bool slow)
+	: log_("/flow"),
+	  mtx_("Flow"),
+	  group_(group),
+	  client_(client),
+	  stream_(NULL),
+	  received_(),
+	  write_done_(false),
+	  read_done_(false),
+	  write_action_(NULL),
+	  read_action_(NULL),
+	  write_complete_(NULL, &mtx_, this, &Flow::write_complete),
+	  shutdown_complete_(NULL, &mtx_, this, &Flow::shutdown_complete),
+	  read_complete_(NULL, &mtx_, this, &Flow::read_complete),
+	  close_complete_(NULL, &mtx_, this, &Flow::close_complete)
+	{
+		ScopedLock _(&mtx_);
+		stream_ = session->open();
+		ASSERT_NON_NULL(log_, stream_);
+
+		Buffer buf(data, sizeof data);
+		write_action_ = stream_->write(&buf, &write_complete_);
+		if (!slow)
+			read_action_ = stream_->read(0, &read_complete_);
+	}
+
+	~Flow()
+	{
+		Test _(group_, "Flow finished");
+		if (stream_ == NULL && write_action_ == NULL && read_action_ == NULL)
+			_.pass();
+	}
+
+	void start_reading(void)
+	{
+		ScopedLock _(&mtx_);
+		Test t(group_, "Slow flow has received nothing yet");
+		if (received_.empty())
+			t.pass();
+		read_action_ = stream_->read(0, &read_complete_);
+	}
+
+private:
+	void write_complete(Event e)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		write_action_->cancel();
+		write_action_ = NULL;
+
+		{
+			Test _(group_, "Write complete");
+			if (e.type_ == Event::Done)
+				_.pass();
+		}
+
+		write_action_ = stream_->shutdown(false, true, &shutdown_complete_);
+	}
+
+	void shutdown_complete(Event e)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		write_action_->cancel();
+		write_action_ = NULL;
+
+		{
+			Test _(group_, "Shutdown complete");
+			if (e.type_ == Event::Done)
+				_.pass();
+		}
+
+		write_done_ = true;
+		finish();
+	}
+
+	void read_complete(Event e, Buffer buf)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		read_action_->cancel();
+		read_action_ = NULL;
+
+		switch (e.type_) {
+		case Event::Done:
+			received_.append(buf);
+			read_action_ = stream_->read(0, &read_complete_);
+			return;
+		case Event::EOS:
+			received_.append(buf);
+			break;
+		default:
+			HALT(log_) << "Unexpected event: " << e;
+			return;
+		}
+
+		{
+			Test _(group_, "Echoed length correct");
+			if (received_.length() == sizeof data)
+				_.pass();
+		}
+		{
+			Test _(group_, "Echoed data correct");
+			if (received_.equal(data, sizeof data))
+				_.pass();
+		}
+
+		read_done_ = true;
+		finish();
+	}
+
+	void finish(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		if (!write_done_ || !read_done_)
+			return;
+
+		read_action_ = stream_->close(&close_complete_);
+	}
+
+	void close_complete(void);
+};
+
+class Client {
+	LogHandle log_;
+	Mutex mtx_;
+	TestGroup group_;
+	Socket *socket_;
+	MuxSession *session_;
+	Flow *flows_[MUX_TEST_FLOWS];
+	Atomic<unsigned> flows_running_;
+	Action *action_;
+	Action *session_action_;
+	SocketEventCallback::Method<Client> connect_complete_;
+	EventCallback::Method<Client> session_complete_;
+	SimpleCallback::Method<Client> session_close_complete_;
+	SimpleCallback::Method<Client> close_complete_;
+public:
+	Client(const std::string& remote)
+	: log_("/client"),
+	  mtx_("Client"),
+	  group_("/test/io/mux/session/client", "MuxSession client"),
+	  socket_(NULL),
+	  session_(NULL),
+	  flows_(),
+	  flows_running_(MUX_TEST_FLOWS),
+	  action_(NULL),
+	  session_action_(NULL),
+	  connect_complete_(NULL, &mtx_, this, &Client::connect_complete),
+	  session_complete_(NULL, &mtx_, this, &Client::session_complete),
+	  session_close_complete_(NULL, &mtx_, this, &Client::session_close_complete),
+	  close_complete_(NULL, &mtx_, this, &Client::close_complete)
+	{
+		ScopedLock _(&mtx_);
+		/*
+		 * Streams may be opened, and written to, before the session
+		 * has a connection.
+		 */
+		session_ = new MuxSession(log_, true, NULL, NULL);
+
+		unsigned i;
+		for (i = 0; i < MUX_TEST_FLOWS; i++)
+			flows_[i] = new Flow(group_, this, session_, i == 0);
+
+		action_ = TCPClient::connect(SocketImplOS, SocketAddressFamilyIP, remote, &connect_complete_);
+	}
+
+	~Client()
+	{
+		unsigned i;
+		for (i = 0; i < MUX_TEST_FLOWS; i++)
+			delete flows_[i];
+
+		Test _(group_, "Client finished");
+		if (socket_ == NULL && session_ == NULL)
+			_.pass();
+	}
+
+	void flow_finished(void)
+	{
+		unsigned running = flows_running_.subtract(1) - 1;
+		if (running == 1) {
+			flows_[0]->start_reading();
+			return;
+		}
+		if (running != 0)
+			return;
+
+		ScopedLock _(&mtx_);
+		session_action_->cancel();
+		session_action_ = NULL;
+
+		session_action_ = session_->close(&session_close_complete_);
+	}
+
+private:
+	void connect_complete(Event e, Socket *socket)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		{
+			Test _(group_, "Session connected");
+			if (e.type_ != Event::Done)
+				return;
+			_.pass();
+		}
+		socket_ = socket;
+
+		session_action_ = session_->start(socket_, &session_complete_);
+	}
+
+	void session_complete(Event e)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		session_action_->cancel();
+		session_action_ = NULL;
+
+		HALT(log_) << "Session ended early: " << e;
+	}
+
+	void session_close_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		session_action_->cancel();
+		session_action_ = NULL;
+
+		delete session_;
+		session_ = NULL;
+
+		action_ = socket_->close(&close_complete_);
+	}
+
+	void close_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		delete socket_;
+		socket_ = NULL;
+
+		side_finished();
+	}
+};
+
+void
+Flow::close_complete(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	read_action_->cancel();
+	read_action_ = NULL;
+
+	delete stream_;
+	stream_ = NULL;
+
+	client_->flow_finished();
+}
+
+int
+main(void)
+{
+	unsigned i;
+
+	for (i = 0; i < sizeof data; i++)
+		data[i] = random() % 0xff;
+
+	sides_running.add(2);
+
+	Server *server = new Server();
+	Client *client = new Client(server->getsockname());
+
+	event_main();
+
+	delete client;
+	delete server;
+}
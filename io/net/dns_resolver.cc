@@ -0,0 +1,845 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <list>
+#include <sstream>
+
+#include <common/buffer.h>
+
+#include <event/cancellation.h>
+#include <event/event_callback.h>
+#include <event/event_system.h>
+
+#include <io/socket/socket.h>
+
+#include <io/net/dns_resolver.h>
+#include <io/net/udp_client.h>
+
+static bool dns_question(const std::string&, unsigned, Buffer *);
+static bool dns_skip_name(const uint8_t *, size_t, size_t *);
+
+/*
+ * A caller waiting for the answer to a lookup, either on a Query, or for
+ * its callback to run.
+ */
+class DNSResolver::Request {
+public:
+	DNSResolver *resolver_;
+	SocketAddressFamily family_;
+	std::string name_;
+	AddressEventCallback *callback_;
+	Action *callback_action_;
+	Query *query_;
+	Cancellation<Request> cancel_;
+
+	Request(DNSResolver *resolver, SocketAddressFamily family, const std::string& name, AddressEventCallback *cb)
+	: resolver_(resolver),
+	  family_(family),
+	  name_(name),
+	  callback_(cb),
+	  callback_action_(NULL),
+	  query_(NULL),
+	  cancel_(&resolver->mtx_, this, &Request::cancel)
+	{ }
+
+	~Request()
+	{
+		ASSERT_NULL(resolver_->log_, callback_action_);
+		ASSERT_NULL(resolver_->log_, query_);
+	}
+
+	void cancel(void);
+	void complete(QueryType, Event, const std::vector<std::string>&);
+};
+
+/*
+ * A single question, asked of each nameserver in turn until one of them
+ * answers it.  Each Query has its own socket, and so its own source port.
+ */
+class DNSResolver::Query {
+public:
+	LogHandle log_;
+	DNSResolver *resolver_;
+	std::string name_;
+	QueryType type_;
+	std::list<Request *> requests_;
+	Buffer question_;
+	uint16_t id_;
+	unsigned nameserver_;
+	unsigned attempt_;
+	int error_;
+	bool done_;
+	Socket *socket_;
+	SocketEventCallback::Method<Query> connect_complete_;
+	Action *connect_action_;
+	EventCallback::Method<Query> write_complete_;
+	Action *write_action_;
+	BufferEventCallback::Method<Query> read_complete_;
+	Action *read_action_;
+	SimpleCallback::Method<Query> timeout_complete_;
+	Action *timeout_action_;
+	SimpleCallback::Method<Query> close_complete_;
+	Action *close_action_;
+
+	Query(DNSResolver *resolver, const std::string& name, QueryType type)
+	: log_("/dns/resolver/query"),
+	  resolver_(resolver),
+	  name_(name),
+	  type_(type),
+	  requests_(),
+	  question_(),
+	  id_(random()),
+	  nameserver_(0),
+	  attempt_(0),
+	  error_(ETIMEDOUT),
+	  done_(false),
+	  socket_(NULL),
+	  connect_complete_(NULL, &resolver->mtx_, this, &Query::connect_complete),
+	  connect_action_(NULL),
+	  write_complete_(NULL, &resolver->mtx_, this, &Query::write_complete),
+	  write_action_(NULL),
+	  read_complete_(NULL, &resolver->mtx_, this, &Query::read_complete),
+	  read_action_(NULL),
+	  timeout_complete_(NULL, &resolver->mtx_, this, &Query::timeout_complete),
+	  timeout_action_(NULL),
+	  close_complete_(NULL, &resolver->mtx_, this, &Query::close_complete),
+	  close_action_(NULL)
+	{
+		if (!dns_question(name_, type_, &question_))
+			NOTREACHED(log_);
+	}
+
+	~Query()
+	{
+		ASSERT(log_, requests_.empty());
+		ASSERT_NULL(log_, socket_);
+		ASSERT_NULL(log_, connect_action_);
+		ASSERT_NULL(log_, write_action_);
+		ASSERT_NULL(log_, read_action_);
+		ASSERT_NULL(log_, timeout_action_);
+		ASSERT_NULL(log_, close_action_);
+	}
+
+	void start(void);
+	void send(void);
+	bool answer(const Buffer&);
+	void next(void);
+	void stop(void);
+	void finish(void);
+
+	void connect_complete(Event, Socket *);
+	void write_complete(Event);
+	void read_complete(Event, Buffer);
+	void timeout_complete(void);
+	void close_complete(void);
+};
+
+DNSResolver::DNSResolver(void)
+: log_("/dns/resolver"),
+  mtx_("DNSResolver"),
+  nameservers_(),
+  hosts_(),
+  cache_(),
+  queries_()
+{ }
+
+DNSResolver::~DNSResolver()
+{
+	ASSERT(log_, queries_.empty());
+}
+
+void
+DNSResolver::nameserver(const std::string& name)
+{
+	ScopedLock _(&mtx_);
+	nameservers_.push_back(name);
+}
+
+/*
+ * Load names from a file in the format of hosts(5).
+ */
+bool
+DNSResolver::hosts(const std::string& path)
+{
+	std::ifstream file(path.c_str());
+	if (!file.is_open())
+		return (false);
+
+	ScopedLock _(&mtx_);
+	std::string line;
+	while (std::getline(file, line)) {
+		std::string::size_type pos = line.find('#');
+		if (pos != std::string::npos)
+			line.erase(pos);
+
+		std::istringstream is(line);
+		std::string address;
+		if (!(is >> address) || !numeric(address))
+			continue;
+
+		std::string name;
+		while (is >> name) {
+			std::string::iterator it;
+			for (it = name.begin(); it != name.end(); ++it)
+				*it = tolower(*it);
+			hosts_[name].push_back(address);
+		}
+	}
+
+	return (true);
+}
+
+Action *
+DNSResolver::resolve(SocketAddressFamily family, const std::string& name, AddressEventCallback *cb)
+{
+	std::vector<std::string> addresses;
+	QueryType type;
+
+	switch (family) {
+	case SocketAddressFamilyIP:
+	case SocketAddressFamilyIPv4:
+		type = QueryTypeA;
+		break;
+	case SocketAddressFamilyIPv6:
+		type = QueryTypeAAAA;
+		break;
+	default:
+		ERROR(log_) << "Unsupported address family.";
+		cb->param(Event(Event::Error, EINVAL), addresses);
+		return (cb->schedule());
+	}
+
+	if (numeric(name)) {
+		bool inet6 = name.find(':') != std::string::npos;
+		if ((family == SocketAddressFamilyIPv4 && inet6) ||
+		    (family == SocketAddressFamilyIPv6 && !inet6)) {
+			cb->param(Event(Event::Error, EINVAL), addresses);
+			return (cb->schedule());
+		}
+		addresses.push_back(name);
+		cb->param(Event::Done, addresses);
+		return (cb->schedule());
+	}
+
+	std::string host(name);
+	if (!host.empty() && host[host.length() - 1] == '.')
+		host.erase(host.length() - 1);
+	std::string::iterator it;
+	for (it = host.begin(); it != host.end(); ++it)
+		*it = tolower(*it);
+
+	ScopedLock _(&mtx_);
+	std::map<std::string, std::vector<std::string> >::const_iterator hit;
+	hit = hosts_.find(host);
+	if (hit != hosts_.end()) {
+		std::vector<std::string>::const_iterator ait;
+		for (ait = hit->second.begin(); ait != hit->second.end(); ++ait) {
+			bool inet6 = ait->find(':') != std::string::npos;
+			if ((family == SocketAddressFamilyIPv4 && inet6) ||
+			    (family == SocketAddressFamilyIPv6 && !inet6))
+				continue;
+			addresses.push_back(*ait);
+		}
+		if (!addresses.empty()) {
+			cb->param(Event::Done, addresses);
+			return (cb->schedule());
+		}
+	}
+
+	Buffer question;
+	if (!dns_question(host, type, &question)) {
+		ERROR(log_) << "Invalid name: " << name;
+		cb->param(Event(Event::Error, EINVAL), addresses);
+		return (cb->schedule());
+	}
+
+	if (nameservers_.empty()) {
+		ERROR(log_) << "No nameservers with which to look up " << name;
+		cb->param(Event(Event::Error, ENOENT), addresses);
+		return (cb->schedule());
+	}
+
+	Request *r = new Request(this, family, host, cb);
+	lookup(r, type);
+	return (&r->cancel_);
+}
+
+/*
+ * Answer a Request from the cache if we can, and otherwise have it wait
+ * on a Query, starting one if nobody else is already asking.
+ */
+void
+DNSResolver::lookup(Request *r, QueryType type)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	Key key(r->name_, type);
+
+	std::map<Key, CacheEntry>::iterator cit = cache_.find(key);
+	if (cit != cache_.end()) {
+		if (NanoTime::current_time() < cit->second.expire_) {
+			r->complete(type, cit->second.event_, cit->second.addresses_);
+			return;
+		}
+		cache_.erase(cit);
+	}
+
+	Query *q;
+	std::map<Key, Query *>::iterator qit = queries_.find(key);
+	if (qit != queries_.end()) {
+		q = qit->second;
+	} else {
+		q = new Query(this, r->name_, type);
+		queries_[key] = q;
+		q->start();
+	}
+	r->query_ = q;
+	q->requests_.push_back(r);
+}
+
+/*
+ * A Query has its answer.  Answers, and negative answers (ENOENT and
+ * ENODATA), are cached for their TTL; failures to get any answer at all
+ * are not.
+ */
+void
+DNSResolver::complete(Query *q, Event e, const std::vector<std::string>& addresses, unsigned ttl)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	Key key(q->name_, q->type_);
+
+	std::map<Key, Query *>::iterator qit = queries_.find(key);
+	ASSERT(log_, qit != queries_.end() && qit->second == q);
+	queries_.erase(qit);
+
+	if ((e.type_ == Event::Done || e.error_ == ENOENT || e.error_ == ENODATA) &&
+	    ttl != 0) {
+		NanoTime now = NanoTime::current_time();
+
+		if (cache_.size() >= DNS_RESOLVER_CACHE_SIZE) {
+			std::map<Key, CacheEntry>::iterator cit;
+			for (cit = cache_.begin(); cit != cache_.end(); ) {
+				if (cit->second.expire_ <= now)
+					cache_.erase(cit++);
+				else
+					++cit;
+			}
+			if (cache_.size() >= DNS_RESOLVER_CACHE_SIZE)
+				cache_.erase(cache_.begin());
+		}
+
+		NanoTime expire(now), lifetime;
+		lifetime.seconds_ = std::min(ttl, (unsigned)DNS_RESOLVER_TTL_MAX);
+		expire += lifetime;
+
+		CacheEntry ce = { e, addresses, expire };
+		cache_.erase(key);
+		cache_.insert(std::map<Key, CacheEntry>::value_type(key, ce));
+	}
+
+	std::list<Request *> requests;
+	requests.swap(q->requests_);
+	while (!requests.empty()) {
+		Request *r = requests.front();
+		requests.pop_front();
+
+		r->query_ = NULL;
+		r->complete(q->type_, e, addresses);
+	}
+}
+
+bool
+DNSResolver::numeric(const std::string& host)
+{
+	struct in_addr inet;
+
+	if (inet_pton(AF_INET, host.c_str(), &inet) == 1)
+		return (true);
+	/* Only IPv6 addresses, including scoped ones, contain colons.  */
+	if (host.find(':') != std::string::npos)
+		return (true);
+	return (false);
+}
+
+/*
+ * Split a name of the form accepted by socket_address into host and
+ * service.
+ */
+bool
+DNSResolver::split(const std::string& str, std::string *host, std::string *service)
+{
+	std::string::size_type pos = str.find(']');
+	if (pos != std::string::npos) {
+		if (pos < 3 || str[0] != '[' || str[pos + 1] != ':')
+			return (false);
+		*host = str.substr(1, pos - 1);
+		*service = str.substr(pos + 2);
+	} else {
+		pos = str.find(':');
+		if (pos == std::string::npos)
+			return (false);
+		*host = str.substr(0, pos);
+		*service = str.substr(pos + 1);
+	}
+	return (true);
+}
+
+static DNSResolver *
+dns_resolver_create(void)
+{
+	DNSResolver *resolver = new DNSResolver();
+
+	unsigned nameservers = 0;
+
+	std::ifstream file("/etc/resolv.conf");
+	std::string line;
+	while (std::getline(file, line)) {
+		std::istringstream is(line);
+		std::string keyword, address;
+		if (!(is >> keyword >> address) || keyword != "nameserver")
+			continue;
+		if (!DNSResolver::numeric(address))
+			continue;
+		std::ostringstream os;
+		os << '[' << address << "]:" << DNS_RESOLVER_PORT;
+		resolver->nameserver(os.str());
+		nameservers++;
+	}
+
+	/*
+	 * As with the system resolver, with no nameservers listed we
+	 * ask the local host.
+	 */
+	if (nameservers == 0) {
+		std::ostringstream os;
+		os << "[127.0.0.1]:" << DNS_RESOLVER_PORT;
+		resolver->nameserver(os.str());
+	}
+
+	resolver->hosts("/etc/hosts");
+
+	return (resolver);
+}
+
+DNSResolver *
+DNSResolver::instance(void)
+{
+	static DNSResolver *instance = dns_resolver_create();
+
+	return (instance);
+}
+
+void
+DNSResolver::Request::cancel(void)
+{
+	ASSERT_LOCK_OWNED(resolver_->log_, &resolver_->mtx_);
+
+	if (callback_action_ != NULL) {
+		callback_action_->cancel();
+		callback_action_ = NULL;
+	} else {
+		/* Leave the Query running to fill the cache.  */
+		ASSERT_NON_NULL(resolver_->log_, query_);
+		query_->requests_.remove(this);
+		query_ = NULL;
+	}
+
+	delete this;
+}
+
+void
+DNSResolver::Request::complete(QueryType type, Event e, const std::vector<std::string>& addresses)
+{
+	ASSERT_LOCK_OWNED(resolver_->log_, &resolver_->mtx_);
+	ASSERT_NULL(resolver_->log_, query_);
+
+	/*
+	 * Where either family will do, fall back to IPv6 for names which
+	 * have no IPv4 address.
+	 */
+	if (e.type_ == Event::Error && e.error_ == ENODATA &&
+	    family_ == SocketAddressFamilyIP && type == QueryTypeA) {
+		resolver_->lookup(this, QueryTypeAAAA);
+		return;
+	}
+
+	callback_->param(e, addresses);
+	callback_action_ = callback_->schedule();
+	callback_ = NULL;
+}
+
+void
+DNSResolver::Query::start(void)
+{
+	ASSERT_LOCK_OWNED(log_, &resolver_->mtx_);
+	ASSERT(log_, nameserver_ < resolver_->nameservers_.size());
+
+	attempt_ = 0;
+	connect_action_ = UDPClient::connect(SocketImplOS, SocketAddressFamilyIP, resolver_->nameservers_[nameserver_], &connect_complete_);
+}
+
+void
+DNSResolver::Query::send(void)
+{
+	ASSERT_LOCK_OWNED(log_, &resolver_->mtx_);
+	ASSERT_NULL(log_, timeout_action_);
+
+	/*
+	 * If the last attempt is somehow still being written, there is
+	 * no sense in queueing up another behind it.
+	 */
+	if (write_action_ == NULL) {
+		uint8_t header[12] = {
+			(uint8_t)(id_ >> 8), (uint8_t)id_,
+			0x01, 0x00,	/* Query, recursion desired.  */
+			0x00, 0x01,	/* One question.  */
+			0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		};
+		Buffer query(header, sizeof header);
+		query.append(question_);
+
+		write_action_ = socket_->write(&query, &write_complete_);
+	}
+	timeout_action_ = EventSystem::instance()->timeout(DNS_RESOLVER_TIMEOUT, &timeout_complete_);
+}
+
+/*
+ * Look at a response, returning false if it is not for this Query.
+ */
+bool
+DNSResolver::Query::answer(const Buffer& buf)
+{
+	ASSERT_LOCK_OWNED(log_, &resolver_->mtx_);
+
+	size_t len = buf.length();
+	size_t qlen = question_.length();
+	if (len < 12 + qlen)
+		return (false);
+
+	std::vector<uint8_t> msg(len);
+	buf.copyout(&msg[0], len);
+
+	if (msg[0] != (uint8_t)(id_ >> 8) || msg[1] != (uint8_t)id_)
+		return (false);
+	if ((msg[2] & 0x80) == 0 || (msg[2] & 0x78) != 0)
+		return (false);
+	if (msg[4] != 0x00 || msg[5] != 0x01 || !question_.equal(&msg[12], qlen))
+		return (false);
+
+	switch (msg[3] & 0x0f) {
+	case 0:	/* No error.  */
+	case 3:	/* Name error.  */
+		break;
+	default:
+		DEBUG(log_) << "Nameserver " << resolver_->nameservers_[nameserver_] << " failed to answer for " << name_ << ": rcode " << (msg[3] & 0x0f);
+		error_ = EAGAIN;
+		next();
+		return (true);
+	}
+
+	unsigned ancount = (msg[6] << 8) | msg[7];
+	unsigned nscount = (msg[8] << 8) | msg[9];
+	size_t off = 12 + qlen;
+
+	std::vector<std::string> addresses;
+	uint32_t ttl = DNS_RESOLVER_TTL_MAX;
+	bool soa = false;
+	unsigned i;
+
+	for (i = 0; i < ancount + nscount; i++) {
+		if (!dns_skip_name(&msg[0], len, &off) || off + 10 > len)
+			break;
+
+		unsigned type = (msg[off] << 8) | msg[off + 1];
+		unsigned klass = (msg[off + 2] << 8) | msg[off + 3];
+		uint32_t rttl = (msg[off + 4] << 24) | (msg[off + 5] << 16) |
+				(msg[off + 6] << 8) | msg[off + 7];
+		size_t rdlen = (msg[off + 8] << 8) | msg[off + 9];
+		off += 10;
+		if (off + rdlen > len)
+			break;
+		/* TTLs with the high bit set are to be treated as zero.  */
+		if ((rttl & 0x80000000) != 0)
+			rttl = 0;
+
+		if (i < ancount) {
+			/* Take the lowest TTL of any CNAMEs, too.  */
+			ttl = std::min(ttl, rttl);
+
+			if (klass == 1 && type == (unsigned)type_) {
+				char str[INET6_ADDRSTRLEN];
+
+				if (type_ == QueryTypeA && rdlen == 4) {
+					inet_ntop(AF_INET, &msg[off], str, sizeof str);
+					addresses.push_back(str);
+				} else if (type_ == QueryTypeAAAA && rdlen == 16) {
+					inet_ntop(AF_INET6, &msg[off], str, sizeof str);
+					addresses.push_back(str);
+				}
+			}
+		} else if (!addresses.empty()) {
+			break;
+		} else if (klass == 1 && type == 6 && rdlen >= 22) {
+			/*
+			 * Negative answers are cached for the lesser of
+			 * the SOA's TTL and its MINIMUM field, per
+			 * RFC 2308.  Without an SOA, they are not cached.
+			 */
+			const uint8_t *minimum = &msg[off + rdlen - 4];
+			uint32_t min = (minimum[0] << 24) | (minimum[1] << 16) |
+				       (minimum[2] << 8) | minimum[3];
+			ttl = std::min(rttl, min);
+			soa = true;
+			break;
+		}
+		off += rdlen;
+	}
+
+	if (!addresses.empty()) {
+		resolver_->complete(this, Event::Done, addresses, ttl);
+	} else {
+		if (!soa)
+			ttl = 0;
+		int error = (msg[3] & 0x0f) == 3 ? ENOENT : ENODATA;
+		resolver_->complete(this, Event(Event::Error, error), addresses, ttl);
+	}
+	finish();
+	return (true);
+}
+
+/*
+ * Move on to the next nameserver, or give up.
+ */
+void
+DNSResolver::Query::next(void)
+{
+	ASSERT_LOCK_OWNED(log_, &resolver_->mtx_);
+
+	stop();
+
+	if (++nameserver_ == resolver_->nameservers_.size()) {
+		ERROR(log_) << "Could not look up " << name_ << ": " << strerror(error_);
+		resolver_->complete(this, Event(Event::Error, error_), std::vector<std::string>(), 0);
+		finish();
+		return;
+	}
+
+	if (socket_ != NULL) {
+		close_action_ = socket_->close(&close_complete_);
+		return;
+	}
+	start();
+}
+
+void
+DNSResolver::Query::stop(void)
+{
+	ASSERT_LOCK_OWNED(log_, &resolver_->mtx_);
+
+	if (timeout_action_ != NULL) {
+		timeout_action_->cancel();
+		timeout_action_ = NULL;
+	}
+	if (write_action_ != NULL) {
+		write_action_->cancel();
+		write_action_ = NULL;
+	}
+	if (read_action_ != NULL) {
+		read_action_->cancel();
+		read_action_ = NULL;
+	}
+}
+
+/*
+ * Once answered, close the socket and go away.
+ */
+void
+DNSResolver::Query::finish(void)
+{
+	ASSERT_LOCK_OWNED(log_, &resolver_->mtx_);
+
+	stop();
+	done_ = true;
+
+	if (socket_ != NULL) {
+		close_action_ = socket_->close(&close_complete_);
+		return;
+	}
+	delete this;
+}
+
+void
+DNSResolver::Query::connect_complete(Event e, Socket *socket)
+{
+	ASSERT_LOCK_OWNED(log_, &resolver_->mtx_);
+	connect_action_->cancel();
+	connect_action_ = NULL;
+
+	socket_ = socket;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	default:
+		ERROR(log_) << "Could not connect to nameserver " << resolver_->nameservers_[nameserver_] << ": " << e;
+		next();
+		return;
+	}
+
+	send();
+	read_action_ = socket_->read(0, &read_complete_);
+}
+
+void
+DNSResolver::Query::write_complete(Event e)
+{
+	ASSERT_LOCK_OWNED(log_, &resolver_->mtx_);
+	write_action_->cancel();
+	write_action_ = NULL;
+
+	/* Leave it to the timeout to try again.  */
+	if (e.type_ != Event::Done)
+		DEBUG(log_) << "Could not send query for " << name_ << ": " << e;
+}
+
+void
+DNSResolver::Query::read_complete(Event e, Buffer buf)
+{
+	ASSERT_LOCK_OWNED(log_, &resolver_->mtx_);
+	read_action_->cancel();
+	read_action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	case Event::Error:
+		/* Most likely ECONNREFUSED: nobody is listening.  */
+		DEBUG(log_) << "Nameserver " << resolver_->nameservers_[nameserver_] << " unreachable: " << e;
+		error_ = e.error_;
+		next();
+		return;
+	default:
+		/* An empty datagram.  */
+		break;
+	}
+
+	if (answer(buf))
+		return;
+	read_action_ = socket_->read(0, &read_complete_);
+}
+
+void
+DNSResolver::Query::timeout_complete(void)
+{
+	ASSERT_LOCK_OWNED(log_, &resolver_->mtx_);
+	timeout_action_->cancel();
+	timeout_action_ = NULL;
+
+	if (++attempt_ < DNS_RESOLVER_ATTEMPTS) {
+		send();
+		return;
+	}
+	error_ = ETIMEDOUT;
+	next();
+}
+
+void
+DNSResolver::Query::close_complete(void)
+{
+	ASSERT_LOCK_OWNED(log_, &resolver_->mtx_);
+	close_action_->cancel();
+	close_action_ = NULL;
+
+	delete socket_;
+	socket_ = NULL;
+
+	if (done_) {
+		delete this;
+		return;
+	}
+	start();
+}
+
+/*
+ * Build the question section for a query.
+ */
+static bool
+dns_question(const std::string& name, unsigned type, Buffer *question)
+{
+	std::string::size_type start, end;
+
+	if (name.empty() || name.length() > 253)
+		return (false);
+
+	for (start = 0; start < name.length(); start = end + 1) {
+		end = name.find('.', start);
+		if (end == std::string::npos)
+			end = name.length();
+		if (end == start || end - start > 63)
+			return (false);
+		question->append((uint8_t)(end - start));
+		question->append(name.substr(start, end - start));
+	}
+	question->append((uint8_t)0x00);
+	question->append((uint8_t)(type >> 8));
+	question->append((uint8_t)type);
+	question->append((uint8_t)0x00);	/* Class IN.  */
+	question->append((uint8_t)0x01);
+
+	return (true);
+}
+
+static bool
+dns_skip_name(const uint8_t *msg, size_t len, size_t *offp)
+{
+	size_t off = *offp;
+
+	for (;;) {
+		if (off >= len)
+			return (false);
+		uint8_t c = msg[off];
+		if (c == 0x00) {
+			*offp = off + 1;
+			return (true);
+		}
+		/* A compression pointer ends the name.  */
+		if ((c & 0xc0) == 0xc0) {
+			if (off + 2 > len)
+				return (false);
+			*offp = off + 2;
+			return (true);
+		}
+		if ((c & 0xc0) != 0)
+			return (false);
+		off += 1 + c;
+	}
+}
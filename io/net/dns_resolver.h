@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	IO_NET_DNS_RESOLVER_H
+#define	IO_NET_DNS_RESOLVER_H
+
+#include <map>
+#include <vector>
+
+#include <common/thread/mutex.h>
+#include <common/time/time.h>
+
+#include <event/event.h>
+#include <event/typed_pair_callback.h>
+
+#include <io/socket/socket_types.h>
+
+/*
+ * An asynchronous stub resolver, which sends DNS queries over UDP to the
+ * nameservers in resolv.conf(5) rather than blocking the calling thread
+ * in getaddrinfo(3).  Answers, including negative answers, are cached
+ * for as long as their TTL allows, and concurrent lookups of the same
+ * name share a single query.  A name which does not exist fails with
+ * ENOENT, and one with no addresses of the family asked for with ENODATA.
+ *
+ * Names in hosts(5) and numeric addresses are answered without a query.
+ * Search domains are not applied; names are always fully-qualified.
+ */
+
+#define	DNS_RESOLVER_PORT		53
+#define	DNS_RESOLVER_TIMEOUT		1000	/* Milliseconds per attempt.  */
+#define	DNS_RESOLVER_ATTEMPTS		2	/* Attempts per nameserver.  */
+#define	DNS_RESOLVER_TTL_MAX		86400	/* Seconds.  */
+#define	DNS_RESOLVER_CACHE_SIZE		4096
+
+typedef	class TypedPairCallback<Event, std::vector<std::string> > AddressEventCallback;
+
+class DNSResolver {
+	class Query;
+	class Request;
+
+	enum QueryType {
+		QueryTypeA = 1,
+		QueryTypeAAAA = 28,
+	};
+
+	typedef std::pair<std::string, QueryType> Key;
+
+	struct CacheEntry {
+		Event event_;
+		std::vector<std::string> addresses_;
+		NanoTime expire_;
+	};
+
+	LogHandle log_;
+	Mutex mtx_;
+	std::vector<std::string> nameservers_;
+	std::map<std::string, std::vector<std::string> > hosts_;
+	std::map<Key, CacheEntry> cache_;
+	std::map<Key, Query *> queries_;
+public:
+	DNSResolver(void);
+	~DNSResolver();
+
+	void nameserver(const std::string&);
+	bool hosts(const std::string&);
+
+	Action *resolve(SocketAddressFamily, const std::string&, AddressEventCallback *);
+
+private:
+	void lookup(Request *, QueryType);
+	void complete(Query *, Event, const std::vector<std::string>&, unsigned);
+
+public:
+	static bool numeric(const std::string&);
+	static bool split(const std::string&, std::string *, std::string *);
+
+	static DNSResolver *instance(void);
+};
+
+#endif /* !IO_NET_DNS_RESOLVER_H */
@@ -0,0 +1,300 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <common/thread/atomic.h>
+#include <common/thread/mutex.h>
+#include <common/thread/thread.h>
+#include <common/time/time.h>
+
+#include <event/event_callback.h>
+#include <event/event_main.h>
+#include <event/event_system.h>
+
+#include <io/net/tcp_server.h>
+
+#include <io/socket/simple_server.h>
+
+/*
+ * Measure how quickly a SimpleServer<TCPServer> accepts connections, or
+ * how quickly it sinks data, with some number of reactors.  LOAD_THREADS
+ * threads drive it with blocking sockets: in connect mode, each opens and
+ * closes LOAD_CONNECTIONS connections, one after another; in stream mode,
+ * each writes LOAD_STREAM_MB megabytes over one connection.
+ *
+ * Reactors may be placed on a list of CPUs, one each.  Where the CPU's
+ * performance counters can be read, the number of loads which missed in
+ * the local NUMA node is reported, as a measure of how much memory the
+ * server used was remote to the thread using it.
+ *
+ * Usage: tcp-reactor-speed1 [connect | stream] [reactors] [cpus]
+ */
+#define	LOAD_THREADS		4
+#define	LOAD_CONNECTIONS	128
+#define	LOAD_STREAM_MB		64
+
+static bool load_stream;
+static Atomic<unsigned> load_finished;
+static Atomic<unsigned> clients_finished;
+static Atomic<uintmax_t> bytes_received;
+static NanoTime *finish_time;
+
+class SinkClient {
+	LogHandle log_;
+	Mutex mtx_;
+	Socket *client_;
+	Action *action_;
+	BufferEventCallback::Method<SinkClient> read_complete_;
+	SimpleCallback::Method<SinkClient> close_complete_;
+public:
+	SinkClient(Socket *client)
+	: log_("/example/tcp/reactor/speed1/client"),
+	  mtx_("SinkClient"),
+	  client_(client),
+	  action_(NULL),
+	  read_complete_(NULL, &mtx_, this, &SinkClient::read_complete),
+	  close_complete_(NULL, &mtx_, this, &SinkClient::close_complete)
+	{
+		ScopedLock _(&mtx_);
+		action_ = client_->read(0, &read_complete_);
+	}
+
+	~SinkClient()
+	{
+		ASSERT_NULL(log_, client_);
+		ASSERT_NULL(log_, action_);
+	}
+
+private:
+	void read_complete(Event e, Buffer buf)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		switch (e.type_) {
+		case Event::Done:
+			bytes_received.add(buf.length());
+			action_ = client_->read(0, &read_complete_);
+			return;
+		case Event::EOS:
+			bytes_received.add(buf.length());
+			break;
+		default:
+			ERROR(log_) << "Unexpected event: " << e;
+			break;
+		}
+
+		action_ = client_->close(&close_complete_);
+	}
+
+	void close_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		ASSERT_NON_NULL(log_, client_);
+		delete client_;
+		client_ = NULL;
+
+		clients_finished.add(1);
+
+		EventSystem::instance()->destroy(&mtx_, this);
+	}
+};
+
+class SinkListener : public SimpleServer<TCPServer> {
+public:
+	SinkListener(void)
+	: SimpleServer<TCPServer>("/example/tcp/reactor/speed1/listener", SocketImplOS, SocketAddressFamilyIPv4, "[127.0.0.1]:0")
+	{ }
+
+	~SinkListener()
+	{ }
+
+	void client_connected(Socket *socket)
+	{
+		new SinkClient(socket);
+	}
+};
+
+class LoadThread : public Thread {
+	struct sockaddr_in sin_;
+public:
+	LoadThread(unsigned port)
+	: Thread("LoadThread"),
+	  sin_()
+	{
+		sin_.sin_family = AF_INET;
+		sin_.sin_port = htons(port);
+		sin_.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	}
+
+	~LoadThread()
+	{ }
+
+private:
+	void main(void)
+	{
+		static uint8_t data[65536];
+		unsigned i;
+
+		for (i = 0; i < (load_stream ? 1 : LOAD_CONNECTIONS); i++) {
+			int s = ::socket(AF_INET, SOCK_STREAM, 0);
+			if (s == -1)
+				HALT("/example/tcp/reactor/speed1/load") << "Could not create socket.";
+			if (::connect(s, (struct sockaddr *)&sin_, sizeof sin_) == -1)
+				HALT("/example/tcp/reactor/speed1/load") << "Could not connect.";
+
+			if (load_stream) {
+				uintmax_t resid = (uintmax_t)LOAD_STREAM_MB << 20;
+				while (resid != 0) {
+					ssize_t len = ::write(s, data, resid < sizeof data ? resid : sizeof data);
+					if (len <= 0)
+						HALT("/example/tcp/reactor/speed1/load") << "Write failed.";
+					resid -= len;
+				}
+			}
+
+			::close(s);
+		}
+
+		/*
+		 * The last thread to finish waits for the server to finish
+		 * with every connection, and then stops the event system.
+		 */
+		if (load_finished.add(1) + 1 != LOAD_THREADS)
+			return;
+		while (clients_finished.load() != LOAD_THREADS * i)
+			usleep(1000);
+		finish_time = new NanoTime(NanoTime::current_time());
+
+		EventSystem::instance()->stop();
+	}
+
+public:
+	void stop(void)
+	{ }
+};
+
+/*
+ * Count loads which missed in the local NUMA node, in this thread and any
+ * it goes on to create.  Returns -1 if the counter is not available.
+ */
+static int
+remote_counter_open(void)
+{
+#if defined(__linux__)
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.size = sizeof attr;
+	attr.config = PERF_COUNT_HW_CACHE_NODE |
+		(PERF_COUNT_HW_CACHE_OP_READ << 8) |
+		(PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.inherit = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return (::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+	return (-1);
+#endif
+}
+
+int
+main(int argc, char *argv[])
+{
+	LoadThread *load[LOAD_THREADS];
+	unsigned reactors;
+	unsigned i;
+
+	load_stream = argc > 1 && strcmp(argv[1], "stream") == 0;
+	reactors = argc > 2 ? atoi(argv[2]) : 1;
+
+	/*
+	 * The counter must be opened before any threads are created.
+	 */
+	int remote_counter = remote_counter_open();
+
+	if (reactors != 1 && !EventSystem::instance()->set_reactors(reactors))
+		HALT("/example/tcp/reactor/speed1") << "Could not set number of reactors.";
+
+	if (argc > 3) {
+		Thread::CPUSet cpus;
+
+		if (!Thread::parse_cpus(argv[3], &cpus))
+			HALT("/example/tcp/reactor/speed1") << "Invalid list of CPUs.";
+		if (!EventSystem::instance()->set_reactor_cpus(cpus))
+			HALT("/example/tcp/reactor/speed1") << "Could not place reactors.";
+	}
+
+	SinkListener *listener = new SinkListener();
+
+	std::string name = listener->getsockname();
+	unsigned port = atoi(name.substr(name.rfind(':') + 1).c_str());
+
+	NanoTime start_time = NanoTime::current_time();
+
+	for (i = 0; i < LOAD_THREADS; i++) {
+		load[i] = new LoadThread(port);
+		load[i]->start();
+	}
+
+	event_main();
+
+	for (i = 0; i < LOAD_THREADS; i++) {
+		load[i]->join();
+		delete load[i];
+	}
+
+	NanoTime elapsed(*finish_time);
+	elapsed -= start_time;
+	double seconds = elapsed.seconds_ + elapsed.nanoseconds_ / 1e9;
+
+	if (load_stream)
+		INFO("/example/tcp/reactor/speed1") << reactors << " reactors: " << ((bytes_received.load() >> 20) / seconds) << " MB/s";
+	else
+		INFO("/example/tcp/reactor/speed1") << reactors << " reactors: " << (clients_finished.load() / seconds) << " connections/s";
+
+	uint64_t remote;
+	if (remote_counter == -1 || ::read(remote_counter, &remote, sizeof remote) != sizeof remote)
+		INFO("/example/tcp/reactor/speed1") << "Remote memory accesses: not available.";
+	else
+		INFO("/example/tcp/reactor/speed1") << "Remote memory accesses: " << remote;
+}
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/resource.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <common/thread/mutex.h>
+#include <common/time/time.h>
+
+#include <event/event_callback.h>
+#include <event/event_main.h>
+#include <event/event_system.h>
+
+#include <io/net/tcp_client.h>
+
+#include <io/socket/socket.h>
+
+/*
+ * Send a stream of data to a discard server as fast as it will take it,
+ * in writes of WRITE_SIZE bytes, optionally sending writes of at least
+ * a threshold size with MSG_ZEROCOPY.  Reports throughput and the CPU
+ * time the sender spent per gigabyte, which is what zero-copy sends are
+ * meant to save.
+ */
+#define	WRITE_SIZE	(1024 * 1024)
+
+class Sender {
+	LogHandle log_;
+	Mutex mtx_;
+	size_t threshold_;
+	uintmax_t resid_;
+	Buffer data_;
+	Socket *socket_;
+	Action *action_;
+	SocketEventCallback::Method<Sender> connect_complete_;
+	EventCallback::Method<Sender> write_complete_;
+	SimpleCallback::Method<Sender> close_complete_;
+public:
+	Sender(const std::string& remote, uintmax_t bytes, size_t threshold)
+	: log_("/example/tcp/zerocopy/speed1"),
+	  mtx_("Sender"),
+	  threshold_(threshold),
+	  resid_(bytes),
+	  data_(),
+	  socket_(NULL),
+	  action_(NULL),
+	  connect_complete_(NULL, &mtx_, this, &Sender::connect_complete),
+	  write_complete_(NULL, &mtx_, this, &Sender::write_complete),
+	  close_complete_(NULL, &mtx_, this, &Sender::close_complete)
+	{
+		while (data_.length() < WRITE_SIZE) {
+			uint8_t buf[BUFFER_SEGMENT_SIZE];
+			unsigned i;
+
+			for (i = 0; i < sizeof buf; i++)
+				buf[i] = random();
+			data_.append(buf, sizeof buf);
+		}
+
+		ScopedLock _(&mtx_);
+		action_ = TCPClient::connect(SocketImplOS, SocketAddressFamilyIP, remote, &connect_complete_);
+	}
+
+	~Sender()
+	{
+		ASSERT_NULL(log_, socket_);
+		ASSERT_NULL(log_, action_);
+	}
+
+private:
+	void connect_complete(Event e, Socket *socket)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		if (e.type_ != Event::Done)
+			HALT(log_) << "Could not connect: " << e;
+		socket_ = socket;
+
+		if (threshold_ != 0 && !socket_->zerocopy(threshold_))
+			HALT(log_) << "Could not enable zero-copy sends.";
+
+		schedule_write();
+	}
+
+	void write_complete(Event e)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		if (e.type_ != Event::Done)
+			HALT(log_) << "Unexpected event: " << e;
+
+		if (resid_ == 0) {
+			action_ = socket_->close(&close_complete_);
+			return;
+		}
+		schedule_write();
+	}
+
+	void close_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		delete socket_;
+		socket_ = NULL;
+
+		EventSystem::instance()->stop();
+	}
+
+	void schedule_write(void)
+	{
+		Buffer tmp(data_, std::min(resid_, (uintmax_t)data_.length()));
+		resid_ -= tmp.length();
+		action_ = socket_->write(&tmp, &write_complete_);
+	}
+};
+
+static double
+cpu_seconds(void)
+{
+	struct rusage ru;
+
+	if (::getrusage(RUSAGE_SELF, &ru) == -1)
+		HALT("/example/tcp/zerocopy/speed1") << "Could not get resource usage.";
+	return (ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+		ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: tcp-zerocopy-speed1 address megabytes [threshold]\n");
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc != 3 && argc != 4)
+		usage();
+
+	uintmax_t bytes = (uintmax_t)atoll(argv[2]) << 20;
+	size_t threshold = argc == 4 ? atoll(argv[3]) : 0;
+
+	double start_cpu = cpu_seconds();
+	NanoTime start_time = NanoTime::current_time();
+
+	Sender *sender = new Sender(argv[1], bytes, threshold);
+
+	event_main();
+
+	NanoTime elapsed = NanoTime::current_time();
+	elapsed -= start_time;
+	double seconds = elapsed.seconds_ + elapsed.nanoseconds_ / 1e9;
+	double cpu = cpu_seconds() - start_cpu;
+
+	delete sender;
+
+	INFO("/example/tcp/zerocopy/speed1") << (threshold == 0 ? "writev" : "MSG_ZEROCOPY") << ": " << ((bytes >> 20) / seconds) << " MB/s, " << (cpu * 1000 / (bytes / 1e9)) << " ms CPU per GB";
+}
@@ -1,5 +1,6 @@
 VPATH+=	${TOPDIR}/io/net
 
+SRCS+=	dns_resolver.cc
 SRCS+=	tcp_client.cc
 SRCS+=	tcp_server.cc
 SRCS+=	udp_client.cc
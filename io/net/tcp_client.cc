@@ -41,7 +41,10 @@ TCPClient::TCPClient(SocketImpl impl, SocketAddressFamily family)
   connect_complete_(NULL, &mtx_, this, &TCPClient::connect_complete),
   connect_cancel_(&mtx_, this, &TCPClient::connect_cancel),
   connect_action_(NULL),
-  connect_callback_(NULL)
+  connect_callback_(NULL),
+  resolve_complete_(NULL, &mtx_, this, &TCPClient::resolve_complete),
+  resolve_iface_(),
+  resolve_service_()
 { }
 
 TCPClient::~TCPClient()
@@ -64,8 +67,23 @@ TCPClient::connect(const std::string& iface, const std::string& name, SocketEven
 	ASSERT_NULL(log_, connect_callback_);
 	ASSERT_NULL(log_, socket_);
 
-	socket_ = Socket::create(impl_, family_, SocketTypeStream, "tcp", name);
-	if (socket_ == NULL) {
+	/*
+	 * Look up names with the DNSResolver rather than letting the
+	 * Socket do it, so as not to block this thread on the system
+	 * resolver.
+	 */
+	std::string host;
+	if (family_ != SocketAddressFamilyUnix &&
+	    DNSResolver::split(name, &host, &resolve_service_) &&
+	    !DNSResolver::numeric(host)) {
+		resolve_iface_ = iface;
+		connect_action_ = DNSResolver::instance()->resolve(family_, host, &resolve_complete_);
+		connect_callback_ = ccb;
+
+		return (&connect_cancel_);
+	}
+
+	if (!connect_socket(iface, name)) {
 		ccb->param(Event::Error, NULL);
 		Action *a = ccb->schedule();
 
@@ -73,36 +91,33 @@ TCPClient::connect(const std::string& iface, const std::string& name, SocketEven
 
 		return (a);
 	}
+	connect_callback_ = ccb;
 
-	if (iface != "" && !socket_->bind(iface)) {
-		ccb->param(Event::Error, NULL);
-		Action *a = ccb->schedule();
+	return (&connect_cancel_);
+}
 
+bool
+TCPClient::connect_socket(const std::string& iface, const std::string& name)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+
+	socket_ = Socket::create(impl_, family_, SocketTypeStream, "tcp", name);
+	if (socket_ == NULL)
+		return (false);
+
+	if (iface != "" && !socket_->bind(iface)) {
 		/*
 		 * XXX
 		 * I think maybe just pass the Socket up to the caller
 		 * and make them close it?
-		 *
-		 * NB:
-		 * Not duplicating this to other similar code.
 		 */
-#if 0
-		/*
-		 * XXX
-		 * Need to schedule close and then delete ourselves.
-		 */
-		delete this;
-#else
 		HALT(log_) << "Socket bind failed.";
-#endif
-
-		return (a);
+		return (false);
 	}
 
 	connect_action_ = socket_->connect(name, &connect_complete_);
-	connect_callback_ = ccb;
 
-	return (&connect_cancel_);
+	return (true);
 }
 
 void
@@ -117,6 +132,12 @@ TCPClient::connect_cancel(void)
 
 	if (connect_callback_ != NULL) {
 		connect_callback_ = NULL;
+
+		/* Cancelled while resolving.  */
+		if (socket_ == NULL) {
+			EventSystem::instance()->destroy(&mtx_, this);
+			return;
+		}
 	} else {
 		/* XXX This has a race; caller could cancel after we schedule, but before callback occurs.  */
 		/* Caller consumed Socket.  */
@@ -142,6 +163,32 @@ TCPClient::connect_complete(Event e)
 	connect_callback_ = NULL;
 }
 
+void
+TCPClient::resolve_complete(Event e, std::vector<std::string> addresses)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	connect_action_->cancel();
+	connect_action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	default:
+		connect_callback_->param(e, NULL);
+		connect_action_ = connect_callback_->schedule();
+		connect_callback_ = NULL;
+		return;
+	}
+
+	/* Just use the first one, as socket_address would.  */
+	std::string name = "[" + addresses.front() + "]:" + resolve_service_;
+	if (!connect_socket(resolve_iface_, name)) {
+		connect_callback_->param(Event::Error, NULL);
+		connect_action_ = connect_callback_->schedule();
+		connect_callback_ = NULL;
+	}
+}
+
 void
 TCPClient::close_complete(void)
 {
@@ -32,6 +32,8 @@
 
 #include <io/socket/socket.h>
 
+#include <io/net/dns_resolver.h>
+
 class TCPClient {
 	friend class DestroyThread;
 
@@ -49,13 +51,20 @@ class TCPClient {
 	Action *connect_action_;
 	SocketEventCallback *connect_callback_;
 
+	AddressEventCallback::Method<TCPClient> resolve_complete_;
+	std::string resolve_iface_;
+	std::string resolve_service_;
+
 	TCPClient(SocketImpl, SocketAddressFamily);
 	~TCPClient();
 
 	Action *connect(const std::string&, const std::string&, SocketEventCallback *);
+	bool connect_socket(const std::string&, const std::string&);
 	void connect_cancel(void);
 	void connect_complete(Event);
 
+	void resolve_complete(Event, std::vector<std::string>);
+
 	void close_complete(void);
 
 public:
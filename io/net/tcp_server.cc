@@ -24,13 +24,14 @@
  */
 
 #include <event/event_callback.h>
+#include <event/event_system.h>
 
 #include <io/socket/socket.h>
 
 #include <io/net/tcp_server.h>
 
 TCPServer *
-TCPServer::listen(SocketImpl impl, SocketAddressFamily family, const std::string& name)
+TCPServer::listen(SocketImpl impl, SocketAddressFamily family, const std::string& name, bool reuseport)
 {
 	Socket *socket = Socket::create(impl, family, SocketTypeStream, "tcp", name);
 	if (socket == NULL) {
@@ -42,6 +43,20 @@ TCPServer::listen(SocketImpl impl, SocketAddressFamily family, const std::string
 	 * After this we could leak a socket, sigh.  Need a blocking close, or
 	 * a pool to return the socket to.
 	 */
+	if (reuseport && !socket->reuseport()) {
+		ERROR("/tcp/server") << "Socket reuseport failed, leaking socket.";
+		return (NULL);
+	}
+	/*
+	 * A listener shared between reactors asks for the connections
+	 * which arrive on the CPU of the reactor opening it, if it has
+	 * one, so that they are handled where their interrupts are.
+	 */
+	if (reuseport) {
+		int cpu = EventSystem::instance()->reactor_cpu(EventSystem::instance()->reactor());
+		if (cpu != -1)
+			socket->incoming_cpu(cpu);
+	}
 	if (!socket->bind(name)) {
 		ERROR("/tcp/server") << "Socket bind failed, leaking socket.";
 		return (NULL);
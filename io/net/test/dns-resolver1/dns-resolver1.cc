@@ -0,0 +1,478 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <map>
+
+#include <common/test.h>
+#include <common/thread/mutex.h>
+
+#include <event/event_callback.h>
+#include <event/event_main.h>
+#include <event/event_system.h>
+
+#include <io/net/dns_resolver.h>
+
+/*
+ * A stub nameserver which knows a handful of names, and counts how many
+ * times it is asked about each of them.
+ */
+class StubServer {
+	LogHandle log_;
+	Mutex mtx_;
+	int fd_;
+	std::string name_;
+	std::map<std::string, unsigned> queries_;
+	EventCallback::Method<StubServer> poll_complete_;
+	Action *poll_action_;
+public:
+	StubServer(void)
+	: log_("/stub/server"),
+	  mtx_("StubServer"),
+	  fd_(-1),
+	  name_(),
+	  queries_(),
+	  poll_complete_(NULL, &mtx_, this, &StubServer::poll_complete),
+	  poll_action_(NULL)
+	{
+		struct sockaddr_in sin;
+		socklen_t sinlen;
+
+		fd_ = ::socket(AF_INET, SOCK_DGRAM, 0);
+		ASSERT(log_, fd_ != -1);
+
+		memset(&sin, 0, sizeof sin);
+		sin.sin_family = AF_INET;
+		sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (::bind(fd_, (struct sockaddr *)&sin, sizeof sin) == -1)
+			HALT(log_) << "Could not bind: " << strerror(errno);
+		sinlen = sizeof sin;
+		if (::getsockname(fd_, (struct sockaddr *)&sin, &sinlen) == -1)
+			HALT(log_) << "Could not get socket name: " << strerror(errno);
+
+		std::ostringstream os;
+		os << "[127.0.0.1]:" << ntohs(sin.sin_port);
+		name_ = os.str();
+
+		ScopedLock _(&mtx_);
+		poll_action_ = EventSystem::instance()->poll(EventPoll::Readable, fd_, &poll_complete_);
+	}
+
+	~StubServer()
+	{
+		ScopedLock _(&mtx_);
+		if (poll_action_ != NULL) {
+			poll_action_->cancel();
+			poll_action_ = NULL;
+		}
+		::close(fd_);
+	}
+
+	const std::string& name(void) const
+	{
+		return (name_);
+	}
+
+	unsigned queries(const std::string& name)
+	{
+		ScopedLock _(&mtx_);
+		return (queries_[name]);
+	}
+
+private:
+	void poll_complete(Event e)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		poll_action_->cancel();
+		poll_action_ = NULL;
+
+		ASSERT(log_, e.type_ == Event::Done);
+
+		uint8_t msg[512];
+		struct sockaddr_in sin;
+		socklen_t sinlen = sizeof sin;
+		ssize_t len = ::recvfrom(fd_, msg, sizeof msg, 0, (struct sockaddr *)&sin, &sinlen);
+		if (len > 12)
+			query(msg, len, &sin, sinlen);
+
+		poll_action_ = EventSystem::instance()->poll(EventPoll::Readable, fd_, &poll_complete_);
+	}
+
+	void query(uint8_t *msg, size_t len, const struct sockaddr_in *sin, socklen_t sinlen)
+	{
+		std::string name;
+		size_t off = 12;
+
+		while (off < len && msg[off] != 0) {
+			if (!name.empty())
+				name += ".";
+			name += std::string((const char *)&msg[off + 1], msg[off]);
+			off += 1 + msg[off];
+		}
+		off++;
+		if (off + 4 > len)
+			return;
+		unsigned type = (msg[off] << 8) | msg[off + 1];
+		off += 4;
+
+		std::ostringstream key;
+		key << name << '/' << type;
+		unsigned count = ++queries_[key.str()];
+
+		/* Make the first query for this name go unanswered.  */
+		if (name == "slow.example" && count == 1)
+			return;
+
+		uint8_t rcode = 0;
+		Buffer answers, authority;
+		unsigned ancount = 0, nscount = 0;
+
+		if (name == "a.example" && type == 1) {
+			record(&answers, 1, 1, 192, 0, 2, 1);
+			record(&answers, 1, 1, 192, 0, 2, 2);
+			ancount = 2;
+		} else if ((name == "slow.example" || name == "cancel.example") && type == 1) {
+			record(&answers, 1, 60, 192, 0, 2, 3);
+			ancount = 1;
+		} else if (name == "v6.example" && type == 28) {
+			uint8_t rr[] = {
+				0xc0, 0x0c, 0x00, 0x1c, 0x00, 0x01,
+				0x00, 0x00, 0x00, 0x3c, 0x00, 0x10,
+				0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0,
+				0, 0, 0, 0, 0, 0, 0, 0x01,
+			};
+			answers.append(rr, sizeof rr);
+			ancount = 1;
+		} else {
+			if (name != "v6.example")
+				rcode = 3;
+			/* An SOA with a TTL of 60 and a minimum of 30.  */
+			uint8_t rr[] = {
+				0xc0, 0x0c, 0x00, 0x06, 0x00, 0x01,
+				0x00, 0x00, 0x00, 0x3c, 0x00, 0x16,
+				0x00, 0x00,
+				0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x0e, 0x10,
+				0x00, 0x00, 0x02, 0x58, 0x00, 0x01, 0x51, 0x80,
+				0x00, 0x00, 0x00, 0x1e,
+			};
+			authority.append(rr, sizeof rr);
+			nscount = 1;
+		}
+
+		msg[2] = 0x81;
+		msg[3] = 0x80 | rcode;
+		msg[6] = 0;
+		msg[7] = ancount;
+		msg[8] = 0;
+		msg[9] = nscount;
+		msg[10] = 0;
+		msg[11] = 0;
+
+		Buffer response(msg, off);
+		response.append(answers);
+		response.append(authority);
+
+		uint8_t out[512];
+		size_t outlen = response.length();
+		response.copyout(out, outlen);
+		::sendto(fd_, out, outlen, 0, (const struct sockaddr *)sin, sinlen);
+	}
+
+	static void record(Buffer *buf, unsigned type, uint8_t ttl, uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+	{
+		uint8_t rr[] = {
+			0xc0, 0x0c, 0x00, (uint8_t)type, 0x00, 0x01,
+			0x00, 0x00, 0x00, ttl, 0x00, 0x04,
+			a, b, c, d,
+		};
+		buf->append(rr, sizeof rr);
+	}
+};
+
+class Driver {
+	LogHandle log_;
+	Mutex mtx_;
+	TestGroup group_;
+	StubServer *server_;
+	DNSResolver resolver_;
+	unsigned step_;
+	unsigned outstanding_;
+	Event event_[4];
+	std::vector<std::string> addresses_[4];
+	AddressEventCallback::Method<Driver> resolve0_complete_;
+	AddressEventCallback::Method<Driver> resolve1_complete_;
+	AddressEventCallback::Method<Driver> resolve2_complete_;
+	AddressEventCallback::Method<Driver> resolve3_complete_;
+	Action *action_[4];
+	SimpleCallback::Method<Driver> timeout_complete_;
+	Action *timeout_action_;
+public:
+	Driver(StubServer *server)
+	: log_("/driver"),
+	  mtx_("Driver"),
+	  group_("/test/net/dns/resolver", "DNSResolver"),
+	  server_(server),
+	  resolver_(),
+	  step_(0),
+	  outstanding_(0),
+	  resolve0_complete_(NULL, &mtx_, this, &Driver::resolve0_complete),
+	  resolve1_complete_(NULL, &mtx_, this, &Driver::resolve1_complete),
+	  resolve2_complete_(NULL, &mtx_, this, &Driver::resolve2_complete),
+	  resolve3_complete_(NULL, &mtx_, this, &Driver::resolve3_complete),
+	  timeout_complete_(NULL, &mtx_, this, &Driver::timeout_complete),
+	  timeout_action_(NULL)
+	{
+		unsigned i;
+
+		for (i = 0; i < 4; i++)
+			action_[i] = NULL;
+
+		resolver_.nameserver(server_->name());
+
+		ScopedLock _(&mtx_);
+		step();
+	}
+
+	~Driver()
+	{
+		unsigned i;
+
+		{
+			Test _(group_, "Ran all steps");
+			if (step_ == 10)
+				_.pass();
+		}
+		{
+			Test _(group_, "No pending action");
+			bool pending = timeout_action_ != NULL;
+			for (i = 0; i < 4; i++)
+				if (action_[i] != NULL)
+					pending = true;
+			if (!pending)
+				_.pass();
+		}
+	}
+
+private:
+	void resolve(unsigned i, SocketAddressFamily family, const std::string& name)
+	{
+		AddressEventCallback *cb[4] = {
+			&resolve0_complete_,
+			&resolve1_complete_,
+			&resolve2_complete_,
+			&resolve3_complete_,
+		};
+
+		ASSERT_NULL(log_, action_[i]);
+		action_[i] = resolver_.resolve(family, name, cb[i]);
+		outstanding_++;
+	}
+
+	void resolve0_complete(Event e, std::vector<std::string> addresses)
+	{
+		resolve_complete(0, e, addresses);
+	}
+
+	void resolve1_complete(Event e, std::vector<std::string> addresses)
+	{
+		resolve_complete(1, e, addresses);
+	}
+
+	void resolve2_complete(Event e, std::vector<std::string> addresses)
+	{
+		resolve_complete(2, e, addresses);
+	}
+
+	void resolve3_complete(Event e, std::vector<std::string> addresses)
+	{
+		resolve_complete(3, e, addresses);
+	}
+
+	void resolve_complete(unsigned i, Event e, const std::vector<std::string>& addresses)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_[i]->cancel();
+		action_[i] = NULL;
+
+		event_[i] = e;
+		addresses_[i] = addresses;
+
+		if (--outstanding_ == 0)
+			step();
+	}
+
+	void timeout_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		timeout_action_->cancel();
+		timeout_action_ = NULL;
+
+		step();
+	}
+
+	bool answered(unsigned i, const std::string& address)
+	{
+		if (event_[i].type_ != Event::Done)
+			return (false);
+		return (!addresses_[i].empty() && addresses_[i][0] == address);
+	}
+
+	bool failed(unsigned i, int error)
+	{
+		return (event_[i].type_ == Event::Error && event_[i].error_ == error);
+	}
+
+	void step(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+
+		switch (step_++) {
+		case 0:
+			resolve(0, SocketAddressFamilyIPv4, "a.example");
+			resolve(1, SocketAddressFamilyIPv4, "A.Example.");
+			resolve(2, SocketAddressFamilyIP, "a.example");
+			break;
+		case 1:
+			{
+				Test _(group_, "Concurrent lookups answered");
+				if (answered(0, "192.0.2.1") && answered(1, "192.0.2.1") &&
+				    answered(2, "192.0.2.1") && addresses_[0].size() == 2)
+					_.pass();
+			}
+			{
+				Test _(group_, "Concurrent lookups share one query");
+				if (server_->queries("a.example/1") == 1)
+					_.pass();
+			}
+			resolve(0, SocketAddressFamilyIPv4, "a.example");
+			break;
+		case 2:
+			{
+				Test _(group_, "Answer served from cache");
+				if (answered(0, "192.0.2.1") && server_->queries("a.example/1") == 1)
+					_.pass();
+			}
+			resolve(0, SocketAddressFamilyIPv4, "missing.example");
+			resolve(1, SocketAddressFamilyIPv4, "missing.example");
+			break;
+		case 3:
+			{
+				Test _(group_, "Name error returned");
+				if (failed(0, ENOENT) && failed(1, ENOENT))
+					_.pass();
+			}
+			resolve(0, SocketAddressFamilyIPv4, "missing.example");
+			break;
+		case 4:
+			{
+				Test _(group_, "Name error served from cache");
+				if (failed(0, ENOENT) && server_->queries("missing.example/1") == 1)
+					_.pass();
+			}
+			resolve(0, SocketAddressFamilyIP, "v6.example");
+			resolve(1, SocketAddressFamilyIPv6, "v6.example");
+			resolve(2, SocketAddressFamilyIPv4, "192.0.2.9");
+			resolve(3, SocketAddressFamilyIP, "missing.example");
+			break;
+		case 5:
+			{
+				Test _(group_, "IPv6 used when there is no IPv4 address");
+				if (answered(0, "2001:db8::1") && answered(1, "2001:db8::1"))
+					_.pass();
+			}
+			{
+				Test _(group_, "Each record type queried once");
+				if (server_->queries("v6.example/1") == 1 &&
+				    server_->queries("v6.example/28") == 1)
+					_.pass();
+			}
+			{
+				Test _(group_, "No IPv6 fallback for a name which does not exist");
+				if (failed(3, ENOENT) && server_->queries("missing.example/28") == 0)
+					_.pass();
+			}
+			{
+				Test _(group_, "Numeric address answered without a query");
+				if (answered(2, "192.0.2.9") && server_->queries("192.0.2.9/1") == 0)
+					_.pass();
+			}
+			/* A lookup which is cancelled should still complete, and be cached.  */
+			resolve(0, SocketAddressFamilyIPv4, "cancel.example");
+			action_[0]->cancel();
+			action_[0] = NULL;
+			outstanding_--;
+			resolve(0, SocketAddressFamilyIPv4, "slow.example");
+			break;
+		case 6:
+			{
+				Test _(group_, "Unanswered query is retried");
+				if (answered(0, "192.0.2.3") && server_->queries("slow.example/1") == 2)
+					_.pass();
+			}
+			resolve(0, SocketAddressFamilyIPv4, "cancel.example");
+			break;
+		case 7:
+			{
+				Test _(group_, "Cancelled lookup filled the cache");
+				if (answered(0, "192.0.2.3") && server_->queries("cancel.example/1") == 1)
+					_.pass();
+			}
+			/* Wait out the 1 second TTL on a.example.  */
+			timeout_action_ = EventSystem::instance()->timeout(1100, &timeout_complete_);
+			break;
+		case 8:
+			resolve(0, SocketAddressFamilyIPv4, "a.example");
+			break;
+		case 9:
+			{
+				Test _(group_, "Expired answer looked up again");
+				if (answered(0, "192.0.2.1") && server_->queries("a.example/1") == 2)
+					_.pass();
+			}
+			EventSystem::instance()->stop();
+			break;
+		default:
+			NOTREACHED(log_);
+		}
+	}
+};
+
+int
+main(void)
+{
+	StubServer *server = new StubServer();
+	Driver *driver = new Driver(server);
+
+	event_main();
+
+	delete driver;
+	delete server;
+}
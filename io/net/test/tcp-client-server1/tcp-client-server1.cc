@@ -24,9 +24,12 @@
  */
 
 #include <common/test.h>
+#include <common/thread/atomic.h>
+#include <common/thread/mutex.h>
 
 #include <event/event_callback.h>
 #include <event/event_main.h>
+#include <event/event_system.h>
 
 #include <io/net/tcp_client.h>
 #include <io/net/tcp_server.h>
@@ -35,23 +38,39 @@
 
 static uint8_t data[65536];
 
+static Atomic<unsigned> listeners_running;
+
+static void
+listener_finished(void)
+{
+	if (listeners_running.subtract(1) == 1)
+		EventSystem::instance()->stop();
+}
+
 class Connector {
 	LogHandle log_;
+	Mutex mtx_;
 	TestGroup group_;
 	Socket *socket_;
 	Action *action_;
 	Test *test_;
+	SocketEventCallback::Method<Connector> connect_complete_;
+	EventCallback::Method<Connector> write_complete_;
+	SimpleCallback::Method<Connector> close_complete_;
 public:
 	Connector(const std::string& suffix, SocketAddressFamily family, const std::string& remote)
 	: log_("/connector"),
+	  mtx_("Connector"),
 	  group_("/test/net/socket/connector" + suffix, "Socket connector"),
 	  socket_(NULL),
-	  action_(NULL)
+	  action_(NULL),
+	  connect_complete_(NULL, &mtx_, this, &Connector::connect_complete),
+	  write_complete_(NULL, &mtx_, this, &Connector::write_complete),
+	  close_complete_(NULL, &mtx_, this, &Connector::close_complete)
 	{
+		ScopedLock _(&mtx_);
 		test_ = new Test(group_, "TCPClient::connect");
-		SocketEventCallback *cb =
-			callback(this, &Connector::connect_complete);
-		action_ = TCPClient::connect(SocketImplOS, family, remote, cb);
+		action_ = TCPClient::connect(SocketImplOS, family, remote, &connect_complete_);
 	}
 
 	~Connector()
@@ -87,6 +106,7 @@ public:
 
 	void close_complete(void)
 	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
 		action_->cancel();
 		action_ = NULL;
 
@@ -97,6 +117,7 @@ public:
 
 	void connect_complete(Event e, Socket *socket)
 	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
 		action_->cancel();
 		action_ = NULL;
 
@@ -118,13 +139,13 @@ public:
 		if (socket_ != NULL)
 			_.pass();
 
-		EventCallback *cb = callback(this, &Connector::write_complete);
 		Buffer buf(data, sizeof data);
-		action_ = socket_->write(&buf, cb);
+		action_ = socket_->write(&buf, &write_complete_);
 	}
 
 	void write_complete(Event e)
 	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
 		action_->cancel();
 		action_ = NULL;
 
@@ -136,40 +157,52 @@ public:
 			return;
 		}
 
-		SimpleCallback *cb = callback(this, &Connector::close_complete);
-		action_ = socket_->close(cb);
+		action_ = socket_->close(&close_complete_);
 	}
 };
 
 class Listener {
 	LogHandle log_;
+	Mutex mtx_;
 	TestGroup group_;
 	TCPServer *server_;
 	Action *action_;
 	Connector *connector_;
 	Socket *client_;
 	Buffer read_buffer_;
+	SocketEventCallback::Method<Listener> accept_complete_;
+	SimpleCallback::Method<Listener> close_complete_;
+	BufferEventCallback::Method<Listener> client_read_;
+	SimpleCallback::Method<Listener> client_close_;
 public:
 	Listener(const std::string& suffix, SocketAddressFamily family, const std::string& name)
 	: log_("/listener"),
+	  mtx_("Listener"),
 	  group_("/test/net/tcp_server/listener" + suffix, "Socket listener"),
 	  action_(NULL),
 	  connector_(NULL),
 	  client_(NULL),
-	  read_buffer_()
+	  read_buffer_(),
+	  accept_complete_(NULL, &mtx_, this, &Listener::accept_complete),
+	  close_complete_(NULL, &mtx_, this, &Listener::close_complete),
+	  client_read_(NULL, &mtx_, this, &Listener::client_read),
+	  client_close_(NULL, &mtx_, this, &Listener::client_close)
 	{
+		listeners_running.add(1);
 		{
 			Test _(group_, "TCPServer::listen");
 			server_ = TCPServer::listen(SocketImplOS, family, name);
-			if (server_ == NULL)
+			if (server_ == NULL) {
+				listener_finished();
 				return;
+			}
 			_.pass();
 		}
 
+		ScopedLock _(&mtx_);
 		connector_ = new Connector(suffix, family, server_->getsockname());
 
-		SocketEventCallback *cb = callback(this, &Listener::accept_complete);
-		action_ = server_->accept(cb);
+		action_ = server_->accept(&accept_complete_);
 	}
 
 	~Listener()
@@ -205,6 +238,7 @@ public:
 
 	void accept_complete(Event e, Socket *socket)
 	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
 		action_->cancel();
 		action_ = NULL;
 
@@ -223,12 +257,12 @@ public:
 				_.pass();
 		}
 
-		SimpleCallback *cb = callback(this, &Listener::close_complete);
-		action_ = server_->close(cb);
+		action_ = server_->close(&close_complete_);
 	}
 
 	void close_complete(void)
 	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
 		action_->cancel();
 		action_ = NULL;
 
@@ -236,28 +270,25 @@ public:
 		delete server_;
 		server_ = NULL;
 
-		EventCallback *cb = callback(this, &Listener::client_read);
-		action_ = client_->read(0, cb);
+		action_ = client_->read(0, &client_read_);
 	}
 
-	void client_read(Event e)
+	void client_read(Event e, Buffer buf)
 	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
 		action_->cancel();
 		action_ = NULL;
 
 		{
 			Test _(group_, "Socket read success");
 			switch (e.type_) {
-			case Event::Done: {
-				read_buffer_.append(e.buffer_);
+			case Event::Done:
+				read_buffer_.append(buf);
 				_.pass();
-				EventCallback *cb =
-					callback(this, &Listener::client_read);
-				action_ = client_->read(0, cb);
+				action_ = client_->read(0, &client_read_);
 				return;
-			}
 			case Event::EOS:
-				read_buffer_.append(e.buffer_);
+				read_buffer_.append(buf);
 				_.pass();
 				break;
 			default:
@@ -275,12 +306,12 @@ public:
 			if (read_buffer_.equal(data, sizeof data))
 				_.pass();
 		}
-		SimpleCallback *cb = callback(this, &Listener::client_close);
-		action_ = client_->close(cb);
+		action_ = client_->close(&client_close_);
 	}
 
 	void client_close(void)
 	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
 		action_->cancel();
 		action_ = NULL;
 
@@ -290,6 +321,8 @@ public:
 
 		delete connector_;
 		connector_ = NULL;
+
+		listener_finished();
 	}
 };
 
@@ -23,38 +23,93 @@
  * SUCH DAMAGE.
  */
 
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
+#include <common/thread/mutex.h>
+
 #include <event/event_callback.h>
 #include <event/event_main.h>
+#include <event/event_system.h>
 
 #include <io/stream_handle.h>
 #include <io/pipe/pipe.h>
 #include <io/pipe/pipe_null.h>
 #include <io/pipe/splice.h>
 
+/*
+ * Hides a StreamHandle from Splice, so that data is passed through
+ * userspace even where the kernel could move it.
+ */
+class StreamForward : public StreamChannel {
+	StreamChannel *channel_;
+public:
+	StreamForward(StreamChannel *channel)
+	: channel_(channel)
+	{ }
+
+	~StreamForward()
+	{ }
+
+	Action *close(SimpleCallback *cb)
+	{
+		return (channel_->close(cb));
+	}
+
+	Action *read(size_t amount, BufferEventCallback *cb)
+	{
+		return (channel_->read(amount, cb));
+	}
+
+	Action *write(Buffer *buf, EventCallback *cb)
+	{
+		return (channel_->write(buf, cb));
+	}
+
+	Action *shutdown(bool shut_read, bool shut_write, EventCallback *cb)
+	{
+		return (channel_->shutdown(shut_read, shut_write, cb));
+	}
+};
+
 class Catenate {
 	LogHandle log_;
+	Mutex mtx_;
 
 	StreamHandle input_;
+	SimpleCallback::Method<Catenate> input_close_complete_;
 	Action *input_action_;
 
 	StreamHandle output_;
+	SimpleCallback::Method<Catenate> output_close_complete_;
 	Action *output_action_;
 
+	StreamForward input_forward_;
+	StreamForward output_forward_;
+
 	Splice splice_;
+	EventCallback::Method<Catenate> splice_complete_;
 	Action *splice_action_;
 public:
-	Catenate(int input, Pipe *pipe, int output)
+	Catenate(int input, Pipe *pipe, int output, bool forward)
 	: log_("/catenate"),
+	  mtx_("Catenate"),
 	  input_(input),
+	  input_close_complete_(NULL, &mtx_, this, &Catenate::input_close_complete),
 	  input_action_(NULL),
 	  output_(output),
+	  output_close_complete_(NULL, &mtx_, this, &Catenate::output_close_complete),
 	  output_action_(NULL),
-	  splice_(log_, &input_, pipe, &output_)
+	  input_forward_(&input_),
+	  output_forward_(&output_),
+	  splice_(log_, forward ? (StreamChannel *)&input_forward_ : &input_, pipe,
+		  forward ? (StreamChannel *)&output_forward_ : &output_),
+	  splice_complete_(NULL, &mtx_, this, &Catenate::splice_complete),
+	  splice_action_(NULL)
 	{
-		EventCallback *cb = callback(this, &Catenate::splice_complete);
-		splice_action_ = splice_.start(cb);
+		ScopedLock _(&mtx_);
+		splice_action_ = splice_.start(&splice_complete_);
 	}
 
 	~Catenate()
@@ -66,6 +121,7 @@ public:
 
 	void splice_complete(Event e)
 	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
 		splice_action_->cancel();
 		splice_action_ = NULL;
 
@@ -79,32 +135,67 @@ public:
 
 		ASSERT(log_, e.type_ == Event::EOS);
 
-		SimpleCallback *icb = callback(this, &Catenate::close_complete, &input_);
-		input_action_ = input_.close(icb);
+		input_action_ = input_.close(&input_close_complete_);
+		output_action_ = output_.close(&output_close_complete_);
+	}
+
+	void input_close_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		input_action_->cancel();
+		input_action_ = NULL;
 
-		SimpleCallback *ocb = callback(this, &Catenate::close_complete, &output_);
-		output_action_ = output_.close(ocb);
+		if (output_action_ == NULL)
+			EventSystem::instance()->stop();
 	}
 
-	void close_complete(StreamHandle *fd)
+	void output_close_complete(void)
 	{
-		if (fd == &input_) {
-			input_action_->cancel();
-			input_action_ = NULL;
-		} else if (fd == &output_) {
-			output_action_->cancel();
-			output_action_ = NULL;
-		} else {
-			NOTREACHED(log_);
-		}
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		output_action_->cancel();
+		output_action_ = NULL;
+
+		if (input_action_ == NULL)
+			EventSystem::instance()->stop();
 	}
 };
 
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: splice-cat1 [pipe | copy | kernel]\n");
+	exit(1);
+}
+
+/*
+ * Copies standard input to standard output with a Splice, to compare the
+ * cost of the ways a Splice can move data:
+ *
+ *	pipe	Through a PipeNull (the default.)
+ *	copy	Without a Pipe, reading in to and writing out of userspace.
+ *	kernel	Without a Pipe, letting the kernel move the data if it can.
+ */
 int
-main(void)
+main(int argc, char *argv[])
 {
 	PipeNull pipe;
-	Catenate cat(STDIN_FILENO, &pipe, STDOUT_FILENO);
+	Pipe *p;
+	bool forward;
+
+	if (argc == 1 || strcmp(argv[1], "pipe") == 0) {
+		p = &pipe;
+		forward = false;
+	} else if (argc == 2 && strcmp(argv[1], "copy") == 0) {
+		p = NULL;
+		forward = true;
+	} else if (argc == 2 && strcmp(argv[1], "kernel") == 0) {
+		p = NULL;
+		forward = false;
+	} else {
+		usage();
+	}
+
+	Catenate cat(STDIN_FILENO, p, STDOUT_FILENO, forward);
 
 	event_main();
 }
@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <common/thread/mutex.h>
+
+#include <event/event_callback.h>
+
+#include <io/pipe/pipe.h>
+#include <io/pipe/pipe_chain.h>
+
+/*
+ * PipeChain is a pipe which runs data through a series of PipeProducers.
+ *
+ * Each stage has an output callback registered with it throughout, so
+ * that output which a stage produces on its own is picked up and passed on
+ * to the next stage.  Output produced while the chain is running a stage
+ * is taken directly instead, unless some of the stage's earlier output is
+ * still waiting to be delivered, in which case it goes after it.
+ */
+
+class PipeChain::Stage {
+	LogHandle log_;
+public:
+	PipeChain *chain_;
+	PipeProducer *pipe_;
+	unsigned index_;
+
+	BufferEventCallback::Method<Stage> output_complete_;
+	Action *output_action_;
+
+	Stage(PipeChain *chain, PipeProducer *pipe, unsigned index)
+	: log_(chain->log_ + "/stage"),
+	  chain_(chain),
+	  pipe_(pipe),
+	  index_(index),
+	  output_complete_(NULL, &chain->mtx_, this, &Stage::output_complete),
+	  output_action_(NULL)
+	{ }
+
+	~Stage()
+	{
+		ASSERT_NULL(log_, output_action_);
+	}
+
+	void output(void)
+	{
+		ASSERT_NULL(log_, output_action_);
+		Pipe *pipe = pipe_;
+		output_action_ = pipe->output(&output_complete_);
+	}
+
+	void cancel(void)
+	{
+		if (output_action_ != NULL) {
+			output_action_->cancel();
+			output_action_ = NULL;
+		}
+	}
+
+private:
+	void output_complete(Event e, Buffer buf)
+	{
+		output_action_->cancel();
+		output_action_ = NULL;
+
+		chain_->stage_output_complete(this, e, buf);
+	}
+};
+
+PipeChain::PipeChain(const std::vector<PipeProducer *>& pipes)
+: PipeProducer("/pipe/chain", &mtx_),
+  mtx_("PipeChain"),
+  stages_(),
+  failed_(false)
+{
+	ASSERT(log_, !pipes.empty());
+
+	ScopedLock _(&mtx_);
+	unsigned i;
+	for (i = 0; i < pipes.size(); i++) {
+		Stage *stage = new Stage(this, pipes[i], i);
+		stages_.push_back(stage);
+		stage->output();
+	}
+}
+
+PipeChain::~PipeChain()
+{
+	ScopedLock _(&mtx_);
+	while (!stages_.empty()) {
+		Stage *stage = stages_.back();
+		stages_.pop_back();
+
+		stage->cancel();
+		delete stage;
+	}
+}
+
+void
+PipeChain::consume(Buffer *buf)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	ASSERT(log_, !failed_);
+
+	run(0, buf);
+}
+
+/*
+ * Run buf through the stages starting with the given one, for as long as
+ * each stage produces output right away, and produce whatever comes out of
+ * the last stage.  An empty buf is end of stream, which each stage passes
+ * on by way of its output callback.
+ */
+void
+PipeChain::run(unsigned first, Buffer *buf)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+
+	Buffer out;
+	unsigned i;
+	for (i = first; i < stages_.size(); i++) {
+		if (!stages_[i]->pipe_->transfer(buf, &out))
+			return;
+		if (out.empty())
+			return;
+		out.moveout(buf);
+	}
+	produce(buf);
+}
+
+void
+PipeChain::stage_output_complete(Stage *stage, Event e, Buffer buf)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	if (failed_)
+		return;
+
+	switch (e.type_) {
+	case Event::Done:
+		run(stage->index_ + 1, &buf);
+		stage->output();
+		break;
+	case Event::EOS:
+		if (!buf.empty())
+			run(stage->index_ + 1, &buf);
+		if (stage->index_ + 1 == stages_.size()) {
+			produce_eos();
+		} else {
+			ASSERT(log_, buf.empty());
+			run(stage->index_ + 1, &buf);
+		}
+		break;
+	default:
+		if (e.type_ != Event::Error)
+			ERROR(log_) << "Unexpected event: " << e;
+		failed_ = true;
+		produce_error();
+		break;
+	}
+}
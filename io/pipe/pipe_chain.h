@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	IO_PIPE_PIPE_CHAIN_H
+#define	IO_PIPE_PIPE_CHAIN_H
+
+#include <vector>
+
+#include <io/pipe/pipe_producer.h>
+
+/*
+ * A PipeChain passes data through a series of PipeProducers, like a row of
+ * PipeLinks, but runs each stage's consume() directly from the previous
+ * one, in one callback, rather than splicing each pair of stages together,
+ * which costs an output callback and an input callback for every stage
+ * that a Buffer passes through.
+ *
+ * A stage which produces output other than in response to what it has just
+ * been given, such as an XCodec encoder sending an <ASK> for its decoder,
+ * still has its output delivered by callback, and that output then carries
+ * on through the rest of the chain.
+ *
+ * The stages are not owned by the chain, which must be deleted first.
+ */
+class PipeChain : public PipeProducer {
+	class Stage;
+	friend class Stage;
+
+	Mutex mtx_;
+	std::vector<Stage *> stages_;
+	bool failed_;
+public:
+	PipeChain(const std::vector<PipeProducer *>&);
+	~PipeChain();
+
+private:
+	void consume(Buffer *);
+
+	void run(unsigned, Buffer *);
+	void stage_output_complete(Stage *, Event, Buffer);
+};
+
+#endif /* !IO_PIPE_PIPE_CHAIN_H */
@@ -40,6 +40,9 @@
 PipeProducer::PipeProducer(const LogHandle& log, Lock *lock)
 : log_(log),
   lock_(lock),
+  input_cancel_(lock_, this, &PipeProducer::input_cancel),
+  input_action_(NULL),
+  input_callback_(NULL),
   output_cancel_(lock_, this, &PipeProducer::output_cancel),
   output_buffer_(),
   output_action_(NULL),
@@ -51,20 +54,30 @@ PipeProducer::PipeProducer(const LogHandle& log, Lock *lock)
 
 PipeProducer::~PipeProducer()
 {
+	ASSERT_NULL(log_, input_action_);
+	ASSERT_NULL(log_, input_callback_);
 	ASSERT_NULL(log_, output_action_);
 	ASSERT_NULL(log_, output_callback_);
 }
 
+/*
+ * Input completes once the consumer has taken what we have produced, if
+ * that is more than PIPE_PRODUCER_WATERMARK bytes, so that whoever is
+ * feeding us waits for the consumer rather than having us buffer without
+ * limit; when pipes are linked, this holds up each pipe in turn back to
+ * the first.
+ *
+ * XXX
+ * Allow consume() to only consume part of buf.
+ */
 Action *
 PipeProducer::input(Buffer *buf, EventCallback *cb)
 {
 	ScopedLock _(lock_);
+	ASSERT_NULL(log_, input_action_);
+	ASSERT_NULL(log_, input_callback_);
+
 	if (!error_) {
-		/*
-		 * XXX
-		 * Allow consume() to only consume part of buf, and to
-		 * delay further input.
-		 */
 		cork();
 		consume(buf);
 		uncork();
@@ -75,11 +88,10 @@ PipeProducer::input(Buffer *buf, EventCallback *cb)
 		buf->clear();
 	}
 
-	if (error_)
-		cb->param(Event::Error);
-	else
-		cb->param(Event::Done);
-	return (cb->schedule());
+	input_callback_ = cb;
+	input_complete();
+
+	return (&input_cancel_);
 }
 
 Action *
@@ -100,6 +112,37 @@ PipeProducer::output(BufferEventCallback *cb)
 	return (&output_cancel_);
 }
 
+void
+PipeProducer::input_cancel(void)
+{
+	ASSERT_LOCK_OWNED(log_, lock_);
+	if (input_callback_ != NULL) {
+		input_callback_ = NULL;
+	} else {
+		ASSERT_NON_NULL(log_, input_action_);
+		input_action_->cancel();
+		input_action_ = NULL;
+	}
+}
+
+void
+PipeProducer::input_complete(void)
+{
+	ASSERT_LOCK_OWNED(log_, lock_);
+	if (input_callback_ == NULL)
+		return;
+
+	if (error_) {
+		input_callback_->param(Event::Error);
+	} else {
+		if (output_buffer_.length() > PIPE_PRODUCER_WATERMARK)
+			return;
+		input_callback_->param(Event::Done);
+	}
+	input_action_ = input_callback_->schedule();
+	input_callback_ = NULL;
+}
+
 void
 PipeProducer::output_cancel(void)
 {
@@ -131,6 +174,7 @@ PipeProducer::output_do(BufferEventCallback *cb)
 	if (!output_buffer_.empty()) {
 		cb->param(Event::Done, output_buffer_);
 		output_buffer_.clear();
+		input_complete();
 		return (cb->schedule());
 	}
 
@@ -207,6 +251,7 @@ PipeProducer::produce_error(void)
 	error_ = true;
 	output_buffer_.clear();
 
+	input_complete();
 	output_produced();
 }
 
@@ -30,12 +30,17 @@
 
 class Action;
 
+#define	PIPE_PRODUCER_WATERMARK	262144	/* Bytes produced ahead of the consumer.  */
+
 class PipeProducer : public Pipe {
 protected:
 	LogHandle log_;
 
 private:
 	Lock *lock_;
+	Cancellation<PipeProducer> input_cancel_;
+	Action *input_action_;
+	EventCallback *input_callback_;
 	Cancellation<PipeProducer> output_cancel_;
 	Buffer output_buffer_;
 	Action *output_action_;
@@ -52,6 +57,8 @@ protected:
 	Action *output(BufferEventCallback *);
 
 private:
+	void input_cancel(void);
+	void input_complete(void);
 	void output_cancel(void);
 	Action *output_do(BufferEventCallback *);
 	void output_produced(void);
@@ -28,11 +28,15 @@
 #include <event/event_callback.h>
 
 #include <io/channel.h>
+#include <io/stream_handle.h>
 #include <io/pipe/pipe.h>
 #include <io/pipe/splice.h>
 
 /*
  * A Splice passes data unidirectionally between StreamChannels across a Pipe.
+ *
+ * Without a Pipe, and between two StreamHandles, the data is moved by the
+ * kernel where the system allows, never being copied in to userspace.
  */
 
 Splice::Splice(const LogHandle& log, StreamChannel *source, Pipe *pipe, StreamChannel *sink)
@@ -55,7 +59,9 @@ Splice::Splice(const LogHandle& log, StreamChannel *source, Pipe *pipe, StreamCh
   write_complete_(NULL, &mtx_, this, &Splice::write_complete),
   write_action_(NULL),
   shutdown_complete_(NULL, &mtx_, this, &Splice::shutdown_complete),
-  shutdown_action_(NULL)
+  shutdown_action_(NULL),
+  kernel_complete_(NULL, &mtx_, this, &Splice::kernel_complete),
+  kernel_action_(NULL)
 {
 	log_ = log + "/splice";
 
@@ -73,6 +79,7 @@ Splice::~Splice()
 	ASSERT_NULL(log_, output_action_);
 	ASSERT_NULL(log_, write_action_);
 	ASSERT_NULL(log_, shutdown_action_);
+	ASSERT_NULL(log_, kernel_action_);
 }
 
 Action *
@@ -82,6 +89,17 @@ Splice::start(EventCallback *cb)
 	ASSERT(log_, callback_ == NULL && callback_action_ == NULL);
 	callback_ = cb;
 
+	if (pipe_ == NULL) {
+		StreamHandle *source = dynamic_cast<StreamHandle *>(source_);
+		StreamHandle *sink = dynamic_cast<StreamHandle *>(sink_);
+
+		if (source != NULL && sink != NULL) {
+			kernel_action_ = source->splice(sink, &kernel_complete_);
+			if (kernel_action_ != NULL)
+				return (&cancel_);
+		}
+	}
+
 	read_action_ = source_->read(0, &read_complete_);
 
 	if (pipe_ != NULL)
@@ -123,6 +141,11 @@ Splice::cancel(void)
 			shutdown_action_->cancel();
 			shutdown_action_ = NULL;
 		}
+
+		if (kernel_action_ != NULL) {
+			kernel_action_->cancel();
+			kernel_action_ = NULL;
+		}
 	} else {
 		ASSERT_NON_NULL(log_, callback_action_);
 		callback_action_->cancel();
@@ -162,6 +185,11 @@ Splice::complete(Event e)
 		shutdown_action_ = NULL;
 	}
 
+	if (kernel_action_ != NULL) {
+		kernel_action_->cancel();
+		kernel_action_ = NULL;
+	}
+
 	callback_->param(e);
 	callback_action_ = callback_->schedule();
 	callback_ = NULL;
@@ -310,3 +338,25 @@ Splice::shutdown_complete(Event e)
 		output_eos_ = true;
 	}
 }
+
+void
+Splice::kernel_complete(Event e)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	kernel_action_->cancel();
+	kernel_action_ = NULL;
+
+	switch (e.type_) {
+	case Event::EOS:
+		break;
+	default:
+		DEBUG(log_) << "Unexpected event: " << e;
+		complete(e);
+		return;
+	}
+
+	read_eos_ = true;
+
+	ASSERT_NULL(log_, shutdown_action_);
+	shutdown_action_ = sink_->shutdown(false, true, &shutdown_complete_);
+}
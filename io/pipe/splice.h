@@ -59,6 +59,9 @@ class Splice {
 	EventCallback::Method<Splice> shutdown_complete_;
 	Action *shutdown_action_;
 
+	EventCallback::Method<Splice> kernel_complete_;
+	Action *kernel_action_;
+
 public:
 	Splice(const LogHandle&, StreamChannel *, Pipe *, StreamChannel *);
 	~Splice();
@@ -76,6 +79,8 @@ private:
 	void write_complete(Event);
 
 	void shutdown_complete(Event);
+
+	void kernel_complete(Event);
 };
 
 #endif /* !IO_PIPE_SPLICE_H */
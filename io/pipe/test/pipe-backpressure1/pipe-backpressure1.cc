@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <common/test.h>
+#include <common/thread/mutex.h>
+
+#include <event/cancellation.h>
+#include <event/event_callback.h>
+#include <event/event_main.h>
+#include <event/event_system.h>
+
+#include <io/channel.h>
+
+#include <io/pipe/pipe.h>
+#include <io/pipe/pipe_link.h>
+#include <io/pipe/pipe_null.h>
+#include <io/pipe/splice.h>
+
+/*
+ * Splice from a source which can always be read at once, through a chain
+ * of pipes, to a sink which takes a while to finish each write.  Without
+ * backpressure, everything read from the source piles up in the pipes, so
+ * check that what has been read but not yet written stays within a few
+ * watermarks, and that the process does not grow by anything like the
+ * amount of data which passes through it.
+ */
+#define	BACKPRESSURE_CHUNK	65536
+#define	BACKPRESSURE_DATA	(64 * 1024 * 1024)
+#define	BACKPRESSURE_DELAY	1
+#define	BACKPRESSURE_LIMIT	(8 * PIPE_PRODUCER_WATERMARK)
+#define	BACKPRESSURE_RSS_LIMIT	(4 * 1024)	/* In kilobytes.  */
+
+static uint8_t data[BACKPRESSURE_CHUNK];
+
+static size_t bytes_read;
+static size_t bytes_written;
+static size_t bytes_outstanding_max;
+
+static long
+max_rss(void)
+{
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == -1)
+		HALT("/max/rss") << "Could not get resource usage.";
+	return (usage.ru_maxrss);
+}
+
+class Source : public StreamChannel {
+	LogHandle log_;
+public:
+	Source(void)
+	: log_("/source")
+	{ }
+
+	~Source()
+	{ }
+
+	Action *close(SimpleCallback *cb)
+	{
+		return (cb->schedule());
+	}
+
+	Action *read(size_t, BufferEventCallback *cb)
+	{
+		if (bytes_read == BACKPRESSURE_DATA) {
+			cb->param(Event::EOS, Buffer());
+			return (cb->schedule());
+		}
+
+		bytes_read += sizeof data;
+		if (bytes_read - bytes_written > bytes_outstanding_max)
+			bytes_outstanding_max = bytes_read - bytes_written;
+
+		cb->param(Event::Done, Buffer(data, sizeof data));
+		return (cb->schedule());
+	}
+
+	Action *write(Buffer *, EventCallback *)
+	{
+		NOTREACHED(log_);
+	}
+
+	Action *shutdown(bool, bool, EventCallback *cb)
+	{
+		cb->param(Event::Done);
+		return (cb->schedule());
+	}
+};
+
+class Sink : public StreamChannel {
+	LogHandle log_;
+	Mutex mtx_;
+	size_t length_;
+	EventCallback *write_callback_;
+	Action *write_action_;
+	Cancellation<Sink> write_cancel_;
+	SimpleCallback::Method<Sink> delay_complete_;
+public:
+	Sink(void)
+	: log_("/sink"),
+	  mtx_("Sink"),
+	  length_(0),
+	  write_callback_(NULL),
+	  write_action_(NULL),
+	  write_cancel_(&mtx_, this, &Sink::write_cancel),
+	  delay_complete_(NULL, &mtx_, this, &Sink::delay_complete)
+	{ }
+
+	~Sink()
+	{
+		ASSERT_NULL(log_, write_action_);
+	}
+
+	Action *close(SimpleCallback *cb)
+	{
+		return (cb->schedule());
+	}
+
+	Action *read(size_t, BufferEventCallback *)
+	{
+		NOTREACHED(log_);
+	}
+
+	/*
+	 * Hold on to each write for a while before letting it complete.
+	 */
+	Action *write(Buffer *buf, EventCallback *cb)
+	{
+		ScopedLock _(&mtx_);
+		ASSERT_NULL(log_, write_action_);
+		length_ = buf->length();
+		buf->clear();
+		write_callback_ = cb;
+		write_action_ = EventSystem::instance()->timeout(BACKPRESSURE_DELAY, &delay_complete_);
+		return (&write_cancel_);
+	}
+
+	Action *shutdown(bool, bool, EventCallback *cb)
+	{
+		cb->param(Event::Done);
+		return (cb->schedule());
+	}
+
+private:
+	void delay_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		write_action_->cancel();
+		bytes_written += length_;
+		write_callback_->param(Event::Done);
+		write_action_ = write_callback_->schedule();
+		write_callback_ = NULL;
+	}
+
+	void write_cancel(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		write_action_->cancel();
+		write_action_ = NULL;
+		write_callback_ = NULL;
+	}
+};
+
+class Transfer {
+	LogHandle log_;
+	Mutex mtx_;
+	TestGroup group_;
+	Source source_;
+	Sink sink_;
+	Pipe *first_;
+	Pipe *second_;
+	Pipe *pipe_;
+	Splice *splice_;
+	Action *action_;
+	long rss_;
+	EventCallback::Method<Transfer> splice_complete_;
+public:
+	Transfer(void)
+	: log_("/transfer"),
+	  mtx_("Transfer"),
+	  group_("/test/io/pipe/backpressure", "Pipe backpressure"),
+	  source_(),
+	  sink_(),
+	  first_(new PipeNull()),
+	  second_(new PipeNull()),
+	  pipe_(new PipeLink(first_, second_)),
+	  splice_(NULL),
+	  action_(NULL),
+	  rss_(max_rss()),
+	  splice_complete_(NULL, &mtx_, this, &Transfer::splice_complete)
+	{
+		ScopedLock _(&mtx_);
+		splice_ = new Splice(log_, &source_, pipe_, &sink_);
+		action_ = splice_->start(&splice_complete_);
+	}
+
+	~Transfer()
+	{
+		delete pipe_;
+		delete second_;
+		delete first_;
+	}
+
+private:
+	void splice_complete(Event e)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		delete splice_;
+		splice_ = NULL;
+
+		{
+			Test _(group_, "Splice reached end of stream");
+			if (e.type_ == Event::EOS)
+				_.pass();
+		}
+		{
+			Test _(group_, "Sink got everything");
+			if (bytes_written == BACKPRESSURE_DATA)
+				_.pass();
+		}
+		{
+			Test _(group_, "Data held in pipes is bounded");
+			INFO(log_) << "At most " << bytes_outstanding_max << " bytes read but not yet written.";
+			if (bytes_outstanding_max <= BACKPRESSURE_LIMIT)
+				_.pass();
+		}
+		{
+			Test _(group_, "Memory use is bounded");
+			long growth = max_rss() - rss_;
+			INFO(log_) << "Grew by at most " << growth << "KB.";
+			if (growth <= BACKPRESSURE_RSS_LIMIT)
+				_.pass();
+		}
+
+		EventSystem::instance()->stop();
+	}
+};
+
+int
+main(void)
+{
+	Transfer *transfer = new Transfer();
+
+	event_main();
+
+	delete transfer;
+}
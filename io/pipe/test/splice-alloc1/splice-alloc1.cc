@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <common/test.h>
+#include <common/thread/atomic.h>
+#include <common/thread/mutex.h>
+#include <common/thread/thread.h>
+
+#include <event/event_callback.h>
+#include <event/event_main.h>
+#include <event/event_system.h>
+
+#include <io/stream_handle.h>
+#include <io/pipe/pipe.h>
+#include <io/pipe/pipe_null.h>
+#include <io/pipe/splice.h>
+
+/*
+ * Proxy data through a Splice from one socket to another, as the proxies
+ * do, in lockstep: the load thread writes a chunk in to the source and
+ * waits to read it back out of the sink before writing the next.  Once
+ * warmed up, nothing on the path should allocate memory, so count every
+ * allocation made with operator new while the load thread runs
+ * SPLICE_CYCLES cycles.  (BufferSegment data comes from malloc rather than
+ * operator new, but is only ever allocated along with a new BufferSegment.)
+ */
+#define	SPLICE_WARMUP_CYCLES	1024
+#define	SPLICE_CYCLES		4096
+#define	SPLICE_CHUNK		1024
+#define	SPLICE_IDLE_CYCLES	8
+
+static Atomic<uintmax_t> new_count;
+
+void *
+operator new(size_t size)
+{
+	new_count.add(1);
+	void *p = malloc(size == 0 ? 1 : size);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return (p);
+}
+
+class Proxy {
+	LogHandle log_;
+	Mutex mtx_;
+
+	StreamHandle source_;
+	SimpleCallback::Method<Proxy> source_close_complete_;
+	Action *source_action_;
+
+	StreamHandle sink_;
+	SimpleCallback::Method<Proxy> sink_close_complete_;
+	Action *sink_action_;
+
+	PipeNull pipe_;
+	Splice splice_;
+	EventCallback::Method<Proxy> splice_complete_;
+	Action *splice_action_;
+public:
+	Proxy(int source, int sink)
+	: log_("/test/io/pipe/splice/alloc"),
+	  mtx_("Proxy"),
+	  source_(source),
+	  source_close_complete_(NULL, &mtx_, this, &Proxy::source_close_complete),
+	  source_action_(NULL),
+	  sink_(sink),
+	  sink_close_complete_(NULL, &mtx_, this, &Proxy::sink_close_complete),
+	  sink_action_(NULL),
+	  pipe_(),
+	  splice_(log_, &source_, &pipe_, &sink_),
+	  splice_complete_(NULL, &mtx_, this, &Proxy::splice_complete),
+	  splice_action_(NULL)
+	{
+		ScopedLock _(&mtx_);
+		splice_action_ = splice_.start(&splice_complete_);
+	}
+
+	~Proxy()
+	{
+		ASSERT_NULL(log_, source_action_);
+		ASSERT_NULL(log_, sink_action_);
+		ASSERT_NULL(log_, splice_action_);
+	}
+
+private:
+	void splice_complete(Event e)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		splice_action_->cancel();
+		splice_action_ = NULL;
+
+		if (e.type_ != Event::EOS)
+			HALT(log_) << "Unexpected event: " << e;
+
+		source_action_ = source_.close(&source_close_complete_);
+		sink_action_ = sink_.close(&sink_close_complete_);
+	}
+
+	void source_close_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		source_action_->cancel();
+		source_action_ = NULL;
+
+		if (sink_action_ == NULL)
+			EventSystem::instance()->stop();
+	}
+
+	void sink_close_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		sink_action_->cancel();
+		sink_action_ = NULL;
+
+		if (source_action_ == NULL)
+			EventSystem::instance()->stop();
+	}
+};
+
+class Load : public Thread {
+	int source_;
+	int sink_;
+	bool ok_;
+	uintmax_t allocations_;
+public:
+	Load(int source, int sink)
+	: Thread("Load"),
+	  source_(source),
+	  sink_(sink),
+	  ok_(false),
+	  allocations_(0)
+	{ }
+
+	~Load()
+	{ }
+
+	bool ok(void) const
+	{
+		return (ok_);
+	}
+
+	uintmax_t allocations(void) const
+	{
+		return (allocations_);
+	}
+
+	void stop(void)
+	{ }
+
+private:
+	void main(void)
+	{
+		uintmax_t before;
+		unsigned i;
+
+		for (i = 0; i < SPLICE_WARMUP_CYCLES; i++)
+			if (!cycle(i))
+				goto out;
+
+		before = new_count.load();
+		for (i = 0; i < SPLICE_CYCLES; i++)
+			if (!cycle(i))
+				goto out;
+		allocations_ = new_count.load() - before;
+		ok_ = true;
+out:
+		::close(source_);
+		::close(sink_);
+	}
+
+	bool cycle(unsigned n)
+	{
+		uint8_t out[SPLICE_CHUNK], in[SPLICE_CHUNK];
+		size_t resid;
+
+		/*
+		 * Every so often, let the Splice go idle so that its next read
+		 * goes by way of EventPoll, as reads mostly do in a proxy.
+		 */
+		if ((n % SPLICE_IDLE_CYCLES) == 0)
+			usleep(1000);
+
+		memset(out, n & 0xff, sizeof out);
+		if (::write(source_, out, sizeof out) != (ssize_t)sizeof out)
+			return (false);
+		for (resid = 0; resid < sizeof in; ) {
+			ssize_t len = ::read(sink_, in + resid, sizeof in - resid);
+			if (len <= 0)
+				return (false);
+			resid += len;
+		}
+		return (memcmp(in, out, sizeof in) == 0);
+	}
+};
+
+int
+main(void)
+{
+	TestGroup g("/test/io/pipe/splice/alloc1", "Splice allocation");
+	int source[2], sink[2];
+
+	if (::socketpair(AF_UNIX, SOCK_STREAM, 0, source) == -1 ||
+	    ::socketpair(AF_UNIX, SOCK_STREAM, 0, sink) == -1)
+		HALT("/test/io/pipe/splice/alloc1") << "Could not create socket pairs.";
+
+	Proxy *proxy = new Proxy(source[1], sink[0]);
+	Load load(source[0], sink[1]);
+	load.start();
+
+	event_main();
+
+	load.join();
+	delete proxy;
+
+	{
+		Test _(g, "Data proxied intact");
+		if (load.ok())
+			_.pass();
+	}
+	{
+		Test _(g, "No allocations in steady state");
+		INFO("/test/io/pipe/splice/alloc1") << load.allocations() << " allocations in " << SPLICE_CYCLES << " cycles.";
+		if (load.ok() && load.allocations() == 0)
+			_.pass();
+	}
+}
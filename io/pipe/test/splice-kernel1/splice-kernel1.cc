@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <common/test.h>
+#include <common/thread/mutex.h>
+#include <common/thread/thread.h>
+
+#include <event/event_callback.h>
+#include <event/event_main.h>
+#include <event/event_system.h>
+
+#include <io/stream_handle.h>
+#include <io/pipe/splice.h>
+
+/*
+ * Splice one socket to another without a Pipe, which lets the kernel
+ * move the data.  Before the Splice starts, the source is read from
+ * once, so that it has data buffered in userspace which must be passed
+ * on ahead of everything else.  The source is then fed a large amount
+ * of data and shut down, and everything must come out of the sink in
+ * order, followed by EOS.
+ */
+#define	SPLICE_HEADER		"HELO"
+#define	SPLICE_PREFIX		1000
+#define	SPLICE_DATA		(4 * 1024 * 1024)
+
+static uint8_t prefix[SPLICE_PREFIX];
+static uint8_t data[SPLICE_DATA];
+
+class Proxy {
+	LogHandle log_;
+	Mutex mtx_;
+
+	StreamHandle source_;
+	BufferEventCallback::Method<Proxy> read_complete_;
+	SimpleCallback::Method<Proxy> source_close_complete_;
+	Action *source_action_;
+
+	StreamHandle sink_;
+	SimpleCallback::Method<Proxy> sink_close_complete_;
+	Action *sink_action_;
+
+	Splice splice_;
+	EventCallback::Method<Proxy> splice_complete_;
+	Action *splice_action_;
+
+	bool header_;
+	bool eos_;
+public:
+	Proxy(int source, int sink)
+	: log_("/test/io/pipe/splice/kernel"),
+	  mtx_("Proxy"),
+	  source_(source),
+	  read_complete_(NULL, &mtx_, this, &Proxy::read_complete),
+	  source_close_complete_(NULL, &mtx_, this, &Proxy::source_close_complete),
+	  source_action_(NULL),
+	  sink_(sink),
+	  sink_close_complete_(NULL, &mtx_, this, &Proxy::sink_close_complete),
+	  sink_action_(NULL),
+	  splice_(log_, &source_, NULL, &sink_),
+	  splice_complete_(NULL, &mtx_, this, &Proxy::splice_complete),
+	  splice_action_(NULL),
+	  header_(false),
+	  eos_(false)
+	{
+		ScopedLock _(&mtx_);
+		source_action_ = source_.read(strlen(SPLICE_HEADER), &read_complete_);
+	}
+
+	~Proxy()
+	{
+		ASSERT_NULL(log_, source_action_);
+		ASSERT_NULL(log_, sink_action_);
+		ASSERT_NULL(log_, splice_action_);
+	}
+
+	bool header(void) const
+	{
+		return (header_);
+	}
+
+	bool eos(void) const
+	{
+		return (eos_);
+	}
+
+private:
+	void read_complete(Event e, Buffer buf)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		source_action_->cancel();
+		source_action_ = NULL;
+
+		if (e.type_ != Event::Done)
+			HALT(log_) << "Unexpected event: " << e;
+
+		header_ = buf.equal(SPLICE_HEADER);
+
+		splice_action_ = splice_.start(&splice_complete_);
+	}
+
+	void splice_complete(Event e)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		splice_action_->cancel();
+		splice_action_ = NULL;
+
+		if (e.type_ == Event::EOS)
+			eos_ = true;
+		else
+			ERROR(log_) << "Unexpected event: " << e;
+
+		source_action_ = source_.close(&source_close_complete_);
+		sink_action_ = sink_.close(&sink_close_complete_);
+	}
+
+	void source_close_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		source_action_->cancel();
+		source_action_ = NULL;
+
+		if (sink_action_ == NULL)
+			EventSystem::instance()->stop();
+	}
+
+	void sink_close_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		sink_action_->cancel();
+		sink_action_ = NULL;
+
+		if (source_action_ == NULL)
+			EventSystem::instance()->stop();
+	}
+};
+
+class Writer : public Thread {
+	int fd_;
+	bool ok_;
+public:
+	Writer(int fd)
+	: Thread("Writer"),
+	  fd_(fd),
+	  ok_(false)
+	{ }
+
+	~Writer()
+	{ }
+
+	bool ok(void) const
+	{
+		return (ok_);
+	}
+
+	void stop(void)
+	{ }
+
+private:
+	void main(void)
+	{
+		size_t resid;
+
+		for (resid = 0; resid < sizeof data; ) {
+			ssize_t len = ::write(fd_, data + resid, sizeof data - resid);
+			if (len <= 0)
+				goto out;
+			resid += len;
+		}
+		if (::shutdown(fd_, SHUT_WR) == -1)
+			goto out;
+		ok_ = true;
+out:
+		return;
+	}
+};
+
+class Reader : public Thread {
+	int fd_;
+	Buffer buffer_;
+public:
+	Reader(int fd)
+	: Thread("Reader"),
+	  fd_(fd),
+	  buffer_()
+	{ }
+
+	~Reader()
+	{ }
+
+	const Buffer& buffer(void) const
+	{
+		return (buffer_);
+	}
+
+	void stop(void)
+	{ }
+
+private:
+	void main(void)
+	{
+		uint8_t in[65536];
+
+		for (;;) {
+			ssize_t len = ::read(fd_, in, sizeof in);
+			if (len <= 0)
+				break;
+			buffer_.append(in, len);
+		}
+	}
+};
+
+int
+main(void)
+{
+	TestGroup g("/test/io/pipe/splice/kernel1", "Splice without a Pipe");
+	int source[2], sink[2];
+	unsigned i;
+
+	for (i = 0; i < sizeof prefix; i++)
+		prefix[i] = random() % 0xff;
+	for (i = 0; i < sizeof data; i++)
+		data[i] = random() % 0xff;
+
+	if (::socketpair(AF_UNIX, SOCK_STREAM, 0, source) == -1 ||
+	    ::socketpair(AF_UNIX, SOCK_STREAM, 0, sink) == -1)
+		HALT("/test/io/pipe/splice/kernel1") << "Could not create socket pairs.";
+
+	{
+		Test _(g, "Header and prefix written");
+		if (::write(source[0], SPLICE_HEADER, strlen(SPLICE_HEADER)) == (ssize_t)strlen(SPLICE_HEADER) &&
+		    ::write(source[0], prefix, sizeof prefix) == (ssize_t)sizeof prefix)
+			_.pass();
+	}
+
+	Proxy *proxy = new Proxy(source[1], sink[0]);
+	Writer writer(source[0]);
+	Reader reader(sink[1]);
+	writer.start();
+	reader.start();
+
+	event_main();
+
+	writer.join();
+	reader.join();
+
+	{
+		Test _(g, "Header read before splicing");
+		if (proxy->header())
+			_.pass();
+	}
+	{
+		Test _(g, "Splice completed with EOS");
+		if (proxy->eos())
+			_.pass();
+	}
+	delete proxy;
+
+	{
+		Test _(g, "All data written");
+		if (writer.ok())
+			_.pass();
+	}
+
+	Buffer expected(prefix, sizeof prefix);
+	expected.append(data, sizeof data);
+	{
+		Test _(g, "Buffered data passed on first");
+		if (reader.buffer().prefix(prefix, sizeof prefix))
+			_.pass();
+	}
+	{
+		Test _(g, "Data spliced intact");
+		if (reader.buffer().equal(&expected))
+			_.pass();
+	}
+
+	::close(source[0]);
+	::close(sink[1]);
+}
@@ -26,6 +26,9 @@
 #ifndef	IO_SOCKET_SIMPLE_SERVER_H
 #define	IO_SOCKET_SIMPLE_SERVER_H
 
+#include <vector>
+
+#include <common/thread/atomic.h>
 #include <common/thread/mutex.h>
 
 #include <io/socket/socket.h>
@@ -37,98 +40,215 @@
  */
 template<typename L>
 class SimpleServer {
+	/*
+	 * With multiple reactors, there is one Acceptor per reactor, each
+	 * listening on the same address with SO_REUSEPORT, so that the
+	 * kernel spreads connections over the reactors and each connection
+	 * stays in the reactor which accepted it.  All but the first are
+	 * opened from within their reactor, so that their sockets are too.
+	 */
+	class Acceptor {
+		SimpleServer *owner_;
+		LogHandle log_;
+		Mutex mtx_;
+		L *server_;
+		std::string interface_;
+		SimpleCallback::Method<Acceptor> open_;
+		Action *open_action_;
+		SocketEventCallback::Method<Acceptor> accept_complete_;
+		Action *accept_action_;
+		SimpleCallback::Method<Acceptor> close_complete_;
+		Action *close_action_;
+	public:
+		Acceptor(SimpleServer *owner, CallbackScheduler *scheduler)
+		: owner_(owner),
+		  log_(owner->log_),
+		  mtx_("SimpleServer::Acceptor"),
+		  server_(NULL),
+		  interface_(),
+		  open_(scheduler, &mtx_, this, &Acceptor::open),
+		  open_action_(NULL),
+		  accept_complete_(scheduler, &mtx_, this, &Acceptor::accept_complete),
+		  accept_action_(NULL),
+		  close_complete_(scheduler, &mtx_, this, &Acceptor::close_complete),
+		  close_action_(NULL)
+		{ }
+
+		~Acceptor()
+		{
+			ASSERT_NULL(log_, server_);
+			ASSERT_NULL(log_, open_action_);
+			ASSERT_NULL(log_, accept_action_);
+			ASSERT_NULL(log_, close_action_);
+		}
+
+		std::string listen(const std::string& interface, bool reuseport)
+		{
+			ScopedLock _(&mtx_);
+			server_ = L::listen(owner_->impl_, owner_->family_, interface, reuseport);
+			if (server_ == NULL)
+				HALT(log_) << "Unable to create listener.";
+
+			accept_action_ = server_->accept(&accept_complete_);
+
+			return (server_->getsockname());
+		}
+
+		void schedule_listen(const std::string& interface)
+		{
+			ScopedLock _(&mtx_);
+			interface_ = interface;
+			open_action_ = open_.schedule();
+		}
+
+		void stop(void)
+		{
+			ScopedLock _(&mtx_);
+			if (open_action_ != NULL) {
+				open_action_->cancel();
+				open_action_ = NULL;
+
+				owner_->acceptor_closed();
+				EventSystem::instance()->destroy(&mtx_, this);
+				return;
+			}
+
+			accept_action_->cancel();
+			accept_action_ = NULL;
+
+			ASSERT_NULL(log_, close_action_);
+			close_action_ = server_->close(&close_complete_);
+		}
+
+	private:
+		void open(void)
+		{
+			ASSERT_LOCK_OWNED(log_, &mtx_);
+			open_action_->cancel();
+			open_action_ = NULL;
+
+			server_ = L::listen(owner_->impl_, owner_->family_, interface_, true);
+			if (server_ == NULL)
+				HALT(log_) << "Unable to create listener.";
+
+			accept_action_ = server_->accept(&accept_complete_);
+		}
+
+		void accept_complete(Event e, Socket *client)
+		{
+			ASSERT_LOCK_OWNED(log_, &mtx_);
+			accept_action_->cancel();
+			accept_action_ = NULL;
+
+			switch (e.type_) {
+			case Event::Done:
+				break;
+			case Event::Error:
+				ERROR(log_) << "Accept error: " << e;
+				break;
+			default:
+				ERROR(log_) << "Unexpected event: " << e;
+				break;
+			}
+
+			if (e.type_ == Event::Done) {
+				DEBUG(log_) << "Accepted client: " << client->getpeername();
+				owner_->client_connected(client);
+			}
+
+			accept_action_ = server_->accept(&accept_complete_);
+		}
+
+		void close_complete(void)
+		{
+			ASSERT_LOCK_OWNED(log_, &mtx_);
+			close_action_->cancel();
+			close_action_ = NULL;
+
+			ASSERT_NON_NULL(log_, server_);
+			delete server_;
+			server_ = NULL;
+
+			owner_->acceptor_closed();
+			EventSystem::instance()->destroy(&mtx_, this);
+		}
+	};
+
 	LogHandle log_;
 	Mutex mtx_;
-	L *server_;
-	SocketEventCallback::Method<SimpleServer> accept_complete_;
-	Action *accept_action_;
-	SimpleCallback::Method<SimpleServer> close_complete_;
-	Action *close_action_;
+	SocketImpl impl_;
+	SocketAddressFamily family_;
+	std::string name_;
+	std::vector<Acceptor *> acceptors_;
+	Atomic<unsigned> acceptors_open_;
 	SimpleCallback::Method<SimpleServer> stop_;
 	Action *stop_action_;
 public:
 	SimpleServer(LogHandle log, SocketImpl impl, SocketAddressFamily family, const std::string& interface)
 	: log_(log),
 	  mtx_("SimpleServer"),
-	  server_(NULL),
-	  accept_complete_(NULL, &mtx_, this, &SimpleServer::accept_complete),
-	  accept_action_(NULL),
-	  close_complete_(NULL, &mtx_, this, &SimpleServer::close_complete),
-	  close_action_(NULL),
+	  impl_(impl),
+	  family_(family),
+	  name_(),
+	  acceptors_(),
+	  acceptors_open_(0),
 	  stop_(NULL, &mtx_, this, &SimpleServer::stop),
 	  stop_action_(NULL)
 	{
-		server_ = L::listen(impl, family, interface);
-		if (server_ == NULL)
-			HALT(log_) << "Unable to create listener.";
+		unsigned reactors = EventSystem::instance()->reactors();
+		unsigned i;
 
-		INFO(log_) << "Listening on: " << server_->getsockname();
+		for (i = 0; i < reactors; i++)
+			acceptors_.push_back(new Acceptor(this, EventSystem::instance()->reactor_scheduler(i)));
+		acceptors_open_.add(reactors);
 
-		ScopedLock _(&mtx_);
-		accept_action_ = server_->accept(&accept_complete_);
+		/*
+		 * The first listener is opened here, so that the others can
+		 * bind to the port it was given if the interface has none.
+		 */
+		name_ = acceptors_[0]->listen(interface, reactors != 1);
+		INFO(log_) << "Listening on: " << name_;
+
+		for (i = 1; i < reactors; i++)
+			acceptors_[i]->schedule_listen(name_);
 
+		ScopedLock _(&mtx_);
 		stop_action_ = EventSystem::instance()->register_interest(EventInterestStop, &stop_);
 	}
 
 	virtual ~SimpleServer()
 	{
-		ASSERT_NULL(log_, server_);
-		ASSERT_NULL(log_, accept_action_);
-		ASSERT_NULL(log_, close_action_);
+		ASSERT_ZERO(log_, acceptors_open_.load());
 		ASSERT_NULL(log_, stop_action_);
 	}
 
-private:
-	void accept_complete(Event e, Socket *client)
-	{
-		ASSERT_LOCK_OWNED(log_, &mtx_);
-		accept_action_->cancel();
-		accept_action_ = NULL;
-
-		switch (e.type_) {
-		case Event::Done:
-			break;
-		case Event::Error:
-			ERROR(log_) << "Accept error: " << e;
-			break;
-		default:
-			ERROR(log_) << "Unexpected event: " << e;
-			break;
-		}
-
-		if (e.type_ == Event::Done) {
-			DEBUG(log_) << "Accepted client: " << client->getpeername();
-			client_connected(client);
-		}
-
-		accept_action_ = server_->accept(&accept_complete_);
-	}
-
-	void close_complete(void)
+	std::string getsockname(void) const
 	{
-		ASSERT_LOCK_OWNED(log_, &mtx_);
-		close_action_->cancel();
-		close_action_ = NULL;
-
-		ASSERT_NON_NULL(log_, server_);
-		delete server_;
-		server_ = NULL;
-
-		EventSystem::instance()->destroy(&mtx_, this);
+		return (name_);
 	}
 
+private:
 	void stop(void)
 	{
+		typename std::vector<Acceptor *>::const_iterator it;
+
 		ASSERT_LOCK_OWNED(log_, &mtx_);
 		stop_action_->cancel();
 		stop_action_ = NULL;
 
-		accept_action_->cancel();
-		accept_action_ = NULL;
-
-		ASSERT_NULL(log_, close_action_);
+		for (it = acceptors_.begin(); it != acceptors_.end(); ++it)
+			(*it)->stop();
+		acceptors_.clear();
+	}
 
-		close_action_ = server_->close(&close_complete_);
+	/*
+	 * Acceptors destroy themselves once closed, and the last to close
+	 * destroys the server.
+	 */
+	void acceptor_closed(void)
+	{
+		if (acceptors_open_.subtract(1) == 1)
+			EventSystem::instance()->destroy(&mtx_, this);
 	}
 
 	virtual void client_connected(Socket *) = 0;
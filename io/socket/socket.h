@@ -54,6 +54,9 @@ public:
 	virtual bool bind(const std::string&) = 0;
 	virtual Action *connect(const std::string&, EventCallback *) = 0;
 	virtual bool listen(void) = 0;
+	virtual bool reuseport(void) = 0;
+	virtual bool incoming_cpu(unsigned) = 0;
+	virtual bool zerocopy(size_t) = 0;
 
 	virtual std::string getpeername(void) const = 0;
 	virtual std::string getsockname(void) const = 0;
@@ -35,6 +35,7 @@
 #include <event/event_callback.h>
 #include <event/event_system.h>
 
+#include <io/io_system.h>
 #include <io/socket/resolver.h>
 #include <io/socket/socket_handle.h>
 
@@ -172,6 +173,77 @@ SocketHandle::listen(void)
 	return (true);
 }
 
+/*
+ * Allow several sockets to bind the same address, and have the kernel
+ * spread incoming connections over them.  Must be done before bind.
+ */
+bool
+SocketHandle::reuseport(void)
+{
+#if defined(SO_REUSEPORT)
+	ScopedLock _(&mtx_);
+	int on = 1;
+	int rv = setsockopt(fd_, SOL_SOCKET, SO_REUSEPORT, &on, sizeof on);
+	if (rv == -1) {
+		ERROR(log_) << "Could not setsockopt(SO_REUSEPORT): " << strerror(errno);
+		return (false);
+	}
+	return (true);
+#else
+	ERROR(log_) << "SO_REUSEPORT is not supported.";
+	return (false);
+#endif
+}
+
+/*
+ * Ask for connections whose packets arrive on the given CPU to go to this
+ * socket rather than any other bound to the same address.  This is only a
+ * hint, for a listener used from a thread pinned to that CPU.
+ */
+bool
+SocketHandle::incoming_cpu(unsigned cpu)
+{
+#if defined(SO_INCOMING_CPU)
+	ScopedLock _(&mtx_);
+	int val = cpu;
+	int rv = setsockopt(fd_, SOL_SOCKET, SO_INCOMING_CPU, &val, sizeof val);
+	if (rv == -1) {
+		ERROR(log_) << "Could not setsockopt(SO_INCOMING_CPU): " << strerror(errno);
+		return (false);
+	}
+	return (true);
+#else
+	(void)cpu;
+	DEBUG(log_) << "SO_INCOMING_CPU is not supported.";
+	return (false);
+#endif
+}
+
+/*
+ * Send writes of at least threshold bytes without copying them in to the
+ * kernel, where supported.  This only pays for large writes, since each
+ * one has to be tracked until the kernel is done with it.
+ */
+bool
+SocketHandle::zerocopy(size_t threshold)
+{
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+	ScopedLock _(&mtx_);
+	int val = threshold != 0;
+	int rv = setsockopt(fd_, SOL_SOCKET, SO_ZEROCOPY, &val, sizeof val);
+	if (rv == -1) {
+		ERROR(log_) << "Could not setsockopt(SO_ZEROCOPY): " << strerror(errno);
+		return (false);
+	}
+	IOSystem::instance()->zerocopy(fd_, this, threshold);
+	return (true);
+#else
+	(void)threshold;
+	DEBUG(log_) << "SO_ZEROCOPY is not supported.";
+	return (false);
+#endif
+}
+
 Action *
 SocketHandle::shutdown(bool shut_read, bool shut_write, EventCallback *cb)
 {
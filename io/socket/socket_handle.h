@@ -56,6 +56,9 @@ public:
 	virtual bool bind(const std::string&);
 	virtual Action *connect(const std::string&, EventCallback *);
 	virtual bool listen(void);
+	virtual bool reuseport(void);
+	virtual bool incoming_cpu(unsigned);
+	virtual bool zerocopy(size_t);
 	virtual Action *shutdown(bool, bool, EventCallback *);
 
 	virtual std::string getpeername(void) const;
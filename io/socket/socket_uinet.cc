@@ -311,6 +311,27 @@ SocketUinet::listen(void)
 	return (true);
 }
 
+bool
+SocketUinet::reuseport(void)
+{
+	ERROR(log_) << "SO_REUSEPORT is not supported.";
+	return (false);
+}
+
+bool
+SocketUinet::incoming_cpu(unsigned)
+{
+	DEBUG(log_) << "SO_INCOMING_CPU is not supported.";
+	return (false);
+}
+
+bool
+SocketUinet::zerocopy(size_t)
+{
+	DEBUG(log_) << "SO_ZEROCOPY is not supported.";
+	return (false);
+}
+
 Action *
 SocketUinet::shutdown(bool shut_read, bool shut_write, EventCallback *cb)
 {
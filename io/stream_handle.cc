@@ -77,3 +77,13 @@ StreamHandle::shutdown(bool, bool, EventCallback *cb)
 	cb->param(Event::Error);
 	return (cb->schedule());
 }
+
+/*
+ * Move everything we read to the sink within the kernel, until EOS.
+ * Returns NULL if that is not possible here.
+ */
+Action *
+StreamHandle::splice(StreamHandle *sink, EventCallback *cb)
+{
+	return (IOSystem::instance()->splice(fd_, this, sink->fd_, sink, cb));
+}
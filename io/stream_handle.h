@@ -40,6 +40,8 @@ public:
 	virtual Action *read(size_t, BufferEventCallback *);
 	virtual Action *write(Buffer *, EventCallback *);
 	virtual Action *shutdown(bool, bool, EventCallback *);
+
+	Action *splice(StreamHandle *, EventCallback *);
 };
 
 #endif /* !IO_STREAM_HANDLE_H */
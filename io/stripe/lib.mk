@@ -0,0 +1,3 @@
+VPATH+=	${TOPDIR}/io/stripe
+
+SRCS+=	stripe_channel.cc
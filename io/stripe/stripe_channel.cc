@@ -0,0 +1,639 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <errno.h>
+
+#include <common/endian.h>
+#include <common/thread/mutex.h>
+
+#include <event/event_callback.h>
+
+#include <io/channel.h>
+
+#include <io/stripe/stripe_channel.h>
+
+/*
+ * Every chunk is a 32-bit sequence number and a 32-bit length, both in
+ * network byte order, followed by that many bytes of data.  A chunk with
+ * no data marks the end of the stream.
+ */
+namespace {
+	static const size_t StripeChunkHeaderLength = 8;
+
+	static void
+	stripe_chunk(Buffer *out, uint32_t seq, uint32_t length)
+	{
+		seq = BigEndian::encode(seq);
+		length = BigEndian::encode(length);
+
+		out->append(&seq);
+		out->append(&length);
+	}
+}
+
+class StripeChannel::Path {
+	LogHandle log_;
+public:
+	StripeChannel *stripe_;
+	StreamChannel *channel_;
+	Buffer receive_buffer_;
+	bool receive_eos_;
+	bool parked_;
+
+	BufferEventCallback::Method<Path> read_complete_;
+	Action *read_action_;
+	EventCallback::Method<Path> write_complete_;
+	Action *write_action_;
+	SimpleCallback::Method<Path> close_complete_;
+	Action *close_action_;
+
+	Path(StripeChannel *stripe, StreamChannel *channel)
+	: log_(stripe->log_ + "/path"),
+	  stripe_(stripe),
+	  channel_(channel),
+	  receive_buffer_(),
+	  receive_eos_(false),
+	  parked_(false),
+	  read_complete_(NULL, &stripe->mtx_, this, &Path::read_complete),
+	  read_action_(NULL),
+	  write_complete_(NULL, &stripe->mtx_, this, &Path::write_complete),
+	  write_action_(NULL),
+	  close_complete_(NULL, &stripe->mtx_, this, &Path::close_complete),
+	  close_action_(NULL)
+	{ }
+
+	~Path()
+	{
+		ASSERT_NULL(log_, channel_);
+		ASSERT_NULL(log_, read_action_);
+		ASSERT_NULL(log_, write_action_);
+		ASSERT_NULL(log_, close_action_);
+	}
+
+	bool busy(void) const
+	{
+		return (write_action_ != NULL);
+	}
+
+	void read(void)
+	{
+		ASSERT_NULL(log_, read_action_);
+		parked_ = false;
+		read_action_ = channel_->read(0, &read_complete_);
+	}
+
+	void write(Buffer *buf)
+	{
+		ASSERT_NULL(log_, write_action_);
+		write_action_ = channel_->write(buf, &write_complete_);
+	}
+
+	void cancel(void)
+	{
+		if (read_action_ != NULL) {
+			read_action_->cancel();
+			read_action_ = NULL;
+		}
+		if (write_action_ != NULL) {
+			write_action_->cancel();
+			write_action_ = NULL;
+		}
+		parked_ = false;
+	}
+
+	void close(void)
+	{
+		ASSERT_NULL(log_, close_action_);
+		cancel();
+		close_action_ = channel_->close(&close_complete_);
+	}
+
+private:
+	void read_complete(Event e, Buffer buf)
+	{
+		read_action_->cancel();
+		read_action_ = NULL;
+
+		stripe_->path_read_complete(this, e, buf);
+	}
+
+	void write_complete(Event e)
+	{
+		write_action_->cancel();
+		write_action_ = NULL;
+
+		stripe_->path_write_complete(this, e);
+	}
+
+	void close_complete(void)
+	{
+		close_action_->cancel();
+		close_action_ = NULL;
+
+		delete channel_;
+		channel_ = NULL;
+
+		stripe_->path_closed();
+	}
+};
+
+StripeChannel::StripeChannel(const LogHandle& log, const std::vector<StreamChannel *>& channels, const std::vector<Buffer> *received)
+: log_(log + "/stripe"),
+  mtx_("StripeChannel"),
+  paths_(),
+  next_path_(0),
+  closing_(0),
+  failed_(false),
+  error_(0),
+  send_seq_(0),
+  send_buffer_(),
+  send_eos_(false),
+  sent_eos_(false),
+  receive_seq_(0),
+  reorder_(),
+  receive_buffer_(),
+  receive_buffered_(0),
+  receive_eos_(false),
+  read_cancel_(&mtx_, this, &StripeChannel::read_cancel),
+  read_amount_(0),
+  read_callback_(NULL),
+  read_action_(NULL),
+  write_cancel_(&mtx_, this, &StripeChannel::write_cancel),
+  write_callback_(NULL),
+  write_action_(NULL),
+  close_cancel_(&mtx_, this, &StripeChannel::close_cancel),
+  close_callback_(NULL),
+  close_action_(NULL)
+{
+	ASSERT(log_, !channels.empty());
+	ASSERT(log_, received == NULL || received->size() == channels.size());
+
+	ScopedLock _(&mtx_);
+	std::vector<StreamChannel *>::const_iterator it;
+	for (it = channels.begin(); it != channels.end(); ++it)
+		paths_.push_back(new Path(this, *it));
+
+	/*
+	 * Anything which arrived before the paths were handed over comes
+	 * first, and once it is taken care of we start reading.
+	 */
+	if (received != NULL) {
+		unsigned i;
+		for (i = 0; i < paths_.size(); i++) {
+			paths_[i]->receive_buffer_.append((*received)[i]);
+			if (!receive(paths_[i])) {
+				fail(EPROTO);
+				return;
+			}
+		}
+	}
+
+	std::vector<Path *>::const_iterator pit;
+	for (pit = paths_.begin(); pit != paths_.end(); ++pit)
+		(*pit)->read();
+}
+
+StripeChannel::~StripeChannel()
+{
+	ASSERT_ZERO(log_, closing_);
+	ASSERT_NULL(log_, read_callback_);
+	ASSERT_NULL(log_, read_action_);
+	ASSERT_NULL(log_, write_callback_);
+	ASSERT_NULL(log_, write_action_);
+	ASSERT_NULL(log_, close_callback_);
+	ASSERT_NULL(log_, close_action_);
+
+	while (!paths_.empty()) {
+		delete paths_.back();
+		paths_.pop_back();
+	}
+}
+
+/*
+ * Close and delete every path.
+ */
+Action *
+StripeChannel::close(SimpleCallback *cb)
+{
+	ScopedLock _(&mtx_);
+	ASSERT_NULL(log_, read_callback_);
+	ASSERT_NULL(log_, read_action_);
+	ASSERT_NULL(log_, write_callback_);
+	ASSERT_NULL(log_, write_action_);
+	ASSERT_NULL(log_, close_callback_);
+	ASSERT_ZERO(log_, closing_);
+
+	close_callback_ = cb;
+	closing_ = paths_.size();
+
+	std::vector<Path *>::const_iterator it;
+	for (it = paths_.begin(); it != paths_.end(); ++it)
+		(*it)->close();
+
+	return (&close_cancel_);
+}
+
+Action *
+StripeChannel::read(size_t amount, BufferEventCallback *cb)
+{
+	ScopedLock _(&mtx_);
+	ASSERT_NULL(log_, read_callback_);
+	ASSERT_NULL(log_, read_action_);
+
+	read_amount_ = amount;
+	read_callback_ = cb;
+	deliver();
+
+	return (&read_cancel_);
+}
+
+/*
+ * A write completes once all of its data has been handed to the paths,
+ * so at most one chunk per path is outstanding beyond what the writer has
+ * yet to give us.
+ */
+Action *
+StripeChannel::write(Buffer *buf, EventCallback *cb)
+{
+	ScopedLock _(&mtx_);
+	ASSERT_NULL(log_, write_callback_);
+	ASSERT_NULL(log_, write_action_);
+	ASSERT(log_, !send_eos_);
+
+	write_callback_ = cb;
+	if (!failed_)
+		buf->moveout(&send_buffer_);
+	send();
+
+	return (&write_cancel_);
+}
+
+/*
+ * Shutting down for writing sends the end of the stream once everything
+ * written so far has gone; the paths themselves are left open, since the
+ * far side may still be sending to us over them.
+ */
+Action *
+StripeChannel::shutdown(bool, bool shut_write, EventCallback *cb)
+{
+	ScopedLock _(&mtx_);
+	ASSERT_NULL(log_, write_callback_);
+	ASSERT_NULL(log_, write_action_);
+
+	if (!shut_write || sent_eos_) {
+		cb->param(Event::Done);
+		return (cb->schedule());
+	}
+
+	write_callback_ = cb;
+	send_eos_ = true;
+	send();
+
+	return (&write_cancel_);
+}
+
+void
+StripeChannel::read_cancel(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	if (read_callback_ != NULL) {
+		read_callback_ = NULL;
+	} else {
+		ASSERT_NON_NULL(log_, read_action_);
+		read_action_->cancel();
+		read_action_ = NULL;
+	}
+}
+
+void
+StripeChannel::write_cancel(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	if (write_callback_ != NULL) {
+		/*
+		 * Whatever has not been handed to a path yet is dropped.
+		 */
+		write_callback_ = NULL;
+		send_buffer_.clear();
+	} else {
+		ASSERT_NON_NULL(log_, write_action_);
+		write_action_->cancel();
+		write_action_ = NULL;
+	}
+}
+
+void
+StripeChannel::close_cancel(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	if (close_callback_ != NULL) {
+		close_callback_ = NULL;
+	} else {
+		ASSERT_NON_NULL(log_, close_action_);
+		close_action_->cancel();
+		close_action_ = NULL;
+	}
+}
+
+/*
+ * Give a chunk to every free path, starting after the one we used last so
+ * that paths which are equally quick share the load evenly.
+ */
+void
+StripeChannel::send(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	while (!failed_ && (!send_buffer_.empty() || (send_eos_ && !sent_eos_))) {
+		Path *path = NULL;
+		unsigned i;
+		for (i = 0; i < paths_.size(); i++) {
+			unsigned index = (next_path_ + i) % paths_.size();
+			if (paths_[index]->busy())
+				continue;
+			path = paths_[index];
+			next_path_ = (index + 1) % paths_.size();
+			break;
+		}
+		if (path == NULL)
+			break;
+
+		size_t amount = send_buffer_.length();
+		if (amount > STRIPE_CHANNEL_CHUNK)
+			amount = STRIPE_CHANNEL_CHUNK;
+
+		Buffer chunk;
+		stripe_chunk(&chunk, send_seq_++, amount);
+		if (amount != 0)
+			send_buffer_.moveout(&chunk, amount);
+		else
+			sent_eos_ = true;
+		path->write(&chunk);
+	}
+
+	if (failed_ || (send_buffer_.empty() && (!send_eos_ || sent_eos_)))
+		flushed();
+}
+
+void
+StripeChannel::path_write_complete(Path *, Event e)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	if (e.type_ != Event::Done) {
+		ERROR(log_) << "Path write failed: " << e;
+		fail(e.error_ != 0 ? e.error_ : EPIPE);
+		return;
+	}
+	send();
+}
+
+void
+StripeChannel::path_read_complete(Path *path, Event e, Buffer buf)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	switch (e.type_) {
+	case Event::Done:
+	case Event::EOS:
+		path->receive_buffer_.append(buf);
+		if (!receive(path)) {
+			fail(EPROTO);
+			return;
+		}
+		break;
+	default:
+		ERROR(log_) << "Path read failed: " << e;
+		fail(e.error_ != 0 ? e.error_ : ECONNRESET);
+		return;
+	}
+
+	if (e.type_ == Event::EOS) {
+		path->receive_eos_ = true;
+		if (!path->receive_buffer_.empty()) {
+			ERROR(log_) << "Path ended within a chunk.";
+			fail(EPROTO);
+			return;
+		}
+
+		/*
+		 * Paths may end in any order, but once all of them have, any
+		 * chunk still missing will never come.
+		 */
+		if (!receive_eos_) {
+			std::vector<Path *>::const_iterator it;
+			for (it = paths_.begin(); it != paths_.end(); ++it) {
+				if (!(*it)->receive_eos_)
+					break;
+			}
+			if (it == paths_.end()) {
+				ERROR(log_) << "Every path ended before the stream did.";
+				fail(ECONNRESET);
+				return;
+			}
+		}
+		deliver();
+		return;
+	}
+
+	deliver();
+
+	/*
+	 * Stop reading from this path while the reader has data in hand and
+	 * we are holding too much; it will be resumed once the reader has
+	 * taken some.  If the reader has nothing, the gap ahead of it must
+	 * yet be filled by some path, and so none may stop.
+	 */
+	if (receive_buffered_ >= STRIPE_CHANNEL_BUFFER && !receive_buffer_.empty()) {
+		path->parked_ = true;
+		return;
+	}
+	path->read();
+}
+
+/*
+ * Take every whole chunk received on a path.  Returns false if the far side
+ * has sent something which makes no sense.
+ */
+bool
+StripeChannel::receive(Path *path)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	while (path->receive_buffer_.length() >= StripeChunkHeaderLength) {
+		uint32_t seq, length;
+
+		path->receive_buffer_.extract(&seq);
+		seq = BigEndian::decode(seq);
+		path->receive_buffer_.extract(&length, sizeof seq);
+		length = BigEndian::decode(length);
+
+		if (length > STRIPE_CHANNEL_CHUNK) {
+			ERROR(log_) << "Chunk too long: " << length;
+			return (false);
+		}
+		if (receive_eos_ || (uint32_t)(seq - receive_seq_) >= 0x80000000u ||
+		    reorder_.find(seq) != reorder_.end()) {
+			ERROR(log_) << "Unexpected chunk: " << seq;
+			return (false);
+		}
+
+		if (path->receive_buffer_.length() < StripeChunkHeaderLength + length)
+			break;
+
+		Buffer chunk;
+		if (length != 0)
+			path->receive_buffer_.moveout(&chunk, StripeChunkHeaderLength, length);
+		else
+			path->receive_buffer_.skip(StripeChunkHeaderLength);
+		receive_chunk(seq, &chunk);
+	}
+	return (true);
+}
+
+/*
+ * Hold a chunk until its turn, then pass it and any which were waiting on
+ * it along to the reader.
+ */
+void
+StripeChannel::receive_chunk(uint32_t seq, Buffer *chunk)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	receive_buffered_ += chunk->length();
+	reorder_[seq] = *chunk;
+
+	std::map<uint32_t, Buffer>::iterator it;
+	while ((it = reorder_.find(receive_seq_)) != reorder_.end()) {
+		if (it->second.empty())
+			receive_eos_ = true;
+		else
+			it->second.moveout(&receive_buffer_);
+		reorder_.erase(it);
+		receive_seq_++;
+	}
+}
+
+/*
+ * Start reading again from paths which were stopped while we held too
+ * much.
+ */
+void
+StripeChannel::resume(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	if (failed_)
+		return;
+
+	std::vector<Path *>::const_iterator it;
+	for (it = paths_.begin(); it != paths_.end(); ++it) {
+		if ((*it)->parked_)
+			(*it)->read();
+	}
+}
+
+/*
+ * Hand the reader whatever is in order, or tell it that there will be
+ * nothing more.
+ */
+void
+StripeChannel::deliver(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	if (read_callback_ == NULL)
+		return;
+
+	if (!receive_buffer_.empty()) {
+		size_t amount = receive_buffer_.length();
+		if (read_amount_ != 0 && read_amount_ < amount)
+			amount = read_amount_;
+
+		Buffer buf;
+		receive_buffer_.moveout(&buf, amount);
+		receive_buffered_ -= amount;
+
+		read_callback_->param(Event::Done, buf);
+		read_action_ = read_callback_->schedule();
+		read_callback_ = NULL;
+
+		resume();
+		return;
+	}
+
+	if (receive_eos_)
+		read_callback_->param(Event::EOS, Buffer());
+	else if (failed_)
+		read_callback_->param(Event(Event::Error, error_), Buffer());
+	else
+		return;
+	read_action_ = read_callback_->schedule();
+	read_callback_ = NULL;
+}
+
+void
+StripeChannel::flushed(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	if (write_callback_ == NULL)
+		return;
+
+	if (failed_)
+		write_callback_->param(Event(Event::Error, error_));
+	else
+		write_callback_->param(Event::Done);
+	write_action_ = write_callback_->schedule();
+	write_callback_ = NULL;
+}
+
+/*
+ * Once any path fails the stream cannot be put back together, so stop
+ * using all of them.  Data already in order may still be read.
+ */
+void
+StripeChannel::fail(int error)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	if (failed_)
+		return;
+	failed_ = true;
+	error_ = error;
+
+	std::vector<Path *>::const_iterator it;
+	for (it = paths_.begin(); it != paths_.end(); ++it)
+		(*it)->cancel();
+	send_buffer_.clear();
+
+	deliver();
+	flushed();
+}
+
+void
+StripeChannel::path_closed(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	ASSERT_NON_ZERO(log_, closing_);
+	if (--closing_ != 0)
+		return;
+	if (close_callback_ == NULL)
+		return;
+
+	close_action_ = close_callback_->schedule();
+	close_callback_ = NULL;
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	IO_STRIPE_STRIPE_CHANNEL_H
+#define	IO_STRIPE_STRIPE_CHANNEL_H
+
+#include <map>
+#include <vector>
+
+#include <common/thread/mutex.h>
+
+#include <event/cancellation.h>
+
+#include <io/channel.h>
+
+#define	STRIPE_CHANNEL_CHUNK	16384	/* Bytes sent on a path at once.  */
+#define	STRIPE_CHANNEL_BUFFER	4194304	/* Bytes received ahead of the reader.  */
+
+/*
+ * A StripeChannel carries one stream over several StreamChannels, or paths,
+ * such as parallel TCP connections, so that a link on which one connection
+ * is limited by its window or by loss can be filled by several.  The stream
+ * is cut into numbered chunks of at most STRIPE_CHANNEL_CHUNK bytes, which
+ * the far side puts back in order.
+ *
+ * Each path has one chunk in flight at a time, and the next chunk goes to
+ * whichever path is free first, so that paths are used in proportion to
+ * how quickly they drain.  Chunks which arrive ahead of their turn are held
+ * until the gap is filled, up to STRIPE_CHANNEL_BUFFER bytes, past which
+ * paths are not read until the reader catches up.
+ *
+ * Both sides must be given the same number of paths, in any order.  The
+ * StripeChannel owns its paths, and closes and deletes them when it is
+ * closed.  Data already read from a path before it was handed over may be
+ * given along with it.
+ */
+class StripeChannel : public StreamChannel {
+	class Path;
+	friend class Path;
+
+	LogHandle log_;
+	Mutex mtx_;
+	std::vector<Path *> paths_;
+	unsigned next_path_;
+	unsigned closing_;
+	bool failed_;
+	int error_;
+
+	uint32_t send_seq_;
+	Buffer send_buffer_;
+	bool send_eos_;
+	bool sent_eos_;
+
+	uint32_t receive_seq_;
+	std::map<uint32_t, Buffer> reorder_;
+	Buffer receive_buffer_;
+	size_t receive_buffered_;
+	bool receive_eos_;
+
+	Cancellation<StripeChannel> read_cancel_;
+	size_t read_amount_;
+	BufferEventCallback *read_callback_;
+	Action *read_action_;
+
+	Cancellation<StripeChannel> write_cancel_;
+	EventCallback *write_callback_;
+	Action *write_action_;
+
+	Cancellation<StripeChannel> close_cancel_;
+	SimpleCallback *close_callback_;
+	Action *close_action_;
+public:
+	StripeChannel(const LogHandle&, const std::vector<StreamChannel *>&, const std::vector<Buffer> * = NULL);
+	~StripeChannel();
+
+	Action *close(SimpleCallback *);
+	Action *read(size_t, BufferEventCallback *);
+	Action *write(Buffer *, EventCallback *);
+	Action *shutdown(bool, bool, EventCallback *);
+
+private:
+	void read_cancel(void);
+	void write_cancel(void);
+	void close_cancel(void);
+
+	void send(void);
+	void path_write_complete(Path *, Event);
+
+	void path_read_complete(Path *, Event, Buffer);
+	bool receive(Path *);
+	void receive_chunk(uint32_t, Buffer *);
+	void resume(void);
+
+	void deliver(void);
+	void flushed(void);
+	void fail(int);
+
+	void path_closed(void);
+};
+
+#endif /* !IO_STRIPE_STRIPE_CHANNEL_H */
@@ -0,0 +1,466 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <vector>
+
+#include <common/test.h>
+#include <common/thread/atomic.h>
+#include <common/thread/mutex.h>
+
+#include <event/cancellation.h>
+#include <event/event_callback.h>
+#include <event/event_main.h>
+#include <event/event_system.h>
+
+#include <io/net/tcp_client.h>
+#include <io/net/tcp_server.h>
+
+#include <io/pipe/splice.h>
+
+#include <io/socket/socket.h>
+
+#include <io/stripe/stripe_channel.h>
+
+/*
+ * A stream is striped over several connections to a server, which echoes
+ * it back.  Writes on one of the client's connections are held up for a
+ * while each, so chunks arrive out of order, and that connection should be
+ * given less than its share of them.
+ */
+#define	STRIPE_TEST_PATHS	4
+#define	STRIPE_TEST_DELAY	5
+#define	STRIPE_TEST_DATA	(4 * 1024 * 1024)
+
+static uint8_t data[STRIPE_TEST_DATA];
+
+static Atomic<unsigned> sides_running;
+
+static void
+side_finished(void)
+{
+	if (sides_running.subtract(1) == 1)
+		EventSystem::instance()->stop();
+}
+
+/*
+ * Wraps a path, counting what is written to it and optionally delaying
+ * each write.
+ */
+class TestPath : public StreamChannel {
+	LogHandle log_;
+	Mutex mtx_;
+	Socket *socket_;
+	unsigned delay_;
+	size_t written_;
+	Buffer write_buffer_;
+	EventCallback *write_callback_;
+	Action *write_action_;
+	Cancellation<TestPath> write_cancel_;
+	SimpleCallback::Method<TestPath> delay_complete_;
+public:
+	TestPath(Socket *socket, unsigned delay)
+	: log_("/path"),
+	  mtx_("TestPath"),
+	  socket_(socket),
+	  delay_(delay),
+	  written_(0),
+	  write_buffer_(),
+	  write_callback_(NULL),
+	  write_action_(NULL),
+	  write_cancel_(&mtx_, this, &TestPath::write_cancel),
+	  delay_complete_(NULL, &mtx_, this, &TestPath::delay_complete)
+	{ }
+
+	~TestPath()
+	{
+		ASSERT_NULL(log_, write_action_);
+		delete socket_;
+	}
+
+	size_t written(void)
+	{
+		ScopedLock _(&mtx_);
+		return (written_);
+	}
+
+	Action *close(SimpleCallback *cb)
+	{
+		return (socket_->close(cb));
+	}
+
+	Action *read(size_t amount, BufferEventCallback *cb)
+	{
+		return (socket_->read(amount, cb));
+	}
+
+	Action *write(Buffer *buf, EventCallback *cb)
+	{
+		ScopedLock _(&mtx_);
+		ASSERT_NULL(log_, write_action_);
+		written_ += buf->length();
+		if (delay_ == 0)
+			write_action_ = socket_->write(buf, cb);
+		else {
+			buf->moveout(&write_buffer_);
+			write_callback_ = cb;
+			write_action_ = EventSystem::instance()->timeout(delay_, &delay_complete_);
+		}
+		return (&write_cancel_);
+	}
+
+	Action *shutdown(bool shut_read, bool shut_write, EventCallback *cb)
+	{
+		return (socket_->shutdown(shut_read, shut_write, cb));
+	}
+
+private:
+	void delay_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		write_action_->cancel();
+		write_action_ = socket_->write(&write_buffer_, write_callback_);
+		write_callback_ = NULL;
+	}
+
+	void write_cancel(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		ASSERT_NON_NULL(log_, write_action_);
+		write_action_->cancel();
+		write_action_ = NULL;
+		write_buffer_.clear();
+		write_callback_ = NULL;
+	}
+};
+
+class Server {
+	LogHandle log_;
+	Mutex mtx_;
+	TestGroup group_;
+	TCPServer *server_;
+	std::vector<StreamChannel *> paths_;
+	StripeChannel *stripe_;
+	Splice *splice_;
+	Action *action_;
+	SocketEventCallback::Method<Server> accept_complete_;
+	SimpleCallback::Method<Server> server_close_complete_;
+	EventCallback::Method<Server> splice_complete_;
+	SimpleCallback::Method<Server> close_complete_;
+public:
+	Server(void)
+	: log_("/server"),
+	  mtx_("Server"),
+	  group_("/test/io/stripe/channel/server", "StripeChannel server"),
+	  server_(NULL),
+	  paths_(),
+	  stripe_(NULL),
+	  splice_(NULL),
+	  action_(NULL),
+	  accept_complete_(NULL, &mtx_, this, &Server::accept_complete),
+	  server_close_complete_(NULL, &mtx_, this, &Server::server_close_complete),
+	  splice_complete_(NULL, &mtx_, this, &Server::splice_complete),
+	  close_complete_(NULL, &mtx_, this, &Server::close_complete)
+	{
+		ScopedLock _(&mtx_);
+		server_ = TCPServer::listen(SocketImplOS, SocketAddressFamilyIP, "[localhost]:0");
+		ASSERT_NON_NULL(log_, server_);
+		action_ = server_->accept(&accept_complete_);
+	}
+
+	~Server()
+	{
+		Test _(group_, "Server finished");
+		if (server_ == NULL && stripe_ == NULL && splice_ == NULL)
+			_.pass();
+	}
+
+	std::string getsockname(void) const
+	{
+		return (server_->getsockname());
+	}
+
+private:
+	void accept_complete(Event e, Socket *socket)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		{
+			Test _(group_, "Path accepted");
+			if (e.type_ != Event::Done)
+				return;
+			_.pass();
+		}
+		paths_.push_back(socket);
+
+		if (paths_.size() != STRIPE_TEST_PATHS) {
+			action_ = server_->accept(&accept_complete_);
+			return;
+		}
+		action_ = server_->close(&server_close_complete_);
+	}
+
+	void server_close_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		delete server_;
+		server_ = NULL;
+
+		stripe_ = new StripeChannel(log_, paths_);
+		splice_ = new Splice(log_, stripe_, NULL, stripe_);
+		action_ = splice_->start(&splice_complete_);
+	}
+
+	void splice_complete(Event e)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		delete splice_;
+		splice_ = NULL;
+
+		{
+			Test _(group_, "Echo reached end of stream");
+			if (e.type_ == Event::EOS)
+				_.pass();
+		}
+
+		action_ = stripe_->close(&close_complete_);
+	}
+
+	void close_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		delete stripe_;
+		stripe_ = NULL;
+
+		side_finished();
+	}
+};
+
+class Client {
+	LogHandle log_;
+	Mutex mtx_;
+	TestGroup group_;
+	std::string remote_;
+	std::vector<StreamChannel *> channels_;
+	std::vector<TestPath *> paths_;
+	StripeChannel *stripe_;
+	Buffer received_;
+	bool write_done_;
+	bool read_done_;
+	Action *write_action_;
+	Action *read_action_;
+	SocketEventCallback::Method<Client> connect_complete_;
+	EventCallback::Method<Client> write_complete_;
+	EventCallback::Method<Client> shutdown_complete_;
+	BufferEventCallback::Method<Client> read_complete_;
+	SimpleCallback::Method<Client> close_complete_;
+public:
+	Client(const std::string& remote)
+	: log_("/client"),
+	  mtx_("Client"),
+	  group_("/test/io/stripe/channel/client", "StripeChannel client"),
+	  remote_(remote),
+	  channels_(),
+	  paths_(),
+	  stripe_(NULL),
+	  received_(),
+	  write_done_(false),
+	  read_done_(false),
+	  write_action_(NULL),
+	  read_action_(NULL),
+	  connect_complete_(NULL, &mtx_, this, &Client::connect_complete),
+	  write_complete_(NULL, &mtx_, this, &Client::write_complete),
+	  shutdown_complete_(NULL, &mtx_, this, &Client::shutdown_complete),
+	  read_complete_(NULL, &mtx_, this, &Client::read_complete),
+	  close_complete_(NULL, &mtx_, this, &Client::close_complete)
+	{
+		ScopedLock _(&mtx_);
+		write_action_ = TCPClient::connect(SocketImplOS, SocketAddressFamilyIP, remote_, &connect_complete_);
+	}
+
+	~Client()
+	{
+		Test _(group_, "Client finished");
+		if (stripe_ == NULL && write_action_ == NULL && read_action_ == NULL)
+			_.pass();
+	}
+
+private:
+	void connect_complete(Event e, Socket *socket)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		write_action_->cancel();
+		write_action_ = NULL;
+
+		{
+			Test _(group_, "Path connected");
+			if (e.type_ != Event::Done)
+				return;
+			_.pass();
+		}
+
+		TestPath *path = new TestPath(socket, paths_.empty() ? STRIPE_TEST_DELAY : 0);
+		paths_.push_back(path);
+		channels_.push_back(path);
+
+		if (paths_.size() != STRIPE_TEST_PATHS) {
+			write_action_ = TCPClient::connect(SocketImplOS, SocketAddressFamilyIP, remote_, &connect_complete_);
+			return;
+		}
+
+		stripe_ = new StripeChannel(log_, channels_);
+
+		Buffer buf(data, sizeof data);
+		write_action_ = stripe_->write(&buf, &write_complete_);
+		read_action_ = stripe_->read(0, &read_complete_);
+	}
+
+	void write_complete(Event e)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		write_action_->cancel();
+		write_action_ = NULL;
+
+		{
+			Test _(group_, "Write complete");
+			if (e.type_ == Event::Done)
+				_.pass();
+		}
+
+		write_action_ = stripe_->shutdown(false, true, &shutdown_complete_);
+	}
+
+	void shutdown_complete(Event e)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		write_action_->cancel();
+		write_action_ = NULL;
+
+		{
+			Test _(group_, "Shutdown complete");
+			if (e.type_ == Event::Done)
+				_.pass();
+		}
+
+		write_done_ = true;
+		finish();
+	}
+
+	void read_complete(Event e, Buffer buf)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		read_action_->cancel();
+		read_action_ = NULL;
+
+		switch (e.type_) {
+		case Event::Done:
+			received_.append(buf);
+			read_action_ = stripe_->read(0, &read_complete_);
+			return;
+		case Event::EOS:
+			received_.append(buf);
+			break;
+		default:
+			HALT(log_) << "Unexpected event: " << e;
+			return;
+		}
+
+		{
+			Test _(group_, "Echoed length correct");
+			if (received_.length() == sizeof data)
+				_.pass();
+		}
+		{
+			Test _(group_, "Echoed data correct");
+			if (received_.equal(data, sizeof data))
+				_.pass();
+		}
+
+		read_done_ = true;
+		finish();
+	}
+
+	void finish(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		if (!write_done_ || !read_done_)
+			return;
+
+		size_t total = 0;
+		std::vector<TestPath *>::const_iterator it;
+		for (it = paths_.begin(); it != paths_.end(); ++it) {
+			INFO(log_) << "Path sent " << (*it)->written() << " bytes.";
+			total += (*it)->written();
+		}
+		{
+			Test _(group_, "Delayed path carried less than its share");
+			if (paths_[0]->written() < total / STRIPE_TEST_PATHS)
+				_.pass();
+		}
+
+		read_action_ = stripe_->close(&close_complete_);
+	}
+
+	void close_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		read_action_->cancel();
+		read_action_ = NULL;
+
+		delete stripe_;
+		stripe_ = NULL;
+
+		side_finished();
+	}
+};
+
+int
+main(void)
+{
+	unsigned i;
+
+	for (i = 0; i < sizeof data; i++)
+		data[i] = random() % 0xff;
+
+	sides_running.add(2);
+
+	Server *server = new Server();
+	Client *client = new Client(server->getsockname());
+
+	event_main();
+
+	delete client;
+	delete server;
+}
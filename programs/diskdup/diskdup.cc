@@ -27,13 +27,17 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include <common/thread/mutex.h>
+
 #include <event/event_callback.h>
 #include <event/event_main.h>
+#include <event/event_system.h>
 
 #include <io/block_handle.h>
 
 class DiskDup {
 	LogHandle log_;
+	Mutex mtx_;
 	BlockHandle *source_;
 	BlockHandle *target_;
 	uint64_t block_number_;
@@ -41,23 +45,52 @@ class DiskDup {
 	Action *target_action_;
 	Buffer source_buffer_;
 	Buffer target_buffer_;
+	BufferEventCallback::Method<DiskDup> source_read_complete_;
+	BufferEventCallback::Method<DiskDup> target_read_complete_;
+	EventCallback::Method<DiskDup> write_complete_;
+	SimpleCallback::Method<DiskDup> source_close_complete_;
+	SimpleCallback::Method<DiskDup> target_close_complete_;
 public:
 	DiskDup(BlockHandle *source, BlockHandle *target)
 	: log_("/diskdup"),
+	  mtx_("DiskDup"),
 	  source_(source),
 	  target_(target),
 	  block_number_(0),
 	  source_action_(NULL),
 	  target_action_(NULL),
 	  source_buffer_(),
-	  target_buffer_()
+	  target_buffer_(),
+	  source_read_complete_(NULL, &mtx_, this, &DiskDup::source_read_complete),
+	  target_read_complete_(NULL, &mtx_, this, &DiskDup::target_read_complete),
+	  write_complete_(NULL, &mtx_, this, &DiskDup::write_complete),
+	  source_close_complete_(NULL, &mtx_, this, &DiskDup::source_close_complete),
+	  target_close_complete_(NULL, &mtx_, this, &DiskDup::target_close_complete)
 	{
+		ScopedLock _(&mtx_);
 		schedule_read();
 	}
 
+	~DiskDup()
+	{
+		ASSERT_NULL(log_, source_);
+		ASSERT_NULL(log_, target_);
+	}
+
 private:
+	void source_close_complete(void)
+	{
+		close_complete(false);
+	}
+
+	void target_close_complete(void)
+	{
+		close_complete(true);
+	}
+
 	void close_complete(bool target)
 	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
 		if (target) {
 			ASSERT_NON_NULL(log_, target_action_);
 			target_action_->cancel();
@@ -74,12 +107,25 @@ private:
 			source_ = NULL;
 		}
 
-		if (source_ == NULL && target_ == NULL)
-			delete this;
+		if (source_ == NULL && target_ == NULL) {
+			EventSystem::instance()->stop();
+			EventSystem::instance()->destroy(&mtx_, this);
+		}
+	}
+
+	void source_read_complete(Event e, Buffer buf)
+	{
+		read_complete(e, buf, false);
 	}
 
-	void read_complete(Event e, bool target)
+	void target_read_complete(Event e, Buffer buf)
 	{
+		read_complete(e, buf, true);
+	}
+
+	void read_complete(Event e, Buffer buf, bool target)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
 		if (target) {
 			ASSERT_NON_NULL(log_, target_action_);
 			target_action_->cancel();
@@ -94,7 +140,7 @@ private:
 		case Event::Done:
 			break;
 		case Event::EOS:
-			if (!e.buffer_.empty()) {
+			if (!buf.empty()) {
 				ERROR(log_) << "Received non-empty end-of-stream: " << e;
 				INFO(log_) << "Block size may be incorrect.";
 			}
@@ -109,11 +155,11 @@ private:
 		}
 
 		if (target) {
-			target_buffer_ = e.buffer_;
+			target_buffer_ = buf;
 			if (source_buffer_.empty())
 				return;
 		} else {
-			source_buffer_ = e.buffer_;
+			source_buffer_ = buf;
 			if (target_buffer_.empty())
 				return;
 		}
@@ -131,6 +177,7 @@ private:
 
 	void write_complete(Event e)
 	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
 		ASSERT_NON_NULL(log_, target_action_);
 		target_action_->cancel();
 		target_action_ = NULL;
@@ -165,11 +212,8 @@ private:
 			target_action_ = NULL;
 		}
 
-		SimpleCallback *scb = callback(this, &DiskDup::close_complete, false);
-		source_action_ = source_->close(scb);
-
-		SimpleCallback *tcb = callback(this, &DiskDup::close_complete, true);
-		target_action_ = target_->close(tcb);
+		source_action_ = source_->close(&source_close_complete_);
+		target_action_ = target_->close(&target_close_complete_);
 	}
 
 	void schedule_read(void)
@@ -178,20 +222,17 @@ private:
 		target_buffer_.clear();
 
 		ASSERT_NULL(log_, source_action_);
-		EventCallback *scb = callback(this, &DiskDup::read_complete, false);
-		source_action_ = source_->read(block_number_, scb);
+		source_action_ = source_->read(block_number_, &source_read_complete_);
 
 		ASSERT_NULL(log_, target_action_);
-		EventCallback *tcb = callback(this, &DiskDup::read_complete, true);
-		target_action_ = target_->read(block_number_, tcb);
+		target_action_ = target_->read(block_number_, &target_read_complete_);
 	}
 
 	void schedule_write(void)
 	{
 		ASSERT_NULL(log_, source_action_);
 		ASSERT_NULL(log_, target_action_);
-		EventCallback *cb = callback(this, &DiskDup::write_complete);
-		target_action_ = target_->write(block_number_, &source_buffer_, cb);
+		target_action_ = target_->write(block_number_, &source_buffer_, &write_complete_);
 	}
 };
 
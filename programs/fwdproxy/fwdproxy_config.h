@@ -26,6 +26,8 @@
 #ifndef	PROGRAMS_FWDPROXY_FWDPROXY_CONFIG_H
 #define	PROGRAMS_FWDPROXY_FWDPROXY_CONFIG_H
 
+#include <deque>
+
 class FWDProxyConfig {
 	LogHandle log_;
 public:
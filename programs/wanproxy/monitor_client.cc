@@ -25,6 +25,8 @@
 
 #include <common/buffer.h>
 
+#include <common/thread/mutex_profile.h>
+
 #include <config/config.h>
 #include <config/config_class.h>
 #include <config/config_exporter.h>
@@ -162,6 +164,26 @@ MonitorClient::handle_request(const std::string& method, const std::string& uri,
 		path_components.erase(path_components.begin());
 	}
 
+	if (!path_components.empty() && path_components[0].equal("mutexes")) {
+		if (path_components.size() != 1) {
+			pipe_->send_response(HTTPProtocol::NotFound, "Wrong number of path components in URI.");
+			return;
+		}
+
+		std::ostringstream os;
+		if (MutexProfile::enabled_)
+			MutexProfile::dump(os);
+		else
+			os << "Mutex profiling is not enabled." << std::endl;
+
+		if (text) {
+			pipe_->send_response(HTTPProtocol::OK, os.str());
+			return;
+		}
+		pipe_->send_response(HTTPProtocol::OK, "<html><head><title>WANProxy Monitor</title><style type=\"text/css\">body { font-family: sans-serif; }</style></head><body><h1>Mutex contention [<a href=\"/\">up</a>]</h1><pre>" + os.str() + "</pre></body></html>", "text/html");
+		return;
+	}
+
 	std::string select;
 	if (!path_components.empty()) {
 		switch (path_components.size()) {
@@ -39,12 +39,15 @@
 #include <io/net/tcp_client.h>
 
 #include "proxy_connector.h"
+#include "proxy_peer_pool.h"
 
 ProxyConnector::ProxyConnector(const std::string& name,
-			 PipePair *pipe_pair, Socket *local_socket,
+			 PipePair *pipe_pair, StreamChannel *local_socket,
 			 SocketImpl impl,
 			 SocketAddressFamily family,
-			 const std::string& remote_name)
+			 const std::string& remote_name,
+			 Buffer *local_buffer,
+			 ProxyPeerPool *remote_pool)
 : log_("/wanproxy/proxy/" + name + "/connector"),
   mtx_("ProxyConnector::" + name),
   stop_(NULL, &mtx_, this, &ProxyConnector::stop),
@@ -52,7 +55,9 @@ ProxyConnector::ProxyConnector(const std::string& name,
   local_close_complete_(NULL, &mtx_, this, &ProxyConnector::local_close_complete),
   local_action_(NULL),
   local_socket_(local_socket),
+  local_buffer_(),
   connect_complete_(NULL, &mtx_, this, &ProxyConnector::connect_complete),
+  local_buffer_write_complete_(NULL, &mtx_, this, &ProxyConnector::local_buffer_write_complete),
   remote_close_complete_(NULL, &mtx_, this, &ProxyConnector::remote_close_complete),
   remote_action_(NULL),
   remote_socket_(NULL),
@@ -70,8 +75,69 @@ ProxyConnector::ProxyConnector(const std::string& name,
 		outgoing_pipe_ = pipe_pair_->get_outgoing();
 	}
 
+	/*
+	 * Data which whoever accepted the local socket has already read
+	 * from it is written to the remote socket before we start to
+	 * splice, so it must not need to go through a pipe.
+	 */
+	if (local_buffer != NULL && !local_buffer->empty()) {
+		ASSERT_NULL(log_, incoming_pipe_);
+		local_buffer->moveout(&local_buffer_);
+	}
+
 	ScopedLock _(&mtx_);
-	remote_action_ = TCPClient::connect(impl, family, remote_name, &connect_complete_);
+	StreamChannel *remote_socket = NULL;
+	if (remote_pool != NULL)
+		remote_socket = remote_pool->get();
+	if (remote_socket != NULL)
+		remote_connected(remote_socket);
+	else
+		remote_action_ = TCPClient::connect(impl, family, remote_name, &connect_complete_);
+
+	stop_action_ = EventSystem::instance()->register_interest(EventInterestStop, &stop_);
+}
+
+/*
+ * For a remote channel which is already open, such as a stream multiplexed
+ * over a connection to a peer, or none at all, if no such channel could be
+ * had, in which case the local socket is simply closed.
+ */
+ProxyConnector::ProxyConnector(const std::string& name,
+			 PipePair *pipe_pair, StreamChannel *local_socket,
+			 StreamChannel *remote_socket)
+: log_("/wanproxy/proxy/" + name + "/connector"),
+  mtx_("ProxyConnector::" + name),
+  stop_(NULL, &mtx_, this, &ProxyConnector::stop),
+  stop_action_(NULL),
+  local_close_complete_(NULL, &mtx_, this, &ProxyConnector::local_close_complete),
+  local_action_(NULL),
+  local_socket_(local_socket),
+  local_buffer_(),
+  connect_complete_(NULL, &mtx_, this, &ProxyConnector::connect_complete),
+  local_buffer_write_complete_(NULL, &mtx_, this, &ProxyConnector::local_buffer_write_complete),
+  remote_close_complete_(NULL, &mtx_, this, &ProxyConnector::remote_close_complete),
+  remote_action_(NULL),
+  remote_socket_(NULL),
+  pipe_pair_(pipe_pair),
+  incoming_pipe_(NULL),
+  incoming_splice_(NULL),
+  outgoing_pipe_(NULL),
+  outgoing_splice_(NULL),
+  splice_complete_(NULL, &mtx_, this, &ProxyConnector::splice_complete),
+  splice_pair_(NULL),
+  splice_action_(NULL)
+{
+	if (pipe_pair_ != NULL) {
+		incoming_pipe_ = pipe_pair_->get_incoming();
+		outgoing_pipe_ = pipe_pair_->get_outgoing();
+	}
+
+	ScopedLock _(&mtx_);
+	if (remote_socket == NULL) {
+		schedule_close();
+		return;
+	}
+	remote_connected(remote_socket);
 
 	stop_action_ = EventSystem::instance()->register_interest(EventInterestStop, &stop_);
 }
@@ -158,9 +224,50 @@ ProxyConnector::connect_complete(Event e, Socket *socket)
 		return;
 	}
 
+	remote_connected(socket);
+}
+
+void
+ProxyConnector::remote_connected(StreamChannel *socket)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	ASSERT_NULL(log_, remote_action_);
+
 	remote_socket_ = socket;
 	ASSERT_NON_NULL(log_, remote_socket_);
 
+	if (!local_buffer_.empty()) {
+		remote_action_ = remote_socket_->write(&local_buffer_, &local_buffer_write_complete_);
+		return;
+	}
+
+	schedule_splice();
+}
+
+void
+ProxyConnector::local_buffer_write_complete(Event e)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	remote_action_->cancel();
+	remote_action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	default:
+		ERROR(log_) << "Unexpected event: " << e;
+		schedule_close();
+		return;
+	}
+
+	schedule_splice();
+}
+
+void
+ProxyConnector::schedule_splice(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+
 	incoming_splice_ = new Splice(log_ + "/incoming", local_socket_, incoming_pipe_, remote_socket_);
 	outgoing_splice_ = new Splice(log_ + "/outgoing", remote_socket_, outgoing_pipe_, local_socket_);
 
@@ -204,7 +311,8 @@ ProxyConnector::stop(void)
 	stop_action_ = NULL;
 
 	/*
-	 * Connecting.
+	 * Connecting, or writing what was already read from the local
+	 * socket.
 	 */
 	if (local_action_ == NULL && remote_action_ != NULL &&
 	    splice_action_ == NULL) {
@@ -30,9 +30,11 @@
 
 class Pipe;
 class PipePair;
+class ProxyPeerPool;
 class Socket;
 class Splice;
 class SplicePair;
+class StreamChannel;
 
 class ProxyConnector {
 	friend class DestroyThread;
@@ -46,12 +48,14 @@ class ProxyConnector {
 
 	SimpleCallback::Method<ProxyConnector> local_close_complete_;
 	Action *local_action_;
-	Socket *local_socket_;
+	StreamChannel *local_socket_;
+	Buffer local_buffer_;
 
 	SocketEventCallback::Method<ProxyConnector> connect_complete_;
+	EventCallback::Method<ProxyConnector> local_buffer_write_complete_;
 	SimpleCallback::Method<ProxyConnector> remote_close_complete_;
 	Action *remote_action_;
-	Socket *remote_socket_;
+	StreamChannel *remote_socket_;
 
 	PipePair *pipe_pair_;
 
@@ -66,17 +70,21 @@ class ProxyConnector {
 	Action *splice_action_;
 
 public:
-	ProxyConnector(const std::string&, PipePair *, Socket *, SocketImpl, SocketAddressFamily, const std::string&);
+	ProxyConnector(const std::string&, PipePair *, StreamChannel *, SocketImpl, SocketAddressFamily, const std::string&, Buffer * = NULL, ProxyPeerPool * = NULL);
+	ProxyConnector(const std::string&, PipePair *, StreamChannel *, StreamChannel *);
 private:
 	~ProxyConnector();
 
 	void local_close_complete(void);
 	void remote_close_complete(void);
 	void connect_complete(Event, Socket *);
+	void remote_connected(StreamChannel *);
+	void local_buffer_write_complete(Event);
 	void splice_complete(Event);
 	void stop(void);
 
 	void schedule_close(void);
+	void schedule_splice(void);
 };
 
 #endif /* !PROGRAMS_WANPROXY_PROXY_CONNECTOR_H */
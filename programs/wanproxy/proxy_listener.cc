@@ -34,6 +34,8 @@
 
 #include "proxy_connector.h"
 #include "proxy_listener.h"
+#include "proxy_mux_connector.h"
+#include "proxy_stripe_connector.h"
 
 #include "wanproxy_codec_pipe_pair.h"
 
@@ -45,14 +47,22 @@ ProxyListener::ProxyListener(const std::string& name,
 			     const std::string& interface,
 			     SocketImpl remote_impl,
 			     SocketAddressFamily remote_family,
-			     const std::string& remote_name)
+			     const std::string& remote_name,
+			     ProxyPeerPool *remote_pool,
+			     size_t interface_zerocopy,
+			     ProxyMuxConnector *remote_mux,
+			     unsigned remote_paths)
 : SimpleServer<TCPServer>("/wanproxy/proxy/" + name + "/listener", interface_impl, interface_family, interface),
   name_(name),
   interface_codec_(interface_codec),
+  interface_zerocopy_(interface_zerocopy),
   remote_codec_(remote_codec),
   remote_impl_(remote_impl),
   remote_family_(remote_family),
-  remote_name_(remote_name)
+  remote_name_(remote_name),
+  remote_pool_(remote_pool),
+  remote_mux_(remote_mux),
+  remote_paths_(remote_paths)
 { }
 
 ProxyListener::~ProxyListener()
@@ -61,6 +71,27 @@ ProxyListener::~ProxyListener()
 void
 ProxyListener::client_connected(Socket *socket)
 {
+	/*
+	 * Large writes of decoded data to clients may be sent without
+	 * copying.
+	 */
+	if (interface_zerocopy_ != 0)
+		socket->zerocopy(interface_zerocopy_);
+
+	/*
+	 * The peer's codec is applied to the session as a whole, not to each
+	 * stream in it.
+	 */
+	if (remote_mux_ != NULL) {
+		PipePair *pipe_pair = new WANProxyCodecPipePair(interface_codec_, NULL);
+		new ProxyConnector(name_, pipe_pair, socket, remote_mux_->open());
+		return;
+	}
+
 	PipePair *pipe_pair = new WANProxyCodecPipePair(interface_codec_, remote_codec_);
-	new ProxyConnector(name_, pipe_pair, socket, remote_impl_, remote_family_, remote_name_);
+	if (remote_paths_ != 0) {
+		new ProxyStripeConnector(name_, pipe_pair, socket, remote_impl_, remote_family_, remote_name_, remote_paths_);
+		return;
+	}
+	new ProxyConnector(name_, pipe_pair, socket, remote_impl_, remote_family_, remote_name_, NULL, remote_pool_);
 }
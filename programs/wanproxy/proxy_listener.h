@@ -28,6 +28,8 @@
 
 #include <io/socket/simple_server.h>
 
+class ProxyMuxConnector;
+class ProxyPeerPool;
 class Socket;
 class TCPServer;
 struct WANProxyCodec;
@@ -35,14 +37,19 @@ struct WANProxyCodec;
 class ProxyListener : public SimpleServer<TCPServer> {
 	std::string name_;
 	WANProxyCodec *interface_codec_;
+	size_t interface_zerocopy_;
 	WANProxyCodec *remote_codec_;
 	SocketImpl remote_impl_;
 	SocketAddressFamily remote_family_;
 	std::string remote_name_;
+	ProxyPeerPool *remote_pool_;
+	ProxyMuxConnector *remote_mux_;
+	unsigned remote_paths_;
 public:
 	ProxyListener(const std::string&, WANProxyCodec *, WANProxyCodec *, SocketImpl, SocketAddressFamily,
 		      const std::string&, SocketImpl, SocketAddressFamily,
-		      const std::string&);
+		      const std::string&, ProxyPeerPool *, size_t, ProxyMuxConnector * = NULL,
+		      unsigned = 0);
 	~ProxyListener();
 
 private:
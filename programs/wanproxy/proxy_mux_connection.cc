@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <common/thread/mutex.h>
+
+#include <event/event_callback.h>
+#include <event/event_system.h>
+
+#include <io/socket/socket.h>
+
+#include "proxy_connector.h"
+#include "proxy_mux_connection.h"
+#include "proxy_mux_session.h"
+#include "wanproxy_codec_pipe_pair.h"
+
+ProxyMuxConnection::ProxyMuxConnection(const std::string& name,
+				       WANProxyCodec *interface_codec,
+				       Socket *socket,
+				       WANProxyCodec *remote_codec,
+				       SocketImpl remote_impl,
+				       SocketAddressFamily remote_family,
+				       const std::string& remote_name)
+: log_("/wanproxy/proxy/" + name + "/mux/connection"),
+  mtx_("ProxyMuxConnection::" + name),
+  name_(name),
+  remote_codec_(remote_codec),
+  remote_impl_(remote_impl),
+  remote_family_(remote_family),
+  remote_name_(remote_name),
+  session_(NULL),
+  session_complete_(NULL, &mtx_, this, &ProxyMuxConnection::session_complete),
+  session_action_(NULL),
+  accept_complete_(NULL, &mtx_, this, &ProxyMuxConnection::accept_complete),
+  accept_action_(NULL),
+  stop_(NULL, &mtx_, this, &ProxyMuxConnection::stop),
+  stop_action_(NULL)
+{
+	ScopedLock _(&mtx_);
+	session_ = new ProxyMuxSession(log_, false, new WANProxyCodecPipePair(interface_codec, NULL));
+	session_action_ = session_->start(socket, &session_complete_);
+	accept_action_ = session_->accept(&accept_complete_);
+
+	stop_action_ = EventSystem::instance()->register_interest(EventInterestStop, &stop_);
+}
+
+ProxyMuxConnection::~ProxyMuxConnection()
+{
+	ASSERT_NULL(log_, session_);
+	ASSERT_NULL(log_, session_action_);
+	ASSERT_NULL(log_, accept_action_);
+	ASSERT_NULL(log_, stop_action_);
+}
+
+void
+ProxyMuxConnection::session_complete(Event e)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	session_action_->cancel();
+	session_action_ = NULL;
+
+	switch (e.type_) {
+	case Event::EOS:
+		DEBUG(log_) << "Session closed by peer.";
+		break;
+	default:
+		INFO(log_) << "Session failed: " << e;
+		break;
+	}
+
+	schedule_close();
+}
+
+void
+ProxyMuxConnection::accept_complete(Event e, StreamChannel *stream)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	accept_action_->cancel();
+	accept_action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	case Event::EOS:
+		return;
+	default:
+		HALT(log_) << "Unexpected event: " << e;
+		return;
+	}
+
+	PipePair *pipe_pair = new WANProxyCodecPipePair(NULL, remote_codec_);
+	new ProxyConnector(name_, pipe_pair, stream, remote_impl_, remote_family_, remote_name_);
+
+	accept_action_ = session_->accept(&accept_complete_);
+}
+
+void
+ProxyMuxConnection::stop(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	stop_action_->cancel();
+	stop_action_ = NULL;
+
+	session_action_->cancel();
+	session_action_ = NULL;
+
+	schedule_close();
+}
+
+void
+ProxyMuxConnection::schedule_close(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	if (stop_action_ != NULL) {
+		stop_action_->cancel();
+		stop_action_ = NULL;
+	}
+
+	if (accept_action_ != NULL) {
+		accept_action_->cancel();
+		accept_action_ = NULL;
+	}
+
+	session_->close();
+	session_ = NULL;
+
+	EventSystem::instance()->destroy(&mtx_, this);
+}
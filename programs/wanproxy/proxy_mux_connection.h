@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	PROGRAMS_WANPROXY_PROXY_MUX_CONNECTION_H
+#define	PROGRAMS_WANPROXY_PROXY_MUX_CONNECTION_H
+
+#include <io/mux/mux_session.h>
+
+class ProxyMuxSession;
+class Socket;
+struct WANProxyCodec;
+
+/*
+ * Accepts the streams of a session from a peer, and hands each to a
+ * ProxyConnector to be carried on to the remote host.
+ */
+class ProxyMuxConnection {
+	friend class DestroyThread;
+
+	LogHandle log_;
+	Mutex mtx_;
+	std::string name_;
+	WANProxyCodec *remote_codec_;
+	SocketImpl remote_impl_;
+	SocketAddressFamily remote_family_;
+	std::string remote_name_;
+	ProxyMuxSession *session_;
+
+	EventCallback::Method<ProxyMuxConnection> session_complete_;
+	Action *session_action_;
+
+	StreamChannelEventCallback::Method<ProxyMuxConnection> accept_complete_;
+	Action *accept_action_;
+
+	SimpleCallback::Method<ProxyMuxConnection> stop_;
+	Action *stop_action_;
+public:
+	ProxyMuxConnection(const std::string&, WANProxyCodec *, Socket *, WANProxyCodec *, SocketImpl, SocketAddressFamily, const std::string&);
+private:
+	~ProxyMuxConnection();
+
+	void session_complete(Event);
+	void accept_complete(Event, StreamChannel *);
+	void stop(void);
+
+	void schedule_close(void);
+};
+
+#endif /* !PROGRAMS_WANPROXY_PROXY_MUX_CONNECTION_H */
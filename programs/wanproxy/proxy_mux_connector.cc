@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <common/thread/mutex.h>
+
+#include <common/time/time.h>
+
+#include <event/event_callback.h>
+#include <event/event_system.h>
+
+#include <io/net/tcp_client.h>
+
+#include <io/socket/socket.h>
+
+#include "proxy_mux_connector.h"
+#include "proxy_mux_session.h"
+#include "wanproxy_codec_pipe_pair.h"
+
+ProxyMuxConnector::ProxyMuxConnector(const std::string& name,
+				     WANProxyCodec *codec,
+				     SocketImpl impl,
+				     SocketAddressFamily family,
+				     const std::string& remote_name)
+: log_("/wanproxy/proxy/" + name + "/mux/connector"),
+  mtx_("ProxyMuxConnector::" + name),
+  codec_(codec),
+  impl_(impl),
+  family_(family),
+  remote_name_(remote_name),
+  session_(NULL),
+  session_started_(),
+  connect_complete_(NULL, &mtx_, this, &ProxyMuxConnector::connect_complete),
+  connect_action_(NULL),
+  session_complete_(NULL, &mtx_, this, &ProxyMuxConnector::session_complete),
+  session_action_(NULL),
+  retry_complete_(NULL, &mtx_, this, &ProxyMuxConnector::retry_complete),
+  retry_action_(NULL),
+  stop_(NULL, &mtx_, this, &ProxyMuxConnector::stop),
+  stop_action_(NULL)
+{
+	ScopedLock _(&mtx_);
+	connect();
+
+	stop_action_ = EventSystem::instance()->register_interest(EventInterestStop, &stop_);
+}
+
+ProxyMuxConnector::~ProxyMuxConnector()
+{
+	ASSERT_NULL(log_, session_);
+	ASSERT_NULL(log_, connect_action_);
+	ASSERT_NULL(log_, session_action_);
+	ASSERT_NULL(log_, retry_action_);
+	ASSERT_NULL(log_, stop_action_);
+}
+
+/*
+ * Streams may be opened while the session is still connecting; what is
+ * written to them is sent once it has.
+ */
+StreamChannel *
+ProxyMuxConnector::open(void)
+{
+	ScopedLock _(&mtx_);
+	if (session_ == NULL)
+		return (NULL);
+	return (session_->open());
+}
+
+void
+ProxyMuxConnector::connect(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	ASSERT_NULL(log_, session_);
+
+	session_ = new ProxyMuxSession(log_, true, new WANProxyCodecPipePair(NULL, codec_));
+	connect_action_ = TCPClient::connect(impl_, family_, remote_name_, &connect_complete_);
+}
+
+void
+ProxyMuxConnector::connect_complete(Event e, Socket *socket)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	connect_action_->cancel();
+	connect_action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	case Event::Error:
+		INFO(log_) << "Connect failed: " << e;
+		retire();
+		retry_action_ = EventSystem::instance()->timeout(PROXY_MUX_CONNECTOR_RETRY, &retry_complete_);
+		return;
+	default:
+		HALT(log_) << "Unexpected event: " << e;
+		return;
+	}
+
+	session_started_ = NanoTime::current_time();
+	session_action_ = session_->start(socket, &session_complete_);
+}
+
+void
+ProxyMuxConnector::session_complete(Event e)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	session_action_->cancel();
+	session_action_ = NULL;
+
+	switch (e.type_) {
+	case Event::EOS:
+		DEBUG(log_) << "Session closed by peer.";
+		break;
+	default:
+		INFO(log_) << "Session failed: " << e;
+		break;
+	}
+
+	retire();
+
+	/*
+	 * A peer which refuses sessions, or ends them at once, is left alone
+	 * for a while.
+	 */
+	NanoTime elapsed = NanoTime::current_time();
+	elapsed -= session_started_;
+	if (elapsed.seconds_ * 1000 + elapsed.nanoseconds_ / 1000000 < PROXY_MUX_CONNECTOR_RETRY) {
+		retry_action_ = EventSystem::instance()->timeout(PROXY_MUX_CONNECTOR_RETRY, &retry_complete_);
+		return;
+	}
+	connect();
+}
+
+void
+ProxyMuxConnector::retry_complete(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	retry_action_->cancel();
+	retry_action_ = NULL;
+
+	connect();
+}
+
+/*
+ * The session closes once every stream in it has been.
+ */
+void
+ProxyMuxConnector::retire(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	ASSERT_NON_NULL(log_, session_);
+
+	session_->close();
+	session_ = NULL;
+}
+
+void
+ProxyMuxConnector::stop(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	stop_action_->cancel();
+	stop_action_ = NULL;
+
+	if (connect_action_ != NULL) {
+		connect_action_->cancel();
+		connect_action_ = NULL;
+	}
+
+	if (session_action_ != NULL) {
+		session_action_->cancel();
+		session_action_ = NULL;
+	}
+
+	if (retry_action_ != NULL) {
+		retry_action_->cancel();
+		retry_action_ = NULL;
+	}
+
+	if (session_ != NULL)
+		retire();
+}
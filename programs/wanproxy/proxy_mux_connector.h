@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	PROGRAMS_WANPROXY_PROXY_MUX_CONNECTOR_H
+#define	PROGRAMS_WANPROXY_PROXY_MUX_CONNECTOR_H
+
+#define	PROXY_MUX_CONNECTOR_RETRY	1000	/* Milliseconds.  */
+
+class ProxyMuxSession;
+class Socket;
+class StreamChannel;
+struct WANProxyCodec;
+
+/*
+ * Keeps a session open to a peer, over which clients' connections are
+ * carried as streams.  A new session is started as soon as one ends,
+ * unless it ended almost as soon as it began, or the peer could not be
+ * reached, in which case clients are turned away until it has been tried
+ * again.
+ */
+class ProxyMuxConnector {
+	LogHandle log_;
+	Mutex mtx_;
+	WANProxyCodec *codec_;
+	SocketImpl impl_;
+	SocketAddressFamily family_;
+	std::string remote_name_;
+	ProxyMuxSession *session_;
+	NanoTime session_started_;
+
+	SocketEventCallback::Method<ProxyMuxConnector> connect_complete_;
+	Action *connect_action_;
+
+	EventCallback::Method<ProxyMuxConnector> session_complete_;
+	Action *session_action_;
+
+	SimpleCallback::Method<ProxyMuxConnector> retry_complete_;
+	Action *retry_action_;
+
+	SimpleCallback::Method<ProxyMuxConnector> stop_;
+	Action *stop_action_;
+public:
+	ProxyMuxConnector(const std::string&, WANProxyCodec *, SocketImpl, SocketAddressFamily, const std::string&);
+	~ProxyMuxConnector();
+
+	StreamChannel *open(void);
+
+private:
+	void connect(void);
+	void connect_complete(Event, Socket *);
+	void session_complete(Event);
+	void retry_complete(void);
+	void retire(void);
+	void stop(void);
+};
+
+#endif /* !PROGRAMS_WANPROXY_PROXY_MUX_CONNECTOR_H */
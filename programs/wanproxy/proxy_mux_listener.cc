@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <event/event_callback.h>
+#include <event/event_system.h>
+
+#include <io/socket/socket.h>
+
+#include <io/net/tcp_server.h>
+
+#include "proxy_mux_connection.h"
+#include "proxy_mux_listener.h"
+
+ProxyMuxListener::ProxyMuxListener(const std::string& name,
+				   WANProxyCodec *interface_codec,
+				   WANProxyCodec *remote_codec,
+				   SocketImpl interface_impl,
+				   SocketAddressFamily interface_family,
+				   const std::string& interface,
+				   SocketImpl remote_impl,
+				   SocketAddressFamily remote_family,
+				   const std::string& remote_name)
+: SimpleServer<TCPServer>("/wanproxy/proxy/" + name + "/mux/listener", interface_impl, interface_family, interface),
+  name_(name),
+  interface_codec_(interface_codec),
+  remote_codec_(remote_codec),
+  remote_impl_(remote_impl),
+  remote_family_(remote_family),
+  remote_name_(remote_name)
+{ }
+
+ProxyMuxListener::~ProxyMuxListener()
+{ }
+
+void
+ProxyMuxListener::client_connected(Socket *socket)
+{
+	new ProxyMuxConnection(name_, interface_codec_, socket, remote_codec_, remote_impl_, remote_family_, remote_name_);
+}
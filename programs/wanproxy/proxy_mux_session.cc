@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <common/thread/mutex.h>
+
+#include <event/event_callback.h>
+#include <event/event_system.h>
+
+#include <io/pipe/pipe.h>
+#include <io/pipe/pipe_pair.h>
+#include <io/socket/socket.h>
+
+#include "proxy_mux_session.h"
+
+/*
+ * The pipe pair is oriented as for a ProxyConnector: the client sends
+ * what goes in to its incoming pipe, and the server what goes in to its
+ * outgoing pipe.
+ */
+ProxyMuxSession::ProxyMuxSession(const LogHandle& log, bool client, PipePair *pipe_pair)
+: log_(log + "/session"),
+  mtx_("ProxyMuxSession"),
+  socket_(NULL),
+  pipe_pair_(pipe_pair),
+  session_(NULL),
+  session_close_complete_(NULL, &mtx_, this, &ProxyMuxSession::session_close_complete),
+  socket_close_complete_(NULL, &mtx_, this, &ProxyMuxSession::socket_close_complete),
+  close_action_(NULL)
+{
+	if (client)
+		session_ = new MuxSession(log_, true, pipe_pair_->get_incoming(), pipe_pair_->get_outgoing());
+	else
+		session_ = new MuxSession(log_, false, pipe_pair_->get_outgoing(), pipe_pair_->get_incoming());
+}
+
+ProxyMuxSession::~ProxyMuxSession()
+{
+	ASSERT_NULL(log_, socket_);
+	ASSERT_NULL(log_, pipe_pair_);
+	ASSERT_NULL(log_, session_);
+	ASSERT_NULL(log_, close_action_);
+}
+
+Action *
+ProxyMuxSession::start(Socket *socket, EventCallback *cb)
+{
+	ScopedLock _(&mtx_);
+	ASSERT_NULL(log_, socket_);
+	socket_ = socket;
+	return (session_->start(socket_, cb));
+}
+
+StreamChannel *
+ProxyMuxSession::open(void)
+{
+	return (session_->open());
+}
+
+Action *
+ProxyMuxSession::accept(StreamChannelEventCallback *cb)
+{
+	return (session_->accept(cb));
+}
+
+void
+ProxyMuxSession::close(void)
+{
+	ScopedLock _(&mtx_);
+	ASSERT_NULL(log_, close_action_);
+	close_action_ = session_->close(&session_close_complete_);
+}
+
+void
+ProxyMuxSession::session_close_complete(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	close_action_->cancel();
+	close_action_ = NULL;
+
+	delete session_;
+	session_ = NULL;
+
+	delete pipe_pair_;
+	pipe_pair_ = NULL;
+
+	if (socket_ == NULL) {
+		EventSystem::instance()->destroy(&mtx_, this);
+		return;
+	}
+	close_action_ = socket_->close(&socket_close_complete_);
+}
+
+void
+ProxyMuxSession::socket_close_complete(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	close_action_->cancel();
+	close_action_ = NULL;
+
+	delete socket_;
+	socket_ = NULL;
+
+	EventSystem::instance()->destroy(&mtx_, this);
+}
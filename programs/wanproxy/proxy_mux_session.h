@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	PROGRAMS_WANPROXY_PROXY_MUX_SESSION_H
+#define	PROGRAMS_WANPROXY_PROXY_MUX_SESSION_H
+
+#include <io/mux/mux_session.h>
+
+class PipePair;
+class Socket;
+
+/*
+ * A MuxSession over a connection between two peers, with the peers' codec
+ * between the two, so that every stream in the session shares one encoder
+ * and one decoder.  Whoever creates one closes it once its start and accept
+ * have finished or been cancelled; it goes away once its streams have been
+ * closed.
+ */
+class ProxyMuxSession {
+	friend class DestroyThread;
+
+	LogHandle log_;
+	Mutex mtx_;
+	Socket *socket_;
+	PipePair *pipe_pair_;
+	MuxSession *session_;
+
+	SimpleCallback::Method<ProxyMuxSession> session_close_complete_;
+	SimpleCallback::Method<ProxyMuxSession> socket_close_complete_;
+	Action *close_action_;
+public:
+	ProxyMuxSession(const LogHandle&, bool, PipePair *);
+private:
+	~ProxyMuxSession();
+
+public:
+	Action *start(Socket *, EventCallback *);
+	StreamChannel *open(void);
+	Action *accept(StreamChannelEventCallback *);
+	void close(void);
+
+private:
+	void session_close_complete(void);
+	void socket_close_complete(void);
+};
+
+#endif /* !PROGRAMS_WANPROXY_PROXY_MUX_SESSION_H */
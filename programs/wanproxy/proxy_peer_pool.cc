@@ -0,0 +1,327 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <common/thread/mutex.h>
+
+#include <event/event_callback.h>
+#include <event/event_system.h>
+
+#include <io/socket/socket.h>
+
+#include <io/net/tcp_client.h>
+
+#include "proxy_peer_pool.h"
+
+class ProxyPeerPool::Connection {
+public:
+	ProxyPeerPool *pool_;
+	Socket *socket_;
+	std::list<Connection *>::iterator it_;
+
+	SocketEventCallback::Method<Connection> connect_complete_;
+	SimpleCallback::Method<Connection> close_complete_;
+	Action *action_;
+
+	BufferEventCallback::Method<Connection> read_complete_;
+	Action *read_action_;
+
+	SimpleCallback::Method<Connection> timeout_complete_;
+	Action *timeout_action_;
+
+	Connection(ProxyPeerPool *pool)
+	: pool_(pool),
+	  socket_(NULL),
+	  it_(),
+	  connect_complete_(NULL, &pool->mtx_, this, &Connection::connect_complete),
+	  close_complete_(NULL, &pool->mtx_, this, &Connection::close_complete),
+	  action_(NULL),
+	  read_complete_(NULL, &pool->mtx_, this, &Connection::read_complete),
+	  read_action_(NULL),
+	  timeout_complete_(NULL, &pool->mtx_, this, &Connection::timeout_complete),
+	  timeout_action_(NULL)
+	{ }
+
+	~Connection()
+	{
+		ASSERT_NULL(pool_->log_, socket_);
+		ASSERT_NULL(pool_->log_, action_);
+		ASSERT_NULL(pool_->log_, read_action_);
+		ASSERT_NULL(pool_->log_, timeout_action_);
+	}
+
+	void connect_complete(Event e, Socket *socket)
+	{
+		action_->cancel();
+		action_ = NULL;
+
+		pool_->connected(this, e, socket);
+	}
+
+	/*
+	 * Anything at all happening on an idle connection means that it
+	 * is of no further use to us.
+	 */
+	void read_complete(Event e, Buffer)
+	{
+		read_action_->cancel();
+		read_action_ = NULL;
+
+		switch (e.type_) {
+		case Event::EOS:
+			DEBUG(pool_->log_) << "Idle connection closed by peer.";
+			break;
+		default:
+			INFO(pool_->log_) << "Unexpected event on idle connection: " << e;
+			break;
+		}
+
+		pool_->expire(this, false);
+	}
+
+	void timeout_complete(void)
+	{
+		timeout_action_->cancel();
+		timeout_action_ = NULL;
+
+		pool_->expire(this, true);
+	}
+
+	void close_complete(void)
+	{
+		action_->cancel();
+		action_ = NULL;
+
+		delete socket_;
+		socket_ = NULL;
+
+		delete this;
+	}
+
+	void idle(void)
+	{
+		read_action_ = socket_->read(0, &read_complete_);
+		timeout_action_ = EventSystem::instance()->timeout(pool_->idle_timeout_ * 1000, &timeout_complete_);
+	}
+
+	void close(void)
+	{
+		cancel();
+
+		if (socket_ == NULL) {
+			delete this;
+			return;
+		}
+		action_ = socket_->close(&close_complete_);
+	}
+
+	Socket *take(void)
+	{
+		cancel();
+
+		Socket *socket = socket_;
+		socket_ = NULL;
+		delete this;
+
+		return (socket);
+	}
+
+private:
+	void cancel(void)
+	{
+		if (read_action_ != NULL) {
+			read_action_->cancel();
+			read_action_ = NULL;
+		}
+		if (timeout_action_ != NULL) {
+			timeout_action_->cancel();
+			timeout_action_ = NULL;
+		}
+	}
+};
+
+ProxyPeerPool::ProxyPeerPool(const std::string& name,
+			     SocketImpl impl,
+			     SocketAddressFamily family,
+			     const std::string& remote_name,
+			     unsigned min_idle,
+			     unsigned max_idle,
+			     unsigned idle_timeout)
+: log_("/wanproxy/peer/" + name + "/pool"),
+  mtx_("ProxyPeerPool::" + name),
+  impl_(impl),
+  family_(family),
+  remote_name_(remote_name),
+  min_idle_(min_idle),
+  max_idle_(max_idle),
+  idle_timeout_(idle_timeout),
+  target_(min_idle),
+  connecting_(0),
+  idle_(),
+  stopping_(false),
+  retry_complete_(NULL, &mtx_, this, &ProxyPeerPool::retry_complete),
+  retry_action_(NULL),
+  stop_(NULL, &mtx_, this, &ProxyPeerPool::stop),
+  stop_action_(NULL)
+{
+	ScopedLock _(&mtx_);
+	refill();
+
+	stop_action_ = EventSystem::instance()->register_interest(EventInterestStop, &stop_);
+}
+
+ProxyPeerPool::~ProxyPeerPool()
+{
+	ASSERT(log_, idle_.empty());
+	ASSERT_NULL(log_, retry_action_);
+	ASSERT_NULL(log_, stop_action_);
+}
+
+/*
+ * Hand out an idle connection, if there is one.  Otherwise the caller
+ * must connect for itself, and we will keep another connection ready
+ * for next time.
+ */
+Socket *
+ProxyPeerPool::get(void)
+{
+	ScopedLock _(&mtx_);
+
+	if (idle_.empty()) {
+		if (target_ < max_idle_)
+			target_++;
+		refill();
+		return (NULL);
+	}
+
+	Connection *c = idle_.front();
+	idle_.pop_front();
+
+	Socket *socket = c->take();
+	refill();
+
+	return (socket);
+}
+
+void
+ProxyPeerPool::connected(Connection *c, Event e, Socket *socket)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	ASSERT_NON_ZERO(log_, connecting_);
+	connecting_--;
+
+	c->socket_ = socket;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	default:
+		INFO(log_) << "Connect failed: " << e;
+		c->close();
+
+		if (!stopping_ && retry_action_ == NULL)
+			retry_action_ = EventSystem::instance()->timeout(PROXY_PEER_POOL_RETRY, &retry_complete_);
+		return;
+	}
+
+	if (stopping_) {
+		c->close();
+		return;
+	}
+
+	c->idle();
+	c->it_ = idle_.insert(idle_.end(), c);
+}
+
+/*
+ * An idle connection has either timed out, in which case we keep one
+ * fewer in future, or been closed by the peer, in which case we wait a
+ * while before replacing it, lest the peer be closing every connection
+ * we make.
+ */
+void
+ProxyPeerPool::expire(Connection *c, bool timed_out)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+
+	idle_.erase(c->it_);
+	c->close();
+
+	if (timed_out) {
+		if (target_ > min_idle_)
+			target_--;
+		refill();
+		return;
+	}
+
+	if (!stopping_ && retry_action_ == NULL)
+		retry_action_ = EventSystem::instance()->timeout(PROXY_PEER_POOL_RETRY, &retry_complete_);
+}
+
+void
+ProxyPeerPool::refill(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+
+	if (stopping_ || retry_action_ != NULL)
+		return;
+
+	while (idle_.size() + connecting_ < target_) {
+		Connection *c = new Connection(this);
+		connecting_++;
+		c->action_ = TCPClient::connect(impl_, family_, remote_name_, &c->connect_complete_);
+	}
+}
+
+void
+ProxyPeerPool::retry_complete(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	retry_action_->cancel();
+	retry_action_ = NULL;
+
+	refill();
+}
+
+void
+ProxyPeerPool::stop(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	stop_action_->cancel();
+	stop_action_ = NULL;
+
+	stopping_ = true;
+
+	if (retry_action_ != NULL) {
+		retry_action_->cancel();
+		retry_action_ = NULL;
+	}
+
+	while (!idle_.empty()) {
+		Connection *c = idle_.front();
+		idle_.pop_front();
+
+		c->close();
+	}
+}
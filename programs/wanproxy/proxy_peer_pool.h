@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	PROGRAMS_WANPROXY_PROXY_PEER_POOL_H
+#define	PROGRAMS_WANPROXY_PROXY_PEER_POOL_H
+
+#include <list>
+
+#include <common/thread/mutex.h>
+
+#include <io/socket/socket.h>
+
+#define	PROXY_PEER_POOL_RETRY	1000	/* Milliseconds.  */
+
+/*
+ * Keeps connections to a peer open and idle, so that a new client need
+ * not wait for a handshake across the WAN before its data can be sent.
+ *
+ * At least min_idle connections are kept ready.  Each time a client
+ * finds none ready, one more is kept, up to max_idle; each time one sits
+ * unused for idle_timeout seconds, it is closed and one fewer is kept.
+ * An idle connection which the peer closes, or which receives data, is
+ * thrown away, so this is only suitable for protocols in which the
+ * client speaks first.
+ */
+class ProxyPeerPool {
+	class Connection;
+
+	LogHandle log_;
+	Mutex mtx_;
+	SocketImpl impl_;
+	SocketAddressFamily family_;
+	std::string remote_name_;
+	unsigned min_idle_;
+	unsigned max_idle_;
+	unsigned idle_timeout_;
+	unsigned target_;
+	unsigned connecting_;
+	std::list<Connection *> idle_;
+	bool stopping_;
+
+	SimpleCallback::Method<ProxyPeerPool> retry_complete_;
+	Action *retry_action_;
+
+	SimpleCallback::Method<ProxyPeerPool> stop_;
+	Action *stop_action_;
+public:
+	ProxyPeerPool(const std::string&, SocketImpl, SocketAddressFamily, const std::string&, unsigned, unsigned, unsigned);
+	~ProxyPeerPool();
+
+	Socket *get(void);
+
+private:
+	void connected(Connection *, Event, Socket *);
+	void expire(Connection *, bool);
+	void refill(void);
+	void retry_complete(void);
+	void stop(void);
+};
+
+#endif /* !PROGRAMS_WANPROXY_PROXY_PEER_POOL_H */
@@ -33,6 +33,8 @@
 
 #include <io/socket/socket.h>
 
+#include <io/coroutine/coroutine_channel.h>
+
 #include "proxy_connector.h"
 #include "proxy_socks_connection.h"
 
@@ -41,237 +43,222 @@ ProxySocksConnection::ProxySocksConnection(const std::string& name, Socket *clie
   mtx_("ProxySocksConnection::" + name),
   name_(name),
   client_(client),
-  read_complete_(NULL, &mtx_, this, &ProxySocksConnection::read_complete),
-  write_complete_(NULL, &mtx_, this, &ProxySocksConnection::write_complete),
-  close_complete_(NULL, &mtx_, this, &ProxySocksConnection::close_complete),
-  action_(NULL),
-  state_(GetSOCKSVersion),
-  network_port_(0),
-  network_address_(),
-  socks5_authenticated_(false),
-  socks5_remote_name_()
+  channel_(log_, &mtx_, client_)
 {
 	ScopedLock _(&mtx_);
-	schedule_read(1);
+	handshake();
 }
 
 ProxySocksConnection::~ProxySocksConnection()
 {
-	ASSERT_NULL(log_, action_);
+	ASSERT_NULL(log_, client_);
 }
 
-void
-ProxySocksConnection::read_complete(Event e, Buffer buf)
+Coroutine
+ProxySocksConnection::handshake(void)
 {
-	ASSERT_LOCK_OWNED(log_, &mtx_);
-	action_->cancel();
-	action_ = NULL;
+	static const uint8_t socks4_connected[] = {
+		0x00,
+		0x5a,
+		0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00
+	};
 
-	switch (e.type_) {
-	case Event::Done:
-		break;
-	case Event::EOS:
-		INFO(log_) << "Client closed before connection established.";
-		schedule_close();
-		return;
-	default:
-		ERROR(log_) << "Unexpected event: " << e;
-		schedule_close();
-		return;
-	}
+	static const uint8_t socks5_authenticated[] = {
+		0x05,
+		0x00,
+	};
+
+	static const uint8_t socks5_connected[] = {
+		0x05,
+		0x00,
+		0x00,
+	};
+
+	bool authenticated = false;
+	std::string socks5_remote_name;
+	Buffer network_address;
+	uint16_t network_port;
+	std::ostringstream remote_name;
+	SocketAddressFamily family;
+	Buffer response;
+	Buffer buf;
+	Event e;
+
+	for (;;) {
+		buf.clear();
+		e = co_await channel_.read(1, &buf);
+		if (e.type_ != Event::Done)
+			goto read_failed;
 
-	switch (state_) {
-	case GetSOCKSVersion:
 		switch (buf.peek()) {
 		case 0x04:
-			state_ = GetSOCKS4Command;
-			schedule_read(1);
-			break;
+			goto socks4;
 		case 0x05:
-			if (socks5_authenticated_) {
-				state_ = GetSOCKS5Command;
-				schedule_read(1);
-			} else {
-				state_ = GetSOCKS5AuthLength;
-				schedule_read(1);
-			}
 			break;
 		default:
-			schedule_close();
-			break;
+			goto close;
 		}
-		break;
 
-		/* SOCKS4 */
-	case GetSOCKS4Command:
-		if (buf.peek() != 0x01) {
-			schedule_close();
-			break;
-		}
-		state_ = GetSOCKS4Port;
-		schedule_read(2);
-		break;
-	case GetSOCKS4Port:
-		buf.extract(&network_port_);
-		network_port_ = BigEndian::decode(network_port_);
-
-		state_ = GetSOCKS4Address;
-		schedule_read(4);
-		break;
-	case GetSOCKS4Address:
-		ASSERT(log_, buf.length() == 4);
-		network_address_ = buf;
+		if (authenticated)
+			goto socks5;
+
+		/*
+		 * SOCKS5 method selection.  We only offer "no authentication
+		 * required", so all we need to know is whether the client
+		 * does too.
+		 */
+		buf.clear();
+		e = co_await channel_.read(1, &buf);
+		if (e.type_ != Event::Done)
+			goto read_failed;
+		if (buf.peek() == 0x00)
+			goto close;
+
+		size_t methods = buf.peek();
+		buf.clear();
+		e = co_await channel_.read(methods, &buf);
+		if (e.type_ != Event::Done)
+			goto read_failed;
+		while (!buf.empty() && buf.peek() != 0x00)
+			buf.skip(1);
+		if (buf.empty())
+			goto close;
 
-		state_ = GetSOCKS4User;
-		schedule_read(1);
-		break;
-	case GetSOCKS4User:
-		if (buf.peek() == 0x00) {
-			schedule_write();
-			break;
-		}
-		schedule_read(1);
-		break;
+		response.append(socks5_authenticated, sizeof socks5_authenticated);
+		e = co_await channel_.write(&response);
+		if (e.type_ != Event::Done)
+			goto write_failed;
 
-		/* SOCKS5 */
-	case GetSOCKS5AuthLength:
-		state_ = GetSOCKS5Auth;
-		schedule_read(buf.peek());
-		break;
-	case GetSOCKS5Auth:
-		while (!buf.empty()) {
-			if (buf.peek() == 0x00) {
-				schedule_write();
-				break;
-			}
-			buf.skip(1);
-		}
-		if (buf.empty()) {
-			schedule_close();
-			break;
-		}
-		break;
+		authenticated = true;
+	}
 
-	case GetSOCKS5Command:
-		if (buf.peek() != 0x01) {
-			schedule_close();
+socks4:
+	buf.clear();
+	e = co_await channel_.read(1 + 2 + 4, &buf);
+	if (e.type_ != Event::Done)
+		goto read_failed;
+	if (buf.peek() != 0x01)
+		goto close;
+	buf.skip(1);
+
+	buf.extract(&network_port);
+	network_port = BigEndian::decode(network_port);
+	buf.skip(2);
+
+	network_address = buf;
+
+	/* Skip the user ID.  */
+	for (;;) {
+		buf.clear();
+		e = co_await channel_.read(1, &buf);
+		if (e.type_ != Event::Done)
+			goto read_failed;
+		if (buf.peek() == 0x00)
 			break;
-		}
-		state_ = GetSOCKS5Reserved;
-		schedule_read(1);
-		break;
-	case GetSOCKS5Reserved:
-		if (buf.peek() != 0x00) {
-			schedule_close();
-			break;
-		}
-		state_ = GetSOCKS5AddressType;
-		schedule_read(1);
-		break;
-	case GetSOCKS5AddressType:
-		switch (buf.peek()) {
-		case 0x01:
-			state_ = GetSOCKS5Address;
-			schedule_read(4);
-			break;
-		case 0x03:
-			state_ = GetSOCKS5NameLength;
-			schedule_read(1);
-			break;
-		case 0x04:
-			state_ = GetSOCKS5Address6;
-			schedule_read(16);
-			break;
-		default:
-			schedule_close();
-			break;
-		}
-		break;
-	case GetSOCKS5Address:
-		ASSERT(log_, buf.length() == 4);
-		network_address_ = buf;
-
-		state_ = GetSOCKS5Port;
-		schedule_read(2);
-		break;
-	case GetSOCKS5Address6:
-		ASSERT(log_, buf.length() == 16);
-		network_address_ = buf;
+	}
 
-		state_ = GetSOCKS5Port;
-		schedule_read(2);
+	response.append(socks4_connected, sizeof socks4_connected);
+	e = co_await channel_.write(&response);
+	if (e.type_ != Event::Done)
+		goto write_failed;
+	goto connect;
+
+socks5:
+	/* Command, reserved byte and address type.  */
+	buf.clear();
+	e = co_await channel_.read(3, &buf);
+	if (e.type_ != Event::Done)
+		goto read_failed;
+	if (buf.peek() != 0x01)
+		goto close;
+	buf.skip(1);
+	if (buf.peek() != 0x00)
+		goto close;
+	buf.skip(1);
+
+	switch (buf.peek()) {
+	case 0x01:
+		buf.clear();
+		e = co_await channel_.read(4, &buf);
+		if (e.type_ != Event::Done)
+			goto read_failed;
+		network_address = buf;
 		break;
-	case GetSOCKS5NameLength:
-		state_ = GetSOCKS5Name;
-		schedule_read(buf.peek());
-		break;
-	case GetSOCKS5Name:
-		while (!buf.empty()) {
-			socks5_remote_name_ += (char)buf.peek();
-			buf.skip(1);
+	case 0x03:
+		buf.clear();
+		e = co_await channel_.read(1, &buf);
+		if (e.type_ != Event::Done)
+			goto read_failed;
+		if (buf.peek() == 0x00)
+			goto close;
+		{
+			size_t length = buf.peek();
+			buf.clear();
+			e = co_await channel_.read(length, &buf);
 		}
-		state_ = GetSOCKS5Port;
-		schedule_read(2);
+		if (e.type_ != Event::Done)
+			goto read_failed;
+		buf.extract(socks5_remote_name);
 		break;
-	case GetSOCKS5Port:
-		buf.extract(&network_port_);
-		network_port_ = BigEndian::decode(network_port_);
-
-		schedule_write();
+	case 0x04:
+		buf.clear();
+		e = co_await channel_.read(16, &buf);
+		if (e.type_ != Event::Done)
+			goto read_failed;
+		network_address = buf;
 		break;
+	default:
+		goto close;
 	}
-}
 
-void
-ProxySocksConnection::write_complete(Event e)
-{
-	ASSERT_LOCK_OWNED(log_, &mtx_);
-	action_->cancel();
-	action_ = NULL;
+	buf.clear();
+	e = co_await channel_.read(2, &buf);
+	if (e.type_ != Event::Done)
+		goto read_failed;
+	buf.extract(&network_port);
+	network_port = BigEndian::decode(network_port);
 
-	switch (e.type_) {
-	case Event::Done:
-		break;
-	default:
-		ERROR(log_) << "Unexpected event: " << e;
-		schedule_close();
-		return;
-	}
+	response.append(socks5_connected, sizeof socks5_connected);
 
-	if (state_ == GetSOCKS5Auth) {
-		ASSERT(log_, !socks5_authenticated_);
-		ASSERT(log_, socks5_remote_name_ == "");
-		ASSERT(log_, network_address_.empty());
-		ASSERT_ZERO(log_, network_port_);
+	/* XXX It's fun to lie about what kind of name we were given.  */
+	if (socks5_remote_name != "" || network_address.empty()) {
+		response.append((uint8_t)0x03);
+		response.append((uint8_t)socks5_remote_name.length());
+		response.append(socks5_remote_name);
+	} else {
+		response.append((uint8_t)0x01);
+		response.append(&network_address);
+	}
 
-		socks5_authenticated_ = true;
-		state_ = GetSOCKSVersion;
-		schedule_read(1);
-		return;
+	{
+		uint16_t port = BigEndian::encode(network_port);
+		response.append(&port);
 	}
 
-	std::ostringstream remote_name;
+	e = co_await channel_.write(&response);
+	if (e.type_ != Event::Done)
+		goto write_failed;
 
-	SocketAddressFamily family;
-	if (state_ == GetSOCKS5Port && socks5_remote_name_ != "") {
-		ASSERT(log_, socks5_authenticated_);
-		ASSERT(log_, network_address_.empty());
+connect:
+	if (socks5_remote_name != "") {
+		ASSERT(log_, network_address.empty());
 
-		remote_name << '[' << socks5_remote_name_ << ']' << ':' << network_port_;
+		remote_name << '[' << socks5_remote_name << ']' << ':' << network_port;
 
 		family = SocketAddressFamilyIP;
 	} else {
 		remote_name << '[';
-		switch (network_address_.length()) {
+		switch (network_address.length()) {
 		case 4:
-			remote_name << (unsigned)network_address_.peek() << '.';
-			network_address_.skip(1);
-			remote_name << (unsigned)network_address_.peek() << '.';
-			network_address_.skip(1);
-			remote_name << (unsigned)network_address_.peek() << '.';
-			network_address_.skip(1);
-			remote_name << (unsigned)network_address_.peek();
-			network_address_.skip(1);
+			remote_name << (unsigned)network_address.peek() << '.';
+			network_address.skip(1);
+			remote_name << (unsigned)network_address.peek() << '.';
+			network_address.skip(1);
+			remote_name << (unsigned)network_address.peek() << '.';
+			network_address.skip(1);
+			remote_name << (unsigned)network_address.peek();
+			network_address.skip(1);
 			family = SocketAddressFamilyIPv4;
 			break;
 		case 16:
@@ -279,7 +266,7 @@ ProxySocksConnection::write_complete(Event e)
 				uint8_t bytes[2];
 				char hex[5];
 
-				network_address_.moveout(bytes, sizeof bytes);
+				network_address.moveout(bytes, sizeof bytes);
 
 				if (bytes[0] == 0 && bytes[1] == 0)
 					snprintf(hex, sizeof hex, "0");
@@ -287,7 +274,7 @@ ProxySocksConnection::write_complete(Event e)
 					snprintf(hex, sizeof hex, "%0hhx%02hhx", bytes[0], bytes[1]);
 				remote_name << hex;
 
-				if (network_address_.empty())
+				if (network_address.empty())
 					break;
 				remote_name << ":";
 			}
@@ -297,21 +284,32 @@ ProxySocksConnection::write_complete(Event e)
 			NOTREACHED(log_);
 		}
 		remote_name << ']';
-		remote_name << ':' << network_port_;
+		remote_name << ':' << network_port;
 	}
 
-	new ProxyConnector(name_, NULL, client_, SocketImplOS, family, remote_name.str());
+	/*
+	 * Anything the client sent after its request has already been
+	 * read from the socket, and must be passed along ahead of
+	 * whatever follows it.
+	 */
+	new ProxyConnector(name_, NULL, client_, SocketImplOS, family, remote_name.str(), channel_.buffered());
 
 	client_ = NULL;
 	EventSystem::instance()->destroy(&mtx_, this);
-}
+	co_return;
 
-void
-ProxySocksConnection::close_complete(void)
-{
-	ASSERT_LOCK_OWNED(log_, &mtx_);
-	action_->cancel();
-	action_ = NULL;
+read_failed:
+	if (e.type_ == Event::EOS)
+		INFO(log_) << "Client closed before connection established.";
+	else
+		ERROR(log_) << "Unexpected event: " << e;
+	goto close;
+
+write_failed:
+	ERROR(log_) << "Unexpected event: " << e;
+
+close:
+	co_await channel_.close();
 
 	ASSERT_NON_NULL(log_, client_);
 	delete client_;
@@ -319,81 +317,3 @@ ProxySocksConnection::close_complete(void)
 
 	EventSystem::instance()->destroy(&mtx_, this);
 }
-
-void
-ProxySocksConnection::schedule_read(size_t amount)
-{
-	ASSERT_LOCK_OWNED(log_, &mtx_);
-	ASSERT_NULL(log_, action_);
-
-	ASSERT_NON_NULL(log_, client_);
-	action_ = client_->read(amount, &read_complete_);
-}
-
-void
-ProxySocksConnection::schedule_write(void)
-{
-	ASSERT_LOCK_OWNED(log_, &mtx_);
-	ASSERT_NULL(log_, action_);
-
-	static const uint8_t socks4_connected[] = {
-		0x00,
-		0x5a,
-		0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00
-	};
-
-	static const uint8_t socks5_authenticated[] = {
-		0x05,
-		0x00,
-	};
-
-	static const uint8_t socks5_connected[] = {
-		0x05,
-		0x00,
-		0x00,
-	};
-
-	Buffer response;
-
-	switch (state_) {
-	case GetSOCKS4User:
-		response.append(socks4_connected, sizeof socks4_connected);
-		break;
-	case GetSOCKS5Auth:
-		response.append(socks5_authenticated, sizeof socks5_authenticated);
-		break;
-	case GetSOCKS5Port: {
-		response.append(socks5_connected, sizeof socks5_connected);
-
-		/* XXX It's fun to lie about what kind of name we were given.  */
-		if (socks5_remote_name_ != "" || network_address_.empty()) {
-			response.append((uint8_t)0x03);
-			response.append((uint8_t)socks5_remote_name_.length());
-			response.append(socks5_remote_name_);
-		} else {
-			response.append((uint8_t)0x01);
-			response.append(&network_address_);
-		}
-
-		uint16_t port = BigEndian::encode(network_port_);
-		response.append(&port);
-		break;
-	}
-	default:
-		NOTREACHED(log_);
-	}
-
-	ASSERT_NON_NULL(log_, client_);
-	action_ = client_->write(&response, &write_complete_);
-}
-
-void
-ProxySocksConnection::schedule_close(void)
-{
-	ASSERT_LOCK_OWNED(log_, &mtx_);
-	ASSERT_NULL(log_, action_);
-
-	ASSERT_NON_NULL(log_, client_);
-	action_ = client_->close(&close_complete_);
-}
@@ -26,56 +26,28 @@
 #ifndef	PROGRAMS_WANPROXY_PROXY_SOCKS_CONNECTION_H
 #define	PROGRAMS_WANPROXY_PROXY_SOCKS_CONNECTION_H
 
+/*
+ * Accepts a SOCKS4 or SOCKS5 CONNECT request from a client and hands the
+ * client to a ProxyConnector for the requested destination.  The whole
+ * exchange is a single Coroutine; requests usually arrive in one or two
+ * segments, and reads of the individual fields are satisfied from what
+ * has already been buffered without waiting on the socket.
+ */
 class ProxySocksConnection {
 	friend class DestroyThread;
 
-	enum State {
-		GetSOCKSVersion,
-
-		GetSOCKS4Command,
-		GetSOCKS4Port,
-		GetSOCKS4Address,
-		GetSOCKS4User,
-
-		GetSOCKS5AuthLength,
-		GetSOCKS5Auth,
-		GetSOCKS5Command,
-		GetSOCKS5Reserved,
-		GetSOCKS5AddressType,
-		GetSOCKS5Address,
-		GetSOCKS5Address6,
-		GetSOCKS5NameLength,
-		GetSOCKS5Name,
-		GetSOCKS5Port,
-	};
-
 	LogHandle log_;
 	Mutex mtx_;
 	std::string name_;
 	Socket *client_;
-	BufferEventCallback::Method<ProxySocksConnection> read_complete_;
-	EventCallback::Method<ProxySocksConnection> write_complete_;
-	SimpleCallback::Method<ProxySocksConnection> close_complete_;
-	Action *action_;
-	State state_;
-	uint16_t network_port_;
-	Buffer network_address_;
-	bool socks5_authenticated_;
-	std::string socks5_remote_name_;
+	CoroutineChannel channel_;
 
 public:
 	ProxySocksConnection(const std::string&, Socket *);
 private:
 	~ProxySocksConnection();
 
-private:
-	void read_complete(Event, Buffer);
-	void write_complete(Event);
-	void close_complete(void);
-
-	void schedule_read(size_t);
-	void schedule_write(void);
-	void schedule_close(void);
+	Coroutine handshake(void);
 };
 
 #endif /* !PROGRAMS_WANPROXY_PROXY_SOCKS_CONNECTION_H */
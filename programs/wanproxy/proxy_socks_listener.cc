@@ -32,6 +32,8 @@
 
 #include <io/net/tcp_server.h>
 
+#include <io/coroutine/coroutine_channel.h>
+
 #include "proxy_socks_connection.h"
 #include "proxy_socks_listener.h"
 
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <common/buffer.h>
+#include <common/thread/mutex.h>
+
+#include <common/uuid/uuid.h>
+
+#include <event/event_callback.h>
+#include <event/event_system.h>
+
+#include <io/socket/socket.h>
+
+#include <io/coroutine/coroutine_channel.h>
+
+#include "proxy_stripe_connection.h"
+#include "proxy_stripe_connector.h"
+#include "proxy_stripe_listener.h"
+
+ProxyStripeConnection::ProxyStripeConnection(const std::string& name, ProxyStripeListener *listener, Socket *client)
+: log_("/wanproxy/proxy/" + name + "/stripe/connection"),
+  mtx_("ProxyStripeConnection::" + name),
+  listener_(listener),
+  client_(client),
+  channel_(log_, &mtx_, client_)
+{
+	ScopedLock _(&mtx_);
+	handshake();
+}
+
+ProxyStripeConnection::~ProxyStripeConnection()
+{
+	ASSERT_NULL(log_, client_);
+}
+
+Coroutine
+ProxyStripeConnection::handshake(void)
+{
+	UUID uuid;
+	unsigned count;
+	Buffer buf;
+	Event e;
+
+	e = co_await channel_.read(PROXY_STRIPE_HELLO_LENGTH, &buf);
+	if (e.type_ != Event::Done) {
+		if (e.type_ == Event::EOS)
+			INFO(log_) << "Peer closed before sending hello.";
+		else
+			ERROR(log_) << "Unexpected event: " << e;
+		goto close;
+	}
+
+	if (!uuid.decode(&buf)) {
+		ERROR(log_) << "Invalid stripe UUID.";
+		goto close;
+	}
+	count = buf.peek();
+	if (count == 0) {
+		ERROR(log_) << "Stripe has no paths.";
+		goto close;
+	}
+
+	/*
+	 * Anything the peer sent after its hello has already been read
+	 * from the socket, and belongs to the stripe.
+	 */
+	listener_->join(uuid, count, client_, channel_.buffered());
+
+	client_ = NULL;
+	EventSystem::instance()->destroy(&mtx_, this);
+	co_return;
+
+close:
+	co_await channel_.close();
+
+	ASSERT_NON_NULL(log_, client_);
+	delete client_;
+	client_ = NULL;
+
+	EventSystem::instance()->destroy(&mtx_, this);
+}
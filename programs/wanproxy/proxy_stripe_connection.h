@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	PROGRAMS_WANPROXY_PROXY_STRIPE_CONNECTION_H
+#define	PROGRAMS_WANPROXY_PROXY_STRIPE_CONNECTION_H
+
+class ProxyStripeListener;
+
+/*
+ * Reads the hello from a path of a stripe, and hands the path to the
+ * listener to be gathered together with the rest of the stripe.
+ */
+class ProxyStripeConnection {
+	friend class DestroyThread;
+
+	LogHandle log_;
+	Mutex mtx_;
+	ProxyStripeListener *listener_;
+	Socket *client_;
+	CoroutineChannel channel_;
+
+public:
+	ProxyStripeConnection(const std::string&, ProxyStripeListener *, Socket *);
+private:
+	~ProxyStripeConnection();
+
+	Coroutine handshake(void);
+};
+
+#endif /* !PROGRAMS_WANPROXY_PROXY_STRIPE_CONNECTION_H */
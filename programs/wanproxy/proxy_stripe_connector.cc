@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <common/buffer.h>
+#include <common/thread/mutex.h>
+
+#include <common/uuid/uuid.h>
+
+#include <event/event_callback.h>
+#include <event/event_system.h>
+
+#include <io/net/tcp_client.h>
+
+#include <io/socket/socket.h>
+
+#include <io/stripe/stripe_channel.h>
+
+#include "proxy_connector.h"
+#include "proxy_stripe_connector.h"
+
+class ProxyStripeConnector::Path {
+	LogHandle log_;
+public:
+	ProxyStripeConnector *connector_;
+	Socket *socket_;
+
+	SocketEventCallback::Method<Path> connect_complete_;
+	EventCallback::Method<Path> write_complete_;
+	SimpleCallback::Method<Path> close_complete_;
+	Action *action_;
+
+	Path(ProxyStripeConnector *connector)
+	: log_(connector->log_ + "/path"),
+	  connector_(connector),
+	  socket_(NULL),
+	  connect_complete_(NULL, &connector->mtx_, this, &Path::connect_complete),
+	  write_complete_(NULL, &connector->mtx_, this, &Path::write_complete),
+	  close_complete_(NULL, &connector->mtx_, this, &Path::close_complete),
+	  action_(NULL)
+	{ }
+
+	~Path()
+	{
+		ASSERT_NULL(log_, action_);
+	}
+
+	void connect(SocketImpl impl, SocketAddressFamily family, const std::string& remote_name)
+	{
+		action_ = TCPClient::connect(impl, family, remote_name, &connect_complete_);
+	}
+
+	/*
+	 * Returns false if there was no connection to close.
+	 */
+	bool close(void)
+	{
+		ASSERT_NULL(log_, action_);
+		if (socket_ == NULL)
+			return (false);
+		action_ = socket_->close(&close_complete_);
+		return (true);
+	}
+
+private:
+	void connect_complete(Event e, Socket *socket)
+	{
+		action_->cancel();
+		action_ = NULL;
+
+		if (e.type_ != Event::Done) {
+			ERROR(log_) << "Connect failed: " << e;
+			connector_->path_complete(false);
+			return;
+		}
+		socket_ = socket;
+
+		Buffer hello(connector_->hello_);
+		action_ = socket_->write(&hello, &write_complete_);
+	}
+
+	void write_complete(Event e)
+	{
+		action_->cancel();
+		action_ = NULL;
+
+		if (e.type_ != Event::Done) {
+			ERROR(log_) << "Write failed: " << e;
+			connector_->path_complete(false);
+			return;
+		}
+		connector_->path_complete(true);
+	}
+
+	void close_complete(void)
+	{
+		action_->cancel();
+		action_ = NULL;
+
+		delete socket_;
+		socket_ = NULL;
+
+		connector_->path_closed();
+	}
+};
+
+ProxyStripeConnector::ProxyStripeConnector(const std::string& name,
+					   PipePair *pipe_pair,
+					   Socket *local_socket,
+					   SocketImpl impl,
+					   SocketAddressFamily family,
+					   const std::string& remote_name,
+					   unsigned paths)
+: log_("/wanproxy/proxy/" + name + "/stripe/connector"),
+  mtx_("ProxyStripeConnector::" + name),
+  name_(name),
+  pipe_pair_(pipe_pair),
+  local_socket_(local_socket),
+  hello_(),
+  paths_(),
+  paths_pending_(paths),
+  failed_(false)
+{
+	ASSERT(log_, paths != 0 && paths <= PROXY_STRIPE_PATHS_MAX);
+
+	UUID uuid;
+	uuid.generate();
+	uuid.encode(&hello_);
+	hello_.append((uint8_t)paths);
+
+	ScopedLock _(&mtx_);
+	unsigned i;
+	for (i = 0; i < paths; i++) {
+		Path *path = new Path(this);
+		paths_.push_back(path);
+		path->connect(impl, family, remote_name);
+	}
+}
+
+ProxyStripeConnector::~ProxyStripeConnector()
+{
+	ASSERT_NULL(log_, local_socket_);
+	ASSERT_ZERO(log_, paths_pending_);
+
+	while (!paths_.empty()) {
+		delete paths_.back();
+		paths_.pop_back();
+	}
+}
+
+void
+ProxyStripeConnector::path_complete(bool ok)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	if (!ok)
+		failed_ = true;
+	if (--paths_pending_ != 0)
+		return;
+
+	if (!failed_) {
+		std::vector<StreamChannel *> channels;
+		std::vector<Path *>::iterator it;
+		for (it = paths_.begin(); it != paths_.end(); ++it) {
+			channels.push_back((*it)->socket_);
+			(*it)->socket_ = NULL;
+		}
+
+		StripeChannel *stripe = new StripeChannel(log_, channels);
+		finish(stripe);
+		return;
+	}
+
+	/*
+	 * Close whichever connections were made before turning the client
+	 * away.
+	 */
+	std::vector<Path *>::iterator it;
+	for (it = paths_.begin(); it != paths_.end(); ++it) {
+		if ((*it)->close())
+			paths_pending_++;
+	}
+	if (paths_pending_ == 0)
+		finish(NULL);
+}
+
+void
+ProxyStripeConnector::path_closed(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	if (--paths_pending_ != 0)
+		return;
+	finish(NULL);
+}
+
+/*
+ * Without a remote side, the ProxyConnector just closes the client.
+ */
+void
+ProxyStripeConnector::finish(StreamChannel *remote)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	new ProxyConnector(name_, pipe_pair_, local_socket_, remote);
+	pipe_pair_ = NULL;
+	local_socket_ = NULL;
+
+	EventSystem::instance()->destroy(&mtx_, this);
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	PROGRAMS_WANPROXY_PROXY_STRIPE_CONNECTOR_H
+#define	PROGRAMS_WANPROXY_PROXY_STRIPE_CONNECTOR_H
+
+#include <vector>
+
+/*
+ * Each path of a stripe begins with the stripe's UUID, as a string, and
+ * the number of paths in it, as a single byte, so that the far side can
+ * gather the paths of each stripe together however they arrive.
+ */
+#define	PROXY_STRIPE_HELLO_LENGTH	(UUID_SIZE + 1)
+#define	PROXY_STRIPE_PATHS_MAX		255
+
+class PipePair;
+class StreamChannel;
+class Socket;
+
+/*
+ * Opens several connections to a peer for a client and, once all of them
+ * are up, hands the client to a ProxyConnector with a StripeChannel over
+ * them as its remote side.  If any connection fails, the client is turned
+ * away.
+ */
+class ProxyStripeConnector {
+	friend class DestroyThread;
+
+	class Path;
+	friend class Path;
+
+	LogHandle log_;
+	Mutex mtx_;
+	std::string name_;
+	PipePair *pipe_pair_;
+	Socket *local_socket_;
+	Buffer hello_;
+	std::vector<Path *> paths_;
+	unsigned paths_pending_;
+	bool failed_;
+public:
+	ProxyStripeConnector(const std::string&, PipePair *, Socket *, SocketImpl, SocketAddressFamily, const std::string&, unsigned);
+private:
+	~ProxyStripeConnector();
+
+	void path_complete(bool);
+	void path_closed(void);
+	void finish(StreamChannel *);
+};
+
+#endif /* !PROGRAMS_WANPROXY_PROXY_STRIPE_CONNECTOR_H */
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <common/thread/mutex.h>
+
+#include <event/event_callback.h>
+#include <event/event_system.h>
+
+#include <io/socket/socket.h>
+
+#include <io/net/tcp_server.h>
+
+#include <io/coroutine/coroutine_channel.h>
+
+#include <io/stripe/stripe_channel.h>
+
+#include "proxy_connector.h"
+#include "proxy_stripe_connection.h"
+#include "proxy_stripe_listener.h"
+#include "wanproxy_codec_pipe_pair.h"
+
+ProxyStripeListener::ProxyStripeListener(const std::string& name,
+					 WANProxyCodec *interface_codec,
+					 WANProxyCodec *remote_codec,
+					 SocketImpl interface_impl,
+					 SocketAddressFamily interface_family,
+					 const std::string& interface,
+					 SocketImpl remote_impl,
+					 SocketAddressFamily remote_family,
+					 const std::string& remote_name)
+: SimpleServer<TCPServer>("/wanproxy/proxy/" + name + "/stripe/listener", interface_impl, interface_family, interface),
+  name_(name),
+  groups_log_("/wanproxy/proxy/" + name + "/stripe/listener"),
+  groups_mtx_("ProxyStripeListener::" + name),
+  interface_codec_(interface_codec),
+  remote_codec_(remote_codec),
+  remote_impl_(remote_impl),
+  remote_family_(remote_family),
+  remote_name_(remote_name),
+  groups_(),
+  expire_(NULL, &groups_mtx_, this, &ProxyStripeListener::expire),
+  expire_action_(NULL),
+  stop_(NULL, &groups_mtx_, this, &ProxyStripeListener::stop),
+  stop_action_(NULL)
+{
+	ScopedLock _(&groups_mtx_);
+	stop_action_ = EventSystem::instance()->register_interest(EventInterestStop, &stop_);
+}
+
+ProxyStripeListener::~ProxyStripeListener()
+{
+	ASSERT(groups_log_, groups_.empty());
+	ASSERT_NULL(groups_log_, expire_action_);
+}
+
+/*
+ * Add a path to its stripe, along with anything received on it after its
+ * hello, and start the stripe once it has all of its paths.
+ */
+void
+ProxyStripeListener::join(const UUID& uuid, unsigned count, Socket *socket, Buffer *received)
+{
+	ScopedLock _(&groups_mtx_);
+	if (stop_action_ == NULL) {
+		Group group;
+		group.paths_.push_back(socket);
+		group.received_.push_back(*received);
+		reject(&group);
+		return;
+	}
+
+	std::map<UUID, Group>::iterator it = groups_.find(uuid);
+	if (it == groups_.end()) {
+		it = groups_.insert(std::make_pair(uuid, Group())).first;
+		it->second.count_ = count;
+		it->second.started_ = NanoTime::current_time();
+	}
+	Group *group = &it->second;
+
+	group->paths_.push_back(socket);
+	group->received_.push_back(*received);
+
+	if (group->count_ != count) {
+		ERROR(groups_log_) << "Stripe " << uuid.string_ << " has paths which disagree about how many it has.";
+		reject(group);
+		groups_.erase(it);
+		return;
+	}
+
+	if (group->paths_.size() == count) {
+		DEBUG(groups_log_) << "Stripe " << uuid.string_ << " has all " << count << " paths.";
+		StripeChannel *stripe = new StripeChannel(groups_log_, group->paths_, &group->received_);
+		PipePair *pipe_pair = new WANProxyCodecPipePair(interface_codec_, remote_codec_);
+		new ProxyConnector(name_, pipe_pair, stripe, remote_impl_, remote_family_, remote_name_);
+		groups_.erase(it);
+		return;
+	}
+
+	if (expire_action_ == NULL)
+		expire_action_ = EventSystem::instance()->timeout(PROXY_STRIPE_LISTENER_TIMEOUT * 1000, &expire_);
+}
+
+void
+ProxyStripeListener::client_connected(Socket *socket)
+{
+	new ProxyStripeConnection(name_, this, socket);
+}
+
+/*
+ * Turn away stripes which have been waiting too long for the rest of
+ * their paths.
+ */
+void
+ProxyStripeListener::expire(void)
+{
+	ASSERT_LOCK_OWNED(groups_log_, &groups_mtx_);
+	expire_action_->cancel();
+	expire_action_ = NULL;
+
+	NanoTime now = NanoTime::current_time();
+	std::map<UUID, Group>::iterator it = groups_.begin();
+	while (it != groups_.end()) {
+		if (it->second.started_.seconds_ + PROXY_STRIPE_LISTENER_TIMEOUT > now.seconds_) {
+			++it;
+			continue;
+		}
+		INFO(groups_log_) << "Stripe " << it->first.string_ << " timed out with " << it->second.paths_.size() << " of " << it->second.count_ << " paths.";
+		reject(&it->second);
+		groups_.erase(it++);
+	}
+
+	if (!groups_.empty())
+		expire_action_ = EventSystem::instance()->timeout(PROXY_STRIPE_LISTENER_TIMEOUT * 1000, &expire_);
+}
+
+void
+ProxyStripeListener::stop(void)
+{
+	ASSERT_LOCK_OWNED(groups_log_, &groups_mtx_);
+	stop_action_->cancel();
+	stop_action_ = NULL;
+
+	if (expire_action_ != NULL) {
+		expire_action_->cancel();
+		expire_action_ = NULL;
+	}
+
+	std::map<UUID, Group>::iterator it;
+	for (it = groups_.begin(); it != groups_.end(); ++it)
+		reject(&it->second);
+	groups_.clear();
+}
+
+/*
+ * Without a remote side, the ProxyConnector just closes the stripe, and
+ * with it every path.
+ */
+void
+ProxyStripeListener::reject(Group *group)
+{
+	ASSERT_LOCK_OWNED(groups_log_, &groups_mtx_);
+	StripeChannel *stripe = new StripeChannel(groups_log_, group->paths_, &group->received_);
+	new ProxyConnector(name_, NULL, stripe, NULL);
+}
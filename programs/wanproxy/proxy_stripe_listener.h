@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	PROGRAMS_WANPROXY_PROXY_STRIPE_LISTENER_H
+#define	PROGRAMS_WANPROXY_PROXY_STRIPE_LISTENER_H
+
+#include <map>
+#include <vector>
+
+#include <common/time/time.h>
+#include <common/uuid/uuid.h>
+
+#include <io/socket/simple_server.h>
+
+#define	PROXY_STRIPE_LISTENER_TIMEOUT	10	/* Seconds a stripe may take to gather.  */
+
+class Socket;
+class StreamChannel;
+class TCPServer;
+struct WANProxyCodec;
+
+/*
+ * Accepts the paths of stripes from a peer, gathers the paths of each
+ * stripe together, and hands each complete stripe to a ProxyConnector to
+ * be carried on to the remote host.  Stripes whose paths do not all
+ * arrive in time are turned away.
+ */
+class ProxyStripeListener : public SimpleServer<TCPServer> {
+	struct Group {
+		unsigned count_;
+		std::vector<StreamChannel *> paths_;
+		std::vector<Buffer> received_;
+		NanoTime started_;
+
+		Group(void)
+		: count_(0),
+		  paths_(),
+		  received_(),
+		  started_()
+		{ }
+	};
+
+	std::string name_;
+	LogHandle groups_log_;
+	Mutex groups_mtx_;
+	WANProxyCodec *interface_codec_;
+	WANProxyCodec *remote_codec_;
+	SocketImpl remote_impl_;
+	SocketAddressFamily remote_family_;
+	std::string remote_name_;
+	std::map<UUID, Group> groups_;
+
+	SimpleCallback::Method<ProxyStripeListener> expire_;
+	Action *expire_action_;
+	SimpleCallback::Method<ProxyStripeListener> stop_;
+	Action *stop_action_;
+public:
+	ProxyStripeListener(const std::string&, WANProxyCodec *, WANProxyCodec *, SocketImpl, SocketAddressFamily,
+			    const std::string&, SocketImpl, SocketAddressFamily, const std::string&);
+	~ProxyStripeListener();
+
+	void join(const UUID&, unsigned, Socket *, Buffer *);
+
+private:
+	void client_connected(Socket *);
+
+	void expire(void);
+	void stop(void);
+
+	void reject(Group *);
+};
+
+#endif /* !PROGRAMS_WANPROXY_PROXY_STRIPE_LISTENER_H */
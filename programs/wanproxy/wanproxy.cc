@@ -28,6 +28,8 @@
 #include <common/buffer.h>
 #include <common/endian.h>
 
+#include <common/thread/mutex_profile.h>
+
 #include <event/action.h>
 #include <event/callback.h>
 #include <event/event_main.h>
@@ -40,9 +42,10 @@ int
 main(int argc, char *argv[])
 {
 	std::string configfile("");
-	bool quiet, verbose;
+	bool profile, quiet, verbose;
 	int ch;
 
+	profile = false;
 	quiet = false;
 	verbose = false;
 
@@ -50,11 +53,14 @@ main(int argc, char *argv[])
 	INFO("/wanproxy") << "Copyright (c) 2008-2016 WANProxy.org.";
 	INFO("/wanproxy") << "All rights reserved.";
 
-	while ((ch = getopt(argc, argv, "c:qv")) != -1) {
+	while ((ch = getopt(argc, argv, "c:pqv")) != -1) {
 		switch (ch) {
 		case 'c':
 			configfile = optarg;
 			break;
+		case 'p':
+			profile = true;
+			break;
 		case 'q':
 			quiet = true;
 			break;
@@ -80,6 +86,13 @@ main(int argc, char *argv[])
 		Log::mask(".?", Log::Info);
 	}
 
+	/*
+	 * Profile lock contention; the profile can be seen through the
+	 * monitor while running, and is logged on exit.
+	 */
+	if (profile)
+		MutexProfile::enable();
+
 	WANProxyConfig config;
 	if (!config.configure(configfile)) {
 		ERROR("/wanproxy") << "Could not configure proxies.";
@@ -87,11 +100,14 @@ main(int argc, char *argv[])
 	}
 
 	event_main();
+
+	if (profile)
+		MutexProfile::dump("/wanproxy");
 }
 
 static void
 usage(void)
 {
-	INFO("/wanproxy/usage") << "wanproxy [-q | -v] -c configfile";
+	INFO("/wanproxy/usage") << "wanproxy [-p] [-q | -v] -c configfile";
 	exit(1);
 }
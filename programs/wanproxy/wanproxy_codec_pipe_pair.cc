@@ -23,6 +23,8 @@
  * SUCH DAMAGE.
  */
 
+#include <deque>
+
 #include <common/endian.h>
 #include <common/thread/mutex.h>
 
@@ -46,12 +48,15 @@
 
 namespace {
 	class PipeByteCount : public PipeProducer {
-		Mutex mtx_;
+		/*
+		 * Counters are shared by every connection using a codec.
+		 */
+		static Mutex mtx_;
+
 		intmax_t *counterp_;
 	public:
 		PipeByteCount(intmax_t *counterp)
 		: PipeProducer("/wanproxy/codec/byte_count", &mtx_),
-		  mtx_("PipeByteCount"),
 		  counterp_(counterp)
 		{ }
 
@@ -71,6 +76,8 @@ namespace {
 			}
 		}
 	};
+
+	Mutex PipeByteCount::mtx_("PipeByteCount");
 };
 
 WANProxyCodecPipePair::WANProxyCodecPipePair(WANProxyCodec *incoming, WANProxyCodec *outgoing)
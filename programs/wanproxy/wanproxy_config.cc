@@ -29,6 +29,7 @@
 
 #include <config/config.h>
 #include <config/config_class.h>
+#include <config/config_class_event_system.h>
 #include <config/config_class_log_mask.h>
 
 #include <event/event_callback.h>
@@ -153,6 +154,7 @@ WANProxyConfig::configure(const std::string& name)
 	}
 
 	config_ = new Config();
+	config_->import(&config_class_event_system);
 	config_->import(&config_class_log_mask);
 	config_->import(&wanproxy_config_class_cache);
 	config_->import(&wanproxy_config_class_codec);
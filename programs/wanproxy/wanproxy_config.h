@@ -26,6 +26,8 @@
 #ifndef	PROGRAMS_WANPROXY_WANPROXY_CONFIG_H
 #define	PROGRAMS_WANPROXY_WANPROXY_CONFIG_H
 
+#include <deque>
+
 class Config;
 
 class WANProxyConfig {
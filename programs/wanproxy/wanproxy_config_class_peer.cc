@@ -26,6 +26,42 @@
 #include <config/config_class.h>
 #include <config/config_object.h>
 
+#include <event/event_callback.h>
+
+#include <io/socket/socket_types.h>
+
+#include "proxy_peer_pool.h"
+#include "proxy_stripe_connector.h"
 #include "wanproxy_config_class_peer.h"
 
 WANProxyConfigClassPeer wanproxy_config_class_peer;
+
+bool
+WANProxyConfigClassPeer::Instance::activate(const ConfigObject *co)
+{
+	if (!ConfigClassAddress::Instance::activate(co))
+		return (false);
+
+	if (pool_min_idle_ < 0 || pool_max_idle_ < 0 || pool_idle_timeout_ <= 0)
+		return (false);
+
+	if (paths_ < 1 || paths_ > PROXY_STRIPE_PATHS_MAX)
+		return (false);
+
+	if (pool_max_idle_ == 0)
+		pool_max_idle_ = pool_min_idle_;
+	if (pool_max_idle_ < pool_min_idle_)
+		return (false);
+
+	if (pool_max_idle_ == 0)
+		return (true);
+
+	if (family_ == SocketAddressFamilyUnix || host_ == "" || port_ == "")
+		return (false);
+
+	ASSERT_NULL("/wanproxy/config/peer", pool_);
+	pool_ = new ProxyPeerPool(co->name_, SocketImplOS, family_, '[' + host_ + ']' + ':' + port_,
+				  pool_min_idle_, pool_max_idle_, pool_idle_timeout_);
+
+	return (true);
+}
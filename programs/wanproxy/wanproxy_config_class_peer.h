@@ -27,12 +27,38 @@
 #define	PROGRAMS_WANPROXY_WANPROXY_CONFIG_CLASS_PEER_H
 
 #include <config/config_class_address.h>
+#include <config/config_type_int.h>
+
+class ProxyPeerPool;
 
 class WANProxyConfigClassPeer : public ConfigClassAddress {
 public:
+	struct Instance : public ConfigClassAddress::Instance {
+		intmax_t pool_min_idle_;
+		intmax_t pool_max_idle_;
+		intmax_t pool_idle_timeout_;
+		intmax_t paths_;
+		ProxyPeerPool *pool_;
+
+		Instance(void)
+		: pool_min_idle_(0),
+		  pool_max_idle_(0),
+		  pool_idle_timeout_(30),
+		  paths_(1),
+		  pool_(NULL)
+		{ }
+
+		bool activate(const ConfigObject *);
+	};
+
 	WANProxyConfigClassPeer(void)
-	: ConfigClassAddress("peer")
-	{ }
+	: ConfigClassAddress("peer", new ConstructorFactory<ConfigClassInstance, Instance>)
+	{
+		add_member("pool_min_idle", &config_type_int, &Instance::pool_min_idle_);
+		add_member("pool_max_idle", &config_type_int, &Instance::pool_max_idle_);
+		add_member("pool_idle_timeout", &config_type_int, &Instance::pool_idle_timeout_);
+		add_member("paths", &config_type_int, &Instance::paths_);
+	}
 
 	~WANProxyConfigClassPeer()
 	{ }
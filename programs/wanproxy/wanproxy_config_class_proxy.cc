@@ -36,6 +36,9 @@
 #include <ssh/ssh_session.h>
 
 #include "proxy_listener.h"
+#include "proxy_mux_connector.h"
+#include "proxy_mux_listener.h"
+#include "proxy_stripe_listener.h"
 #include "ssh_proxy_config.h"
 #include "ssh_proxy_listener.h"
 #include "wanproxy_config_class_codec.h"
@@ -56,6 +59,12 @@ WANProxyConfigClassProxy::Instance::activate(const ConfigObject *co)
 	if (interface->host_ == "" || interface->port_ == "")
 		return (false);
 
+	if (interface_zerocopy_ < 0)
+		return (false);
+	if (interface_zerocopy_ != 0 && type_ != WANProxyConfigProxyTypeTCPTCP &&
+	    type_ != WANProxyConfigProxyTypeTCPMux && type_ != WANProxyConfigProxyTypeTCPStripe)
+		return (false);
+
 	WANProxyCodec *interface_codec;
 	if (interface_codec_ != NULL) {
 		WANProxyConfigClassCodec::Instance *codec =
@@ -110,10 +119,27 @@ WANProxyConfigClassProxy::Instance::activate(const ConfigObject *co)
 	std::string interface_address = '[' + interface->host_ + ']' + ':' + interface->port_;
 	std::string peer_address = '[' + peer->host_ + ']' + ':' + peer->port_;
 
-	if (type_ == WANProxyConfigProxyTypeTCPTCP) {
-		new ProxyListener(co->name_, interface_codec, peer_codec, SocketImplOS, interface->family_, interface_address, SocketImplOS, peer->family_, peer_address);
-	} else {
+	ProxyMuxConnector *mux;
+	switch (type_) {
+	case WANProxyConfigProxyTypeTCPTCP:
+		new ProxyListener(co->name_, interface_codec, peer_codec, SocketImplOS, interface->family_, interface_address, SocketImplOS, peer->family_, peer_address, peer->pool_, interface_zerocopy_);
+		break;
+	case WANProxyConfigProxyTypeSSHSSH:
 		new SSHProxyListener(co->name_, ssh_config, interface_codec, peer_codec, SocketImplOS, interface->family_, interface_address, SocketImplOS, peer->family_, peer_address);
+		break;
+	case WANProxyConfigProxyTypeTCPMux:
+		mux = new ProxyMuxConnector(co->name_, peer_codec, SocketImplOS, peer->family_, peer_address);
+		new ProxyListener(co->name_, interface_codec, peer_codec, SocketImplOS, interface->family_, interface_address, SocketImplOS, peer->family_, peer_address, NULL, interface_zerocopy_, mux);
+		break;
+	case WANProxyConfigProxyTypeMuxTCP:
+		new ProxyMuxListener(co->name_, interface_codec, peer_codec, SocketImplOS, interface->family_, interface_address, SocketImplOS, peer->family_, peer_address);
+		break;
+	case WANProxyConfigProxyTypeTCPStripe:
+		new ProxyListener(co->name_, interface_codec, peer_codec, SocketImplOS, interface->family_, interface_address, SocketImplOS, peer->family_, peer_address, NULL, interface_zerocopy_, NULL, peer->paths_);
+		break;
+	case WANProxyConfigProxyTypeStripeTCP:
+		new ProxyStripeListener(co->name_, interface_codec, peer_codec, SocketImplOS, interface->family_, interface_address, SocketImplOS, peer->family_, peer_address);
+		break;
 	}
 
 	return (true);
@@ -26,6 +26,7 @@
 #ifndef	PROGRAMS_WANPROXY_WANPROXY_CONFIG_CLASS_PROXY_H
 #define	PROGRAMS_WANPROXY_WANPROXY_CONFIG_CLASS_PROXY_H
 
+#include <config/config_type_int.h>
 #include <config/config_type_pointer.h>
 #include <config/config_type_string.h>
 
@@ -38,6 +39,7 @@ class WANProxyConfigClassProxy : public ConfigClass {
 		WANProxyConfigProxyType type_;
 		ConfigObject *interface_;
 		ConfigObject *interface_codec_;
+		intmax_t interface_zerocopy_;
 		ConfigObject *peer_;
 		ConfigObject *peer_codec_;
 		std::string server_host_key_;
@@ -46,6 +48,7 @@ class WANProxyConfigClassProxy : public ConfigClass {
 		: type_(WANProxyConfigProxyTypeTCPTCP),
 		  interface_(NULL),
 		  interface_codec_(NULL),
+		  interface_zerocopy_(0),
 		  peer_(NULL),
 		  peer_codec_(NULL),
 		  server_host_key_("")
@@ -60,6 +63,7 @@ public:
 		add_member("type", &wanproxy_config_type_proxy_type, &Instance::type_);
 		add_member("interface", &config_type_pointer, &Instance::interface_);
 		add_member("interface_codec", &config_type_pointer, &Instance::interface_codec_);
+		add_member("interface_zerocopy", &config_type_int, &Instance::interface_zerocopy_);
 		add_member("peer", &config_type_pointer, &Instance::peer_);
 		add_member("peer_codec", &config_type_pointer, &Instance::peer_codec_);
 		add_member("server_host_key", &config_type_string, &Instance::server_host_key_);
@@ -30,6 +30,10 @@ static struct WANProxyConfigTypeProxyType::Mapping wanproxy_config_type_proxy_ty
 	{ "TCP-TCP",	WANProxyConfigProxyTypeTCPTCP },
 	{ "SSH",	WANProxyConfigProxyTypeSSHSSH },
 	{ "SSH-SSH",	WANProxyConfigProxyTypeSSHSSH },
+	{ "TCP-MUX",	WANProxyConfigProxyTypeTCPMux },
+	{ "MUX-TCP",	WANProxyConfigProxyTypeMuxTCP },
+	{ "TCP-STRIPE",	WANProxyConfigProxyTypeTCPStripe },
+	{ "STRIPE-TCP",	WANProxyConfigProxyTypeStripeTCP },
 	{ NULL,		WANProxyConfigProxyTypeTCPTCP }
 };
 
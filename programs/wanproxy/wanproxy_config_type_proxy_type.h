@@ -31,6 +31,10 @@
 enum WANProxyConfigProxyType {
 	WANProxyConfigProxyTypeTCPTCP,
 	WANProxyConfigProxyTypeSSHSSH,
+	WANProxyConfigProxyTypeTCPMux,
+	WANProxyConfigProxyTypeMuxTCP,
+	WANProxyConfigProxyTypeTCPStripe,
+	WANProxyConfigProxyTypeStripeTCP,
 };
 
 typedef ConfigTypeEnum<WANProxyConfigProxyType> WANProxyConfigTypeProxyType;
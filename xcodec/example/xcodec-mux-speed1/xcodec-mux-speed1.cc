@@ -0,0 +1,657 @@
+/*
+ * Copyright (c) 2014 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include <common/buffer.h>
+
+#include <common/thread/atomic.h>
+#include <common/thread/mutex.h>
+#include <common/time/time.h>
+#include <common/uuid/uuid.h>
+
+#include <event/event_callback.h>
+#include <event/event_main.h>
+#include <event/event_system.h>
+
+#include <io/mux/mux_session.h>
+
+#include <io/net/tcp_client.h>
+#include <io/net/tcp_server.h>
+
+#include <io/pipe/pipe.h>
+#include <io/pipe/pipe_pair.h>
+
+#include <io/socket/socket.h>
+
+#include <xcodec/xcodec.h>
+#include <xcodec/xcodec_cache.h>
+#include <xcodec/xcodec_decoder.h>
+#include <xcodec/xcodec_encoder.h>
+#include <xcodec/xcodec_pipe_pair.h>
+
+/*
+ * Each flow sends a short header of its own followed by segments drawn
+ * from a corpus which all of the flows share, as pages from one web site
+ * would, from a client to a server over the loopback interface.
+ */
+#define	CORPUS_SEGMENTS		64
+#define	FLOW_HEADER		64
+#define	FLOW_SEGMENTS		8
+
+/*
+ * Connections are set up a few at a time so as not to overflow the
+ * listen queue.
+ */
+#define	CONNECTS_RUNNING	64
+
+static uint8_t corpus[CORPUS_SEGMENTS][XCODEC_SEGMENT_LENGTH];
+
+static unsigned flow_count;
+static unsigned session_count;
+
+static std::string remote;
+static Atomic<unsigned> connects_started;
+static Atomic<unsigned> flows_running;
+static Atomic<unsigned> sessions_running;
+static Atomic<uintmax_t> payload_bytes;
+static Atomic<uintmax_t> wire_bytes;
+
+static NanoTime start_time;
+static NanoTime end_time;
+
+class ClientSession;
+static std::vector<ClientSession *> client_sessions;
+
+static void connect_next(void);
+static void flows_finished(void);
+
+static void
+session_finished(void)
+{
+	if (sessions_running.subtract(1) == 1)
+		EventSystem::instance()->stop();
+}
+
+/*
+ * Counts what is written to a channel, which is to say what goes on the wire.
+ */
+class CountingChannel : public StreamChannel {
+	StreamChannel *channel_;
+	uintmax_t bytes_;
+public:
+	CountingChannel(StreamChannel *channel)
+	: channel_(channel),
+	  bytes_(0)
+	{ }
+
+	~CountingChannel()
+	{
+		wire_bytes.add(bytes_);
+	}
+
+	Action *close(SimpleCallback *cb)
+	{
+		return (channel_->close(cb));
+	}
+
+	Action *read(size_t amount, BufferEventCallback *cb)
+	{
+		return (channel_->read(amount, cb));
+	}
+
+	Action *write(Buffer *buf, EventCallback *cb)
+	{
+		bytes_ += buf->length();
+		return (channel_->write(buf, cb));
+	}
+
+	Action *shutdown(bool shut_read, bool shut_write, EventCallback *cb)
+	{
+		return (channel_->shutdown(shut_read, shut_write, cb));
+	}
+};
+
+/*
+ * One end of a connection: a socket, a codec and the session on top.
+ */
+class Session {
+protected:
+	LogHandle log_;
+	Mutex mtx_;
+	Socket *socket_;
+	CountingChannel *channel_;
+	XCodecPipePair *codec_;
+	MuxSession *session_;
+	Action *action_;
+	Action *session_action_;
+	EventCallback::Method<Session> session_complete_;
+	SimpleCallback::Method<Session> session_close_complete_;
+	SimpleCallback::Method<Session> close_complete_;
+
+	Session(const LogHandle& log, XCodec *codec, XCodecPipePairType type)
+	: log_(log),
+	  mtx_("Session"),
+	  socket_(NULL),
+	  channel_(NULL),
+	  codec_(new XCodecPipePair(log_, codec, type)),
+	  session_(NULL),
+	  action_(NULL),
+	  session_action_(NULL),
+	  session_complete_(NULL, &mtx_, this, &Session::session_complete),
+	  session_close_complete_(NULL, &mtx_, this, &Session::session_close_complete),
+	  close_complete_(NULL, &mtx_, this, &Session::close_complete)
+	{
+		if (type == XCodecPipePairTypeClient)
+			session_ = new MuxSession(log_, true, codec_->get_incoming(), codec_->get_outgoing());
+		else
+			session_ = new MuxSession(log_, false, codec_->get_outgoing(), codec_->get_incoming());
+	}
+
+public:
+	virtual ~Session()
+	{
+		ASSERT_NULL(log_, socket_);
+		ASSERT_NULL(log_, session_);
+	}
+
+protected:
+	void start(Socket *socket)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		socket_ = socket;
+		channel_ = new CountingChannel(socket_);
+		session_action_ = session_->start(channel_, &session_complete_);
+	}
+
+	void stop(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		if (session_action_ != NULL) {
+			session_action_->cancel();
+			session_action_ = NULL;
+		}
+		session_action_ = session_->close(&session_close_complete_);
+	}
+
+private:
+	void session_complete(Event e)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		session_action_->cancel();
+		session_action_ = NULL;
+
+		/*
+		 * The client closes its connections without reading what is
+		 * left to read, and so they may be reset.
+		 */
+		if (e.type_ != Event::EOS && flows_running.add(0) != 0)
+			HALT(log_) << "Session failed: " << e;
+		stop();
+	}
+
+protected:
+	virtual void session_close_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		session_action_->cancel();
+		session_action_ = NULL;
+
+		delete session_;
+		session_ = NULL;
+
+		delete codec_;
+		codec_ = NULL;
+
+		delete channel_;
+		channel_ = NULL;
+
+		action_ = socket_->close(&close_complete_);
+	}
+
+private:
+	void close_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		delete socket_;
+		socket_ = NULL;
+
+		session_finished();
+	}
+};
+
+class Flow {
+	LogHandle log_;
+	Mutex mtx_;
+	StreamChannel *stream_;
+	Action *action_;
+	EventCallback::Method<Flow> write_complete_;
+	EventCallback::Method<Flow> shutdown_complete_;
+	SimpleCallback::Method<Flow> close_complete_;
+public:
+	Flow(StreamChannel *stream, unsigned n)
+	: log_("/flow"),
+	  mtx_("Flow"),
+	  stream_(stream),
+	  action_(NULL),
+	  write_complete_(NULL, &mtx_, this, &Flow::write_complete),
+	  shutdown_complete_(NULL, &mtx_, this, &Flow::shutdown_complete),
+	  close_complete_(NULL, &mtx_, this, &Flow::close_complete)
+	{
+		Buffer buf;
+		unsigned i;
+
+		for (i = 0; i < FLOW_HEADER; i++)
+			buf.append((uint8_t)random());
+		for (i = 0; i < FLOW_SEGMENTS; i++)
+			buf.append(corpus[(n * 7 + i) % CORPUS_SEGMENTS], XCODEC_SEGMENT_LENGTH);
+		payload_bytes.add(buf.length());
+
+		ScopedLock _(&mtx_);
+		action_ = stream_->write(&buf, &write_complete_);
+	}
+
+	~Flow()
+	{
+		ASSERT_NULL(log_, stream_);
+	}
+
+private:
+	void write_complete(Event e)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		if (e.type_ != Event::Done)
+			HALT(log_) << "Write failed: " << e;
+		action_ = stream_->shutdown(false, true, &shutdown_complete_);
+	}
+
+	void shutdown_complete(Event e)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		if (e.type_ != Event::Done)
+			HALT(log_) << "Shutdown failed: " << e;
+		action_ = stream_->close(&close_complete_);
+	}
+
+	void close_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		delete stream_;
+		stream_ = NULL;
+	}
+};
+
+class ClientSession : public Session {
+	std::vector<Flow *> flows_;
+	SocketEventCallback::Method<ClientSession> connect_complete_;
+public:
+	ClientSession(XCodec *codec, unsigned n)
+	: Session("/client", codec, XCodecPipePairTypeClient),
+	  flows_(),
+	  connect_complete_(NULL, &mtx_, this, &ClientSession::connect_complete)
+	{
+		ScopedLock _(&mtx_);
+		unsigned i;
+		for (i = n; i < flow_count; i += session_count)
+			flows_.push_back(new Flow(session_->open(), i));
+	}
+
+	~ClientSession()
+	{
+		while (!flows_.empty()) {
+			delete flows_.back();
+			flows_.pop_back();
+		}
+	}
+
+	void connect(void)
+	{
+		ScopedLock _(&mtx_);
+		action_ = TCPClient::connect(SocketImplOS, SocketAddressFamilyIP, remote, &connect_complete_);
+	}
+
+	void finish(void)
+	{
+		ScopedLock _(&mtx_);
+		stop();
+	}
+
+private:
+	void connect_complete(Event e, Socket *socket)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		if (e.type_ != Event::Done)
+			HALT(log_) << "Connect failed: " << e;
+		start(socket);
+
+		connect_next();
+	}
+};
+
+/*
+ * Reads a stream to its end.
+ */
+class Sink {
+	LogHandle log_;
+	Mutex mtx_;
+	StreamChannel *stream_;
+	uintmax_t bytes_;
+	Action *action_;
+	BufferEventCallback::Method<Sink> read_complete_;
+	SimpleCallback::Method<Sink> close_complete_;
+public:
+	Sink(StreamChannel *stream)
+	: log_("/sink"),
+	  mtx_("Sink"),
+	  stream_(stream),
+	  bytes_(0),
+	  action_(NULL),
+	  read_complete_(NULL, &mtx_, this, &Sink::read_complete),
+	  close_complete_(NULL, &mtx_, this, &Sink::close_complete)
+	{
+		ScopedLock _(&mtx_);
+		action_ = stream_->read(0, &read_complete_);
+	}
+
+	~Sink()
+	{
+		ASSERT_NULL(log_, stream_);
+	}
+
+private:
+	void read_complete(Event e, Buffer buf)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		bytes_ += buf.length();
+		switch (e.type_) {
+		case Event::Done:
+			action_ = stream_->read(0, &read_complete_);
+			return;
+		case Event::EOS:
+			break;
+		default:
+			HALT(log_) << "Read failed: " << e;
+			return;
+		}
+
+		if (bytes_ != FLOW_HEADER + FLOW_SEGMENTS * XCODEC_SEGMENT_LENGTH)
+			HALT(log_) << "Short flow: " << bytes_ << " bytes.";
+		action_ = stream_->close(&close_complete_);
+	}
+
+	void close_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		delete stream_;
+		stream_ = NULL;
+
+		if (flows_running.subtract(1) == 1)
+			flows_finished();
+	}
+};
+
+class ServerSession : public Session {
+	std::vector<Sink *> sinks_;
+	Action *accept_action_;
+	StreamChannelEventCallback::Method<ServerSession> accept_complete_;
+public:
+	ServerSession(XCodec *codec, Socket *socket)
+	: Session("/server", codec, XCodecPipePairTypeServer),
+	  sinks_(),
+	  accept_action_(NULL),
+	  accept_complete_(NULL, &mtx_, this, &ServerSession::accept_complete)
+	{
+		ScopedLock _(&mtx_);
+		start(socket);
+		accept_action_ = session_->accept(&accept_complete_);
+	}
+
+	~ServerSession()
+	{
+		while (!sinks_.empty()) {
+			delete sinks_.back();
+			sinks_.pop_back();
+		}
+	}
+
+private:
+	void accept_complete(Event e, StreamChannel *stream)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		accept_action_->cancel();
+		accept_action_ = NULL;
+
+		if (e.type_ != Event::Done)
+			return;
+		sinks_.push_back(new Sink(stream));
+		accept_action_ = session_->accept(&accept_complete_);
+	}
+
+	void session_close_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		if (accept_action_ != NULL) {
+			accept_action_->cancel();
+			accept_action_ = NULL;
+		}
+		Session::session_close_complete();
+	}
+};
+
+class Server {
+	LogHandle log_;
+	Mutex mtx_;
+	XCodec *codec_;
+	TCPServer *server_;
+	unsigned accepted_;
+	std::vector<ServerSession *> sessions_;
+	Action *action_;
+	SocketEventCallback::Method<Server> accept_complete_;
+	SimpleCallback::Method<Server> close_complete_;
+public:
+	Server(XCodec *codec)
+	: log_("/server"),
+	  mtx_("Server"),
+	  codec_(codec),
+	  server_(NULL),
+	  accepted_(0),
+	  sessions_(),
+	  action_(NULL),
+	  accept_complete_(NULL, &mtx_, this, &Server::accept_complete),
+	  close_complete_(NULL, &mtx_, this, &Server::close_complete)
+	{
+		ScopedLock _(&mtx_);
+		server_ = TCPServer::listen(SocketImplOS, SocketAddressFamilyIP, "[localhost]:0");
+		ASSERT_NON_NULL(log_, server_);
+		action_ = server_->accept(&accept_complete_);
+	}
+
+	~Server()
+	{
+		ASSERT_NULL(log_, server_);
+		while (!sessions_.empty()) {
+			delete sessions_.back();
+			sessions_.pop_back();
+		}
+	}
+
+	std::string getsockname(void) const
+	{
+		return (server_->getsockname());
+	}
+
+private:
+	void accept_complete(Event e, Socket *socket)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		if (e.type_ != Event::Done)
+			HALT(log_) << "Accept failed: " << e;
+		sessions_.push_back(new ServerSession(codec_, socket));
+
+		if (++accepted_ == session_count)
+			action_ = server_->close(&close_complete_);
+		else
+			action_ = server_->accept(&accept_complete_);
+	}
+
+	void close_complete(void)
+	{
+		ASSERT_LOCK_OWNED(log_, &mtx_);
+		action_->cancel();
+		action_ = NULL;
+
+		delete server_;
+		server_ = NULL;
+	}
+};
+
+/*
+ * Sessions only ever start the connections of sessions after them, so
+ * their locks are always taken in the same order.
+ */
+static void
+connect_next(void)
+{
+	unsigned n = connects_started.add(1);
+	if (n < session_count)
+		client_sessions[n]->connect();
+}
+
+static void
+flows_finished(void)
+{
+	end_time = NanoTime::current_time();
+
+	std::vector<ClientSession *>::iterator it;
+	for (it = client_sessions.begin(); it != client_sessions.end(); ++it)
+		(*it)->finish();
+}
+
+static XCodec *
+codec(void)
+{
+	UUID uuid;
+	uuid.generate();
+	return (new XCodec(new XCodecMemoryCache(uuid)));
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: xcodec-mux-speed1 [flows [sessions]]\n");
+	exit(1);
+}
+
+/*
+ * Sends a number of flows through XCodec, either each over a connection of
+ * its own or multiplexed over fewer, and reports how long that took and how
+ * many bytes were written to the connections to carry them.
+ */
+int
+main(int argc, char *argv[])
+{
+	unsigned i, j;
+
+	flow_count = 1000;
+	session_count = 1;
+
+	switch (argc) {
+	case 3:
+		session_count = strtoul(argv[2], NULL, 0);
+		/* FALLTHROUGH */
+	case 2:
+		flow_count = strtoul(argv[1], NULL, 0);
+		/* FALLTHROUGH */
+	case 1:
+		break;
+	default:
+		usage();
+	}
+	if (flow_count == 0 || session_count == 0 || session_count > flow_count)
+		usage();
+
+	for (i = 0; i < CORPUS_SEGMENTS; i++)
+		for (j = 0; j < XCODEC_SEGMENT_LENGTH; j++)
+			corpus[i][j] = random();
+
+	flows_running.add(flow_count);
+	sessions_running.add(session_count * 2);
+
+	/*
+	 * Give each end a cache of its own, as if they were on different hosts.
+	 */
+	XCodec *client_codec = codec();
+	XCodec *server_codec = codec();
+
+	Server *server = new Server(server_codec);
+	remote = server->getsockname();
+
+	for (i = 0; i < session_count; i++)
+		client_sessions.push_back(new ClientSession(client_codec, i));
+
+	start_time = NanoTime::current_time();
+	for (i = 0; i < CONNECTS_RUNNING; i++)
+		connect_next();
+
+	event_main();
+
+	NanoTime elapsed = end_time;
+	elapsed -= start_time;
+
+	INFO("/example/xcodec/mux/speed1") << flow_count << " flows over " << session_count << " sessions: " << payload_bytes.add(0) << " bytes in " << wire_bytes.add(0) << " bytes on the wire; " << elapsed.seconds_ * 1000 + elapsed.nanoseconds_ / 1000000 << "ms.";
+
+	while (!client_sessions.empty()) {
+		delete client_sessions.back();
+		client_sessions.pop_back();
+	}
+	delete server;
+}
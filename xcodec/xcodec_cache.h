@@ -247,11 +247,18 @@ class XCodecMemoryCache : public XCodecCache {
 		BufferSegment *seg_;
 		uint64_t counter_;
 
+		/*
+		 * Segments carved out of a larger BufferSegment are copied,
+		 * so that a cache entry holds only its own data.
+		 */
 		CacheEntry(BufferSegment *seg)
 		: seg_(seg),
 		  counter_(0)
 		{
-			seg_->ref();
+			if (seg_->oversized())
+				seg_ = seg_->copy();
+			else
+				seg_->ref();
 		}
 
 		CacheEntry(const CacheEntry& src)
@@ -69,7 +69,7 @@
  * follow.
  */
 
-#define	XCDFS_BLOCK_SIZE	(2048)		/* Same as segment size for Buffer and for XCodec.  */
+#define	XCDFS_BLOCK_SIZE	(2048)		/* Same as segment size for XCodec.  */
 
 /*
  * The index block layout is:
@@ -277,7 +277,7 @@ bool
 XCodecDisk::block_read(BufferSegment **segp, uint64_t blockno)
 {
 	ASSERT(log_, blockno < disk_blocks_);
-	BufferSegment *seg = BufferSegment::create();
+	BufferSegment *seg = BufferSegment::create(XCDFS_BLOCK_SIZE);
 	ssize_t amt = ::pread(fd_, seg->head(), XCDFS_BLOCK_SIZE, blockno * XCDFS_BLOCK_SIZE);
 	if (amt == -1) {
 		seg->unref();
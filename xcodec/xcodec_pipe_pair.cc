@@ -39,6 +39,8 @@
 #include <xcodec/xcodec_pipe_pair.h>
 #include <xcodec/xcodec_pipe_protocol.h>
 
+Mutex XCodecPipePair::mtx_("XCodecPipePair");
+
 /*
  * XXX
  * Especially now that we support disk storage of data, we need to better
@@ -42,7 +42,14 @@ enum XCodecPipePairType {
 
 class XCodecPipePair : public PipePair {
 	LogHandle log_;
-	Mutex mtx_;
+
+	/*
+	 * The caches are shared between all connections and are not
+	 * themselves locked, so all pipe pairs share a single lock.
+	 * That also keeps every codec callback in one callback thread.
+	 */
+	static Mutex mtx_;
+
 	XCodec *codec_;
 	XCodecPipePairType type_;
 
@@ -71,7 +78,6 @@ class XCodecPipePair : public PipePair {
 public:
 	XCodecPipePair(const LogHandle& log, XCodec *codec, XCodecPipePairType type)
 	: log_(log + "/xcodec"),
-	  mtx_("XCodecPipePair"),
 	  codec_(codec),
 	  type_(type),
 	  decoder_(NULL),